@@ -0,0 +1,1592 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+/*! \file main.c
+	\brief Micro benchmarks for the schnur library.
+
+	Run without arguments to execute all benchmarks, or pass the names of
+	the benchmarks to run.
+*/
+
+#include <schnur.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdatomic.h>
+
+/*
+	Counts heap allocations done by the library, by installing a counting
+	allocator on top of the default one.
+*/
+static atomic_size_t g_allocations = 0;
+static atomic_size_t g_allocated_bytes = 0;
+
+static void*
+bench_allocate (void* context, size_t size) {
+	const struct schnur_allocator* a = schnur_default_allocator ();
+	(void)context;
+	++g_allocations;
+	g_allocated_bytes += size;
+	return a->allocate (a->context, size);
+}
+
+static void*
+bench_reallocate (void* context, void* p, size_t old_size, size_t size) {
+	const struct schnur_allocator* a = schnur_default_allocator ();
+	(void)context;
+	++g_allocations;
+	g_allocated_bytes += size - old_size;
+	return a->reallocate (a->context, p, old_size, size);
+}
+
+static void
+bench_release (void* context, void* p) {
+	const struct schnur_allocator* a = schnur_default_allocator ();
+	(void)context;
+	a->release (a->context, p);
+}
+
+static const struct schnur_allocator g_counting_allocator = {
+	bench_allocate, bench_reallocate, bench_release, NULL
+};
+
+/*
+	Retrieves the number of heap allocations done so far.
+*/
+static size_t
+bench_allocations (void) {
+	return g_allocations;
+}
+
+/*
+	Retrieves the number of bytes allocated so far, not counting releases.
+*/
+static size_t
+bench_allocated_bytes (void) {
+	return g_allocated_bytes;
+}
+
+/*
+	Returns a monotonic-ish timestamp in nanoseconds.
+*/
+static double
+bench_now_ns (void) {
+	struct timespec ts;
+	timespec_get (&ts, TIME_UTC);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/*
+	Appends n characters one by one and reports the average cost per append
+	for every doubling of the length. With amortized O(1) appending, the cost
+	per character stays flat while the length grows.
+*/
+static int
+bench_append_policy (enum schnur_growth_policy policy, const char* name) {
+	const size_t total = 1 << 20; // 1M characters.
+	size_t checkpoint = 1 << 10;
+	size_t previous = 0;
+	size_t i;
+	double start, last;
+	schnur_t* s;
+
+	schnur_set_growth_policy (policy);
+	s = schnur_new ();
+	if (NULL == s) {
+		return 0;
+	}
+
+	printf ("append/%s\n", name);
+	start = last = bench_now_ns ();
+	for (i = 0; i < total; ++i) {
+		if (! schnur_append (s, L'x')) {
+			schnur_free (s);
+			return 0;
+		}
+		if (i + 1 == checkpoint) {
+			double now = bench_now_ns ();
+			printf ("  %8zu chars: %8.2f ns/append (window), capacity %zu\n",
+				checkpoint, (now - last) / (double)(checkpoint - previous),
+				schnur_capacity (s));
+			last = now;
+			previous = checkpoint;
+			checkpoint *= 2;
+		}
+	}
+	printf ("  total: %.2f ms\n", (bench_now_ns () - start) / 1e6);
+
+	schnur_free (s);
+	schnur_set_growth_policy (SCHNUR_GROWTH_GEOMETRIC);
+
+	return 1;
+}
+
+static int
+bench_append (void) {
+	return bench_append_policy (SCHNUR_GROWTH_GEOMETRIC, "geometric")
+		&& bench_append_policy (SCHNUR_GROWTH_LINEAR, "linear");
+}
+
+/*
+	Appends n characters after reserving the final size up front.
+*/
+static int
+bench_reserve (void) {
+	const size_t total = 1 << 20;
+	size_t i;
+	double start;
+	schnur_t* s = schnur_new_with_capacity (total);
+	if (NULL == s) {
+		return 0;
+	}
+
+	start = bench_now_ns ();
+	for (i = 0; i < total; ++i) {
+		if (! schnur_append (s, L'x')) {
+			schnur_free (s);
+			return 0;
+		}
+	}
+	printf ("reserve\n  %zu chars: %.2f ns/append\n",
+		total, (bench_now_ns () - start) / (double)total);
+
+	schnur_free (s);
+
+	return 1;
+}
+
+/*
+	Creates, extends and frees short strings, like header names or keys.
+*/
+static int
+bench_short (void) {
+	static const schnur_wide_t* words[] = {
+		L"host", L"accept", L"content-type", L"x-request-id"
+	};
+	const size_t rounds = 1000000;
+	size_t i, allocations;
+	double start;
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; i < rounds; ++i) {
+		schnur_t* s = schnur_new_s (words[i % 4]);
+		if (NULL == s || ! schnur_append (s, L':')) {
+			schnur_free (s);
+			return 0;
+		}
+		schnur_free (s);
+	}
+	printf ("short\n  %.2f ns/string, %.2f allocations/string\n",
+		(bench_now_ns () - start) / (double)rounds,
+		(double)(bench_allocations () - allocations) / (double)rounds);
+
+	return 1;
+}
+
+/*
+	Simulates request handlers, each creating a batch of temporary strings.
+	Compares freeing them one by one against releasing an arena at once.
+*/
+static int
+bench_arena (void) {
+	const size_t requests = 2000;
+	const size_t batch = 500;
+	schnur_t* strings[500];
+	struct schnur_arena* arena;
+	size_t r, i;
+	double start;
+	int ok = 1;
+
+	start = bench_now_ns ();
+	for (r = 0; ok && r < requests; ++r) {
+		for (i = 0; i < batch; ++i) {
+			strings[i] = schnur_new_s (L"content-type: text/plain");
+			ok &= NULL != strings[i];
+		}
+		for (i = 0; i < batch; ++i) {
+			schnur_free (strings[i]);
+		}
+	}
+	printf ("arena\n  one by one: %.2f ns/string\n",
+		(bench_now_ns () - start) / (double)(requests * batch));
+
+	arena = schnur_arena_new (0);
+	if (NULL == arena) {
+		return 0;
+	}
+	start = bench_now_ns ();
+	for (r = 0; ok && r < requests; ++r) {
+		for (i = 0; i < batch; ++i) {
+			strings[i] = schnur_new_with_allocator (
+				schnur_arena_allocator (arena));
+			ok &= NULL != strings[i]
+				&& schnur_copy_cstr (strings[i], L"content-type: text/plain");
+		}
+		schnur_arena_reset (arena);
+	}
+	printf ("  arena:      %.2f ns/string\n",
+		(bench_now_ns () - start) / (double)(requests * batch));
+	schnur_arena_free (arena);
+
+	return ok;
+}
+
+/*
+	Decodes a large utf-8 buffer, once pure ASCII, once mixed with multi-byte
+	sequences.
+*/
+static int
+bench_decode_input (const char* name, const char* unit) {
+	const size_t total = 8 << 20; // 8 MB.
+	const size_t unit_length = strlen (unit);
+	const int rounds = 10;
+	char* input = malloc (total + 1);
+	size_t n = 0;
+	double start;
+	int r, ok = 1;
+
+	if (NULL == input) {
+		return 0;
+	}
+	while (n + unit_length <= total) {
+		memcpy (input + n, unit, unit_length);
+		n += unit_length;
+	}
+	input[n] = '\0';
+
+	start = bench_now_ns ();
+	for (r = 0; ok && r < rounds; ++r) {
+		schnur_t* s = schnur_new_su (input);
+		ok = NULL != s;
+		schnur_free (s);
+	}
+	printf ("  %-6s %8.2f MB/s\n", name,
+		(double)(n * rounds) / ((bench_now_ns () - start) / 1e9) / 1e6);
+
+	free (input);
+
+	return ok;
+}
+
+static int
+bench_decode (void) {
+	printf ("decode\n");
+	return bench_decode_input ("ascii", "GET /index.html HTTP/1.1 ")
+		&& bench_decode_input ("mixed", "Hänsel mag Soße! живот 🤗 ");
+}
+
+/*
+	Exports a large schnur to utf-8 via schnur_narrow, compared against the
+	locale dependent wcstombs.
+*/
+static int
+bench_encode_input (const char* name, const schnur_wide_t* unit) {
+	const size_t total = 4 << 20; // 4M characters.
+	const size_t unit_length = wcslen (unit);
+	const int rounds = 10;
+	schnur_t* s = schnur_new_with_capacity (total);
+	schnur_narrow_t* n = NULL;
+	size_t bytes = 0;
+	double start;
+	int r, ok = NULL != s;
+
+	while (ok && schnur_length (s) + unit_length <= total) {
+		ok = schnur_append_cstr (s, unit);
+	}
+
+	start = bench_now_ns ();
+	for (r = 0; ok && r < rounds; ++r) {
+		n = schnur_narrow (s);
+		ok = NULL != n;
+		bytes = ok ? strlen (n) : 0;
+		schnur_narrow_free (n);
+	}
+	printf ("  %-6s schnur_narrow %8.2f MB/s\n", name,
+		(double)(bytes * rounds) / ((bench_now_ns () - start) / 1e9) / 1e6);
+
+	n = malloc (bytes + 1);
+	start = bench_now_ns ();
+	for (r = 0; ok && r < rounds; ++r) {
+		ok = NULL != n && (size_t)-1 != wcstombs (n, schnur_raw (s), bytes + 1);
+	}
+	printf ("  %-6s wcstombs      %8.2f MB/s\n", name,
+		(double)(bytes * rounds) / ((bench_now_ns () - start) / 1e9) / 1e6);
+	free (n);
+
+	schnur_free (s);
+
+	return ok;
+}
+
+static int
+bench_encode (void) {
+	printf ("encode\n");
+	return bench_encode_input ("ascii", L"GET /index.html HTTP/1.1 ")
+		&& bench_encode_input ("mixed", L"Hänsel mag Soße! живот 🤗 ");
+}
+
+/*
+	Converts a short string many times, allocating each result versus
+	encoding into a reused scratch buffer.
+*/
+static int
+bench_convert (void) {
+	const size_t rounds = 1000000;
+	static schnur_narrow_t scratch[256];
+	schnur_t* s = schnur_new_s (L"content-type: text/plain; charset=utf-8");
+	size_t i, allocations;
+	double start;
+	int ok = NULL != s;
+
+	printf ("convert\n");
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		schnur_narrow_t* n = schnur_narrow (s);
+		ok = NULL != n;
+		schnur_narrow_free (n);
+	}
+	printf ("  schnur_narrow:      %6.2f ns/conversion, %.2f allocations/conversion\n",
+		(bench_now_ns () - start) / (double)rounds,
+		(double)(bench_allocations () - allocations) / (double)rounds);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		ok = schnur_narrow_into (s, scratch, sizeof (scratch), NULL);
+	}
+	printf ("  schnur_narrow_into: %6.2f ns/conversion, %.2f allocations/conversion\n",
+		(bench_now_ns () - start) / (double)rounds,
+		(double)(bench_allocations () - allocations) / (double)rounds);
+
+	schnur_free (s);
+
+	return ok;
+}
+
+/*
+	Copies a configuration value over and over, reading it only. Compares
+	deep copies against shared copy-on-write storage.
+*/
+static int
+bench_copy (void) {
+	const size_t rounds = 1000000;
+	schnur_t* value = schnur_new_with_capacity (1024);
+	size_t i, allocations;
+	double start;
+	int ok = NULL != value;
+
+	for (i = 0; ok && i < 1024; ++i) {
+		ok = schnur_append (value, (schnur_wide_t)(L'a' + i % 26));
+	}
+
+	printf ("copy\n");
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		schnur_t* deep = schnur_new ();
+		ok = NULL != deep
+			&& schnur_copy_view (deep, schnur_view_of (value))
+			&& 1023 == schnur_length (deep) - 1;
+		schnur_free (deep);
+	}
+	printf ("  deep copy: %6.2f ns/copy, %.2f allocations/copy\n",
+		(bench_now_ns () - start) / (double)rounds,
+		(double)(bench_allocations () - allocations) / (double)rounds);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		schnur_t* shared = schnur_new ();
+		ok = NULL != shared
+			&& schnur_copy (shared, value)
+			&& 1023 == schnur_length (shared) - 1;
+		schnur_free (shared);
+	}
+	printf ("  shared:    %6.2f ns/copy, %.2f allocations/copy\n",
+		(bench_now_ns () - start) / (double)rounds,
+		(double)(bench_allocations () - allocations) / (double)rounds);
+
+	schnur_free (value);
+
+	return ok;
+}
+
+/*
+	Hashes a large buffer, then rehashes an unmodified string, whose hash is
+	cached.
+*/
+static int
+bench_hash (void) {
+	const size_t length = 1 << 20;
+	const size_t rounds = 100;
+	schnur_t* s = schnur_new_with_capacity (length);
+	size_t i;
+	uint64_t sum = 0;
+	double start, elapsed;
+	int ok = NULL != s;
+
+	for (i = 0; ok && i < length; ++i) {
+		ok = schnur_append (s, (schnur_wide_t)(L'a' + i % 26));
+	}
+
+	printf ("hash\n");
+
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		sum += schnur_hash_view (schnur_view_of (s));
+	}
+	elapsed = bench_now_ns () - start;
+	printf ("  schnur_hash_view: %6.2f GB/s\n",
+		(double)(rounds * length * sizeof (schnur_wide_t)) / elapsed);
+
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds * 10000; ++i) {
+		sum += schnur_hash (s);
+	}
+	printf ("  schnur_hash:      %6.2f ns/hash, cached (%llx)\n",
+		(bench_now_ns () - start) / (double)(rounds * 10000),
+		(unsigned long long)(sum & 0xF));
+
+	schnur_free (s);
+
+	return ok;
+}
+
+/*
+	Compares header names, once through schnur_equal, once by pointer after
+	interning them. Also measures interning names already in the pool.
+*/
+static int
+bench_intern (void) {
+	static const schnur_wide_t* names[] = {
+		L"accept", L"accept-encoding", L"content-length", L"content-type",
+		L"host", L"user-agent", L"x-forwarded-for", L"x-request-id"
+	};
+	const size_t count = sizeof (names) / sizeof (names[0]);
+	const size_t rounds = 10000000;
+	struct schnur_intern_pool* pool = schnur_intern_pool_new (NULL);
+	const struct schnur_frozen* interned[8];
+	schnur_t* strings[8];
+	struct schnur_intern_stats stats;
+	size_t i, matches;
+	double start;
+	int ok = NULL != pool;
+
+	for (i = 0; i < count; ++i) {
+		strings[i] = schnur_new_s (names[i]);
+		ok &= NULL != strings[i];
+	}
+
+	printf ("intern\n");
+
+	matches = 0;
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		matches += schnur_equal (strings[i % count], strings[(i * 7) % count]);
+	}
+	printf ("  schnur_equal:  %6.2f ns/comparison (%zu matches)\n",
+		(bench_now_ns () - start) / (double)rounds, matches);
+
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds / 10; ++i) {
+		interned[i % count] = schnur_intern (pool, strings[i % count]);
+		ok = NULL != interned[i % count];
+	}
+	printf ("  schnur_intern: %6.2f ns/lookup\n",
+		(bench_now_ns () - start) / (double)(rounds / 10));
+
+	matches = 0;
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		matches += interned[i % count] == interned[(i * 7) % count];
+	}
+	printf ("  pointer:       %6.2f ns/comparison (%zu matches)\n",
+		(bench_now_ns () - start) / (double)rounds, matches);
+
+	if (ok && schnur_intern_pool_stats (pool, &stats)) {
+		printf ("  hit rate %.4f, %zu bytes held, %zu bytes saved\n",
+			(double)stats.hits / (double)stats.lookups, stats.bytes, stats.bytes_saved);
+	}
+
+	for (i = 0; i < count; ++i) {
+		schnur_free (strings[i]);
+	}
+	schnur_intern_pool_free (pool);
+
+	return ok;
+}
+
+/*
+	Assembles a document from large sections, once by appending schnurs,
+	once by concatenating ropes. Then inserts into the middle of the rope.
+*/
+static int
+bench_rope (void) {
+	const size_t sections = 32;
+	const size_t section_length = 256 * 1024;
+	const size_t inserts = 10000;
+	schnur_t* section = schnur_new_with_capacity (section_length);
+	schnur_t* document = schnur_new ();
+	struct schnur_rope* rope = schnur_rope_new ();
+	size_t i, allocations;
+	double start;
+	int ok = NULL != section && NULL != document && NULL != rope;
+
+	for (i = 0; ok && i < section_length; ++i) {
+		ok = schnur_append (section, (schnur_wide_t)(L'a' + i % 26));
+	}
+
+	printf ("rope\n");
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < sections; ++i) {
+		ok = schnur_append_string (document, section);
+	}
+	printf ("  schnur_append_string: %8.2f ms, %zu allocations\n",
+		(bench_now_ns () - start) / 1e6, bench_allocations () - allocations);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < sections; ++i) {
+		struct schnur_rope* part = schnur_rope_new ();
+		ok = NULL != part
+			&& schnur_rope_append (part, schnur_view_of (section))
+			&& schnur_rope_concat (rope, part);
+		schnur_rope_free (part);
+	}
+	printf ("  schnur_rope_concat:   %8.2f ms, %zu allocations\n",
+		(bench_now_ns () - start) / 1e6, bench_allocations () - allocations);
+
+	start = bench_now_ns ();
+	for (i = 0; ok && i < inserts; ++i) {
+		ok = schnur_rope_insert (rope, schnur_rope_length (rope) / 2,
+			schnur_view_cstr (L"<inserted/>"));
+	}
+	printf ("  schnur_rope_insert:   %8.2f us/insert in the middle\n",
+		(bench_now_ns () - start) / 1e3 / (double)inserts);
+
+	ok &= schnur_rope_length (rope) == schnur_length (document) + inserts * 11;
+
+	schnur_rope_free (rope);
+	schnur_free (document);
+	schnur_free (section);
+
+	return ok;
+}
+
+/*
+	Looks up routes through views into a request buffer, so no key has to
+	be materialized as a schnur first.
+*/
+static int
+bench_map (void) {
+	const size_t count = 4096;
+	const size_t rounds = 10000000;
+	struct schnur_map* map = schnur_map_new (NULL);
+	schnur_wide_t (*routes)[32] = malloc (count * sizeof (*routes));
+	size_t i, hits;
+	double start;
+	int ok = NULL != map && NULL != routes;
+
+	for (i = 0; ok && i < count; ++i) {
+		swprintf (routes[i], 32, L"/api/v1/resource/%zu", i);
+		ok = schnur_map_set_view (map, schnur_view_cstr (routes[i]), routes[i]);
+	}
+
+	printf ("map\n");
+
+	hits = 0;
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		hits += schnur_map_get_view (map,
+			schnur_view_cstr (routes[(i * 7919) % count]), NULL);
+	}
+	printf ("  hit:    %6.2f ns/lookup (%zu hits)\n",
+		(bench_now_ns () - start) / (double)rounds, hits);
+
+	// Replaces the leading slash, so every lookup misses.
+	for (i = 0; ok && i < count; ++i) {
+		routes[i][0] = L'#';
+	}
+
+	hits = 0;
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		hits += schnur_map_get_view (map,
+			schnur_view_cstr (routes[(i * 7919) % count]), NULL);
+	}
+	printf ("  miss:   %6.2f ns/lookup (%zu hits)\n",
+		(bench_now_ns () - start) / (double)rounds, hits);
+
+	ok &= 0 == hits && count == schnur_map_count (map);
+
+	free (routes);
+	schnur_map_free (map);
+
+	return ok;
+}
+
+static int
+bench_compare_schnur (const void* a, const void* b) {
+	return schnur_compare (*(schnur_t* const*)a, *(schnur_t* const*)b);
+}
+
+static int
+bench_compare_wcscmp (const void* a, const void* b) {
+	return wcscmp (schnur_view_of (*(schnur_t* const*)a).data,
+		schnur_view_of (*(schnur_t* const*)b).data);
+}
+
+/*
+	Sorts a copy of strings into sorted a few times, returns the fastest run
+	in milliseconds.
+*/
+static double
+bench_sort (schnur_t** sorted, schnur_t** strings, size_t count,
+	int (*compare) (const void*, const void*)) {
+	double best = 0, start, elapsed;
+	int k;
+
+	for (k = 0; k < 3; ++k) {
+		memcpy (sorted, strings, count * sizeof (schnur_t*));
+		start = bench_now_ns ();
+		qsort (sorted, count, sizeof (schnur_t*), compare);
+		elapsed = bench_now_ns () - start;
+		best = 0 == k || elapsed < best ? elapsed : best;
+	}
+
+	return best / 1e6;
+}
+
+/*
+	Compares equal buffers, then sorts paths sharing long prefixes, once with
+	schnur_compare, once with wcscmp.
+*/
+static int
+bench_compare (void) {
+	const size_t length = 1 << 20;
+	const size_t rounds = 200;
+	const size_t count = 200000;
+	schnur_t* a = schnur_new_with_capacity (length);
+	schnur_t* b = schnur_new_with_capacity (length);
+	schnur_t** paths = malloc (count * sizeof (schnur_t*));
+	schnur_t** sorted = malloc (count * sizeof (schnur_t*));
+	schnur_wide_t path[64];
+	size_t i, sum, created = 0;
+	double start;
+	int ok = NULL != a && NULL != b && NULL != paths && NULL != sorted;
+
+	for (i = 0; ok && i < length; ++i) {
+		ok = schnur_append (a, (schnur_wide_t)(L'a' + i % 26))
+			&& schnur_append (b, (schnur_wide_t)(L'a' + i % 26));
+	}
+	for (i = 0; ok && i < count; ++i) {
+		swprintf (path, 64, L"/var/log/service/%03zu/entry-%08zu.log",
+			(i * 7919) % 997, (i * 104729) % count);
+		paths[i] = schnur_new_s (path);
+		ok = NULL != paths[i];
+		created += ok;
+	}
+
+	printf ("compare\n");
+
+	sum = 0;
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		sum += schnur_view_mismatch (schnur_view_of (a), schnur_view_of (b));
+	}
+	printf ("  schnur_view_mismatch: %6.2f GB/s\n",
+		(double)sum * sizeof (schnur_wide_t) / (bench_now_ns () - start));
+
+	sum = 0;
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		sum += 0 == wmemcmp (schnur_view_of (a).data, schnur_view_of (b).data, length);
+	}
+	printf ("  wmemcmp:              %6.2f GB/s\n",
+		(double)(sum * length * sizeof (schnur_wide_t)) / (bench_now_ns () - start));
+
+	printf ("  qsort schnur_compare: %8.2f ms\n",
+		bench_sort (sorted, paths, count, bench_compare_schnur));
+	printf ("  qsort wcscmp:         %8.2f ms\n",
+		bench_sort (sorted, paths, count, bench_compare_wcscmp));
+
+	for (i = 1; ok && i < count; ++i) {
+		ok = 0 >= schnur_compare (sorted[i - 1], sorted[i]);
+	}
+
+	for (i = 0; i < created; ++i) {
+		schnur_free (paths[i]);
+	}
+	free (sorted);
+	free (paths);
+	schnur_free (b);
+	schnur_free (a);
+
+	return ok;
+}
+
+/*
+	Searches a large text for needles placed near its end, compared with
+	wcsstr on the same characters.
+*/
+static int
+bench_find (void) {
+	static const schnur_wide_t* needles[] = {
+		L"needle",
+		L"a rather long needle, longer than the short needle limit of the search"
+	};
+	const size_t length = 1 << 22;
+	const size_t rounds = 20;
+	schnur_t* text = schnur_new_with_capacity (length);
+	size_t i, k, found;
+	double start;
+	int ok = NULL != text;
+
+	for (i = 0; ok && i < length; ++i) {
+		ok = schnur_append (text, (schnur_wide_t)(L'a' + (i * 7) % 23 + (0 == i % 97) * 2));
+	}
+	for (k = 0; ok && k < sizeof (needles) / sizeof (needles[0]); ++k) {
+		ok = schnur_append_cstr (text, needles[k]);
+	}
+
+	printf ("find\n");
+
+	for (k = 0; ok && k < sizeof (needles) / sizeof (needles[0]); ++k) {
+		struct schnur_view needle = schnur_view_cstr (needles[k]);
+		struct schnur_needle* compiled = schnur_needle_new (needle, NULL);
+		const schnur_wide_t* match = NULL;
+
+		found = 0;
+		start = bench_now_ns ();
+		for (i = 0; ok && i < rounds; ++i) {
+			found += schnur_find (text, needle, 0);
+		}
+		printf ("  %2zu characters, schnur_find:        %6.2f GB/s\n", needle.length,
+			(double)(rounds * length * sizeof (schnur_wide_t)) / (bench_now_ns () - start));
+
+		start = bench_now_ns ();
+		for (i = 0; ok && i < rounds; ++i) {
+			found += schnur_needle_find (compiled, schnur_view_of (text), 0);
+		}
+		printf ("  %2zu characters, schnur_needle_find: %6.2f GB/s\n", needle.length,
+			(double)(rounds * length * sizeof (schnur_wide_t)) / (bench_now_ns () - start));
+
+		start = bench_now_ns ();
+		for (i = 0; ok && i < rounds; ++i) {
+			match = wcsstr (schnur_view_of (text).data, needles[k]);
+		}
+		printf ("  %2zu characters, wcsstr:             %6.2f GB/s\n", needle.length,
+			(double)(rounds * length * sizeof (schnur_wide_t)) / (bench_now_ns () - start));
+
+		ok = NULL != compiled && NULL != match
+			&& found == 2 * rounds * (size_t)(match - schnur_view_of (text).data);
+		schnur_needle_free (compiled);
+	}
+
+	schnur_free (text);
+
+	return ok;
+}
+
+/*
+	Appends a pseudo random lowercase word of 4 to 11 characters.
+*/
+static int
+bench_append_word (schnur_t* s, unsigned int* seed) {
+	size_t n, k;
+	int ok = 1;
+
+	*seed = *seed * 1103515245 + 12345;
+	n = 4 + (*seed >> 16) % 8;
+	for (k = 0; ok && k < n; ++k) {
+		*seed = *seed * 1103515245 + 12345;
+		ok = schnur_append (s, (schnur_wide_t)(L'a' + (*seed >> 16) % 26));
+	}
+
+	return ok;
+}
+
+/*
+	Scans a text of random words for blocklists of growing size, once with a
+	matcher, once with a separate search per keyword. Throughput counts the
+	bytes of the wide characters scanned.
+*/
+static int
+bench_matcher (void) {
+	static const size_t sizes[] = { 100, 1000, 5000 };
+	const size_t length = 1 << 22;
+	schnur_t* text = schnur_new_with_capacity (length + 16);
+	schnur_t* keywords[5000];
+	unsigned int seed = 7;
+	size_t i, k, found, created = 0;
+	double start, bytes;
+	int ok = NULL != text;
+
+	while (ok && schnur_length (text) < length) {
+		ok = bench_append_word (text, &seed) && schnur_append (text, L' ');
+	}
+	for (i = 0; ok && i < 5000; ++i) {
+		keywords[i] = schnur_new ();
+		ok = NULL != keywords[i] && bench_append_word (keywords[i], &seed);
+		created += NULL != keywords[i];
+	}
+	bytes = (double)(schnur_length (text) * sizeof (schnur_wide_t));
+
+	printf ("matcher\n");
+
+	for (k = 0; ok && k < sizeof (sizes) / sizeof (sizes[0]); ++k) {
+		struct schnur_matcher* matcher;
+
+		start = bench_now_ns ();
+		matcher = schnur_matcher_new ((const schnur_t* const*)keywords, sizes[k], NULL);
+		ok = NULL != matcher;
+		printf ("  %4zu patterns: built in %6.2f ms, %6zu bytes/pattern\n", sizes[k],
+			(bench_now_ns () - start) / 1e6,
+			schnur_matcher_memory (matcher) / sizes[k]);
+
+		start = bench_now_ns ();
+		found = schnur_matcher_scan (matcher, schnur_view_of (text), NULL, NULL);
+		printf ("  %4zu patterns: schnur_matcher_scan %8.2f MB/s (%zu matches)\n", sizes[k],
+			bytes / (bench_now_ns () - start) * 1e3, found);
+
+		schnur_matcher_free (matcher);
+	}
+
+	found = 0;
+	start = bench_now_ns ();
+	for (i = 0; ok && i < sizes[0]; ++i) {
+		found += schnur_count (text, schnur_view_of (keywords[i]));
+	}
+	printf ("  %4zu patterns: schnur_count each   %8.2f MB/s (%zu matches)\n", sizes[0],
+		bytes / (bench_now_ns () - start) * 1e3, found);
+
+	for (i = 0; i < created; ++i) {
+		schnur_free (keywords[i]);
+	}
+	schnur_free (text);
+
+	return ok;
+}
+
+/*
+	Fills a template of 300 placeholders, once with schnur_replace_all per
+	placeholder, once with a single batch of edits, and once character by
+	character with schnur_get and schnur_append into a new string.
+*/
+static int
+bench_edit (void) {
+	const size_t placeholders = 300;
+	const size_t rounds = 200;
+	schnur_t* document = schnur_new ();
+	schnur_t* filled = schnur_new ();
+	struct schnur_edit* edits = malloc (placeholders * sizeof (struct schnur_edit));
+	struct schnur_view needle = schnur_view_cstr (L"{{name}}");
+	struct schnur_view value = schnur_view_cstr (L"Jane Q. Public");
+	size_t i, j, k, allocations;
+	double start;
+	int ok = NULL != document && NULL != filled && NULL != edits;
+
+	for (i = 0; ok && i < placeholders; ++i) {
+		ok = schnur_append_cstr (document, L"Dear customer, your order ships to ")
+			&& schnur_append_view (document, needle)
+			&& schnur_append_cstr (document, L" tomorrow.\n");
+	}
+	for (i = 0, k = 0; ok && i < placeholders; ++i) {
+		k = schnur_find (document, needle, k);
+		edits[i].begin = k;
+		edits[i].end = k + needle.length;
+		edits[i].replacement = value;
+		k += needle.length;
+	}
+
+	printf ("edit\n");
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		ok = schnur_copy (filled, document)
+			&& schnur_replace_all (filled, needle, value);
+	}
+	printf ("  schnur_replace_all:  %8.2f us/document, %5.2f allocations/document\n",
+		(bench_now_ns () - start) / rounds / 1e3,
+		(double)(bench_allocations () - allocations) / rounds);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		ok = schnur_copy (filled, document)
+			&& schnur_apply_edits (filled, edits, placeholders);
+	}
+	printf ("  schnur_apply_edits:  %8.2f us/document, %5.2f allocations/document\n",
+		(bench_now_ns () - start) / rounds / 1e3,
+		(double)(bench_allocations () - allocations) / rounds);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		schnur_t* naive = schnur_new ();
+		size_t n = schnur_length (document);
+
+		ok = NULL != naive;
+		for (j = 0; ok && j < n;) {
+			if (j + needle.length <= n && L'{' == schnur_get (document, j)
+			 && schnur_view_starts_with (
+				schnur_view_slice (schnur_view_of (document), j, n), needle)) {
+				for (k = 0; ok && k < value.length; ++k) {
+					ok = schnur_append (naive, value.data[k]);
+				}
+				j += needle.length;
+			}
+			else {
+				ok = schnur_append (naive, schnur_get (document, j++));
+			}
+		}
+		ok = ok && schnur_equal (naive, filled);
+		schnur_free (naive);
+	}
+	printf ("  get/append:          %8.2f us/document, %5.2f allocations/document\n",
+		(bench_now_ns () - start) / rounds / 1e3,
+		(double)(bench_allocations () - allocations) / rounds);
+
+	free (edits);
+	schnur_free (filled);
+	schnur_free (document);
+
+	return ok;
+}
+
+/*
+	Splits comma separated records into fields, once with a tokenizer
+	yielding views, once by copying each field into a new schnur.
+*/
+static int
+bench_split (void) {
+	const size_t records = 20000;
+	const size_t rounds = 20;
+	schnur_t* text = schnur_new ();
+	struct schnur_view view;
+	size_t i, j, fields, allocations;
+	double start, bytes;
+	int ok = NULL != text;
+
+	for (i = 0; ok && i < records; ++i) {
+		ok = schnur_append_cstr (text, L"4711,Jane Q. Public,jane@example.org,,Berlin,")
+			&& schnur_append_cstr (text, L"10115,+49 30 1234567,active\n");
+	}
+	view = schnur_view_of (text);
+	bytes = (double)(view.length * sizeof (schnur_wide_t)) * rounds;
+
+	printf ("split\n");
+
+	fields = 0;
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		SCHNUR_FOR_EACH_TOKEN (t, schnur_split_any (view, schnur_view_cstr (L",\n"), 0)) {
+			fields += t.token.length;
+		}
+	}
+	printf ("  schnur_split_any:     %8.2f MB/s, %zu allocations\n",
+		bytes / (bench_now_ns () - start) * 1e3, bench_allocations () - allocations);
+
+	j = 0;
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < rounds; ++i) {
+		size_t k, begin = 0;
+
+		for (k = 0; ok && k <= view.length; ++k) {
+			if (k == view.length || L',' == view.data[k] || L'\n' == view.data[k]) {
+				schnur_t* field = schnur_new ();
+
+				ok = NULL != field
+					&& schnur_append_view (field, schnur_view_slice (view, begin, k));
+				j += schnur_length (field);
+				schnur_free (field);
+				begin = k + 1;
+			}
+		}
+	}
+	printf ("  schnur_new per field: %8.2f MB/s, %zu allocations\n",
+		bytes / (bench_now_ns () - start) * 1e3, bench_allocations () - allocations);
+
+	schnur_free (text);
+
+	return ok && fields == j;
+}
+
+/*
+	Builds log lines out of 30 fields, once appending field by field, once
+	with a single schnur_append_join.
+*/
+static int
+bench_join (void) {
+	const size_t lines = 200000;
+	const size_t count = 30;
+	struct schnur_view fields[30];
+	struct schnur_view separator = schnur_view_cstr (L",");
+	schnur_t* line = schnur_new ();
+	size_t i, j, allocations, total = 0;
+	double start;
+	int ok = NULL != line;
+
+	for (i = 0; i < count; ++i) {
+		fields[i] = schnur_view_cstr (0 == i % 3 ? L"2026-10-16T12:00:00Z"
+			: 1 == i % 3 ? L"42" : L"request served");
+	}
+
+	printf ("join\n");
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < lines; ++i) {
+		schnur_t* s = schnur_new ();
+
+		ok = NULL != s;
+		for (j = 0; ok && j < count; ++j) {
+			ok = (0 == j || schnur_append_view (s, separator))
+				&& schnur_append_view (s, fields[j]);
+		}
+		total += schnur_length (s);
+		schnur_free (s);
+	}
+	printf ("  schnur_append_view: %8.2f ns/line, %5.2f allocations/line\n",
+		(bench_now_ns () - start) / lines,
+		(double)(bench_allocations () - allocations) / lines);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < lines; ++i) {
+		schnur_t* s = schnur_join (separator, fields, count);
+
+		ok = NULL != s;
+		total -= schnur_length (s);
+		schnur_free (s);
+	}
+	printf ("  schnur_join:        %8.2f ns/line, %5.2f allocations/line\n",
+		(bench_now_ns () - start) / lines,
+		(double)(bench_allocations () - allocations) / lines);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < lines; ++i) {
+		ok = schnur_terminate (line, 0)
+			&& schnur_append_join (line, separator, fields, count);
+	}
+	printf ("  schnur_append_join: %8.2f ns/line, %5.2f allocations/line\n",
+		(bench_now_ns () - start) / lines,
+		(double)(bench_allocations () - allocations) / lines);
+
+	schnur_free (line);
+
+	return ok && 0 == total;
+}
+
+/*
+	Formats log lines, once with swprintf into a stack buffer appended
+	afterwards, once straight into the schnur with schnur_appendf.
+*/
+static int
+bench_format (void) {
+	const size_t lines = 200000;
+	struct schnur_view user = schnur_view_cstr (L"jane@example.org");
+	schnur_t* log = schnur_new ();
+	size_t i, allocations, length;
+	double start;
+	int ok = NULL != log;
+
+	printf ("format\n");
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < lines; ++i) {
+		schnur_wide_t line[256];
+
+		ok = 0 <= swprintf (line, 256, L"%zu [%ls] user=%.*ls status=%d took=%.3f ms\n",
+				i, L"info", (int)user.length, user.data, 200, (double)i / 1024.0)
+			&& schnur_append_cstr (log, line);
+	}
+	printf ("  swprintf + append: %8.2f ns/line, %5.2f allocations/line\n",
+		(bench_now_ns () - start) / lines,
+		(double)(bench_allocations () - allocations) / lines);
+
+	length = schnur_length (log);
+	ok = ok && schnur_terminate (log, 0);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < lines; ++i) {
+		ok = schnur_appendf (log, L"%zu [%ls] user=%v status=%d took=%.3f ms\n",
+			i, L"info", user, 200, (double)i / 1024.0);
+	}
+	printf ("  schnur_appendf:    %8.2f ns/line, %5.2f allocations/line\n",
+		(bench_now_ns () - start) / lines,
+		(double)(bench_allocations () - allocations) / lines);
+
+	ok = ok && length == schnur_length (log);
+	schnur_free (log);
+
+	return ok;
+}
+
+/*
+	Formats and parses metric samples, once through snprintf and strtod on
+	narrow strings, once directly on schnurs.
+*/
+static int
+bench_number (void) {
+	const size_t samples = 1000000;
+	schnur_t* out = schnur_new ();
+	struct schnur_view view;
+	size_t i, at, consumed, allocations;
+	double start, sum = 0.0, check = 0.0;
+	int ok = NULL != out;
+
+	printf ("number\n");
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < samples; ++i) {
+		char line[64];
+		schnur_wide_t wide[64];
+
+		snprintf (line, sizeof (line), "%llu %.17g\n",
+			(unsigned long long)i * 7919, (double)i / 7.0);
+		ok = (size_t)-1 != mbstowcs (wide, line, 64)
+			&& schnur_append_cstr (out, wide);
+	}
+	printf ("  snprintf format:    %8.2f ns/sample\n", (bench_now_ns () - start) / samples);
+
+	ok = ok && schnur_terminate (out, 0);
+	start = bench_now_ns ();
+	for (i = 0; ok && i < samples; ++i) {
+		ok = schnur_append_u64 (out, (uint64_t)i * 7919)
+			&& schnur_append (out, L' ')
+			&& schnur_append_f64 (out, (double)i / 7.0)
+			&& schnur_append (out, L'\n');
+		check += (double)i / 7.0;
+	}
+	printf ("  schnur_append_*:    %8.2f ns/sample, %zu allocations\n",
+		(bench_now_ns () - start) / samples, bench_allocations () - allocations);
+
+	view = schnur_view_of (out);
+	start = bench_now_ns ();
+	{
+		schnur_narrow_t* narrow = schnur_narrow (out);
+		char* end;
+
+		ok = NULL != narrow;
+		for (i = 0, end = narrow; ok && i < samples; ++i) {
+			strtoull (end, &end, 10);
+			sum += strtod (end + 1, &end);
+			++end;
+		}
+		schnur_narrow_free (narrow);
+	}
+	printf ("  narrow + strtod:    %8.2f ns/sample\n", (bench_now_ns () - start) / samples);
+	ok = ok && sum == check;
+
+	sum = 0.0;
+	start = bench_now_ns ();
+	for (i = 0, at = 0; ok && i < samples; ++i) {
+		uint64_t u;
+		double d;
+
+		ok = schnur_view_parse_u64 (schnur_view_slice (view, at, view.length), &u, &consumed);
+		at += consumed + 1;
+		ok = ok && schnur_view_parse_f64 (schnur_view_slice (view, at, view.length), &d, &consumed);
+		at += consumed + 1;
+		sum += d;
+	}
+	printf ("  schnur_view_parse_*: %7.2f ns/sample\n", (bench_now_ns () - start) / samples);
+
+	schnur_free (out);
+
+	return ok && sum == check;
+}
+
+static int
+bench_read (void) {
+	const char line[] = "plain ascii text, \xc3\xa4\xc3\xb6\xc3\xbc \xd0\xb6\xd0\xb8\xd0\xb2\xd0\xbe\xd1\x82 \xe2\x82\xac \xf0\x9f\x98\x80\n";
+	const size_t size = 32 * 1024 * 1024;
+	FILE* file = tmpfile ();
+	size_t written = 0, allocations;
+	double start, mb = size / (1024.0 * 1024.0);
+	schnur_t* expected = NULL;
+	int ok = NULL != file;
+
+	printf ("read\n");
+
+	while (ok && written < size) {
+		ok = sizeof (line) - 1 == fwrite (line, 1, sizeof (line) - 1, file);
+		written += sizeof (line) - 1;
+	}
+	ok = ok && 0 == fflush (file);
+
+	rewind (file);
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	{
+		char* bytes = malloc (written);
+
+		ok = ok && NULL != bytes && written == fread (bytes, 1, written, file);
+		expected = ok ? schnur_new_su_n (bytes, written, NULL) : NULL;
+		ok = NULL != expected;
+		free (bytes);
+	}
+	printf ("  fread all + new_su_n: %7.2f ms (%.0f MiB/s), %zu allocations, %zu bytes staged\n",
+		(bench_now_ns () - start) / 1e6, mb / ((bench_now_ns () - start) / 1e9),
+		bench_allocations () - allocations, written);
+
+	rewind (file);
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	SCHNUR_SCOPED (s, schnur_new ()) {
+		ok = ok && schnur_read_file (s, file, NULL) && schnur_equal (expected, s);
+		printf ("  schnur_read_file:     %7.2f ms (%.0f MiB/s), %zu allocations, %d bytes staged\n",
+			(bench_now_ns () - start) / 1e6, mb / ((bench_now_ns () - start) / 1e9),
+			bench_allocations () - allocations, SCHNUR_READ_CHUNK_SIZE);
+	}
+
+	rewind (file);
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	SCHNUR_SCOPED (s, schnur_new ()) {
+		ok = ok && schnur_read_fd (s, fileno (file), NULL) && schnur_equal (expected, s);
+		printf ("  schnur_read_fd:       %7.2f ms (%.0f MiB/s), %zu allocations, %d bytes staged\n",
+			(bench_now_ns () - start) / 1e6, mb / ((bench_now_ns () - start) / 1e9),
+			bench_allocations () - allocations, SCHNUR_READ_CHUNK_SIZE);
+	}
+
+	schnur_free (expected);
+	if (NULL != file) fclose (file);
+
+	return ok;
+}
+
+static int
+bench_write (void) {
+	const size_t samples = 200000, batch = 64;
+	const schnur_t* messages[64];
+	FILE* file = tmpfile ();
+	size_t i, j, allocations;
+	double start;
+	int ok = NULL != file;
+
+	printf ("write\n");
+
+	// Unbuffered, so every message takes its own write, as on a socket.
+	ok = ok && 0 == setvbuf (file, NULL, _IONBF, 0);
+
+	for (i = 0; i < batch; ++i) {
+		schnur_t* s = schnur_new ();
+
+		ok = ok && NULL != s
+			&& schnur_appendf (s, L"%u level=info msg=\"request handled\" path=/api/v1/\u00fcbersicht status=200\n", (unsigned int)i);
+		messages[i] = s;
+	}
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < samples; ++i) {
+		schnur_narrow_t* narrow = schnur_narrow (messages[i % batch]);
+
+		ok = NULL != narrow
+			&& strlen (narrow) == fwrite (narrow, 1, strlen (narrow), file);
+		schnur_narrow_free (narrow);
+	}
+	printf ("  narrow + write:     %8.2f ns/message, %zu allocations\n",
+		(bench_now_ns () - start) / samples, bench_allocations () - allocations);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < samples; ++i) {
+		ok = schnur_write_fd (messages[i % batch], fileno (file));
+	}
+	printf ("  schnur_write_fd:    %8.2f ns/message, %zu allocations\n",
+		(bench_now_ns () - start) / samples, bench_allocations () - allocations);
+
+	allocations = bench_allocations ();
+	start = bench_now_ns ();
+	for (i = 0; ok && i < samples; i += batch) {
+		ok = schnur_writev_fd (messages, batch, fileno (file));
+	}
+	printf ("  schnur_writev_fd:   %8.2f ns/message, %zu allocations, batches of %zu\n",
+		(bench_now_ns () - start) / samples, bench_allocations () - allocations, batch);
+
+	for (j = 0; j < batch; ++j) {
+		schnur_free ((schnur_t*)messages[j]);
+	}
+	if (NULL != file) fclose (file);
+
+	return ok;
+}
+
+static int
+bench_load (void) {
+	const size_t count = 20000;
+	const char line[] = "plain ascii text, \xc3\xa4\xc3\xb6\xc3\xbc \xd0\xb6\xd0\xb8\xd0\xb2\xd0\xbe\xd1\x82 \xe2\x82\xac\n";
+	char** paths = calloc (count, sizeof (char*));
+	schnur_t** schnurs = calloc (count, sizeof (schnur_t*));
+	size_t i, j, characters = 0, expected = 0;
+	char* bytes = malloc (1 << 16);
+	double start;
+	int ok = NULL != paths && NULL != schnurs && NULL != bytes;
+
+	printf ("load\n");
+
+	// A corpus of small files, from a few hundred bytes to a few KiB.
+	for (i = 0; ok && i < count; ++i) {
+		FILE* file;
+
+		paths[i] = malloc (64);
+		ok = NULL != paths[i];
+		if (! ok) break;
+		snprintf (paths[i], 64, "schnur-bench-corpus-%zu.txt", i);
+		file = fopen (paths[i], "wb");
+		ok = NULL != file;
+		for (j = 0; ok && j < 4 + (i * 7919) % 60; ++j) {
+			ok = sizeof (line) - 1 == fwrite (line, 1, sizeof (line) - 1, file);
+		}
+		if (NULL != file) fclose (file);
+	}
+
+	// All schnurs are kept until the end, as an indexer would.
+	start = bench_now_ns ();
+	for (i = 0; ok && i < count; ++i) {
+		FILE* file = fopen (paths[i], "rb");
+		size_t n = NULL == file ? 0 : fread (bytes, 1, (1 << 16) - 1, file);
+
+		if (NULL != file) fclose (file);
+		bytes[n] = '\0';
+		schnurs[i] = schnur_new_su (bytes);
+		ok = NULL != schnurs[i];
+	}
+	printf ("  fopen + schnur_new_su:     %8.2f ms, %.2f us/file\n",
+		(bench_now_ns () - start) / 1e6, (bench_now_ns () - start) / 1e3 / count);
+	for (i = 0; NULL != schnurs && i < count; ++i) {
+		expected += schnur_length (schnurs[i]);
+		schnur_free (schnurs[i]);
+	}
+
+	for (int flags = 0; ok && flags <= SCHNUR_LOAD_THREADS; ++flags) {
+		start = bench_now_ns ();
+		ok = schnur_load_files ((const char* const*)paths, count, schnurs, flags);
+		printf ("  schnur_load_files%s %8.2f ms, %.2f us/file\n",
+			flags ? " (threads):" : ":          ",
+			(bench_now_ns () - start) / 1e6, (bench_now_ns () - start) / 1e3 / count);
+		for (i = 0, characters = 0; i < count; ++i) {
+			characters += schnur_length (schnurs[i]);
+			schnur_free (schnurs[i]);
+		}
+		ok = ok && expected == characters;
+	}
+
+	for (i = 0; NULL != paths && i < count; ++i) {
+		if (NULL != paths[i]) remove (paths[i]);
+		free (paths[i]);
+	}
+	free (paths);
+	free (schnurs);
+	free (bytes);
+
+	return ok;
+}
+
+static int
+bench_compare_packed (const void* a, const void* b) {
+	return schnur_packed_compare (*(struct schnur_packed* const*)a, *(struct schnur_packed* const*)b);
+}
+
+/*
+	Stores random words, one in twenty with a character beyond ascii, once
+	as schnurs, once as packed strings. Then sorts and searches both.
+*/
+static int
+bench_packed (void) {
+	const size_t count = 200000;
+	schnur_t** strings = calloc (count, sizeof (schnur_t*));
+	schnur_t** sorted = calloc (count, sizeof (schnur_t*));
+	struct schnur_packed** packed = calloc (count, sizeof (struct schnur_packed*));
+	struct schnur_packed** sorted_packed = calloc (count, sizeof (struct schnur_packed*));
+	struct schnur_view needle = schnur_view_cstr (L"qx");
+	unsigned int seed = 1;
+	size_t i, bytes, hits = 0, packed_hits = 0;
+	double start, best = 0, elapsed;
+	int k, ok = NULL != strings && NULL != sorted && NULL != packed && NULL != sorted_packed;
+
+	printf ("packed\n");
+
+	bytes = bench_allocated_bytes ();
+	for (i = 0; ok && i < count; ++i) {
+		strings[i] = schnur_new ();
+		ok = NULL != strings[i] && bench_append_word (strings[i], &seed)
+			&& bench_append_word (strings[i], &seed)
+			&& (0 != i % 20 || schnur_append (strings[i], L'\u00e9'));
+	}
+	printf ("  schnur:         %6.1f bytes/string\n",
+		(double)(bench_allocated_bytes () - bytes) / count);
+
+	bytes = bench_allocated_bytes ();
+	for (i = 0; ok && i < count; ++i) {
+		packed[i] = schnur_packed_new (schnur_view_of (strings[i]));
+		ok = NULL != packed[i];
+	}
+	printf ("  schnur_packed:  %6.1f bytes/string\n",
+		(double)(bench_allocated_bytes () - bytes) / count);
+
+	if (ok) {
+		printf ("  sort schnur_compare:         %8.2f ms\n",
+			bench_sort (sorted, strings, count, bench_compare_schnur));
+
+		for (k = 0; k < 3; ++k) {
+			memcpy (sorted_packed, packed, count * sizeof (struct schnur_packed*));
+			start = bench_now_ns ();
+			qsort (sorted_packed, count, sizeof (struct schnur_packed*), bench_compare_packed);
+			elapsed = bench_now_ns () - start;
+			best = 0 == k || elapsed < best ? elapsed : best;
+		}
+		printf ("  sort schnur_packed_compare:  %8.2f ms\n", best / 1e6);
+		for (i = 0; i < count; ++i) {
+			ok = ok && schnur_packed_equal_view (sorted_packed[i], schnur_view_of (sorted[i]));
+		}
+	}
+
+	start = bench_now_ns ();
+	for (i = 0; ok && i < count; ++i) {
+		hits += SCHNUR_NOT_FOUND != schnur_find (strings[i], needle, 0);
+	}
+	printf ("  schnur_find:          %8.2f ns/string\n", (bench_now_ns () - start) / count);
+
+	start = bench_now_ns ();
+	for (i = 0; ok && i < count; ++i) {
+		packed_hits += SCHNUR_NOT_FOUND != schnur_packed_find (packed[i], needle, 0);
+	}
+	printf ("  schnur_packed_find:   %8.2f ns/string\n", (bench_now_ns () - start) / count);
+	ok = ok && hits == packed_hits;
+
+	for (i = 0; i < count; ++i) {
+		if (NULL != strings) schnur_free (strings[i]);
+		if (NULL != packed) schnur_packed_free (packed[i]);
+	}
+	free (strings);
+	free (sorted);
+	free (packed);
+	free (sorted_packed);
+
+	return ok;
+}
+
+static int
+bench_mapped (void) {
+	const char* path = "schnur-bench-mapped.txt";
+	const char line[] = "plain ascii text, \xc3\xa4\xc3\xb6\xc3\xbc \xd0\xb6\xd0\xb8\xd0\xb2\xd0\xbe\xd1\x82 \xe2\x82\xac \xf0\x9f\x98\x80\n";
+	const size_t size = 128 * 1024 * 1024;
+	FILE* file = fopen (path, "wb");
+	struct schnur_mapped* mapped = NULL;
+	struct schnur_view view;
+	size_t written = 0, length = 0;
+	double start;
+	int ok = NULL != file;
+
+	printf ("mapped\n");
+
+	while (ok && written < size) {
+		ok = sizeof (line) - 1 == fwrite (line, 1, sizeof (line) - 1, file);
+		written += sizeof (line) - 1;
+	}
+	if (NULL != file) fclose (file);
+
+	file = ok ? fopen (path, "rb") : NULL;
+	start = bench_now_ns ();
+	SCHNUR_SCOPED (s, schnur_new ()) {
+		ok = NULL != file && schnur_read_file (s, file, NULL);
+		length = schnur_length (s);
+		printf ("  schnur_read_file, first line: %8.2f ms, %zu characters decoded\n",
+			(bench_now_ns () - start) / 1e6, length);
+	}
+	if (NULL != file) fclose (file);
+
+	start = bench_now_ns ();
+	mapped = ok ? schnur_mapped_open (path, NULL) : NULL;
+	ok = NULL != mapped && length == schnur_mapped_length (mapped);
+	view = schnur_mapped_slice (mapped, 0, 48);
+	ok = ok && 48 == view.length && L'p' == view.data[0];
+	printf ("  schnur_mapped, first line:    %8.2f ms, %zu characters decoded\n",
+		(bench_now_ns () - start) / 1e6, schnur_mapped_decoded_length (mapped));
+
+	start = bench_now_ns ();
+	view = schnur_mapped_slice (mapped, 0, length);
+	ok = ok && length == view.length;
+	printf ("  schnur_mapped, rest:          %8.2f ms, %zu characters decoded\n",
+		(bench_now_ns () - start) / 1e6, schnur_mapped_decoded_length (mapped));
+
+	schnur_mapped_free (mapped);
+	remove (path);
+
+	return ok;
+}
+
+struct bench {
+	const char* name;
+	int (*run) (void);
+};
+
+static const struct bench g_benches[] = {
+	{ "append", bench_append },
+	{ "reserve", bench_reserve },
+	{ "short", bench_short },
+	{ "arena", bench_arena },
+	{ "decode", bench_decode },
+	{ "encode", bench_encode },
+	{ "convert", bench_convert },
+	{ "copy", bench_copy },
+	{ "hash", bench_hash },
+	{ "intern", bench_intern },
+	{ "rope", bench_rope },
+	{ "map", bench_map },
+	{ "compare", bench_compare },
+	{ "find", bench_find },
+	{ "matcher", bench_matcher },
+	{ "edit", bench_edit },
+	{ "split", bench_split },
+	{ "join", bench_join },
+	{ "format", bench_format },
+	{ "number", bench_number },
+	{ "read", bench_read },
+	{ "write", bench_write },
+	{ "load", bench_load },
+	{ "packed", bench_packed },
+	{ "mapped", bench_mapped },
+};
+
+int
+main (int argc, char** argv) {
+	size_t count = sizeof (g_benches) / sizeof (g_benches[0]);
+	size_t i;
+	int j, failed = 0;
+
+	setlocale (LC_ALL, "");
+	schnur_set_allocator (&g_counting_allocator);
+
+	for (i = 0; i < count; ++i) {
+		int selected = argc < 2;
+		for (j = 1; j < argc; ++j) {
+			selected |= 0 == strcmp (argv[j], g_benches[i].name);
+		}
+		if (selected && ! g_benches[i].run ()) {
+			fprintf (stderr, "Benchmark '%s' failed.\n", g_benches[i].name);
+			failed = 1;
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
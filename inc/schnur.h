@@ -7,15 +7,85 @@
 */
 
 #include <wchar.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
 
 #ifndef Blurryroots_String_Library_h
 #define Blurryroots_String_Library_h
 
 /**
- * The block size used for resize / reallocations.
+ * The block size used for resize / reallocations. This is the first heap
+ * capacity of a schnur and the step width of the linear growth policy.
  */
 #define SCHNUR_BLOCK_SIZE 32
 
+#if !defined(SCHNUR_INLINE_CAPACITY)
+/**
+ * The number of characters (including the null terminator) a schnur stores
+ * inline, without allocating a separate buffer. This is the initial capacity
+ * of a new schnur. Strings growing beyond it move to heap storage.
+ */
+#define SCHNUR_INLINE_CAPACITY 16
+#endif
+
+#if !defined(SCHNUR_PACKED_INLINE_SIZE)
+/**
+ * The number of bytes a schnur_packed stores inline, without allocating a
+ * separate buffer. Holds that many characters below U+0100, half as many below
+ * U+10000, a quarter as many otherwise. With 64-bit pointers, the whole packed
+ * string then takes 56 bytes.
+ */
+#define SCHNUR_PACKED_INLINE_SIZE 20
+#endif
+
+#if !defined(SCHNUR_ROPE_LEAF_SIZE)
+/**
+ * The maximum number of characters stored in a single leaf of a schnur_rope.
+ */
+#define SCHNUR_ROPE_LEAF_SIZE 1024
+#endif
+
+#if !defined(SCHNUR_READ_CHUNK_SIZE)
+/**
+ * The number of bytes schnur_read_fd and schnur_read_file read at once, into
+ * a buffer on the stack. Small enough for threads with small stacks.
+ */
+#define SCHNUR_READ_CHUNK_SIZE 8192
+#endif
+
+#if !defined(SCHNUR_WRITE_CHUNK_SIZE)
+/**
+ * The size of the buffer on the stack, schnur_write_fd and schnur_writev_fd
+ * encode into before writing. Has to be at least 8 * SCHNUR_UTF8_MAX_BYTES.
+ * Small enough for threads with small stacks.
+ */
+#define SCHNUR_WRITE_CHUNK_SIZE 8192
+#endif
+
+#if !defined(SCHNUR_LOAD_QUEUE_DEPTH)
+/**
+ * The number of files schnur_load_files reads at once through io_uring.
+ */
+#define SCHNUR_LOAD_QUEUE_DEPTH 64
+#endif
+
+#if !defined(SCHNUR_LOAD_THREAD_COUNT)
+/**
+ * The number of threads schnur_load_files reads files on, where io_uring is
+ * not available. Includes the calling thread.
+ */
+#define SCHNUR_LOAD_THREAD_COUNT 8
+#endif
+
+#if !defined(SCHNUR_MAPPED_BLOCK_SIZE)
+/**
+ * The number of bytes of a mapped file schnur_mapped decodes at once, on
+ * first access to any of their characters.
+ */
+#define SCHNUR_MAPPED_BLOCK_SIZE 65536
+#endif
+
 /// Wraps a narrow character or string.
 #define SCHNUR_N(t) t
 /// Wraps a wide character or string.
@@ -25,6 +95,25 @@
 #define SCHNUR_NC_NULL SCHNUR_N ('\0')
 /// The null terminator for a wide character type.
 #define SCHNUR_WC_NULL SCHNUR_W ('\0')
+/// Returned by UTF-8 conversion functions on invalid input.
+#define SCHNUR_UTF8_INVALID ((size_t)-1)
+/// Returned by search functions if there is no match.
+#define SCHNUR_NOT_FOUND ((size_t)-1)
+/// Returned by formatting functions on an invalid format or argument.
+#define SCHNUR_FORMAT_INVALID ((size_t)-1)
+/// Maximum number of characters schnur_format_i64, schnur_format_u64 and
+/// schnur_format_f64 write.
+#define SCHNUR_NUMBER_MAX_CHARS 32
+
+#if WCHAR_MAX > 0xFFFF
+/// Maximum number of utf-8 bytes a single wide character encodes to.
+#define SCHNUR_UTF8_MAX_BYTES 4
+#else
+/// Maximum number of utf-8 bytes a single wide character encodes to.
+/// Surrogate pairs take 4 bytes for 2 characters.
+#define SCHNUR_UTF8_MAX_BYTES 3
+#endif
+
 #if defined(NULL)
 /// A null pointer for use with pointers to schnur_t.
 #define SCHNUR_NULL NULL
@@ -54,6 +143,171 @@ typedef
 	struct schnur
 	schnur_t;
 
+/**
+ * @brief A non-owning view of wide characters, e.g. a slice of a schnur.
+ *
+ * Views do not rely on null termination. A view into a schnur becomes
+ * invalid, as soon as that schnur grows, shrinks or is freed.
+ */
+struct schnur_view {
+	/// First character of the view. Might be NULL for empty views.
+	const schnur_wide_t* data;
+	/// Number of characters in the view.
+	size_t length;
+};
+/**
+ * @brief Convenience typedef for struct schnur_view.
+ * @see struct schnur_view
+ */
+typedef
+	struct schnur_view
+	schnur_view_t;
+
+/**
+ * @brief Replaces the characters in range [begin, end) of a schnur.
+ *
+ * @see schnur_apply_edits
+ */
+struct schnur_edit {
+	/// Index of the first character replaced.
+	size_t begin;
+	/// Index past the last character replaced. Equal to begin to insert.
+	size_t end;
+	/// The characters to put in place of the range.
+	struct schnur_view replacement;
+};
+
+/**
+ * @brief Set of functions used by schnur to manage memory.
+ *
+ * An allocator has to outlive every schnur and buffer allocated through it.
+ */
+struct schnur_allocator {
+	/// Allocates size bytes. Returns NULL on failure.
+	void* (*allocate) (void* context, size_t size);
+	/// Resizes p from old_size to size bytes, keeping its contents. Returns
+	/// NULL on failure, leaving p untouched.
+	void* (*reallocate) (void* context, void* p, size_t old_size, size_t size);
+	/// Releases p, which might be NULL.
+	void (*release) (void* context, void* p);
+	/// User data passed to all functions above.
+	void* context;
+};
+
+/**
+ * @brief      Retrieves the default allocator, which is based on malloc,
+ * realloc and free.
+ *
+ * @return     Pointer to the default allocator.
+ */
+const struct schnur_allocator*
+schnur_default_allocator (void);
+
+/**
+ * @brief      Sets the allocator used by all schnur_t instances created from
+ * now on, without an allocator of their own.
+ *
+ * Instances keep the allocator they were created with.
+ *
+ * @param[in]  allocator  The allocator to use, or NULL to restore the default.
+ *
+ * @return     1 on success, 0 if allocator misses functions.
+ */
+int
+schnur_set_allocator (const struct schnur_allocator* allocator);
+
+/**
+ * @brief      Retrieves the allocator currently used for new instances.
+ *
+ * @return     Pointer to the allocator.
+ */
+const struct schnur_allocator*
+schnur_get_allocator (void);
+
+/**
+ * @brief An arena (region) of memory, handing out allocations by bumping a
+ * pointer. All allocations are released at once.
+ */
+struct schnur_arena;
+
+/**
+ * @brief      Creates a new arena.
+ *
+ * @param[in]  block_size  Number of bytes requested from the system at once.
+ * Zero selects a sensible default.
+ *
+ * @return     Pointer to the new arena, NULL on failure.
+ */
+struct schnur_arena*
+schnur_arena_new (size_t block_size);
+
+/**
+ * @brief      Frees given arena, including all memory allocated through it.
+ *
+ * @param      arena  An arena pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_arena_free (struct schnur_arena* arena);
+
+/**
+ * @brief      Releases all allocations of given arena at once.
+ *
+ * Every schnur and buffer allocated through the arena becomes invalid. The
+ * arena keeps its memory blocks for reuse.
+ *
+ * @param      arena  An arena pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_arena_reset (struct schnur_arena* arena);
+
+/**
+ * @brief      Retrieves the allocator handing out memory of given arena.
+ *
+ * Releasing single allocations through it is cheap, but only gives back
+ * memory of the most recent allocation.
+ *
+ * @param      arena  An arena pointer.
+ *
+ * @return     Pointer to the arena's allocator, NULL if arena is NULL.
+ */
+const struct schnur_allocator*
+schnur_arena_allocator (struct schnur_arena* arena);
+
+/**
+ * @brief Determines by how much a schnur's capacity grows, whenever it has to
+ * make room for more characters.
+ */
+enum schnur_growth_policy {
+	/// Doubles the capacity on each step. Keeps appending amortized O(1).
+	SCHNUR_GROWTH_GEOMETRIC = 0,
+	/// Adds SCHNUR_BLOCK_SIZE characters on each step.
+	SCHNUR_GROWTH_LINEAR
+};
+
+/**
+ * @brief      Sets the growth policy used by all schnur_t instances.
+ *
+ * Defaults to SCHNUR_GROWTH_GEOMETRIC.
+ *
+ * @param[in]  policy  The policy to use from now on.
+ *
+ * @return     1 on success, 0 if policy is unknown.
+ */
+int
+schnur_set_growth_policy (enum schnur_growth_policy policy);
+
+/**
+ * @brief      Retrieves the currently used growth policy.
+ *
+ * @return     The growth policy.
+ */
+enum schnur_growth_policy
+schnur_get_growth_policy (void);
+
 /**
  * @brief      Creates a new schnur_t instance.
  *
@@ -62,6 +316,28 @@ typedef
 struct schnur*
 schnur_new (void);
 
+/**
+ * @brief      Creates a new schnur_t instance using given allocator for all
+ * its memory, including buffers from schnur_wide and schnur_narrow.
+ *
+ * @param[in]  allocator  The allocator to use, or NULL for the current one.
+ *
+ * @return     Pointer to new schnur_t instance.
+ */
+struct schnur*
+schnur_new_with_allocator (const struct schnur_allocator* allocator);
+
+/**
+ * @brief      Creates a new schnur_t instance, able to hold at least n
+ * characters without having to grow.
+ *
+ * @param[in]  n     Number of characters to make room for.
+ *
+ * @return     Pointer to new schnur_t instance.
+ */
+struct schnur*
+schnur_new_with_capacity (size_t n);
+
 /**
  * @brief      Creates a new schnur_t instance.
  * 
@@ -75,13 +351,97 @@ schnur_new_s (const schnur_wide_t* s);
 /**
  * @brief      Creates a new schnur_t instance from narrow utf-8 string.
  * 
+ * Decoding does not depend on the current locale.
+ *
  * @param      s  The string to use as inital value.
  *
- * @return     Pointer to new schnur_t instance.
+ * @return     Pointer to new schnur_t instance, NULL if s is not valid UTF-8.
  */
 struct schnur*
 schnur_new_su (const schnur_narrow_t* s);
 
+/**
+ * @brief      Creates a new schnur_t instance from n bytes of utf-8.
+ *
+ * Null bytes within the first n bytes are decoded like any other character.
+ *
+ * @param      s      The bytes to use as inital value.
+ * @param[in]  n      Number of bytes to decode.
+ * @param[out] error  Receives the offset of the first invalid byte, if s is
+ * not valid UTF-8. Might be NULL.
+ *
+ * @return     Pointer to new schnur_t instance, NULL on failure.
+ */
+struct schnur*
+schnur_new_su_n (const schnur_narrow_t* s, size_t n, size_t* error);
+
+/**
+ * @brief      Validates n bytes of utf-8 and computes the number of wide
+ * characters they decode to.
+ *
+ * Rejects overlong forms, surrogates, truncated sequences and code points
+ * beyond U+10FFFF. Code points beyond U+FFFF take two wide characters, if
+ * schnur_wide_t is 16 bits wide.
+ *
+ * @param      s      The bytes to measure.
+ * @param[in]  n      Number of bytes to measure.
+ * @param[out] error  Receives the offset of the first invalid byte, if s is
+ * not valid UTF-8. Might be NULL.
+ *
+ * @return     Number of wide characters, SCHNUR_UTF8_INVALID on invalid input.
+ */
+size_t
+schnur_utf8_decode_length (const schnur_narrow_t* s, size_t n, size_t* error);
+
+/**
+ * @brief      Decodes n bytes of utf-8 into wide characters.
+ *
+ * Does not null terminate dst.
+ *
+ * @see schnur_utf8_decode_length
+ *
+ * @param      dst   Receives the decoded characters. Has to have room for
+ * schnur_utf8_decode_length (s, n) characters.
+ * @param      s     The bytes to decode.
+ * @param[in]  n     Number of bytes to decode.
+ *
+ * @return     Number of wide characters written, SCHNUR_UTF8_INVALID on
+ * invalid input.
+ */
+size_t
+schnur_utf8_decode (schnur_wide_t* dst, const schnur_narrow_t* s, size_t n);
+
+/**
+ * @brief      Computes the exact number of bytes n wide characters encode to
+ * in utf-8.
+ *
+ * @param      s     The characters to measure.
+ * @param[in]  n     Number of characters to measure.
+ *
+ * @return     Number of bytes, SCHNUR_UTF8_INVALID if s contains lone
+ * surrogates or code points beyond U+10FFFF.
+ */
+size_t
+schnur_utf8_encode_length (const schnur_wide_t* s, size_t n);
+
+/**
+ * @brief      Encodes n wide characters as utf-8.
+ *
+ * Uses vectorized ASCII paths, chosen for the running CPU. Does not null
+ * terminate dst.
+ *
+ * @see schnur_utf8_encode_length
+ *
+ * @param      dst   Receives the encoded bytes. Has to have room for
+ * schnur_utf8_encode_length (s, n) bytes.
+ * @param      s     The characters to encode.
+ * @param[in]  n     Number of characters to encode.
+ *
+ * @return     Number of bytes written, SCHNUR_UTF8_INVALID on invalid input.
+ */
+size_t
+schnur_utf8_encode (schnur_narrow_t* dst, const schnur_wide_t* s, size_t n);
+
 /**
  * @brief      Frees given schnur_t object.
  *
@@ -93,6 +453,8 @@ schnur_free (struct schnur* self);
 /**
  * @brief      Retrieves the data pointer.
  *
+ * Storage shared with copies of self must not be written through it.
+ *
  * @param      self  A schnur pointer.
  *
  * @return     The raw data pointer;
@@ -125,15 +487,156 @@ schnur_wide_t*
 schnur_wide (const struct schnur* self);
 
 /**
- * @brief      Allocates and fills a multi-byte string of given schnur's contents.
+ * @brief      Allocates and fills a utf-8 string of given schnur's contents.
+ *
+ * Encoding does not depend on the current locale.
  *
  * @param      self  A schnur pointer.
  *
- * @return     Content as multi-byte/narrow string. Needs to be free'd;
+ * @return     Content as utf-8/narrow string. Needs to be free'd;
  */
 schnur_narrow_t*
 schnur_narrow (const struct schnur* self);
 
+/**
+ * @brief      Copies the contents in wide character encoding into given buffer.
+ *
+ * Works like snprintf: Call with a NULL buffer to query the size needed.
+ * Nothing is written, if the buffer is too small.
+ *
+ * @param      self    A schnur pointer.
+ * @param      buf     Receives the null terminated contents. Might be NULL.
+ * @param[in]  cap     Number of characters buf is able to hold.
+ * @param[out] needed  Receives the number of characters, excluding the null
+ * terminator. Might be NULL.
+ *
+ * @return     1 if the contents were written, 0 otherwise.
+ */
+int
+schnur_wide_into (const struct schnur* self,
+	schnur_wide_t* buf, size_t cap, size_t* needed);
+
+/**
+ * @brief      Copies the characters in range [begin, end) in wide character
+ * encoding into given buffer.
+ *
+ * @see schnur_wide_into
+ *
+ * @param      self    A schnur pointer.
+ * @param[in]  begin   Index of the first character to copy.
+ * @param[in]  end     Index past the last character to copy.
+ * @param      buf     Receives the null terminated characters. Might be NULL.
+ * @param[in]  cap     Number of characters buf is able to hold.
+ * @param[out] needed  Receives the number of characters, excluding the null
+ * terminator. Might be NULL.
+ *
+ * @return     1 if the characters were written, 0 otherwise.
+ */
+int
+schnur_wide_range_into (const struct schnur* self, size_t begin, size_t end,
+	schnur_wide_t* buf, size_t cap, size_t* needed);
+
+/**
+ * @brief      Encodes the contents as utf-8 into given buffer.
+ *
+ * Works like snprintf: Call with a NULL buffer to query the size needed.
+ * Nothing is written, if the buffer is too small. Buffers able to hold
+ * SCHNUR_UTF8_MAX_BYTES * length + 1 bytes skip measuring the contents.
+ *
+ * @param      self    A schnur pointer.
+ * @param      buf     Receives the null terminated contents. Might be NULL.
+ * @param[in]  cap     Number of bytes buf is able to hold.
+ * @param[out] needed  Receives the number of bytes, excluding the null
+ * terminator, or SCHNUR_UTF8_INVALID if the contents are not encodable.
+ * Might be NULL.
+ *
+ * @return     1 if the contents were written, 0 otherwise.
+ */
+int
+schnur_narrow_into (const struct schnur* self,
+	schnur_narrow_t* buf, size_t cap, size_t* needed);
+
+/**
+ * @brief      Encodes the characters in range [begin, end) as utf-8 into
+ * given buffer.
+ *
+ * @see schnur_narrow_into
+ *
+ * @param      self    A schnur pointer.
+ * @param[in]  begin   Index of the first character to encode.
+ * @param[in]  end     Index past the last character to encode.
+ * @param      buf     Receives the null terminated bytes. Might be NULL.
+ * @param[in]  cap     Number of bytes buf is able to hold.
+ * @param[out] needed  Receives the number of bytes, excluding the null
+ * terminator, or SCHNUR_UTF8_INVALID if the characters are not encodable.
+ * Might be NULL.
+ *
+ * @return     1 if the bytes were written, 0 otherwise.
+ */
+int
+schnur_narrow_range_into (const struct schnur* self, size_t begin, size_t end,
+	schnur_narrow_t* buf, size_t cap, size_t* needed);
+
+/**
+ * @brief      Encodes the contents as utf-8 into given buffer, if they fit.
+ * Otherwise allocates like schnur_narrow.
+ *
+ * Unlike schnur_narrow, empty contents result in an empty string.
+ *
+ * @param      self    A schnur pointer.
+ * @param      buffer  A scratch buffer. Might be NULL.
+ * @param[in]  cap     Number of bytes buffer is able to hold.
+ *
+ * @return     Either buffer or an allocated string, NULL on failure. Has to
+ * be passed to schnur_narrow_buffered_release.
+ */
+schnur_narrow_t*
+schnur_narrow_buffered (const struct schnur* self,
+	schnur_narrow_t* buffer, size_t cap);
+
+/**
+ * @brief      Releases a string returned by schnur_narrow_buffered (owner).
+ *
+ * @param[in]  owner   The schnur pointer str was created from.
+ * @param      str     A narrow string pointer.
+ * @param[in]  buffer  The scratch buffer passed to schnur_narrow_buffered.
+ *
+ * @return     1 on success, 0 when given a nullpointer.
+ */
+int
+schnur_narrow_buffered_release (const struct schnur* owner,
+	schnur_narrow_t* str, const schnur_narrow_t* buffer);
+
+/**
+ * @brief      Copies the contents into given buffer, if they fit. Otherwise
+ * allocates like schnur_wide.
+ *
+ * Unlike schnur_wide, empty contents result in an empty string.
+ *
+ * @param      self    A schnur pointer.
+ * @param      buffer  A scratch buffer. Might be NULL.
+ * @param[in]  cap     Number of characters buffer is able to hold.
+ *
+ * @return     Either buffer or an allocated string, NULL on failure. Has to
+ * be passed to schnur_wide_buffered_release.
+ */
+schnur_wide_t*
+schnur_wide_buffered (const struct schnur* self,
+	schnur_wide_t* buffer, size_t cap);
+
+/**
+ * @brief      Releases a string returned by schnur_wide_buffered (owner).
+ *
+ * @param[in]  owner   The schnur pointer str was created from.
+ * @param      str     A wide string pointer.
+ * @param[in]  buffer  The scratch buffer passed to schnur_wide_buffered.
+ *
+ * @return     1 on success, 0 when given a nullpointer.
+ */
+int
+schnur_wide_buffered_release (const struct schnur* owner,
+	schnur_wide_t* str, const schnur_wide_t* buffer);
+
 /**
  * @brief      Retrieves a wide character at given index.
  *
@@ -217,9 +720,10 @@ int
 schnur_fill_n (struct schnur* self, schnur_wide_t c, size_t n);
 
 /**
- * @brief      Expands the capacity of string according to SCHNUR_BLOCK_SIZE.
+ * @brief      Expands the capacity of string by one step of the current
+ * growth policy.
  *
- * @see SCHNUR_BLOCK_SIZE
+ * @see schnur_set_growth_policy
  *
  * @param      self  A schnur pointer.
  *
@@ -228,6 +732,19 @@ schnur_fill_n (struct schnur* self, schnur_wide_t c, size_t n);
 int
 schnur_expand (struct schnur* self);
 
+/**
+ * @brief      Makes sure string is able to hold at least n characters.
+ *
+ * Grows the capacity in a single step, if necessary. Never shrinks.
+ *
+ * @param      self  A schnur pointer.
+ * @param[in]  n     Number of characters to make room for.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_reserve (struct schnur* self, size_t n);
+
 /**
  * @brief      Compacts string capacity to minimize allocated space, while still
  * able to hold all used places (length).
@@ -243,7 +760,9 @@ schnur_compact (struct schnur* self);
 /**
  * @brief      Copies the actually used data (length) of other to self.
  *
- * If other is longer than the capacity of self, self is expanded.
+ * If other is longer than the capacity of self, self is expanded. Heap storage
+ * of schnurs sharing an allocator is not copied, but shared until either one
+ * of them is modified.
  *
  * @param      self   A schnur pointer.
  * @param[in]  other  Another schnur pointer.
@@ -267,61 +786,1608 @@ int
 schnur_copy_cstr (struct schnur* self, const schnur_wide_t* other);
 
 /**
- * @brief      Appends given character.
- *
- * Capacity of string might get expanded to hold the additional character.
+ * @brief An immutable snapshot of a schnur. Frozen handles are reference
+ * counted atomically, so they can be shared and released across threads.
+ */
+struct schnur_frozen;
+
+/**
+ * @brief      Creates an immutable snapshot of given schnur. Heap storage is
+ * shared with self, until self is modified.
  *
  * @param      self  A schnur pointer.
- * @param[in]  c     A character to append.
  *
- * @return     1 on success, 0 otherwise.
+ * @return     The frozen handle, NULL on failure.
  */
-int
-schnur_append (struct schnur* self, schnur_wide_t c);
+const struct schnur_frozen*
+schnur_freeze (const struct schnur* self);
 
 /**
- * @brief      Appends given character array to string.
+ * @brief      Creates an immutable copy of given characters.
  *
- * @param      self   A schnur pointer.
- * @param[in]  other  A character array pointer.
+ * @param[in]  view       The characters to copy.
+ * @param[in]  allocator  The allocator to use, or NULL for the current one.
  *
- * @return     1 on success, 0 otherwise.
+ * @return     The frozen handle, NULL on failure.
  */
-int
-schnur_append_cstr (struct schnur* self, const schnur_wide_t* other);
+const struct schnur_frozen*
+schnur_frozen_new (struct schnur_view view, const struct schnur_allocator* allocator);
 
 /**
- * @brief      Appends given string to string.
+ * @brief      Adds a reference to given frozen handle.
  *
- * @param      self   A schnur pointer.
- * @param[in]  other  Another schnur pointer.
+ * @param      frozen  A frozen handle.
  *
- * @return     1 on success, 0 otherwise.
+ * @return     The frozen handle.
  */
-int
-schnur_append_string (struct schnur* self, const struct schnur* other);
+const struct schnur_frozen*
+schnur_frozen_retain (const struct schnur_frozen* frozen);
 
 /**
- * @brief      Check if used data of self equals given character array.
+ * @brief      Drops a reference to given frozen handle, freeing it with the
+ * last one.
  *
- * @param[in]  self   A schnur pointer.
- * @param[in]  other  A character array pointer.
+ * @param      frozen  A frozen handle.
  *
- * @return     1 on equality, 0 otherwise.
+ * @return     1 on success, 0 when given a nullpointer.
  */
 int
-schnur_equal_cstr (const struct schnur* self, const schnur_wide_t* other);
+schnur_frozen_release (const struct schnur_frozen* frozen);
+
+/**
+ * @brief      Retrieves the characters of given frozen handle. The view stays
+ * valid as long as the handle is referenced.
+ *
+ * @param      frozen  A frozen handle.
+ *
+ * @return     View of the null terminated characters.
+ */
+struct schnur_view
+schnur_frozen_view (const struct schnur_frozen* frozen);
+
+/**
+ * @brief      Creates a new modifiable schnur from given frozen handle,
+ * sharing its storage until modified.
+ *
+ * @param      frozen  A frozen handle.
+ *
+ * @return     Pointer to the new schnur, NULL on failure.
+ */
+struct schnur*
+schnur_thaw (const struct schnur_frozen* frozen);
+
+/**
+ * @brief A pool of canonical frozen schnurs. Interning equal strings yields
+ * the same handle, so they compare equal by pointer. Threads may intern
+ * concurrently, as long as the pool's allocator is thread safe.
+ */
+struct schnur_intern_pool;
+
+/**
+ * @brief Statistics of an intern pool.
+ */
+struct schnur_intern_stats {
+	/// Number of strings interned, including repeated ones.
+	size_t lookups;
+	/// Number of lookups finding an existing string.
+	size_t hits;
+	/// Number of distinct strings in the pool.
+	size_t strings;
+	/// Number of bytes of character storage held by the pool.
+	size_t bytes;
+	/// Number of bytes of character storage not duplicated thanks to hits.
+	size_t bytes_saved;
+};
+
+/**
+ * @brief      Creates a new empty intern pool.
+ *
+ * @param[in]  allocator  The allocator to use, or NULL for the current one.
+ *
+ * @return     Pointer to the new pool, NULL on failure.
+ */
+struct schnur_intern_pool*
+schnur_intern_pool_new (const struct schnur_allocator* allocator);
+
+/**
+ * @brief      Frees given pool. Interned handles, which were not retained
+ * separately, become invalid.
+ *
+ * @param      pool  A pool pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_intern_pool_free (struct schnur_intern_pool* pool);
+
+/**
+ * @brief      Retrieves the canonical handle of given characters, adding them
+ * to the pool if necessary.
+ *
+ * The handle is owned by the pool and stays valid until the pool is freed,
+ * unless retained through schnur_frozen_retain.
+ *
+ * @param      pool  A pool pointer.
+ * @param[in]  view  The characters to intern.
+ *
+ * @return     The canonical frozen handle, NULL on failure.
+ */
+const struct schnur_frozen*
+schnur_intern_view (struct schnur_intern_pool* pool, struct schnur_view view);
+
+/**
+ * @brief      Retrieves the canonical handle of the contents of given schnur.
+ *
+ * @see schnur_intern_view
+ *
+ * @param      pool  A pool pointer.
+ * @param[in]  s     A schnur pointer.
+ *
+ * @return     The canonical frozen handle, NULL on failure.
+ */
+const struct schnur_frozen*
+schnur_intern (struct schnur_intern_pool* pool, const struct schnur* s);
+
+/**
+ * @brief      Collects statistics of given pool.
+ *
+ * @param      pool   A pool pointer.
+ * @param[out] stats  Receives the statistics.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_intern_pool_stats (struct schnur_intern_pool* pool,
+	struct schnur_intern_stats* stats);
+
+/**
+ * @brief A hash map from strings to pointers, using open addressing. Keys are
+ * kept as frozen snapshots, so they share storage with schnur keys.
+ */
+struct schnur_map;
+
+/**
+ * @brief      Creates a new empty map.
+ *
+ * @param[in]  allocator  The allocator to use, or NULL for the current one.
+ *
+ * @return     Pointer to the new map, NULL on failure.
+ */
+struct schnur_map*
+schnur_map_new (const struct schnur_allocator* allocator);
+
+/**
+ * @brief      Frees given map and its keys. Values are left untouched.
+ *
+ * @param      map   A map pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_map_free (struct schnur_map* map);
+
+/**
+ * @brief      Retrieves the number of entries in given map.
+ *
+ * @param      map   A map pointer.
+ *
+ * @return     The number of entries, 0 if map is NULL.
+ */
+size_t
+schnur_map_count (const struct schnur_map* map);
+
+/**
+ * @brief      Associates value with the contents of key, replacing any
+ * previous value.
+ *
+ * @param      map    A map pointer.
+ * @param[in]  key    A schnur pointer. Its hash is cached.
+ * @param      value  The value to store.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_map_set (struct schnur_map* map, const struct schnur* key, void* value);
+
+/**
+ * @brief      Associates value with a copy of given characters.
+ *
+ * @see schnur_map_set
+ */
+int
+schnur_map_set_view (struct schnur_map* map, struct schnur_view key, void* value);
+
+/**
+ * @brief      Looks up the value associated with the contents of key.
+ *
+ * @param      map    A map pointer.
+ * @param[in]  key    A schnur pointer. Its hash is cached.
+ * @param[out] value  Receives the value, if found. Might be NULL.
+ *
+ * @return     1 if key was found, 0 otherwise.
+ */
+int
+schnur_map_get (const struct schnur_map* map, const struct schnur* key, void** value);
+
+/**
+ * @brief      Looks up the value associated with given characters, without
+ * creating a schnur.
+ *
+ * @see schnur_map_get
+ */
+int
+schnur_map_get_view (const struct schnur_map* map, struct schnur_view key, void** value);
+
+/**
+ * @brief      Looks up the value associated with given null terminated
+ * characters, without creating a schnur.
+ *
+ * @see schnur_map_get
+ */
+int
+schnur_map_get_cstr (const struct schnur_map* map, const schnur_wide_t* key, void** value);
+
+/**
+ * @brief      Removes the entry of key.
+ *
+ * @param      map    A map pointer.
+ * @param[in]  key    A schnur pointer.
+ * @param[out] value  Receives the value of the removed entry. Might be NULL.
+ *
+ * @return     1 if an entry was removed, 0 otherwise.
+ */
+int
+schnur_map_remove (struct schnur_map* map, const struct schnur* key, void** value);
+
+/**
+ * @brief      Removes the entry of given characters.
+ *
+ * @see schnur_map_remove
+ */
+int
+schnur_map_remove_view (struct schnur_map* map, struct schnur_view key, void** value);
+
+/**
+ * @brief      Iterates all entries in unspecified order.
+ *
+ * The map must not be modified while iterating.
+ *
+ * @param      map     A map pointer.
+ * @param      cursor  Position of the iteration, 0 to start.
+ * @param[out] key     Receives the key of the entry. Might be NULL.
+ * @param[out] value   Receives the value of the entry. Might be NULL.
+ *
+ * @return     1 if there was another entry, 0 at the end.
+ */
+int
+schnur_map_next (const struct schnur_map* map, size_t* cursor,
+	struct schnur_view* key, void** value);
+
+/**
+ * @brief A needle preprocessed for searching, so repeated searches for the
+ * same characters skip the preparation.
+ */
+struct schnur_needle;
+
+/**
+ * @brief      Preprocesses needle for searching. The characters are copied.
+ *
+ * @param[in]  needle     The characters to look for.
+ * @param[in]  allocator  The allocator for the needle, NULL for the current
+ *                        global allocator.
+ *
+ * @return     The needle, NULL on failure.
+ */
+struct schnur_needle*
+schnur_needle_new (struct schnur_view needle, const struct schnur_allocator* allocator);
+
+/**
+ * @brief      Frees a needle.
+ *
+ * @param      needle  A needle pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_needle_free (struct schnur_needle* needle);
+
+/**
+ * @brief      Finds the first occurrence of needle in view.
+ *
+ * @see schnur_view_find
+ *
+ * @param[in]  needle  A needle pointer.
+ * @param[in]  view    The characters to search.
+ * @param[in]  from    Index at which the search starts.
+ *
+ * @return     Index of the match, SCHNUR_NOT_FOUND if there is none.
+ */
+size_t
+schnur_needle_find (const struct schnur_needle* needle, struct schnur_view view, size_t from);
+
+/**
+ * @brief      Finds the last occurrence of needle in view, which starts at
+ * or before from.
+ *
+ * @see schnur_view_rfind
+ *
+ * @param[in]  needle  A needle pointer.
+ * @param[in]  view    The characters to search.
+ * @param[in]  from    Largest index a match may start at.
+ *
+ * @return     Index of the match, SCHNUR_NOT_FOUND if there is none.
+ */
+size_t
+schnur_needle_rfind (const struct schnur_needle* needle, struct schnur_view view, size_t from);
+
+/**
+ * @brief      Counts non-overlapping occurrences of needle in view.
+ *
+ * @param[in]  needle  A needle pointer.
+ * @param[in]  view    The characters to search.
+ *
+ * @return     Number of occurrences.
+ */
+size_t
+schnur_needle_count (const struct schnur_needle* needle, struct schnur_view view);
+
+/**
+ * @brief An automaton finding many patterns in a single pass.
+ */
+struct schnur_matcher;
+
+/**
+ * @brief      Receives a match found by schnur_matcher_scan.
+ *
+ * @param      context  The context given to schnur_matcher_scan.
+ * @param[in]  pattern  Index of the matching pattern.
+ * @param[in]  offset   Index of the first matching character.
+ *
+ * @return     1 to continue scanning, 0 to stop.
+ */
+typedef int (*schnur_match_callback_t) (void* context, size_t pattern, size_t offset);
+
+/**
+ * @brief      Builds an Aho-Corasick automaton for given patterns.
+ *
+ * The automaton is a table of transitions for each state and each distinct
+ * character of the patterns, so it grows with the number of patterns times
+ * the number of distinct characters. Patterns are not referenced afterwards.
+ *
+ * @param[in]  patterns   Array of non-empty schnurs. Equal patterns are
+ *                        reported separately.
+ * @param[in]  count      Number of patterns.
+ * @param[in]  allocator  The allocator for the automaton, NULL for the
+ *                        current global allocator.
+ *
+ * @return     The automaton, NULL on failure.
+ */
+struct schnur_matcher*
+schnur_matcher_new (const struct schnur* const* patterns, size_t count,
+	const struct schnur_allocator* allocator);
+
+/**
+ * @brief      Frees an automaton.
+ *
+ * @param      matcher  A matcher pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_matcher_free (struct schnur_matcher* matcher);
+
+/**
+ * @brief      Retrieves the number of bytes held by an automaton.
+ *
+ * @param[in]  matcher  A matcher pointer.
+ *
+ * @return     Number of bytes, 0 when given a nullpointer.
+ */
+size_t
+schnur_matcher_memory (const struct schnur_matcher* matcher);
+
+/**
+ * @brief      Reports all occurrences of all patterns in view, including
+ * overlapping ones, in order of their last character.
+ *
+ * @param[in]  matcher   A matcher pointer.
+ * @param[in]  view      The characters to scan.
+ * @param[in]  callback  Receives each match. Might be NULL to only count.
+ * @param      context   Passed to callback.
+ *
+ * @return     Number of matches reported.
+ */
+size_t
+schnur_matcher_scan (const struct schnur_matcher* matcher, struct schnur_view view,
+	schnur_match_callback_t callback, void* context);
+
+/// Flag of a tokenizer, which skips empty tokens, e.g. between adjacent
+/// delimiters.
+#define SCHNUR_SPLIT_SKIP_EMPTY 1
+
+/**
+ * @brief Determines what separates the tokens of a schnur_tokenizer.
+ */
+enum schnur_split_kind {
+	/// A single character.
+	SCHNUR_SPLIT_CHAR = 0,
+	/// Any character of a set.
+	SCHNUR_SPLIT_ANY,
+	/// A sequence of characters.
+	SCHNUR_SPLIT_VIEW
+};
+
+/**
+ * @brief Iterates over the tokens of a view, separated by delimiters.
+ *
+ * Created by schnur_split_char, schnur_split_any or schnur_split_view and
+ * advanced by schnur_tokenizer_next. Tokens are views into the split view,
+ * so a tokenizer never allocates and may live on the stack. Neither the
+ * split view nor the delimiters may change while iterating.
+ */
+struct schnur_tokenizer {
+	/// The characters split.
+	struct schnur_view view;
+	/// The set of delimiting characters or the delimiting sequence.
+	struct schnur_view delimiters;
+	/// The delimiting character of SCHNUR_SPLIT_CHAR.
+	schnur_wide_t c;
+	enum schnur_split_kind kind;
+	/// Combination of SCHNUR_SPLIT_ flags.
+	int flags;
+	/// Members of delimiters below 128, one bit each.
+	uint32_t ascii[4];
+	/// Index at which the next token starts, beyond the end when done.
+	size_t position;
+	/// The current token, after schnur_tokenizer_next returned 1.
+	struct schnur_view token;
+	/// Index of the current token in view.
+	size_t offset;
+};
+
+/**
+ * @brief      Creates a tokenizer splitting view at each occurrence of c.
+ *
+ * Without SCHNUR_SPLIT_SKIP_EMPTY, n delimiters yield n + 1 tokens, so an
+ * empty view yields a single empty token.
+ *
+ * @param[in]  view   The characters to split.
+ * @param[in]  c      The delimiting character.
+ * @param[in]  flags  Combination of SCHNUR_SPLIT_ flags.
+ *
+ * @return     The tokenizer, positioned before the first token.
+ */
+struct schnur_tokenizer
+schnur_split_char (struct schnur_view view, schnur_wide_t c, int flags);
+
+/**
+ * @brief      Creates a tokenizer splitting view at each character, which is
+ * one of delimiters.
+ *
+ * @see schnur_split_char
+ *
+ * @param[in]  view        The characters to split.
+ * @param[in]  delimiters  The set of delimiting characters. An empty set
+ *                         yields view as a single token.
+ * @param[in]  flags       Combination of SCHNUR_SPLIT_ flags.
+ *
+ * @return     The tokenizer, positioned before the first token.
+ */
+struct schnur_tokenizer
+schnur_split_any (struct schnur_view view, struct schnur_view delimiters, int flags);
+
+/**
+ * @brief      Creates a tokenizer splitting view at each non-overlapping
+ * occurrence of delimiter, searching from the front.
+ *
+ * @see schnur_split_char
+ *
+ * @param[in]  view       The characters to split.
+ * @param[in]  delimiter  The delimiting characters. An empty delimiter
+ *                        yields view as a single token.
+ * @param[in]  flags      Combination of SCHNUR_SPLIT_ flags.
+ *
+ * @return     The tokenizer, positioned before the first token.
+ */
+struct schnur_tokenizer
+schnur_split_view (struct schnur_view view, struct schnur_view delimiter, int flags);
+
+/**
+ * @brief      Advances tokenizer to the next token, stored in its token
+ * and offset fields.
+ *
+ * @param      tokenizer  A tokenizer pointer.
+ *
+ * @return     1 if there was another token, 0 at the end.
+ */
+int
+schnur_tokenizer_next (struct schnur_tokenizer* tokenizer);
+
+/**
+ * @brief      Appends given character.
+ *
+ * Capacity of string might get expanded to hold the additional character.
+ *
+ * @param      self  A schnur pointer.
+ * @param[in]  c     A character to append.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_append (struct schnur* self, schnur_wide_t c);
+
+/**
+ * @brief      Appends given character array to string.
+ *
+ * @param      self   A schnur pointer.
+ * @param[in]  other  A character array pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_append_cstr (struct schnur* self, const schnur_wide_t* other);
+
+/**
+ * @brief      Appends given string to string.
+ *
+ * @param      self   A schnur pointer.
+ * @param[in]  other  Another schnur pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_append_string (struct schnur* self, const struct schnur* other);
+
+/**
+ * @brief      Check if used data of self equals given character array.
+ *
+ * @param[in]  self   A schnur pointer.
+ * @param[in]  other  A character array pointer.
+ *
+ * @return     1 on equality, 0 otherwise.
+ */
+int
+schnur_equal_cstr (const struct schnur* self, const schnur_wide_t* other);
 
 /**
  * @brief      Check if used data of self equals used data of other.
  *
- * @param[in]  self   A schnur pointer.
- * @param[in]  other  Another schnur pointer.
+ * Strings with known, differing hashes are rejected without comparing their
+ * characters.
+ *
+ * @param[in]  self   A schnur pointer.
+ * @param[in]  other  Another schnur pointer.
+ *
+ * @return     1 on equality, 0 otherwise.
+ */
+int
+schnur_equal (const struct schnur* self, const struct schnur* other);
+
+/**
+ * @brief      Computes a 64 bit hash of the used data of self.
+ *
+ * The hash is cached in self until it is modified, so hashing the same string
+ * again is cheap. Hash values differ between platforms with different sizes
+ * of wchar_t or byte orders.
+ *
+ * @param[in]  self  A schnur pointer.
+ *
+ * @return     The hash, 0 when given a nullpointer.
+ */
+uint64_t
+schnur_hash (const struct schnur* self);
+
+/**
+ * @brief      Computes a 64 bit hash of given characters, equal to the hash of
+ * a schnur holding the same characters.
+ *
+ * @param[in]  view  The characters to hash.
+ *
+ * @return     The hash.
+ */
+uint64_t
+schnur_hash_view (struct schnur_view view);
+
+/**
+ * @brief      Creates a new schnur_t instance from the characters of a view.
+ *
+ * @param[in]  view  The characters to use as inital value.
+ *
+ * @return     Pointer to new schnur_t instance.
+ */
+struct schnur*
+schnur_new_view (struct schnur_view view);
+
+/**
+ * @brief      Creates a view of all used data of self.
+ *
+ * @param[in]  self  A schnur pointer.
+ *
+ * @return     The view, empty if self is NULL.
+ */
+struct schnur_view
+schnur_view_of (const struct schnur* self);
+
+/**
+ * @brief      Creates a view of a null terminated character array.
+ *
+ * @param[in]  s     A character array pointer.
+ *
+ * @return     The view, empty if s is NULL.
+ */
+struct schnur_view
+schnur_view_cstr (const schnur_wide_t* s);
+
+/**
+ * @brief      Creates a view of n characters, not necessarily null
+ * terminated.
+ *
+ * @param[in]  s     A character array pointer.
+ * @param[in]  n     Number of characters.
+ *
+ * @return     The view, empty if s is NULL.
+ */
+struct schnur_view
+schnur_view_n (const schnur_wide_t* s, size_t n);
+
+/**
+ * @brief      Creates a view of the characters in range [begin, end) of self.
+ *
+ * @param[in]  self   A schnur pointer.
+ * @param[in]  begin  Index of the first character.
+ * @param[in]  end    Index past the last character.
+ *
+ * @return     The view, empty with NULL data if the range is invalid.
+ */
+struct schnur_view
+schnur_slice (const struct schnur* self, size_t begin, size_t end);
+
+/**
+ * @brief      Creates a view of the characters in range [begin, end) of view.
+ *
+ * @param[in]  view   A view.
+ * @param[in]  begin  Index of the first character.
+ * @param[in]  end    Index past the last character.
+ *
+ * @return     The view, empty with NULL data if the range is invalid.
+ */
+struct schnur_view
+schnur_view_slice (struct schnur_view view, size_t begin, size_t end);
+
+/**
+ * @brief      Retrieves a wide character of view at given index.
+ *
+ * @param[in]  view  A view.
+ * @param[in]  i     Index of character to fetch.
+ *
+ * @return     Character at index or '\0' if index is out of range.
+ */
+schnur_wide_t
+schnur_view_get (struct schnur_view view, size_t i);
+
+/**
+ * @brief      Check if two views contain equal characters.
+ *
+ * @param[in]  a     A view.
+ * @param[in]  b     Another view.
+ *
+ * @return     1 on equality, 0 otherwise.
+ */
+int
+schnur_view_equal (struct schnur_view a, struct schnur_view b);
+
+/**
+ * @brief      Check if used data of self equals the characters of view.
+ *
+ * @param[in]  self  A schnur pointer.
+ * @param[in]  view  A view.
+ *
+ * @return     1 on equality, 0 otherwise.
+ */
+int
+schnur_equal_view (const struct schnur* self, struct schnur_view view);
+
+/**
+ * @brief      Finds the first position at which two views differ.
+ *
+ * Compares many characters per step, using the widest vector instructions
+ * the running CPU supports.
+ *
+ * @param[in]  a     A view.
+ * @param[in]  b     Another view.
+ *
+ * @return     Index of the first differing character, or the length of the
+ *             shorter view if it is a prefix of the other.
+ */
+size_t
+schnur_view_mismatch (struct schnur_view a, struct schnur_view b);
+
+/**
+ * @brief      Orders two views lexicographically by code point.
+ *
+ * @param[in]  a     A view.
+ * @param[in]  b     Another view.
+ *
+ * @return     A negative value if a sorts before b, a positive value if a
+ *             sorts after b, 0 on equality.
+ */
+int
+schnur_view_compare (struct schnur_view a, struct schnur_view b);
+
+/**
+ * @brief      Orders the used data of two schnurs lexicographically by code
+ * point. A nullpointer sorts like an empty string.
+ *
+ * @param[in]  self   A schnur pointer.
+ * @param[in]  other  Another schnur pointer.
+ *
+ * @return     A negative value if self sorts before other, a positive value
+ *             if self sorts after other, 0 on equality.
+ */
+int
+schnur_compare (const struct schnur* self, const struct schnur* other);
+
+/**
+ * @brief      Check if view begins with the characters of prefix.
+ *
+ * @param[in]  view    A view.
+ * @param[in]  prefix  The expected beginning.
+ *
+ * @return     1 if it does, 0 otherwise.
+ */
+int
+schnur_view_starts_with (struct schnur_view view, struct schnur_view prefix);
+
+/**
+ * @brief      Check if view ends with the characters of suffix.
+ *
+ * @param[in]  view    A view.
+ * @param[in]  suffix  The expected ending.
+ *
+ * @return     1 if it does, 0 otherwise.
+ */
+int
+schnur_view_ends_with (struct schnur_view view, struct schnur_view suffix);
+
+/**
+ * @brief      Check if used data of self begins with the characters of prefix.
+ *
+ * @param[in]  self    A schnur pointer.
+ * @param[in]  prefix  The expected beginning.
+ *
+ * @return     1 if it does, 0 otherwise.
+ */
+int
+schnur_starts_with (const struct schnur* self, struct schnur_view prefix);
+
+/**
+ * @brief      Check if used data of self ends with the characters of suffix.
+ *
+ * @param[in]  self    A schnur pointer.
+ * @param[in]  suffix  The expected ending.
+ *
+ * @return     1 if it does, 0 otherwise.
+ */
+int
+schnur_ends_with (const struct schnur* self, struct schnur_view suffix);
+
+/**
+ * @brief      Finds the first occurrence of needle in view.
+ *
+ * Short needles are located by comparing their first and last character
+ * against many positions at once, long needles with the Two-Way algorithm,
+ * which takes linear time. An empty needle matches at from.
+ *
+ * @param[in]  view    The characters to search.
+ * @param[in]  needle  The characters to look for.
+ * @param[in]  from    Index at which the search starts.
+ *
+ * @return     Index of the match, SCHNUR_NOT_FOUND if there is none.
+ */
+size_t
+schnur_view_find (struct schnur_view view, struct schnur_view needle, size_t from);
+
+/**
+ * @brief      Finds the last occurrence of needle in view, which starts at
+ * or before from.
+ *
+ * @param[in]  view    The characters to search.
+ * @param[in]  needle  The characters to look for.
+ * @param[in]  from    Largest index a match may start at. Pass
+ *                     SCHNUR_NOT_FOUND to search all of view.
+ *
+ * @return     Index of the match, SCHNUR_NOT_FOUND if there is none.
+ */
+size_t
+schnur_view_rfind (struct schnur_view view, struct schnur_view needle, size_t from);
+
+/**
+ * @brief      Counts non-overlapping occurrences of needle in view.
+ *
+ * @param[in]  view    The characters to search.
+ * @param[in]  needle  The characters to look for.
+ *
+ * @return     Number of occurrences, length of view plus one for an empty
+ *             needle.
+ */
+size_t
+schnur_view_count (struct schnur_view view, struct schnur_view needle);
+
+/**
+ * @brief      Finds the first occurrence of needle in used data of self.
+ *
+ * @see schnur_view_find
+ *
+ * @param[in]  self    A schnur pointer.
+ * @param[in]  needle  The characters to look for.
+ * @param[in]  from    Index at which the search starts.
+ *
+ * @return     Index of the match, SCHNUR_NOT_FOUND if there is none.
+ */
+size_t
+schnur_find (const struct schnur* self, struct schnur_view needle, size_t from);
+
+/**
+ * @brief      Finds the last occurrence of needle in used data of self,
+ * which starts at or before from.
+ *
+ * @see schnur_view_rfind
+ *
+ * @param[in]  self    A schnur pointer.
+ * @param[in]  needle  The characters to look for.
+ * @param[in]  from    Largest index a match may start at.
+ *
+ * @return     Index of the match, SCHNUR_NOT_FOUND if there is none.
+ */
+size_t
+schnur_rfind (const struct schnur* self, struct schnur_view needle, size_t from);
+
+/**
+ * @brief      Counts non-overlapping occurrences of needle in used data of
+ * self.
+ *
+ * @param[in]  self    A schnur pointer.
+ * @param[in]  needle  The characters to look for.
+ *
+ * @return     Number of occurrences.
+ */
+size_t
+schnur_count (const struct schnur* self, struct schnur_view needle);
+
+/**
+ * @brief      Copies the characters of view to self.
+ *
+ * View might point into self.
+ *
+ * @param      self  A schnur pointer.
+ * @param[in]  view  A view.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_copy_view (struct schnur* self, struct schnur_view view);
+
+/**
+ * @brief      Appends the characters of view to string.
+ *
+ * View might point into self.
+ *
+ * @param      self  A schnur pointer.
+ * @param[in]  view  A view.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_append_view (struct schnur* self, struct schnur_view view);
+
+/**
+ * @brief      Appends n bytes of utf-8, decoded to wide characters.
+ *
+ * Measures the decoded length first, so the capacity grows at most once.
+ *
+ * @see schnur_utf8_decode_length
+ *
+ * @param      self   A schnur pointer.
+ * @param[in]  str    The bytes to decode.
+ * @param[in]  n      Number of bytes to decode.
+ * @param[out] error  Receives the offset of the first invalid byte, if str
+ * is not valid UTF-8. Might be NULL.
+ *
+ * @return     1 on success, 0 otherwise, leaving self untouched.
+ */
+int
+schnur_append_utf8 (struct schnur* self, const schnur_narrow_t* str, size_t n, size_t* error);
+
+/**
+ * @brief      Appends the characters of count views to string.
+ *
+ * Sums the lengths first and grows the capacity at most once. Parts might
+ * point into self.
+ *
+ * @param      self   A schnur pointer.
+ * @param[in]  parts  The views to append, in order.
+ * @param[in]  count  Number of views.
+ *
+ * @return     1 on success, 0 otherwise, leaving self untouched.
+ */
+int
+schnur_append_many (struct schnur* self, const struct schnur_view* parts, size_t count);
+
+/**
+ * @brief      Appends the characters of count views to string, with
+ * separator in between each two of them.
+ *
+ * @see schnur_append_many
+ *
+ * @param      self       A schnur pointer.
+ * @param[in]  separator  The characters put between two parts.
+ * @param[in]  parts      The views to append, in order.
+ * @param[in]  count      Number of views.
+ *
+ * @return     1 on success, 0 otherwise, leaving self untouched.
+ */
+int
+schnur_append_join (struct schnur* self, struct schnur_view separator,
+	const struct schnur_view* parts, size_t count);
+
+/**
+ * @brief      Creates a new schnur_t instance holding count views, with
+ * separator in between each two of them.
+ *
+ * The new instance is allocated with the exact capacity needed.
+ *
+ * @param[in]  separator  The characters put between two parts.
+ * @param[in]  parts      The views to join, in order.
+ * @param[in]  count      Number of views.
+ *
+ * @return     Pointer to the new instance, NULL on failure.
+ */
+struct schnur*
+schnur_join (struct schnur_view separator, const struct schnur_view* parts, size_t count);
+
+/**
+ * @brief      Formats like swprintf into given buffer.
+ *
+ * Works like snprintf: Call with a NULL buffer to query the size needed.
+ * If the buffer is too small, its contents are unspecified.
+ *
+ * Supports the conversions of printf except for %n. Integers are formatted
+ * without the C library. Additional conversions are:
+ *
+ * - %s: A null terminated utf-8 string. Its precision limits the bytes read.
+ * - %ls: A null terminated wide string.
+ * - %v: A struct schnur_view, passed by value.
+ * - %V: A const struct schnur pointer.
+ * - %r: A double formatted by schnur_format_f64, padded to the width.
+ *
+ * The precision of %ls, %v and %V limits the characters written.
+ *
+ * @param      buf     Receives the null terminated result. Might be NULL.
+ * @param[in]  cap     Number of characters buf is able to hold.
+ * @param[out] needed  Receives the number of characters, excluding the null
+ * terminator, or SCHNUR_FORMAT_INVALID on an invalid format or argument.
+ * Might be NULL.
+ * @param[in]  format  The format string.
+ * @param[in]  args    The arguments of format.
+ *
+ * @return     1 if the result was written, 0 otherwise.
+ */
+int
+schnur_vformat_into (schnur_wide_t* buf, size_t cap, size_t* needed,
+	const schnur_wide_t* format, va_list args);
+
+/**
+ * @brief      Formats like swprintf into given buffer.
+ *
+ * @see schnur_vformat_into
+ *
+ * @return     1 if the result was written, 0 otherwise.
+ */
+int
+schnur_format_into (schnur_wide_t* buf, size_t cap, size_t* needed,
+	const schnur_wide_t* format, ...);
+
+/**
+ * @brief      Appends formatted characters to string.
+ *
+ * Formats straight into the spare capacity. If the result does not fit,
+ * grows once to the exact size needed and formats again. Views and schnurs
+ * passed as arguments might point into self.
+ *
+ * @see schnur_vformat_into
+ *
+ * @param      self    A schnur pointer.
+ * @param[in]  format  The format string.
+ * @param[in]  args    The arguments of format.
+ *
+ * @return     1 on success, 0 otherwise, leaving self untouched.
+ */
+int
+schnur_vappendf (struct schnur* self, const schnur_wide_t* format, va_list args);
+
+/**
+ * @brief      Appends formatted characters to string.
+ *
+ * @see schnur_vappendf
+ *
+ * @return     1 on success, 0 otherwise, leaving self untouched.
+ */
+int
+schnur_appendf (struct schnur* self, const schnur_wide_t* format, ...);
+
+/**
+ * @brief      Writes the decimal digits of value, without the locale.
+ *
+ * Does not null terminate buf.
+ *
+ * @param      buf    Receives up to SCHNUR_NUMBER_MAX_CHARS characters.
+ * @param[in]  value  The number to format.
+ *
+ * @return     Number of characters written.
+ */
+size_t
+schnur_format_i64 (schnur_wide_t* buf, int64_t value);
+
+/**
+ * @brief      Writes the decimal digits of value, without the locale.
+ *
+ * @see schnur_format_i64
+ *
+ * @return     Number of characters written.
+ */
+size_t
+schnur_format_u64 (schnur_wide_t* buf, uint64_t value);
+
+/**
+ * @brief      Writes value with the fewest significant digits, which read
+ * back to the same double, without the locale.
+ *
+ * Digits are found by the Grisu3 algorithm, or by the C library for the few
+ * numbers it cannot decide. Decimal exponents below -4 or from 16 on are
+ * written in scientific notation, e.g. 1e+16.
+ * Writes inf, -inf and nan for special values. Does not null terminate buf.
+ *
+ * @param      buf    Receives up to SCHNUR_NUMBER_MAX_CHARS characters.
+ * @param[in]  value  The number to format.
+ *
+ * @return     Number of characters written.
+ */
+size_t
+schnur_format_f64 (schnur_wide_t* buf, double value);
+
+/**
+ * @brief      Appends the decimal digits of value.
+ *
+ * @see schnur_format_i64
+ *
+ * @param      self   A schnur pointer.
+ * @param[in]  value  The number to append.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_append_i64 (struct schnur* self, int64_t value);
+
+/**
+ * @brief      Appends the decimal digits of value.
+ *
+ * @see schnur_format_u64
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_append_u64 (struct schnur* self, uint64_t value);
+
+/**
+ * @brief      Appends value with the fewest significant digits, which read
+ * back to the same double.
+ *
+ * @see schnur_format_f64
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_append_f64 (struct schnur* self, double value);
+
+/**
+ * @brief      Parses a decimal integer at the start of view, without the
+ * locale.
+ *
+ * Accepts an optional sign followed by digits. Whitespace is not skipped.
+ *
+ * @param[in]  view      The characters to parse.
+ * @param[out] value     Receives the number, clamped to the range of
+ *                       int64_t if it is out of range.
+ * @param[out] consumed  Receives the number of characters forming the
+ *                       number, 0 if there is none. Might be NULL.
+ *
+ * @return     1 on success, 0 if there is no number or it is out of range.
+ */
+int
+schnur_view_parse_i64 (struct schnur_view view, int64_t* value, size_t* consumed);
+
+/**
+ * @brief      Parses a decimal integer at the start of view, without the
+ * locale. Accepts an optional plus sign followed by digits.
+ *
+ * @see schnur_view_parse_i64
+ *
+ * @return     1 on success, 0 if there is no number or it is out of range.
+ */
+int
+schnur_view_parse_u64 (struct schnur_view view, uint64_t* value, size_t* consumed);
+
+/**
+ * @brief      Parses a decimal floating point number at the start of view,
+ * without the locale, rounding correctly.
+ *
+ * Accepts an optional sign, digits with an optional '.', and an optional
+ * exponent, as well as inf, infinity and nan in any case. Whitespace is not
+ * skipped. Numbers too small to represent become zero.
+ *
+ * @param[in]  view      The characters to parse.
+ * @param[out] value     Receives the number, an infinity if it is out of
+ *                       range.
+ * @param[out] consumed  Receives the number of characters forming the
+ *                       number, 0 if there is none. Might be NULL.
+ *
+ * @return     1 on success, 0 if there is no number or it is out of range.
+ */
+int
+schnur_view_parse_f64 (struct schnur_view view, double* value, size_t* consumed);
+
+/**
+ * @brief      Parses a decimal integer at the start of used data of self.
+ *
+ * @see schnur_view_parse_i64
+ *
+ * @return     1 on success, 0 if there is no number or it is out of range.
+ */
+int
+schnur_parse_i64 (const struct schnur* self, int64_t* value, size_t* consumed);
+
+/**
+ * @brief      Parses a decimal integer at the start of used data of self.
+ *
+ * @see schnur_view_parse_u64
+ *
+ * @return     1 on success, 0 if there is no number or it is out of range.
+ */
+int
+schnur_parse_u64 (const struct schnur* self, uint64_t* value, size_t* consumed);
+
+/**
+ * @brief      Parses a decimal floating point number at the start of used
+ * data of self.
+ *
+ * @see schnur_view_parse_f64
+ *
+ * @return     1 on success, 0 if there is no number or it is out of range.
+ */
+int
+schnur_parse_f64 (const struct schnur* self, double* value, size_t* consumed);
+
+/**
+    @brief: Decodes utf-8 arriving in chunks of arbitrary size.
+
+    Multi-byte sequences split between two chunks are carried over, so no
+    chunk needs to end on a character boundary. Initialize with
+    schnur_decoder_init. Needs no cleanup.
+*/
+struct schnur_decoder {
+	/// Leading bytes of a sequence, which continues in the next chunk.
+	unsigned char pending[4];
+	/// Number of valid bytes in pending.
+	size_t pending_length;
+	/// Number of bytes fed so far.
+	size_t offset;
+	/// Offset of the first invalid byte in the stream, once feeding failed.
+	size_t error;
+};
+
+/**
+ * @brief      Prepares a decoder for a new stream.
+ *
+ * @param      self  A decoder pointer.
+ */
+void
+schnur_decoder_init (struct schnur_decoder* self);
+
+/**
+ * @brief      Decodes the next n bytes of the stream, appending to target.
+ *
+ * A trailing incomplete sequence is kept until the next call. Measures the
+ * rest of the chunk first, then decodes it straight into target.
+ *
+ * @param      self    A decoder pointer.
+ * @param[in]  bytes   The next chunk of the stream.
+ * @param[in]  n       Number of bytes in the chunk.
+ * @param      target  The schnur to append to.
+ *
+ * @return     1 on success, 0 on invalid utf-8 (self->error receives its
+ * offset in the stream) or allocation failure. Leaves target untouched on
+ * failure.
+ */
+int
+schnur_decoder_feed (struct schnur_decoder* self, const schnur_narrow_t* bytes, size_t n, struct schnur* target);
+
+/**
+ * @brief      Ends the stream, checking that no sequence has been cut off.
+ *
+ * Resets the decoder, so it may be used for a new stream.
+ *
+ * @param      self  A decoder pointer.
+ *
+ * @return     1 if the stream ended on a character boundary, 0 otherwise
+ * (self->error receives the offset of the incomplete sequence).
+ */
+int
+schnur_decoder_finish (struct schnur_decoder* self);
+
+/**
+ * @brief      Reads utf-8 from fd until end of file, appending to self.
+ *
+ * Reads in chunks of SCHNUR_READ_CHUNK_SIZE bytes, decoding each one
+ * straight into self. The chunk lives on the stack, so the call takes
+ * somewhat more than SCHNUR_READ_CHUNK_SIZE bytes of it. Retries reads
+ * interrupted by signals.
+ *
+ * @param      self   A schnur pointer.
+ * @param[in]  fd     A file descriptor open for reading.
+ * @param[out] error  Receives the offset of the first invalid byte, if the
+ * contents are not valid UTF-8. Might be NULL.
+ *
+ * @return     1 on success, 0 on read error, invalid utf-8 or allocation
+ * failure. Characters decoded before a failure stay appended.
+ */
+int
+schnur_read_fd (struct schnur* self, int fd, size_t* error);
+
+/**
+ * @brief      Reads utf-8 from file until end of file, appending to self.
+ *
+ * @see schnur_read_fd
+ *
+ * @param      self   A schnur pointer.
+ * @param      file   A file open for reading in binary mode.
+ * @param[out] error  Receives the offset of the first invalid byte, if the
+ * contents are not valid UTF-8. Might be NULL.
+ *
+ * @return     1 on success, 0 on read error, invalid utf-8 or allocation
+ * failure. Characters decoded before a failure stay appended.
+ */
+int
+schnur_read_file (struct schnur* self, FILE* file, size_t* error);
+
+/**
+ * @brief      Writes self to fd, encoded as utf-8.
+ *
+ * Encodes through a fixed buffer of SCHNUR_WRITE_CHUNK_SIZE bytes, so it
+ * never allocates, whatever the length of self. The buffer lives on the
+ * stack, so the call takes somewhat more than SCHNUR_WRITE_CHUNK_SIZE bytes
+ * of it. Retries writes interrupted by signals.
+ *
+ * @param      self  A schnur pointer.
+ * @param[in]  fd    A file descriptor open for writing.
+ *
+ * @return     1 on success, 0 on write error or if self is not encodable.
+ * Bytes written before a failure stay written.
+ */
+int
+schnur_write_fd (const struct schnur* self, int fd);
+
+/**
+ * @brief      Writes n schnurs to fd one after another, encoded as utf-8.
+ *
+ * Encodes as many schnurs as fit into the same buffer before writing, so a
+ * batch of short strings takes a single write.
+ *
+ * @see schnur_write_fd
+ *
+ * @param[in]  schnurs  Array of n schnur pointers, none of them NULL.
+ * @param[in]  n        Number of schnurs.
+ * @param[in]  fd       A file descriptor open for writing.
+ *
+ * @return     1 on success, 0 on write error or if any schnur is not
+ * encodable. Bytes written before a failure stay written.
+ */
+int
+schnur_writev_fd (const struct schnur* const* schnurs, size_t n, int fd);
+
+/// Makes schnur_load_files read on threads, even where io_uring is available.
+#define SCHNUR_LOAD_THREADS 0x1
+
+/**
+ * @brief      Loads count utf-8 files into new schnurs.
+ *
+ * On Linux, reads SCHNUR_LOAD_QUEUE_DEPTH files at once through io_uring,
+ * decoding each one as soon as it has been read, while the reads of others
+ * proceed. Elsewhere, or if the kernel does not allow io_uring, reads with
+ * blocking calls on SCHNUR_LOAD_THREAD_COUNT threads. Read buffers are
+ * reused from file to file. Files are opened with blocking calls either
+ * way.
+ *
+ * @param[in]  paths    Array of count paths.
+ * @param[in]  count    Number of files.
+ * @param[out] schnurs  Array of count pointers, receiving the new schnur
+ * for each path, or NULL if it could not be read or is not valid UTF-8.
+ * @param[in]  flags    Combination of SCHNUR_LOAD_ flags, or 0.
+ *
+ * @return     1 if every file has been loaded, 0 otherwise.
+ */
+int
+schnur_load_files (const char* const* paths, size_t count, struct schnur** schnurs, int flags);
+
+/**
+ * @brief A read only string backed by a memory mapped utf-8 file.
+ *
+ * Decodes blocks of SCHNUR_MAPPED_BLOCK_SIZE bytes on first access, so only
+ * the regions read ever take wide storage. Opening validates the file and
+ * measures its exact length in one pass, without copying it. Not safe for
+ * concurrent use, as reading may decode. The file must not change while
+ * mapped.
+ */
+struct schnur_mapped;
+
+/**
+ * @brief      Maps the utf-8 file at path, using the current allocator.
+ *
+ * Only available on POSIX systems, fails everywhere else.
+ *
+ * @param[in]  path   Path of the file.
+ * @param[out] error  Receives the offset of the first invalid byte, if the
+ * contents are not valid UTF-8. Might be NULL.
+ *
+ * @return     Pointer to the new mapping, NULL on failure.
+ */
+struct schnur_mapped*
+schnur_mapped_open (const char* path, size_t* error);
+
+/**
+ * @brief      Unmaps the file and frees everything decoded from it.
+ *
+ * Views returned by schnur_mapped_slice become invalid.
+ *
+ * @param      self  A mapping pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_mapped_free (struct schnur_mapped* self);
+
+/**
+ * @brief      Retrieves the number of characters in the file.
+ *
+ * @param      self  A mapping pointer.
+ *
+ * @return     The exact length, 0 if self is NULL.
+ */
+size_t
+schnur_mapped_length (const struct schnur_mapped* self);
+
+/**
+ * @brief      Retrieves the number of characters decoded so far.
+ *
+ * @param      self  A mapping pointer.
+ *
+ * @return     The number of decoded characters, 0 if self is NULL.
+ */
+size_t
+schnur_mapped_decoded_length (const struct schnur_mapped* self);
+
+/**
+ * @brief      Retrieves the character at given index, decoding its block.
+ *
+ * @param      self  A mapping pointer.
+ * @param[in]  i     Index of the character.
+ *
+ * @return     The character, or the null character if i is out of range.
+ */
+schnur_wide_t
+schnur_mapped_get (struct schnur_mapped* self, size_t i);
+
+/**
+ * @brief      Creates a view of the characters in range [begin, end),
+ * decoding the blocks covering it.
+ *
+ * The view stays valid until self is freed, and works with every function
+ * taking a view.
+ *
+ * @param      self   A mapping pointer.
+ * @param[in]  begin  Index of the first character.
+ * @param[in]  end    Index past the last character.
+ *
+ * @return     The view, empty with NULL data if the range is invalid.
+ */
+struct schnur_view
+schnur_mapped_slice (struct schnur_mapped* self, size_t begin, size_t end);
+
+/**
+ * @brief A string storing 1, 2 or 4 bytes per character, the fewest able to
+ * hold every one of its characters.
+ *
+ * Text below U+0100 takes a quarter of the memory of a schnur with 32-bit
+ * wide characters, text below U+10000 half of it. Widens itself, once a
+ * wider character is set or appended, and never narrows again. Indexing
+ * stays constant time. Where wide characters have 16 bits, the widest
+ * storage has 2 bytes per character.
+ */
+struct schnur_packed;
+
+/**
+ * @brief      Creates a compact copy of given characters, using the current
+ * allocator.
+ *
+ * @param[in]  view  The characters to copy.
+ *
+ * @return     Pointer to the new packed string, NULL on failure.
+ */
+struct schnur_packed*
+schnur_packed_new (struct schnur_view view);
+
+/**
+ * @brief      Frees given packed string.
+ *
+ * @param      self  A packed string pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_packed_free (struct schnur_packed* self);
+
+/**
+ * @brief      Retrieves the number of characters.
+ *
+ * @param      self  A packed string pointer.
+ *
+ * @return     The number of characters, 0 if self is NULL.
+ */
+size_t
+schnur_packed_length (const struct schnur_packed* self);
+
+/**
+ * @brief      Retrieves the number of bytes each character takes.
+ *
+ * @param      self  A packed string pointer.
+ *
+ * @return     1, 2 or 4, 0 if self is NULL.
+ */
+size_t
+schnur_packed_width (const struct schnur_packed* self);
+
+/**
+ * @brief      Retrieves the character at given index.
+ *
+ * @param      self  A packed string pointer.
+ * @param[in]  i     Index of the character.
+ *
+ * @return     The character, or the null character if i is out of range.
+ */
+schnur_wide_t
+schnur_packed_get (const struct schnur_packed* self, size_t i);
+
+/**
+ * @brief      Sets the character at given index, widening the storage if c
+ * does not fit.
+ *
+ * @param      self  A packed string pointer.
+ * @param[in]  i     Index of the character.
+ * @param[in]  c     Character to set.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_packed_set (struct schnur_packed* self, size_t i, schnur_wide_t c);
+
+/**
+ * @brief      Appends the characters of view, widening the storage at most
+ * once, if any of them does not fit.
+ *
+ * @param      self  A packed string pointer.
+ * @param[in]  view  The characters to append.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_packed_append_view (struct schnur_packed* self, struct schnur_view view);
+
+/**
+ * @brief      Copies the characters in range [begin, end) to dst as wide
+ * characters. Does not null terminate dst.
+ *
+ * @param      self   A packed string pointer.
+ * @param[in]  begin  Index of the first character.
+ * @param[in]  end    Index past the last character.
+ * @param      dst    Receives end - begin characters.
+ *
+ * @return     Number of characters written, 0 if the range is invalid.
+ */
+size_t
+schnur_packed_expand (const struct schnur_packed* self, size_t begin, size_t end, schnur_wide_t* dst);
+
+/**
+ * @brief      Creates a new modifiable schnur from given packed string.
+ *
+ * @param      self  A packed string pointer.
+ *
+ * @return     The new schnur, NULL on failure.
+ */
+struct schnur*
+schnur_packed_thaw (const struct schnur_packed* self);
+
+/**
+ * @brief      Tells whether self holds the same characters as view.
+ *
+ * @param      self  A packed string pointer.
+ * @param[in]  view  A view.
  *
  * @return     1 on equality, 0 otherwise.
  */
 int
-schnur_equal (const struct schnur* self, const struct schnur* other);
+schnur_packed_equal_view (const struct schnur_packed* self, struct schnur_view view);
+
+/**
+ * @brief      Orders two packed strings lexicographically by code point,
+ * like schnur_view_compare. A nullpointer sorts like an empty string.
+ *
+ * @param[in]  self   A packed string pointer.
+ * @param[in]  other  Another packed string pointer.
+ *
+ * @return     A negative value if self sorts before other, a positive value
+ *             if self sorts after other, 0 on equality.
+ */
+int
+schnur_packed_compare (const struct schnur_packed* self, const struct schnur_packed* other);
+
+/**
+ * @brief      Finds the first occurrence of needle at or after index from.
+ *
+ * Fails right away, if needle holds characters wider than self stores.
+ *
+ * @param      self    A packed string pointer.
+ * @param[in]  needle  The characters to find.
+ * @param[in]  from    Index to start searching at.
+ *
+ * @return     Index of the occurrence, SCHNUR_NOT_FOUND if there is none.
+ */
+size_t
+schnur_packed_find (const struct schnur_packed* self, struct schnur_view needle, size_t from);
+
+/**
+ * @brief      Applies a batch of edits to self at once.
+ *
+ * Computes the final length first, then moves each character at most once.
+ * Works in place if the string does not outgrow its capacity, otherwise
+ * writes the result to a single new allocation. Replacements might point
+ * into self.
+ *
+ * @param      self   A schnur pointer.
+ * @param[in]  edits  Edits sorted by position, with ranges not overlapping.
+ *                    Ranges refer to self before any edit.
+ * @param[in]  count  Number of edits.
+ *
+ * @return     1 on success, 0 otherwise, leaving self untouched.
+ */
+int
+schnur_apply_edits (struct schnur* self, const struct schnur_edit* edits, size_t count);
+
+/**
+ * @brief      Replaces all non-overlapping occurrences of needle in self,
+ * searching from the front.
+ *
+ * Counts the occurrences first, then writes the result in a single pass:
+ * in place if replacement is not longer than needle, otherwise into a
+ * single new allocation.
+ *
+ * @param      self         A schnur pointer.
+ * @param[in]  needle       The characters to replace, must not be empty.
+ * @param[in]  replacement  The characters to put in place of each match.
+ *
+ * @return     1 on success, 0 otherwise, leaving self untouched.
+ */
+int
+schnur_replace_all (struct schnur* self, struct schnur_view needle,
+	struct schnur_view replacement);
 
 /**
  * @brief      Reverses actually used data of string.
@@ -333,6 +2399,174 @@ schnur_equal (const struct schnur* self, const struct schnur* other);
 int
 schnur_reverse (struct schnur* self);
 
+/**
+ * @brief A string stored as balanced tree of leaves, for very large strings.
+ *
+ * Concatenation, insertion and erasure take logarithmic time, instead of
+ * copying the whole string. Leaves hold up to SCHNUR_ROPE_LEAF_SIZE characters.
+ */
+struct schnur_rope;
+
+/**
+ * @brief Walks the leaves of a schnur_rope in order.
+ *
+ * An iterator becomes invalid, as soon as its rope is modified.
+ */
+struct schnur_rope_iterator {
+	/// The rope iterated.
+	const struct schnur_rope* rope;
+	/// Index of the first character not visited yet.
+	size_t offset;
+};
+
+/**
+ * @brief      Creates a new empty rope, using the current allocator.
+ *
+ * @return     Pointer to the new rope, NULL on failure.
+ */
+struct schnur_rope*
+schnur_rope_new (void);
+
+/**
+ * @brief      Creates a new empty rope, managing its memory through given
+ * allocator.
+ *
+ * @param[in]  allocator  The allocator to use, or NULL for the current one.
+ *
+ * @return     Pointer to the new rope, NULL on failure.
+ */
+struct schnur_rope*
+schnur_rope_new_with_allocator (const struct schnur_allocator* allocator);
+
+/**
+ * @brief      Frees given rope and all of its leaves.
+ *
+ * @param      self  A rope pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_rope_free (struct schnur_rope* self);
+
+/**
+ * @brief      Retrieves the number of characters in given rope.
+ *
+ * @param      self  A rope pointer.
+ *
+ * @return     The length of the rope, 0 if self is NULL.
+ */
+size_t
+schnur_rope_length (const struct schnur_rope* self);
+
+/**
+ * @brief      Retrieves the character at given index.
+ *
+ * @param      self  A rope pointer.
+ * @param[in]  i     Index of the character.
+ *
+ * @return     The character, or the null character if i is out of range.
+ */
+schnur_wide_t
+schnur_rope_get (const struct schnur_rope* self, size_t i);
+
+/**
+ * @brief      Appends a copy of given characters to the rope.
+ *
+ * @param      self  A rope pointer.
+ * @param[in]  view  The characters to append.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_rope_append (struct schnur_rope* self, struct schnur_view view);
+
+/**
+ * @brief      Inserts a copy of given characters before index i.
+ *
+ * @param      self  A rope pointer.
+ * @param[in]  i     Index to insert at, up to the length of the rope.
+ * @param[in]  view  The characters to insert. Must not point into self.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_rope_insert (struct schnur_rope* self, size_t i, struct schnur_view view);
+
+/**
+ * @brief      Removes the characters in range [begin, end).
+ *
+ * @param      self   A rope pointer.
+ * @param[in]  begin  Index of the first character to remove.
+ * @param[in]  end    Index past the last character to remove.
+ *
+ * @return     1 on success, 0 on an invalid range.
+ */
+int
+schnur_rope_erase (struct schnur_rope* self, size_t begin, size_t end);
+
+/**
+ * @brief      Moves all characters of other to the end of self, leaving other
+ * empty. Does not copy any characters, if both ropes share an allocator.
+ *
+ * @param      self   A rope pointer.
+ * @param      other  Another rope pointer.
+ *
+ * @return     1 on success, 0 otherwise.
+ */
+int
+schnur_rope_concat (struct schnur_rope* self, struct schnur_rope* other);
+
+/**
+ * @brief      Copies the contents of given rope into a new, contiguous
+ * schnur, using the allocator of the rope.
+ *
+ * @param      self  A rope pointer.
+ *
+ * @return     Pointer to the new schnur, NULL on failure.
+ */
+struct schnur*
+schnur_rope_flatten (const struct schnur_rope* self);
+
+/**
+ * @brief      Creates an iterator positioned before the first leaf.
+ *
+ * @param      self  A rope pointer.
+ *
+ * @return     The iterator.
+ */
+struct schnur_rope_iterator
+schnur_rope_begin (const struct schnur_rope* self);
+
+/**
+ * @brief      Advances given iterator to the next leaf.
+ *
+ * @param      it    An iterator pointer.
+ * @param[out] leaf  Receives the characters of the leaf.
+ *
+ * @return     1 if there was another leaf, 0 at the end of the rope.
+ */
+int
+schnur_rope_next (struct schnur_rope_iterator* it, struct schnur_view* leaf);
+
+/**
+ * @brief      Encodes the rope as utf-8 into given buffer, leaf by leaf,
+ * without flattening it first.
+ *
+ * @see schnur_narrow_into
+ *
+ * @param      self    A rope pointer.
+ * @param      buf     Receives the null terminated bytes. Might be NULL.
+ * @param[in]  cap     Number of bytes buf is able to hold.
+ * @param[out] needed  Receives the number of bytes, excluding the null
+ * terminator, or SCHNUR_UTF8_INVALID if the characters are not encodable.
+ * Might be NULL.
+ *
+ * @return     1 if the bytes were written, 0 otherwise.
+ */
+int
+schnur_rope_narrow_into (const struct schnur_rope* self,
+	schnur_narrow_t* buf, size_t cap, size_t* needed);
+
 /**
  * @brief      Helper function, to determine if the current build environment
  * is supporting wide <-> narrow (aka. multi-byte) character conversion.
@@ -355,12 +2589,56 @@ schnur_supports_multibytes ();
 int
 schnur_scoped_default_error_handler (const schnur_narrow_t* sname);
 
+/**
+ * @brief      Frees a string returned by schnur_narrow, using the current
+ * allocator.
+ *
+ * @see schnur_narrow_release for schnurs with an allocator of their own.
+ *
+ * @param      self  A narrow string pointer.
+ *
+ * @return     1 on success, 0 when given a nullpointer.
+ */
 int
 schnur_narrow_free (schnur_narrow_t* self);
 
+/**
+ * @brief      Frees a string returned by schnur_wide, using the current
+ * allocator.
+ *
+ * @see schnur_wide_release for schnurs with an allocator of their own.
+ *
+ * @param      self  A wide string pointer.
+ *
+ * @return     1 on success, 0 when given a nullpointer.
+ */
 int
 schnur_wide_free (schnur_wide_t* self);
 
+/**
+ * @brief      Frees a string returned by schnur_narrow (owner), using the
+ * allocator of owner.
+ *
+ * @param[in]  owner  The schnur pointer str was created from.
+ * @param      str    A narrow string pointer.
+ *
+ * @return     1 on success, 0 when given a nullpointer.
+ */
+int
+schnur_narrow_release (const struct schnur* owner, schnur_narrow_t* str);
+
+/**
+ * @brief      Frees a string returned by schnur_wide (owner), using the
+ * allocator of owner.
+ *
+ * @param[in]  owner  The schnur pointer str was created from.
+ * @param      str    A wide string pointer.
+ *
+ * @return     1 on success, 0 when given a nullpointer.
+ */
+int
+schnur_wide_release (const struct schnur* owner, schnur_wide_t* str);
+
 /// Generates the header for a scope / code block, which makes sure, that the
 /// schnur_t* with 'sname', created via 'creation', is properly freed after
 /// the block is exited. If anything goes wrong in the creation, it will invoke
@@ -391,7 +2669,7 @@ for ( \
     schnur_narrow_t *strname = schnur_narrow (sname); \
     NULL != strname; \
     (NULL != strname \
-        ? (schnur_narrow_free (strname) && (strname = NULL)) \
+        ? (schnur_narrow_release (sname, strname) && (strname = NULL)) \
         : (error_handler (#strname))) \
 )
 /// Generates header by using SCHNUR_NARROW_SCOPED_HANDLE with the default
@@ -399,6 +2677,21 @@ for ( \
 #define SCHNUR_NARROW_SCOPED(sname, strname) \
     SCHNUR_NARROW_SCOPED_HANDLE(sname, strname, schnur_scoped_default_error_handler)
 
+/// Same as SCHNUR_NARROW_SCOPED_HANDLE, but encodes into the scratch 'buffer'
+/// able to hold 'cap' bytes. Allocates only if the contents do not fit.
+#define SCHNUR_NARROW_SCOPED_BUFFER_HANDLE(sname, strname, buffer, cap, error_handler) \
+for ( \
+    schnur_narrow_t *strname = schnur_narrow_buffered (sname, buffer, cap); \
+    NULL != strname; \
+    (NULL != strname \
+        ? (schnur_narrow_buffered_release (sname, strname, buffer) && (strname = NULL)) \
+        : (error_handler (#strname))) \
+)
+/// Generates header by using SCHNUR_NARROW_SCOPED_BUFFER_HANDLE with the
+/// default error handler function.
+#define SCHNUR_NARROW_SCOPED_BUFFER(sname, strname, buffer, cap) \
+    SCHNUR_NARROW_SCOPED_BUFFER_HANDLE(sname, strname, buffer, cap, schnur_scoped_default_error_handler)
+
 /// Generates the header for a scope / code block, which makes sure, that the
 /// schnur_wide_t* with 'strname', created from the schnur_t* 'sname',
 /// is properly freed after the block is exited. If anything goes wrong in the
@@ -408,7 +2701,7 @@ for ( \
     schnur_wide_t *strname = schnur_wide (sname); \
     NULL != strname; \
     ((NULL != strname) \
-        ? (schnur_wide_free (strname) && (strname = NULL)) \
+        ? (schnur_wide_release (sname, strname) && (strname = NULL)) \
         : (error_handler (#strname))) \
 )
 /// Generates header by using SCHNUR_WIDE_SCOPED_HANDLE with the default
@@ -416,4 +2709,28 @@ for ( \
 #define SCHNUR_WIDE_SCOPED(sname, strname) \
     SCHNUR_WIDE_SCOPED_HANDLE(sname, strname, schnur_scoped_default_error_handler)
 
+/// Same as SCHNUR_WIDE_SCOPED_HANDLE, but copies into the scratch 'buffer'
+/// able to hold 'cap' characters. Allocates only if the contents do not fit.
+#define SCHNUR_WIDE_SCOPED_BUFFER_HANDLE(sname, strname, buffer, cap, error_handler) \
+for ( \
+    schnur_wide_t *strname = schnur_wide_buffered (sname, buffer, cap); \
+    NULL != strname; \
+    (NULL != strname \
+        ? (schnur_wide_buffered_release (sname, strname, buffer) && (strname = NULL)) \
+        : (error_handler (#strname))) \
+)
+/// Generates header by using SCHNUR_WIDE_SCOPED_BUFFER_HANDLE with the
+/// default error handler function.
+#define SCHNUR_WIDE_SCOPED_BUFFER(sname, strname, buffer, cap) \
+    SCHNUR_WIDE_SCOPED_BUFFER_HANDLE(sname, strname, buffer, cap, schnur_scoped_default_error_handler)
+
+/// Generates the header for a loop over the tokens of 'tokenizer', created
+/// by one of the schnur_split functions. Within the block, 'tname'.token
+/// holds the current token. Breaking out of the loop needs no cleanup.
+#define SCHNUR_FOR_EACH_TOKEN(tname, tokenizer) \
+for ( \
+    struct schnur_tokenizer tname = tokenizer; \
+    schnur_tokenizer_next (&tname); \
+)
+
 #endif
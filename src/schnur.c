@@ -8,23 +8,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 #define WCS_ERROR ((size_t)-1)
 
 #if defined(SCHNUR_WITH_ASSERT)
 #define WCS_TEST_CHAR L'Ϡ'
 #define WCS_TEST_STRING_TO_MB_SIZE 2 * sizeof (schnur_wide_t)
-static int g_need_check_multi_byte = 1;
 static int g_supports_multibyte = 0;
 
-static void multi_byte_ok () {
-	g_need_check_multi_byte = 0;
-}
-
-static int should_check_multi_byte () {
-	return g_need_check_multi_byte;
-}
-
 static int check_multi_byte () {
 	static schnur_narrow_t mbstr[WCS_TEST_STRING_TO_MB_SIZE];
 	size_t mbn = wctomb (mbstr, WCS_TEST_CHAR);
@@ -51,6 +45,39 @@ schnur_supports_multibytes () {
 }
 #endif
 
+/**
+	@brief: Reference counted heap storage, shared by copies of a schnur until
+			  one of them is modified. Frozen schnurs are handles to it.
+*/
+struct schnur_buffer {
+	/**
+		@brief: Number of schnurs and frozen handles sharing this buffer.
+				  Shared buffers are never modified.
+	*/
+	atomic_size_t references;
+
+	/**
+		@brief: Allocator this buffer was allocated with.
+	*/
+	const struct schnur_allocator* allocator;
+
+	/**
+		@brief: Number of characters this buffer can hold.
+	*/
+	size_t capacity;
+
+	/**
+		@brief: Number of characters used. Only valid while shared, as the
+				  owner of an exclusive buffer keeps track of it alone.
+	*/
+	atomic_size_t length;
+
+	/**
+		@brief: Null terminated characters.
+	*/
+	schnur_wide_t data[];
+};
+
 /**
 	@brief: Represents a string of characters.
 */
@@ -62,14 +89,32 @@ struct schnur {
 	size_t length;
 
 	/**
-		@brief: Maximum number of characters this string can hold.
+		@brief: Maximum number of characters this string can hold. As long as
+				  this is SCHNUR_INLINE_CAPACITY, the characters are stored
+				  inline, otherwise on the heap.
 	*/
 	size_t capacity;
 
+	/**
+		@brief: Allocator used for this string object and its heap storage.
+	*/
+	const struct schnur_allocator* allocator;
+
+	/**
+		@brief: Cached result of schnur_hash, 0 if unknown. Every modification
+				  resets it.
+	*/
+	atomic_uint_least64_t hash;
+
 	/**
 		@brief: Character array containing all data used by this string object.
 	*/
-	schnur_wide_t* data;
+	union {
+		/// Heap storage, used if capacity exceeds SCHNUR_INLINE_CAPACITY.
+		struct schnur_buffer* heap;
+		/// Inline storage, used for short strings.
+		schnur_wide_t local[SCHNUR_INLINE_CAPACITY];
+	} data;
 };
 /**
  * @brief Convenience typedef for struct schnur.
@@ -79,34 +124,371 @@ typedef
 	struct schnur
 	schnur_t;
 
-struct schnur*
-schnur_new (void) {
-	struct schnur* s;
+/*
+	Tells whether self keeps its characters inline.
+*/
+static inline int
+__schnur_is_inline (const struct schnur* self) {
+	return SCHNUR_INLINE_CAPACITY >= self->capacity;
+}
 
-#if defined(SCHNUR_WITH_ASSERT)
-	if (0 == check_multi_byte ()) {
+/*
+	Retrieves the character array currently in use by self.
+*/
+static inline schnur_wide_t*
+__schnur_data (const struct schnur* self) {
+	return __schnur_is_inline (self)
+		? (schnur_wide_t*)self->data.local
+		: self->data.heap->data;
+}
+
+/*
+	Allocates a buffer for capacity characters, referenced once.
+*/
+static struct schnur_buffer*
+__schnur_buffer_new (const struct schnur_allocator* a, size_t capacity) {
+	struct schnur_buffer* buffer;
+
+	if (capacity > (SIZE_MAX - offsetof (struct schnur_buffer, data))
+		/ sizeof (schnur_wide_t)) {
 		return NULL;
 	}
-#endif
 
-	s = malloc (sizeof (struct schnur));
-	if (NULL == s) {
+	buffer = a->allocate (a->context,
+		offsetof (struct schnur_buffer, data) + capacity * sizeof (schnur_wide_t));
+	if (NULL == buffer) {
 		return NULL;
 	}
 
-	s->data = calloc (SCHNUR_BLOCK_SIZE, sizeof (schnur_wide_t));
-	if (NULL == s->data) {
-		free (s);
-		s = NULL;
+	atomic_init (&buffer->references, 1);
+	buffer->allocator = a;
+	buffer->capacity = capacity;
+	atomic_init (&buffer->length, 0);
+
+	return buffer;
+}
+
+/*
+	Adds a reference to buffer, which is about to be shared by an owner
+	knowing its length.
+*/
+static struct schnur_buffer*
+__schnur_buffer_share (struct schnur_buffer* buffer, size_t length) {
+	// An exclusive buffer might have changed since it was shared last.
+	if (1 == atomic_load_explicit (&buffer->references, memory_order_acquire)) {
+		atomic_store_explicit (&buffer->length, length, memory_order_relaxed);
+	}
+
+	atomic_fetch_add_explicit (&buffer->references, 1, memory_order_relaxed);
+
+	return buffer;
+}
+
+/*
+	Drops a reference to buffer, releasing it with the last one.
+*/
+static void
+__schnur_buffer_release (struct schnur_buffer* buffer) {
+	const struct schnur_allocator* a = buffer->allocator;
+
+	if (1 == atomic_fetch_sub_explicit (&buffer->references, 1, memory_order_acq_rel)) {
+		a->release (a->context, buffer);
+	}
+}
+
+/*
+	Tells whether self shares its storage with another schnur or frozen
+	handle, and thus must not modify it.
+*/
+static inline int
+__schnur_is_shared (const struct schnur* self) {
+	return ! __schnur_is_inline (self)
+		&& 1 < atomic_load_explicit (&self->data.heap->references, memory_order_acquire);
+}
+
+static void*
+__schnur_default_allocate (void* context, size_t size) {
+	(void)context;
+	return malloc (size);
+}
+
+static void*
+__schnur_default_reallocate (void* context, void* p, size_t old_size, size_t size) {
+	(void)context;
+	(void)old_size;
+	return realloc (p, size);
+}
+
+static void
+__schnur_default_release (void* context, void* p) {
+	(void)context;
+	free (p);
+}
+
+static const struct schnur_allocator g_default_allocator = {
+	__schnur_default_allocate,
+	__schnur_default_reallocate,
+	__schnur_default_release,
+	NULL
+};
+
+static const struct schnur_allocator* g_allocator = &g_default_allocator;
+
+const struct schnur_allocator*
+schnur_default_allocator (void) {
+	return &g_default_allocator;
+}
+
+int
+schnur_set_allocator (const struct schnur_allocator* allocator) {
+	if (NULL == allocator) {
+		g_allocator = &g_default_allocator;
+		return 1;
+	}
+
+	if (NULL == allocator->allocate
+	 || NULL == allocator->reallocate
+	 || NULL == allocator->release) {
+		return 0;
+	}
+
+	g_allocator = allocator;
+
+	return 1;
+}
+
+const struct schnur_allocator*
+schnur_get_allocator (void) {
+	return g_allocator;
+}
+
+static enum schnur_growth_policy g_growth_policy = SCHNUR_GROWTH_GEOMETRIC;
+
+int
+schnur_set_growth_policy (enum schnur_growth_policy policy) {
+	if (SCHNUR_GROWTH_GEOMETRIC != policy
+	 && SCHNUR_GROWTH_LINEAR != policy) {
+		return 0;
+	}
+
+	g_growth_policy = policy;
+
+	return 1;
+}
+
+enum schnur_growth_policy
+schnur_get_growth_policy (void) {
+	return g_growth_policy;
+}
+
+/*
+	Computes the capacity following capacity, according to the current growth
+	policy. Returns 0 on overflow.
+*/
+static size_t
+__schnur_next_capacity (size_t capacity) {
+	// Leaving inline storage always starts with a full block.
+	if (capacity < SCHNUR_BLOCK_SIZE) {
+		return SCHNUR_BLOCK_SIZE;
+	}
+
+	if (SCHNUR_GROWTH_LINEAR == g_growth_policy) {
+		if (capacity > SIZE_MAX - SCHNUR_BLOCK_SIZE) {
+			return 0;
+		}
+		return capacity + SCHNUR_BLOCK_SIZE;
+	}
+
+	if (capacity > SIZE_MAX / 2) {
+		return 0;
+	}
+	return capacity * 2;
+}
+
+/*
+	Copies length characters from src into new storage dst, holding capacity
+	characters, and terminates them there if there is room left.
+*/
+static inline void
+__schnur_move_contents (schnur_wide_t* dst, size_t capacity, const schnur_wide_t* src, size_t length) {
+	if (length > capacity) {
+		length = capacity;
+	}
+	memcpy (dst, src, length * sizeof (schnur_wide_t));
+	if (length < capacity) {
+		dst[length] = SCHNUR_WC_NULL;
+	}
+}
+
+/*
+	Reallocates the data buffer to hold exactly capacity characters. Contents
+	up to the null terminator are kept. Switches between inline and heap
+	storage as needed.
+*/
+static int
+__schnur_resize (struct schnur* self, size_t capacity) {
+	const struct schnur_allocator* a = self->allocator;
+	struct schnur_buffer* buffer;
+	// A filled schnur has no room left for its terminator.
+	size_t length = self->length < self->capacity ? self->length : self->capacity;
+
+	if (capacity > SIZE_MAX / sizeof (schnur_wide_t)) {
+		return 0;
+	}
+
+	if (SCHNUR_INLINE_CAPACITY >= capacity) {
+		if (! __schnur_is_inline (self)) {
+			buffer = self->data.heap;
+			__schnur_move_contents (self->data.local, SCHNUR_INLINE_CAPACITY,
+				buffer->data, length);
+			__schnur_buffer_release (buffer);
+			self->capacity = SCHNUR_INLINE_CAPACITY;
+		}
+		return 1;
+	}
+
+	if (__schnur_is_shared (self)) {
+		// Leave the shared buffer to its other owners.
+		buffer = __schnur_buffer_new (a, capacity);
+		if (NULL == buffer) {
+			return 0;
+		}
+		__schnur_move_contents (buffer->data, capacity, self->data.heap->data, length);
+		__schnur_buffer_release (self->data.heap);
+	}
+	else if (__schnur_is_inline (self)) {
+		buffer = __schnur_buffer_new (a, capacity);
+		if (NULL == buffer) {
+			return 0;
+		}
+		__schnur_move_contents (buffer->data, capacity, self->data.local, length);
 	}
 	else {
-		s->capacity = SCHNUR_BLOCK_SIZE;
-		s->length = 0;
+		if (capacity > (SIZE_MAX - offsetof (struct schnur_buffer, data))
+			/ sizeof (schnur_wide_t)) {
+			return 0;
+		}
+		buffer = a->reallocate (a->context, self->data.heap,
+			offsetof (struct schnur_buffer, data) + self->capacity * sizeof (schnur_wide_t),
+			offsetof (struct schnur_buffer, data) + capacity * sizeof (schnur_wide_t));
+		if (NULL == buffer) {
+			return 0;
+		}
+		buffer->capacity = capacity;
+	}
+
+	self->data.heap = buffer;
+	self->capacity = capacity;
+
+	return 1;
+}
+
+static inline void
+__schnur_forget_hash (struct schnur* self) {
+	atomic_store_explicit (&self->hash, 0, memory_order_relaxed);
+}
+
+/*
+	Makes sure self is the only owner of its storage and forgets its cached
+	hash, before modifying it.
+*/
+static int
+__schnur_prepare_write (struct schnur* self) {
+	__schnur_forget_hash (self);
+
+	if (! __schnur_is_shared (self)) {
+		return 1;
+	}
+
+	return __schnur_resize (self, self->capacity);
+}
+
+/*
+	Grows capacity in steps of the current growth policy, until it is able to
+	hold n characters plus null terminator. n has to be less than SIZE_MAX.
+*/
+static size_t
+__schnur_grown_capacity (size_t capacity, size_t n) {
+	while (capacity <= n) {
+		capacity = __schnur_next_capacity (capacity);
+		if (0 == capacity) {
+			// Policy overflows, so just take what is needed.
+			capacity = n + 1;
+		}
+	}
+
+	return capacity;
+}
+
+/*
+	Makes sure self is able to hold n characters plus null terminator. Grows
+	in steps of the current growth policy, but reallocates only once.
+*/
+static int
+__schnur_grow (struct schnur* self, size_t n) {
+	if (n >= SIZE_MAX) {
+		return 0;
+	}
+	if (self->capacity > n) {
+		return __schnur_prepare_write (self);
+	}
+
+	__schnur_forget_hash (self);
+
+	return __schnur_resize (self, __schnur_grown_capacity (self->capacity, n));
+}
+
+static struct schnur*
+__schnur_new (size_t capacity, const struct schnur_allocator* allocator) {
+	struct schnur* s;
+
+	s = allocator->allocate (allocator->context, sizeof (struct schnur));
+	if (NULL == s) {
+		return NULL;
+	}
+
+	s->allocator = allocator;
+	atomic_init (&s->hash, 0);
+	s->capacity = SCHNUR_INLINE_CAPACITY;
+	s->length = 0;
+	s->data.local[0] = SCHNUR_WC_NULL;
+
+	if (! __schnur_resize (s, capacity)) {
+		allocator->release (allocator->context, s);
+		s = NULL;
 	}
 
 	return s;
 }
 
+struct schnur*
+schnur_new (void) {
+	return __schnur_new (SCHNUR_INLINE_CAPACITY, g_allocator);
+}
+
+struct schnur*
+schnur_new_with_allocator (const struct schnur_allocator* allocator) {
+	if (NULL == allocator) {
+		allocator = g_allocator;
+	}
+	else if (NULL == allocator->allocate
+	 || NULL == allocator->reallocate
+	 || NULL == allocator->release) {
+		return NULL;
+	}
+
+	return __schnur_new (SCHNUR_INLINE_CAPACITY, allocator);
+}
+
+struct schnur*
+schnur_new_with_capacity (size_t n) {
+	if (n >= SIZE_MAX) {
+		return NULL;
+	}
+
+	return __schnur_new (n + 1, g_allocator);
+}
+
 struct schnur*
 schnur_new_s (const schnur_wide_t* str) {
 	struct schnur* s = schnur_new ();
@@ -124,428 +506,1377 @@ struct schnur*
 schnur_new_su (const schnur_narrow_t* str) {
 	if (NULL == str) return NULL;
 
-	struct schnur* s = schnur_new ();
+	return schnur_new_su_n (str, strlen (str), NULL);
+}
+
+struct schnur*
+schnur_new_su_n (const schnur_narrow_t* str, size_t n, size_t* error) {
+	struct schnur* s;
+	size_t length;
+
+	if (NULL == str) return NULL;
+
+	// Measure first, so decoding needs a single allocation.
+	length = schnur_utf8_decode_length (str, n, error);
+	if (SCHNUR_UTF8_INVALID == length) return NULL;
+
+	s = schnur_new_with_capacity (length);
 	if (NULL == s) return NULL;
 
-	size_t total_source_length = strlen (str);
-	size_t block_count = total_source_length / 32;
-	size_t rest_count = total_source_length % 32;
-	size_t count_wcs = 0;
-
-	schnur_narrow_t source_block_buffer[32];
-	schnur_wide_t block_buffer[32];
-
-	for (size_t block_index = 0; block_index < block_count; ++block_index) {
-		memcpy (source_block_buffer, str+(block_index*32), 32);
-		count_wcs = mbstowcs (block_buffer, source_block_buffer, 32);
-		assert (32 == count_wcs && "Not the block we were looking for :/");
-		wprintf (L"Encoded block of 32 wide characters: '%ls'\n", block_buffer);
-		if (schnur_append_cstr (s, block_buffer)) {
-			schnur_free (s);
-			return NULL;
-		}
+	schnur_utf8_decode (__schnur_data (s), str, n);
+	s->length = length;
+	__schnur_data (s)[length] = SCHNUR_WC_NULL;
+
+	return s;
+}
+
+int
+schnur_append_utf8 (struct schnur* self, const schnur_narrow_t* str, size_t n, size_t* error) {
+	size_t length;
+
+	if (NULL == self || (NULL == str && 0 < n)) {
+		return 0;
+	}
+	if (0 == n) {
+		return 1;
 	}
 
-	if (0 < rest_count) {
-		memset (source_block_buffer, '\0', 32);
-		memcpy (source_block_buffer, str+(block_count*32), rest_count);
-		memset (block_buffer, L'\0', 32);
-		count_wcs = mbstowcs (block_buffer, source_block_buffer, 32);
-		//assert (rest_count == count_wcs && "That gave it the rest :/");
-		wprintf (L"Encoded remaining %zu wide characters: '%ls'\n", count_wcs, block_buffer);
-		if (0 == schnur_append_cstr (s, block_buffer)) {
-			schnur_free (s);
-			return NULL;
-		}
+	// Measure first, so decoding grows at most once.
+	length = schnur_utf8_decode_length (str, n, error);
+	if (SCHNUR_UTF8_INVALID == length || length > SIZE_MAX - 1 - self->length) {
+		return 0;
 	}
 
-	return s;
+	if (! __schnur_grow (self, self->length + length)) {
+		return 0;
+	}
+
+	schnur_utf8_decode (__schnur_data (self) + self->length, str, n);
+	self->length += length;
+	__schnur_data (self)[self->length] = SCHNUR_WC_NULL;
+
+	return 1;
 }
 
 int
 schnur_free (struct schnur* self) {
+	const struct schnur_allocator* a;
+
 	if (NULL == self) {
 		return 0;
 	}
 
-	if (NULL != self->data) {
-		free (self->data);
-	}
-
-	free (self);
-
-	return 1;
+	a = self->allocator;
+	if (! __schnur_is_inline (self)) {
+		__schnur_buffer_release (self->data.heap);
+	}
+
+	a->release (a->context, self);
+
+	return 1;
+}
+
+int
+schnur_narrow_free (schnur_narrow_t* self) {
+    if (NULL != self) { g_allocator->release (g_allocator->context, self); return 1; } return 0;
+}
+
+int
+schnur_wide_free (schnur_wide_t* self) {
+    if (NULL != self) { g_allocator->release (g_allocator->context, self); return 1; } return 0;
+}
+
+int
+schnur_narrow_release (const struct schnur* owner, schnur_narrow_t* str) {
+	const struct schnur_allocator* a;
+
+	if (NULL == owner || NULL == str) {
+		return 0;
+	}
+
+	a = owner->allocator;
+	a->release (a->context, str);
+
+	return 1;
+}
+
+int
+schnur_wide_release (const struct schnur* owner, schnur_wide_t* str) {
+	const struct schnur_allocator* a;
+
+	if (NULL == owner || NULL == str) {
+		return 0;
+	}
+
+	a = owner->allocator;
+	a->release (a->context, str);
+
+	return 1;
+}
+
+schnur_wide_t
+schnur_get (const struct schnur* self, size_t i) {
+	if (NULL == self) return SCHNUR_WC_NULL;
+	if (i >= self->length) return SCHNUR_WC_NULL;
+
+	return __schnur_data (self)[i];
+}
+
+int
+schnur_set (struct schnur* self, size_t i, schnur_wide_t c) {
+	if (NULL == self) return 0;
+	if (i >= self->length) return 0;
+	if (! __schnur_prepare_write (self)) return 0;
+
+	__schnur_data (self)[i] = c;
+
+	return 1;
+}
+
+void*
+schnur_raw(const struct schnur* self) {
+	if (NULL == self) {
+		return NULL;
+	}
+
+	return __schnur_data (self);
+}
+
+schnur_wide_t*
+schnur_wide(const struct schnur* self) {
+	if (NULL == self) {
+		return NULL;
+	}
+
+	if (0 == self->capacity || 0 == self->length) {
+		return NULL;
+	}
+
+	const struct schnur_allocator* a = self->allocator;
+	schnur_wide_t* return_buffer = a->allocate (a->context,
+		sizeof (schnur_wide_t) * (self->length + 1));
+	if (NULL != return_buffer) {
+		size_t total_bytes = sizeof(schnur_wide_t) * (self->length + 1);
+		memcpy(return_buffer, __schnur_data (self), total_bytes); // Copies null-terminator.
+	}
+
+	return return_buffer;
+}
+
+schnur_narrow_t*
+schnur_narrow (const struct schnur* self) {
+	const struct schnur_allocator* a;
+	schnur_narrow_t* export_string;
+	size_t size;
+
+	if (NULL == self) {
+		return NULL;
+	}
+
+	if (0 == self->capacity || 0 == self->length) {
+		return NULL;
+	}
+
+	size = schnur_utf8_encode_length (__schnur_data (self), self->length);
+	if (SCHNUR_UTF8_INVALID == size) {
+		return NULL;
+	}
+
+	a = self->allocator;
+	export_string = a->allocate (a->context, size + 1);
+	if (NULL == export_string) {
+		return NULL;
+	}
+
+	schnur_utf8_encode (export_string, __schnur_data (self), self->length);
+	export_string[size] = SCHNUR_NC_NULL;
+
+	return export_string;
+}
+
+int
+schnur_wide_range_into (const struct schnur* self, size_t begin, size_t end,
+	schnur_wide_t* buf, size_t cap, size_t* needed) {
+	size_t n;
+
+	if (NULL == self || begin > end || end > self->length) {
+		return 0;
+	}
+
+	n = end - begin;
+	if (NULL != needed) *needed = n;
+	if (NULL == buf || cap <= n) {
+		return 0;
+	}
+
+	memcpy (buf, __schnur_data (self) + begin, n * sizeof (schnur_wide_t));
+	buf[n] = SCHNUR_WC_NULL;
+
+	return 1;
+}
+
+int
+schnur_wide_into (const struct schnur* self,
+	schnur_wide_t* buf, size_t cap, size_t* needed) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_wide_range_into (self, 0, self->length, buf, cap, needed);
+}
+
+int
+schnur_narrow_range_into (const struct schnur* self, size_t begin, size_t end,
+	schnur_narrow_t* buf, size_t cap, size_t* needed) {
+	const schnur_wide_t* s;
+	size_t n, size;
+
+	if (NULL == self || begin > end || end > self->length) {
+		return 0;
+	}
+
+	s = __schnur_data (self) + begin;
+	n = end - begin;
+
+	// Worst case fits, so skip measuring.
+	if (NULL != buf && 0 < cap && n <= (cap - 1) / SCHNUR_UTF8_MAX_BYTES) {
+		size = schnur_utf8_encode (buf, s, n);
+		if (NULL != needed) *needed = size;
+		if (SCHNUR_UTF8_INVALID == size) {
+			buf[0] = SCHNUR_NC_NULL;
+			return 0;
+		}
+		buf[size] = SCHNUR_NC_NULL;
+		return 1;
+	}
+
+	size = schnur_utf8_encode_length (s, n);
+	if (NULL != needed) *needed = size;
+	if (SCHNUR_UTF8_INVALID == size || NULL == buf || cap <= size) {
+		return 0;
+	}
+
+	schnur_utf8_encode (buf, s, n);
+	buf[size] = SCHNUR_NC_NULL;
+
+	return 1;
+}
+
+int
+schnur_narrow_into (const struct schnur* self,
+	schnur_narrow_t* buf, size_t cap, size_t* needed) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_narrow_range_into (self, 0, self->length, buf, cap, needed);
+}
+
+schnur_narrow_t*
+schnur_narrow_buffered (const struct schnur* self,
+	schnur_narrow_t* buffer, size_t cap) {
+	const struct schnur_allocator* a;
+	schnur_narrow_t* str;
+	size_t size;
+
+	if (NULL == self) {
+		return NULL;
+	}
+
+	if (schnur_narrow_into (self, buffer, cap, &size)) {
+		return buffer;
+	}
+	if (SCHNUR_UTF8_INVALID == size) {
+		return NULL;
+	}
+
+	a = self->allocator;
+	str = a->allocate (a->context, size + 1);
+	if (NULL != str && ! schnur_narrow_into (self, str, size + 1, NULL)) {
+		a->release (a->context, str);
+		str = NULL;
+	}
+
+	return str;
+}
+
+int
+schnur_narrow_buffered_release (const struct schnur* owner,
+	schnur_narrow_t* str, const schnur_narrow_t* buffer) {
+	if (NULL == owner || NULL == str) {
+		return 0;
+	}
+
+	if (str != buffer) {
+		return schnur_narrow_release (owner, str);
+	}
+
+	return 1;
+}
+
+schnur_wide_t*
+schnur_wide_buffered (const struct schnur* self,
+	schnur_wide_t* buffer, size_t cap) {
+	const struct schnur_allocator* a;
+	schnur_wide_t* str;
+
+	if (NULL == self) {
+		return NULL;
+	}
+
+	if (schnur_wide_into (self, buffer, cap, NULL)) {
+		return buffer;
+	}
+
+	a = self->allocator;
+	str = a->allocate (a->context, (self->length + 1) * sizeof (schnur_wide_t));
+	if (NULL != str) {
+		schnur_wide_into (self, str, self->length + 1, NULL);
+	}
+
+	return str;
+}
+
+int
+schnur_wide_buffered_release (const struct schnur* owner,
+	schnur_wide_t* str, const schnur_wide_t* buffer) {
+	if (NULL == owner || NULL == str) {
+		return 0;
+	}
+
+	if (str != buffer) {
+		return schnur_wide_release (owner, str);
+	}
+
+	return 1;
+}
+
+size_t
+schnur_raw_size(const struct schnur* self) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return sizeof (schnur_wide_t) * self->capacity;
+}
+
+size_t
+schnur_length(const struct schnur* self) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return self->length;
+}
+
+size_t
+schnur_capacity(const struct schnur* self) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return self->capacity;
+}
+
+int
+schnur_terminate (struct schnur* self, size_t i) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	if (self->capacity < i) {
+		return 0;
+	}
+
+	if (! __schnur_prepare_write (self)) {
+		return 0;
+	}
+
+	self->length = i;
+	__schnur_data (self)[i] = SCHNUR_W ('\0');
+
+	return 1;
+}
+
+/*
+	Raw implementation for string filling.
+*/
+int
+__schnur_fill_n (struct schnur* self, schnur_wide_t c, size_t n) {
+	size_t i;
+
+	if (0 == n || ! __schnur_prepare_write (self)) {
+		return 0;
+	}
+
+	for (i = 0; i < n; ++i) {
+		__schnur_data (self)[i] = c;
+	}
+	__schnur_data (self)[n - 1] = SCHNUR_W ('\0');
+
+	self->length = n;
+
+	return 1;
+}
+
+int
+schnur_fill (struct schnur* self, schnur_wide_t c) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return __schnur_fill_n (self, c, self->capacity);
+}
+
+int
+schnur_fill_n (struct schnur* self, schnur_wide_t c, size_t n) {
+	if (NULL == self
+	 || n > self->capacity) {
+		return 0;
+	}
+
+	return __schnur_fill_n (self, c, n);
+}
+
+int
+schnur_expand (struct schnur* self) {
+	size_t capacity;
+
+	if (NULL == self) {
+		return 0;
+	}
+
+	capacity = __schnur_next_capacity (self->capacity);
+	if (0 == capacity) {
+		return 0;
+	}
+
+	return __schnur_resize (self, capacity);
+}
+
+int
+schnur_reserve (struct schnur* self, size_t n) {
+	if (NULL == self || n >= SIZE_MAX) {
+		return 0;
+	}
+
+	if (self->capacity > n) {
+		return 1;
+	}
+
+	return __schnur_resize (self, n + 1);
+}
+
+int
+schnur_compact (struct schnur* self) {
+	size_t capacity;
+
+	if (NULL == self) {
+		return 0;
+	}
+
+	// Keep capacity aligned to block size, len + \0 rounded up. Short
+	// strings move back into inline storage.
+	capacity = self->length + 1;
+	if (SCHNUR_INLINE_CAPACITY >= capacity) {
+		capacity = SCHNUR_INLINE_CAPACITY;
+	}
+	else {
+		capacity += (SCHNUR_BLOCK_SIZE - capacity % SCHNUR_BLOCK_SIZE)
+			% SCHNUR_BLOCK_SIZE;
+	}
+	if (capacity >= self->capacity) {
+		return 0;
+	}
+
+	return __schnur_resize (self, capacity);
+}
+
+/*
+	Raw implementation for copying n characters of other. Other might point
+	into self, in which case n < capacity and self does not need to grow.
+*/
+static int
+__schnur_copy_n (struct schnur* self, const schnur_wide_t* other, size_t n) {
+	if (! __schnur_grow (self, n)) {
+		return 0;
+	}
+
+	if (0 < n) {
+		memmove (__schnur_data (self), other, n * sizeof (schnur_wide_t));
+	}
+	self->length = n;
+	__schnur_data (self)[self->length] = SCHNUR_W ('\0');
+
+	return 1;
+}
+
+int
+schnur_copy (struct schnur* self, const struct schnur* other) {
+	if (NULL == self || NULL == other) {
+		return 0;
+	}
+
+	if (self == other) {
+		return 1;
+	}
+
+	// Share heap storage until either one is modified.
+	if (! __schnur_is_inline (other) && self->allocator == other->allocator) {
+		__schnur_buffer_share (other->data.heap, other->length);
+		if (! __schnur_is_inline (self)) {
+			__schnur_buffer_release (self->data.heap);
+		}
+		self->data.heap = other->data.heap;
+		self->capacity = other->capacity;
+		self->length = other->length;
+		atomic_store_explicit (&self->hash,
+			atomic_load_explicit (&((struct schnur*)other)->hash, memory_order_relaxed),
+			memory_order_relaxed);
+		return 1;
+	}
+
+	return __schnur_copy_n (self, __schnur_data (other), other->length);
+}
+
+int
+schnur_copy_cstr (struct schnur* self, const schnur_wide_t* other) {
+	if (NULL == self || NULL == other) {
+		return 0;
+	}
+
+	return __schnur_copy_n (self, other, wcslen (other));
+}
+
+const struct schnur_frozen*
+schnur_freeze (const struct schnur* self) {
+	struct schnur_buffer* buffer;
+
+	if (NULL == self) {
+		return NULL;
+	}
+
+	if (! __schnur_is_inline (self)) {
+		buffer = __schnur_buffer_share (self->data.heap, self->length);
+		return (const struct schnur_frozen*)buffer;
+	}
+
+	return schnur_frozen_new (schnur_view_of (self), self->allocator);
+}
+
+const struct schnur_frozen*
+schnur_frozen_new (struct schnur_view view, const struct schnur_allocator* allocator) {
+	struct schnur_buffer* buffer;
+
+	if (NULL == view.data && 0 < view.length) {
+		return NULL;
+	}
+
+	if (NULL == allocator) {
+		allocator = g_allocator;
+	}
+
+	if (view.length >= SIZE_MAX) {
+		return NULL;
+	}
+
+	buffer = __schnur_buffer_new (allocator, view.length + 1);
+	if (NULL == buffer) {
+		return NULL;
+	}
+	if (0 < view.length) {
+		memcpy (buffer->data, view.data, view.length * sizeof (schnur_wide_t));
+	}
+	buffer->data[view.length] = SCHNUR_WC_NULL;
+	atomic_store_explicit (&buffer->length, view.length, memory_order_relaxed);
+
+	return (const struct schnur_frozen*)buffer;
+}
+
+const struct schnur_frozen*
+schnur_frozen_retain (const struct schnur_frozen* frozen) {
+	struct schnur_buffer* buffer = (struct schnur_buffer*)frozen;
+
+	if (NULL != buffer) {
+		atomic_fetch_add_explicit (&buffer->references, 1, memory_order_relaxed);
+	}
+
+	return frozen;
+}
+
+int
+schnur_frozen_release (const struct schnur_frozen* frozen) {
+	if (NULL == frozen) {
+		return 0;
+	}
+
+	__schnur_buffer_release ((struct schnur_buffer*)frozen);
+
+	return 1;
+}
+
+struct schnur_view
+schnur_frozen_view (const struct schnur_frozen* frozen) {
+	const struct schnur_buffer* buffer = (const struct schnur_buffer*)frozen;
+
+	if (NULL == buffer) {
+		return schnur_view_n (NULL, 0);
+	}
+
+	return schnur_view_n (buffer->data,
+		atomic_load_explicit (&((struct schnur_buffer*)buffer)->length, memory_order_relaxed));
+}
+
+struct schnur*
+schnur_thaw (const struct schnur_frozen* frozen) {
+	struct schnur_buffer* buffer = (struct schnur_buffer*)frozen;
+	struct schnur* s;
+	size_t length;
+
+	if (NULL == buffer) {
+		return NULL;
+	}
+
+	length = atomic_load_explicit (&buffer->length, memory_order_relaxed);
+
+	// Short snapshots are copied into inline storage.
+	if (SCHNUR_INLINE_CAPACITY >= buffer->capacity) {
+		s = __schnur_new (SCHNUR_INLINE_CAPACITY, buffer->allocator);
+		if (NULL != s) {
+			__schnur_copy_n (s, buffer->data, length);
+		}
+		return s;
+	}
+
+	s = buffer->allocator->allocate (buffer->allocator->context, sizeof (struct schnur));
+	if (NULL == s) {
+		return NULL;
+	}
+
+	s->allocator = buffer->allocator;
+	atomic_init (&s->hash, 0);
+	s->capacity = buffer->capacity;
+	s->length = length;
+	s->data.heap = __schnur_buffer_share (buffer, length);
+
+	return s;
+}
+
+int
+schnur_append (struct schnur* self, schnur_wide_t c) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	if (! __schnur_grow (self, self->length + 1)) {
+		return 0;
+	}
+
+	__schnur_data (self)[self->length++] = c;
+	__schnur_data (self)[self->length] = SCHNUR_W ('\0');
+
+	return 1;
+}
+
+/*
+	Raw implementation for appending n characters of other.
+*/
+static int
+__schnur_append_n (struct schnur* self, const schnur_wide_t* other, size_t n) {
+	int aliased;
+	size_t offset = 0;
+
+	if (n > SIZE_MAX - 1 - self->length) {
+		return 0;
+	}
+
+	// Other might point into our own buffer, which could move on growth.
+	aliased = other >= __schnur_data (self)
+		&& other < __schnur_data (self) + self->capacity;
+	if (aliased) {
+		offset = (size_t)(other - __schnur_data (self));
+	}
+
+	if (! __schnur_grow (self, self->length + n)) {
+		return 0;
+	}
+
+	if (aliased) {
+		other = __schnur_data (self) + offset;
+	}
+
+	if (0 == n) {
+		return 1;
+	}
+
+	memmove (__schnur_data (self) + self->length, other, n * sizeof (schnur_wide_t));
+	self->length += n;
+	__schnur_data (self)[self->length] = SCHNUR_W ('\0');
+
+	return 1;
+}
+
+int
+schnur_append_cstr (struct schnur* self, const schnur_wide_t* other) {
+	size_t len;
+
+	if (NULL == self
+	 || NULL == other) {
+		return 0;
+	}
+
+	len = wcslen (other);
+	if (0 == len) {
+		return 1;
+	}
+
+	return __schnur_append_n (self, other, len);
+}
+
+int
+schnur_append_string (struct schnur* self, const struct schnur* other) {
+	if (NULL == self
+	 || NULL == other) {
+		return 0;
+	}
+
+	return __schnur_append_n (self, __schnur_data (other), other->length);
 }
 
 int
-schnur_narrow_free (schnur_narrow_t* self) {
-    if (NULL != self) { free (self); return 1; } return 0;
-}
+schnur_equal_cstr (const struct schnur* self, const schnur_wide_t* other) {
+	size_t n;
 
-int
-schnur_wide_free (schnur_wide_t* self) {
-    if (NULL != self) { free (self); return 1; } return 0;
-}
+	if (NULL == self
+	 || NULL == other) {
+		return 0;
+	}
 
-schnur_wide_t
-schnur_get (const struct schnur* self, size_t i) {
-	if (NULL == self) return SCHNUR_WC_NULL;
-	if (i >= self->length) return SCHNUR_WC_NULL;
+	// Never looks further into other than self is long.
+	for (n = 0; n < self->length && SCHNUR_WC_NULL != other[n]; ++n) {}
 
-	return self->data[i];
+	return self->length == n
+		&& SCHNUR_WC_NULL == other[n]
+		&& n == schnur_view_mismatch (schnur_view_of (self), schnur_view_n (other, n));
 }
 
 int
-schnur_set (struct schnur* self, size_t i, schnur_wide_t c) {
-	if (NULL == self) return 0;
-	if (i >= self->length) return 0;
+schnur_equal (const struct schnur* self, const struct schnur* other) {
+	uint64_t a, b;
+
+	if (NULL == self
+	 || NULL == other) {
+		return 0;
+	}
 
-	self->data[i] = c;
+	if (self->length != other->length) {
+		return 0;
+	}
 
-	return 1;
+	// Known hashes reject most mismatches without touching the characters.
+	a = atomic_load_explicit (&((struct schnur*)self)->hash, memory_order_relaxed);
+	b = atomic_load_explicit (&((struct schnur*)other)->hash, memory_order_relaxed);
+	if (0 != a && 0 != b && a != b) {
+		return 0;
+	}
+
+	return self->length == schnur_view_mismatch (schnur_view_of (self), schnur_view_of (other));
 }
 
-void*
-schnur_raw(const struct schnur* self) {
+uint64_t
+schnur_hash (const struct schnur* self) {
+	atomic_uint_least64_t* cache;
+	uint64_t hash;
+
 	if (NULL == self) {
-		return NULL;
+		return 0;
+	}
+
+	cache = &((struct schnur*)self)->hash;
+	hash = atomic_load_explicit (cache, memory_order_relaxed);
+	if (0 == hash) {
+		hash = schnur_hash_view (schnur_view_of (self));
+		atomic_store_explicit (cache, hash, memory_order_relaxed);
 	}
 
-	return self->data;
+	return hash;
 }
 
-schnur_wide_t*
-schnur_wide(const struct schnur* self) {
-	if (NULL == self) {
+struct schnur*
+schnur_new_view (struct schnur_view view) {
+	struct schnur* s;
+
+	if (NULL == view.data && 0 < view.length) {
 		return NULL;
 	}
 
-	if (0 == self->capacity || 0 == self->length) {
+	s = schnur_new_with_capacity (view.length);
+	if (NULL == s) {
 		return NULL;
 	}
 
-	schnur_wide_t* return_buffer = calloc (sizeof (schnur_wide_t), self->length + 1);
-	if (NULL != return_buffer) {
-		size_t total_bytes = sizeof(schnur_wide_t) * (self->length + 1);
-		memcpy(return_buffer, self->data, total_bytes); // Copies null-terminator.
+	if (0 == __schnur_copy_n (s, view.data, view.length)) {
+		schnur_free (s);
+		return NULL;
 	}
 
-	return return_buffer;
+	return s;
 }
 
-schnur_narrow_t*
-schnur_narrow (const struct schnur* self) {
-	if (NULL == self) {
-		return NULL;
-	}
+struct schnur_view
+schnur_view_of (const struct schnur* self) {
+	struct schnur_view view = { NULL, 0 };
 
-	if (0 == self->capacity || 0 == self->length) {
-		return NULL;
+	if (NULL != self) {
+		view.data = __schnur_data (self);
+		view.length = self->length;
 	}
 
-	size_t allocation_count = self->length + 1;
-	size_t wcs_size = sizeof (schnur_wide_t);
-	size_t utf8_size = sizeof (schnur_narrow_t) * 4;
-	// make room for 16 and 32 bit wchar's
-	allocation_count *= wcs_size;
+	return view;
+}
 
-	printf ("allocation_count: %zu, utf8_size: %zu wcs_size: %zu, self->length: %zu\n",
-		allocation_count, utf8_size, wcs_size, self->length);
+struct schnur_view
+schnur_view_cstr (const schnur_wide_t* s) {
+	return schnur_view_n (s, NULL == s ? 0 : wcslen (s));
+}
 
-	schnur_narrow_t* export_string = calloc(utf8_size, allocation_count);
-	size_t total_bytes = allocation_count * utf8_size;
-	size_t mbsc = wcstombs (export_string, self->data, total_bytes);
-	if (WCS_ERROR == mbsc) return NULL;
+struct schnur_view
+schnur_view_n (const schnur_wide_t* s, size_t n) {
+	struct schnur_view view = { NULL, 0 };
 
-	printf ("compating export string from %zu to %zu.\n", total_bytes, mbsc);
-	schnur_narrow_t* compact_export = realloc (export_string, mbsc + 1);
-	if (NULL == compact_export) {
-		free (export_string);
-		return NULL;
+	if (NULL != s) {
+		view.data = s;
+		view.length = n;
 	}
 
-	return compact_export;
+	return view;
 }
 
-size_t
-schnur_raw_size(const struct schnur* self) {
-	if (NULL == self) {
-		return 0;
+struct schnur_view
+schnur_slice (const struct schnur* self, size_t begin, size_t end) {
+	return schnur_view_slice (schnur_view_of (self), begin, end);
+}
+
+struct schnur_view
+schnur_view_slice (struct schnur_view view, size_t begin, size_t end) {
+	struct schnur_view slice = { NULL, 0 };
+
+	if (NULL == view.data || begin > end || end > view.length) {
+		return slice;
 	}
 
-	if (NULL != self->data && 0 < self->capacity) {
-		return sizeof (self->data[0]) * self->capacity;
+	slice.data = view.data + begin;
+	slice.length = end - begin;
+
+	return slice;
+}
+
+schnur_wide_t
+schnur_view_get (struct schnur_view view, size_t i) {
+	if (NULL == view.data || i >= view.length) {
+		return SCHNUR_WC_NULL;
 	}
 
-	return 0;
+	return view.data[i];
 }
 
-size_t
-schnur_length(const struct schnur* self) {
-	if (NULL == self) {
+int
+schnur_view_equal (struct schnur_view a, struct schnur_view b) {
+	if (a.length != b.length) {
 		return 0;
 	}
 
-	return self->length;
+	return a.length == schnur_view_mismatch (a, b);
 }
 
-size_t
-schnur_capacity(const struct schnur* self) {
+int
+schnur_equal_view (const struct schnur* self, struct schnur_view view) {
 	if (NULL == self) {
 		return 0;
 	}
 
-	return self->capacity;
+	return schnur_view_equal (schnur_view_of (self), view);
 }
 
 int
-schnur_terminate (struct schnur* self, size_t i) {
-	if (NULL == self) {
+schnur_copy_view (struct schnur* self, struct schnur_view view) {
+	if (NULL == self
+	 || (NULL == view.data && 0 < view.length)) {
 		return 0;
 	}
 
-	if (self->capacity < i) {
+	return __schnur_copy_n (self, view.data, view.length);
+}
+
+int
+schnur_append_view (struct schnur* self, struct schnur_view view) {
+	if (NULL == self
+	 || (NULL == view.data && 0 < view.length)) {
 		return 0;
 	}
 
-	self->length = i;
-	self->data[i] = SCHNUR_W ('\0');
+	return __schnur_append_n (self, view.data, view.length);
+}
 
-	return 1;
+/// Longest result of an edit, so differences in length fit a ptrdiff_t.
+#define SCHNUR_EDIT_MAX_LENGTH (PTRDIFF_MAX / sizeof (schnur_wide_t))
+
+/*
+	Tells whether view points into the storage of self.
+*/
+static int
+__schnur_aliases (const struct schnur* self, struct schnur_view view) {
+	const schnur_wide_t* data = __schnur_data (self);
+
+	return 0 < view.length
+		&& view.data < data + self->capacity
+		&& view.data + view.length > data;
 }
 
 /*
-	Raw implementation for string filling.
+	Storage for the result of an edit, which cannot be done in place. A
+	result fitting inline storage is assembled in local.
 */
-int
-__schnur_fill_n (struct schnur* self, schnur_wide_t c, size_t n) {
-	size_t i;
+struct __schnur_edit_target {
+	struct schnur_buffer* buffer;
+	schnur_wide_t local[SCHNUR_INLINE_CAPACITY];
+};
 
-	if (0 == n) {
-		return 0;
-	}
+/*
+	Prepares target to receive length characters and returns where to write
+	them. Keeps the capacity of self, if sufficient.
+*/
+static schnur_wide_t*
+__schnur_edit_target_begin (const struct schnur* self,
+	struct __schnur_edit_target* target, size_t length) {
+	target->buffer = NULL;
 
-	for (i = 0; i < n; ++i) {
-		self->data[i] = c;
+	if (SCHNUR_INLINE_CAPACITY > length) {
+		return target->local;
 	}
-	self->data[n - 1] = SCHNUR_W ('\0');
 
-	self->length = n;
+	target->buffer = __schnur_buffer_new (self->allocator,
+		__schnur_grown_capacity (self->capacity, length));
 
-	return 1;
+	return NULL == target->buffer ? NULL : target->buffer->data;
 }
 
-int
-schnur_fill (struct schnur* self, schnur_wide_t c) {
-	if (NULL == self) {
-		return 0;
+/*
+	Replaces the storage of self with target, holding length characters.
+*/
+static void
+__schnur_edit_target_commit (struct schnur* self,
+	struct __schnur_edit_target* target, size_t length) {
+	if (! __schnur_is_inline (self)) {
+		__schnur_buffer_release (self->data.heap);
 	}
 
-	return __schnur_fill_n (self, c, self->capacity);
-}
-
-int
-schnur_fill_n (struct schnur* self, schnur_wide_t c, size_t n) {
-	if (NULL == self
-	 || n > self->capacity) {
-		return 0;
+	if (NULL == target->buffer) {
+		memcpy (self->data.local, target->local, length * sizeof (schnur_wide_t));
+		self->capacity = SCHNUR_INLINE_CAPACITY;
+	}
+	else {
+		self->data.heap = target->buffer;
+		self->capacity = target->buffer->capacity;
 	}
 
-	return __schnur_fill_n (self, c, n);
+	self->length = length;
 }
 
-int
-schnur_expand (struct schnur* self) {
-	schnur_wide_t* buffer;
+/*
+	Writes the n characters of src with edits applied to dst, front to back.
+	dst might equal src, if no edit moves characters to the right.
+*/
+static size_t
+__schnur_edit_forward (schnur_wide_t* dst, const schnur_wide_t* src, size_t n,
+	const struct schnur_edit* edits, size_t count) {
+	size_t i, w = 0, r = 0;
 
-	if (NULL == self) {
-		return 0;
+	for (i = 0; i < count; ++i) {
+		size_t kept = edits[i].begin - r;
+
+		if (0 < kept && dst + w != src + r) {
+			memmove (dst + w, src + r, kept * sizeof (schnur_wide_t));
+		}
+		w += kept;
+		if (0 < edits[i].replacement.length) {
+			memcpy (dst + w, edits[i].replacement.data,
+				edits[i].replacement.length * sizeof (schnur_wide_t));
+		}
+		w += edits[i].replacement.length;
+		r = edits[i].end;
 	}
 
-	buffer = calloc (
-		self->capacity + SCHNUR_BLOCK_SIZE,
-		sizeof (schnur_wide_t)
-	);
-	if (NULL == buffer) {
-		return 0;
+	if (r < n && dst + w != src + r) {
+		memmove (dst + w, src + r, (n - r) * sizeof (schnur_wide_t));
 	}
 
-	wcsncpy (buffer, self->data, self->length);
-	buffer[self->length] = SCHNUR_W ('\0');
+	return w + n - r;
+}
 
-	free (self->data);
+/*
+	Applies edits to the n characters of data in place, back to front, so
+	the result of length characters is able to grow into spare capacity.
+	No edit may move characters to the left.
+*/
+static void
+__schnur_edit_backward (schnur_wide_t* data, size_t n, size_t length,
+	const struct schnur_edit* edits, size_t count) {
+	size_t w = length, r = n;
 
-	self->data = buffer;
-	self->capacity += SCHNUR_BLOCK_SIZE;
+	while (0 < count--) {
+		size_t kept = r - edits[count].end;
 
-	return 1;
+		w -= kept;
+		if (0 < kept && w != edits[count].end) {
+			memmove (data + w, data + edits[count].end, kept * sizeof (schnur_wide_t));
+		}
+		w -= edits[count].replacement.length;
+		if (0 < edits[count].replacement.length) {
+			memcpy (data + w, edits[count].replacement.data,
+				edits[count].replacement.length * sizeof (schnur_wide_t));
+		}
+		r = edits[count].begin;
+	}
 }
 
 int
-schnur_compact (struct schnur* self) {
-	size_t diff, memoff;
-	schnur_wide_t* buffer;
-
-	if (NULL == self) {
+schnur_apply_edits (struct schnur* self, const struct schnur_edit* edits, size_t count) {
+	struct __schnur_edit_target target;
+	schnur_wide_t* dst;
+	size_t i, length, end = 0;
+	int forward = 1, backward = 1, aliased = 0;
+	// Net number of characters added by the edits so far.
+	ptrdiff_t shift = 0;
+
+	if (NULL == self || (NULL == edits && 0 < count)) {
 		return 0;
 	}
 
-	diff = self->capacity - (self->length + 1); // \0
+	length = self->length;
+	for (i = 0; i < count; ++i) {
+		const struct schnur_edit* e = &edits[i];
 
-	memoff = diff % SCHNUR_BLOCK_SIZE;
-	if (memoff > 0) {
-		buffer = realloc (self->data,
-			sizeof (schnur_wide_t) * (self->length + 1 + memoff) // len + \0 + offset
-		);
-		if (NULL == buffer) {
+		if (e->begin < end || e->begin > e->end || e->end > self->length
+		 || (NULL == e->replacement.data && 0 < e->replacement.length)) {
 			return 0;
 		}
+		end = e->end;
 
-		//wcsncpy (buffer, self->data, self->length + 1 + memoff);
-
-		//free (self->data);
-		self->data = buffer;
-
-		self->capacity = self->length + 1 + memoff;
+		length -= e->end - e->begin;
+		if (e->replacement.length > SCHNUR_EDIT_MAX_LENGTH - length) {
+			return 0;
+		}
+		length += e->replacement.length;
+
+		// Writing front to back must not overtake reading, and the same
+		// holds back to front, where characters are written behind them.
+		shift += (ptrdiff_t)e->replacement.length - (ptrdiff_t)(e->end - e->begin);
+		forward &= 0 >= shift;
+		backward &= 0 <= shift;
+		aliased |= __schnur_aliases (self, e->replacement);
+	}
 
+	if (0 == count) {
 		return 1;
 	}
 
-	return 0;
-}
+	__schnur_forget_hash (self);
 
-int
-schnur_copy (struct schnur* self, const struct schnur* other) {
-	if (NULL == self || NULL == other) {
-		return 0;
+	if (! aliased && ! __schnur_is_shared (self)) {
+		if (forward) {
+			__schnur_edit_forward (__schnur_data (self), __schnur_data (self),
+				self->length, edits, count);
+			self->length = length;
+			__schnur_data (self)[length] = SCHNUR_W ('\0');
+			return 1;
+		}
+		if (backward && self->capacity > length) {
+			__schnur_edit_backward (__schnur_data (self), self->length, length, edits, count);
+			self->length = length;
+			__schnur_data (self)[length] = SCHNUR_W ('\0');
+			return 1;
+		}
 	}
 
-	while (self->capacity <= other->length) {
-		if (! schnur_expand (self)) {
-			return 0;
-		}
+	dst = __schnur_edit_target_begin (self, &target, length);
+	if (NULL == dst) {
+		return 0;
 	}
 
-	wcsncpy (self->data, other->data, other->length);
-	self->length = other->length;
-	self->data[self->length] = SCHNUR_W ('\0');
+	__schnur_edit_forward (dst, __schnur_data (self), self->length, edits, count);
+	__schnur_edit_target_commit (self, &target, length);
+	__schnur_data (self)[length] = SCHNUR_W ('\0');
 
 	return 1;
 }
 
 int
-schnur_copy_cstr (struct schnur* self, const schnur_wide_t* other) {
-	size_t ol;
+schnur_replace_all (struct schnur* self, struct schnur_view needle,
+	struct schnur_view replacement) {
+	struct __schnur_edit_target target;
+	const schnur_wide_t* src;
+	schnur_wide_t* dst;
+	size_t count, length, found, w = 0, r = 0;
+
+	if (NULL == self || 0 == needle.length || NULL == needle.data
+	 || (NULL == replacement.data && 0 < replacement.length)) {
+		return 0;
+	}
 
-	if (NULL == self || NULL == other) {
+	count = schnur_view_count (schnur_view_of (self), needle);
+	if (0 == count) {
+		return 1;
+	}
+
+	length = self->length - count * needle.length;
+	if (replacement.length > (SCHNUR_EDIT_MAX_LENGTH - length) / count) {
 		return 0;
 	}
+	length += count * replacement.length;
 
-	ol = wcslen (other);
+	__schnur_forget_hash (self);
 
-	while (self->capacity <= ol) {
-		if (! schnur_expand (self)) {
+	src = __schnur_data (self);
+	if (replacement.length <= needle.length
+	 && ! __schnur_is_shared (self)
+	 && ! __schnur_aliases (self, needle)
+	 && ! __schnur_aliases (self, replacement)) {
+		// Never writes beyond the characters searched already.
+		dst = __schnur_data (self);
+	}
+	else {
+		dst = __schnur_edit_target_begin (self, &target, length);
+		if (NULL == dst) {
 			return 0;
 		}
 	}
 
-	wcsncpy (self->data, other, ol);
-	self->length = ol;
-	self->data[self->length] = L'\0';
+	while (SCHNUR_NOT_FOUND != (found = schnur_view_find (
+		schnur_view_n (src, self->length), needle, r))) {
+		if (found > r && dst + w != src + r) {
+			memmove (dst + w, src + r, (found - r) * sizeof (schnur_wide_t));
+		}
+		w += found - r;
+		if (0 < replacement.length) {
+			memcpy (dst + w, replacement.data, replacement.length * sizeof (schnur_wide_t));
+		}
+		w += replacement.length;
+		r = found + needle.length;
+	}
+	if (r < self->length && dst + w != src + r) {
+		memmove (dst + w, src + r, (self->length - r) * sizeof (schnur_wide_t));
+	}
+
+	if (dst != src) {
+		__schnur_edit_target_commit (self, &target, length);
+	}
+	self->length = length;
+	__schnur_data (self)[length] = SCHNUR_W ('\0');
 
 	return 1;
 }
 
-int
-schnur_append (struct schnur* self, schnur_wide_t c) {
-	if (NULL == self) {
+/*
+	Computes the number of characters of count parts joined by separator,
+	checks the views and whether any of them points into self. Returns 0 if
+	the views are invalid or the result is too long.
+*/
+static int
+__schnur_join_length (const struct schnur* self, struct schnur_view separator,
+	const struct schnur_view* parts, size_t count, size_t* length, int* aliased) {
+	size_t i, n = 0;
+
+	if ((NULL == parts && 0 < count)
+	 || (NULL == separator.data && 0 < separator.length)) {
 		return 0;
 	}
 
-	if ((self->length + 1) >= self->capacity) {
-		if (! schnur_expand (self)) {
+	*aliased = NULL != self && 1 < count && __schnur_aliases (self, separator);
+	for (i = 0; i < count; ++i) {
+		size_t part = parts[i].length;
+
+		if (NULL == parts[i].data && 0 < part) {
+			return 0;
+		}
+		if (0 < i) {
+			part += separator.length;
+			if (part < separator.length) {
+				return 0;
+			}
+		}
+		if (part > SCHNUR_EDIT_MAX_LENGTH - n) {
 			return 0;
 		}
+		n += part;
+		if (NULL != self) {
+			*aliased |= __schnur_aliases (self, parts[i]);
+		}
 	}
 
-	self->data[self->length++] = c;
-	self->data[self->length] = SCHNUR_W ('\0');
+	*length = n;
 
 	return 1;
 }
 
+/*
+	Writes count parts joined by separator to dst.
+*/
+static void
+__schnur_join_into (schnur_wide_t* dst, struct schnur_view separator,
+	const struct schnur_view* parts, size_t count) {
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		if (0 < i && 0 < separator.length) {
+			memcpy (dst, separator.data, separator.length * sizeof (schnur_wide_t));
+			dst += separator.length;
+		}
+		if (0 < parts[i].length) {
+			memcpy (dst, parts[i].data, parts[i].length * sizeof (schnur_wide_t));
+			dst += parts[i].length;
+		}
+	}
+}
+
 int
-schnur_append_cstr (struct schnur* self, const schnur_wide_t* other) {
-	size_t len, i;
+schnur_append_join (struct schnur* self, struct schnur_view separator,
+	const struct schnur_view* parts, size_t count) {
+	struct __schnur_edit_target target;
+	schnur_wide_t* dst;
+	size_t n, length;
+	int aliased;
 
 	if (NULL == self
-	 || NULL == other) {
+	 || ! __schnur_join_length (self, separator, parts, count, &n, &aliased)
+	 || n > SCHNUR_EDIT_MAX_LENGTH - self->length) {
 		return 0;
 	}
 
-	len = wcslen (other);
-	if (0 == len) {
+	if (0 == n) {
 		return 1;
 	}
 
-	while (self->capacity < (self->length + len + 1)) {
-		schnur_expand (self);
+	length = self->length + n;
+	if (! aliased || (self->capacity > length && ! __schnur_is_shared (self))) {
+		// Parts do not move, if they point into self.
+		if (! __schnur_grow (self, length)) {
+			return 0;
+		}
+		__schnur_join_into (__schnur_data (self) + self->length, separator, parts, count);
 	}
-
-	for (i = 0; i < len; ++i) {
-		self->data[self->length + i] = other[i];
+	else {
+		// Growing would move parts pointing into self, so assemble the
+		// result next to the current storage.
+		__schnur_forget_hash (self);
+		dst = __schnur_edit_target_begin (self, &target, length);
+		if (NULL == dst) {
+			return 0;
+		}
+		memcpy (dst, __schnur_data (self), self->length * sizeof (schnur_wide_t));
+		__schnur_join_into (dst + self->length, separator, parts, count);
+		__schnur_edit_target_commit (self, &target, length);
 	}
-	self->data[self->length + len] = SCHNUR_W ('\0');
-	self->length += len;
+
+	self->length = length;
+	__schnur_data (self)[length] = SCHNUR_W ('\0');
 
 	return 1;
 }
 
 int
-schnur_append_string (struct schnur* self, const struct schnur* other) {
-	size_t i;
+schnur_append_many (struct schnur* self, const struct schnur_view* parts, size_t count) {
+	struct schnur_view none = { NULL, 0 };
 
-	if (NULL == self
-	 || NULL == other) {
-		return 0;
-	}
+	return schnur_append_join (self, none, parts, count);
+}
+
+struct schnur*
+schnur_join (struct schnur_view separator, const struct schnur_view* parts, size_t count) {
+	struct schnur* s;
+	size_t n;
+	int aliased;
 
-	while (self->capacity < (self->length + other->length + 1)) {
-		schnur_expand (self);
+	if (! __schnur_join_length (NULL, separator, parts, count, &n, &aliased)) {
+		return NULL;
 	}
 
-	for (i = 0; i < other->length; ++i) {
-		self->data[self->length + i] = other->data[i];
+	s = __schnur_new (n + 1, g_allocator);
+	if (NULL == s) {
+		return NULL;
 	}
-	self->length += other->length;
 
-	return 1;
+	__schnur_join_into (__schnur_data (s), separator, parts, count);
+	s->length = n;
+	__schnur_data (s)[n] = SCHNUR_W ('\0');
+
+	return s;
 }
 
 int
-schnur_equal_cstr (const struct schnur* self, const schnur_wide_t* other) {
-	size_t ol;
+schnur_vappendf (struct schnur* self, const schnur_wide_t* format, va_list args) {
+	struct __schnur_edit_target target;
+	schnur_wide_t* spare = NULL;
+	schnur_wide_t* dst;
+	size_t n, cap = 0;
+	va_list retry;
+
+	if (NULL == self || NULL == format) {
+		return 0;
+	}
 
-	if (NULL == self
-	 || NULL == other) {
+	if (! __schnur_is_shared (self)) {
+		spare = __schnur_data (self) + self->length;
+		cap = self->capacity - self->length;
+	}
+
+	va_copy (retry, args);
+	if (schnur_vformat_into (spare, cap, &n, format, args)) {
+		va_end (retry);
+		__schnur_forget_hash (self);
+		self->length += n;
+		return 1;
+	}
+
+	// The first attempt might have overwritten the terminator, if it had
+	// room in storage of our own.
+	if (0 < cap) {
+		spare[0] = SCHNUR_W ('\0');
+	}
+
+	if (SCHNUR_FORMAT_INVALID == n || n > SCHNUR_EDIT_MAX_LENGTH - self->length) {
+		va_end (retry);
+		return 0;
+	}
+
+	// Arguments might point into self, so format next to the current
+	// storage instead of growing it.
+	dst = __schnur_edit_target_begin (self, &target, self->length + n);
+	if (NULL == dst) {
+		va_end (retry);
 		return 0;
 	}
+	memcpy (dst, __schnur_data (self), self->length * sizeof (schnur_wide_t));
+	schnur_vformat_into (dst + self->length, n + 1, NULL, format, retry);
+	va_end (retry);
 
-	ol = wcslen (other);
+	__schnur_forget_hash (self);
+	__schnur_edit_target_commit (self, &target, self->length + n);
+	__schnur_data (self)[self->length] = SCHNUR_W ('\0');
 
-	return self->length == ol
-		&& 0 == wcsncmp (self->data, other, ol);
+	return 1;
 }
 
 int
-schnur_equal (const struct schnur* self, const struct schnur* other) {
-	if (NULL == self
-	 || NULL == other) {
-		return 0;
-	}
+schnur_appendf (struct schnur* self, const schnur_wide_t* format, ...) {
+	va_list args;
+	int result;
 
-	return self->length == other->length
-		&& 0 == wcsncmp (self->data, other->data, self->length);
+	va_start (args, format);
+	result = schnur_vappendf (self, format, args);
+	va_end (args);
+
+	return result;
 }
 
 int
@@ -561,13 +1892,17 @@ schnur_reverse (struct schnur* self) {
 		return 1;
 	}
 
+	if (! __schnur_prepare_write (self)) {
+		return 0;
+	}
+
 	i = 0;
 	n = self->length - 1;
 	mid = self->length / 2;
 	while (i < mid) {
-		buffer        = self->data[i];
-		self->data[i] = self->data[n];
-		self->data[n] = buffer;
+		buffer        = __schnur_data (self)[i];
+		__schnur_data (self)[i] = __schnur_data (self)[n];
+		__schnur_data (self)[n] = buffer;
 
 		--n;
 		++i;
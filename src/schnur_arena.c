@@ -0,0 +1,251 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/// Number of bytes requested from the system at once, if not specified.
+#define SCHNUR_ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+/// Alignment of every allocation handed out by an arena.
+#define SCHNUR_ARENA_ALIGNMENT 16
+
+#define SCHNUR_ARENA_ALIGN(n) \
+	(((n) + (SCHNUR_ARENA_ALIGNMENT - 1)) & ~(size_t)(SCHNUR_ARENA_ALIGNMENT - 1))
+
+/**
+	@brief: A chunk of memory requested from the system.
+*/
+struct schnur_arena_block {
+	/**
+		@brief: Next block in chain, kept for reuse after a reset.
+	*/
+	struct schnur_arena_block* next;
+
+	/**
+		@brief: Number of usable bytes following the block header.
+	*/
+	size_t size;
+};
+
+/**
+	@brief: An arena handing out memory by bumping an offset.
+*/
+struct schnur_arena {
+	/**
+		@brief: Allocator interface, with this arena as context.
+	*/
+	struct schnur_allocator allocator;
+
+	/**
+		@brief: Minimum number of usable bytes per block.
+	*/
+	size_t block_size;
+
+	/**
+		@brief: First block in chain, NULL until first allocation.
+	*/
+	struct schnur_arena_block* first;
+
+	/**
+		@brief: Block allocations are currently bumped from.
+	*/
+	struct schnur_arena_block* current;
+
+	/**
+		@brief: Number of bytes used in current block.
+	*/
+	size_t offset;
+
+	/**
+		@brief: Most recent allocation, which can be resized or released in
+				  place. NULL if there is none.
+	*/
+	void* last;
+
+	/**
+		@brief: Offset in current block before the most recent allocation.
+	*/
+	size_t last_offset;
+};
+
+static size_t
+__schnur_arena_header_size (void) {
+	return SCHNUR_ARENA_ALIGN (sizeof (struct schnur_arena_block));
+}
+
+static char*
+__schnur_arena_block_data (struct schnur_arena_block* block) {
+	return (char*)block + __schnur_arena_header_size ();
+}
+
+/*
+	Makes the next block in chain, able to hold size bytes, the current one.
+	Reuses blocks left over from a reset if possible.
+*/
+static int
+__schnur_arena_next_block (struct schnur_arena* arena, size_t size) {
+	struct schnur_arena_block* block;
+	size_t usable = size < arena->block_size ? arena->block_size : size;
+
+	block = NULL != arena->current ? arena->current->next : arena->first;
+	if (NULL == block || block->size < size) {
+		if (usable > SIZE_MAX - __schnur_arena_header_size ()) {
+			return 0;
+		}
+		block = malloc (__schnur_arena_header_size () + usable);
+		if (NULL == block) {
+			return 0;
+		}
+		block->size = usable;
+
+		// Insert after current block, keeping the rest for later reuse.
+		if (NULL == arena->current) {
+			block->next = arena->first;
+			arena->first = block;
+		}
+		else {
+			block->next = arena->current->next;
+			arena->current->next = block;
+		}
+	}
+
+	arena->current = block;
+	arena->offset = 0;
+
+	return 1;
+}
+
+static void*
+__schnur_arena_allocate (void* context, size_t size) {
+	struct schnur_arena* arena = context;
+	void* p;
+
+	if (size > SIZE_MAX - SCHNUR_ARENA_ALIGNMENT) {
+		return NULL;
+	}
+	size = SCHNUR_ARENA_ALIGN (0 == size ? 1 : size);
+
+	if (NULL == arena->current
+	 || arena->current->size - arena->offset < size) {
+		if (! __schnur_arena_next_block (arena, size)) {
+			return NULL;
+		}
+	}
+
+	p = __schnur_arena_block_data (arena->current) + arena->offset;
+	arena->last = p;
+	arena->last_offset = arena->offset;
+	arena->offset += size;
+
+	return p;
+}
+
+static void*
+__schnur_arena_reallocate (void* context, void* p, size_t old_size, size_t size) {
+	struct schnur_arena* arena = context;
+	void* q;
+
+	if (NULL == p) {
+		return __schnur_arena_allocate (context, size);
+	}
+
+	// The most recent allocation grows or shrinks in place, if it fits.
+	if (p == arena->last
+	 && size <= SIZE_MAX - SCHNUR_ARENA_ALIGNMENT
+	 && arena->current->size - arena->last_offset
+		>= SCHNUR_ARENA_ALIGN (0 == size ? 1 : size)) {
+		arena->offset = arena->last_offset
+			+ SCHNUR_ARENA_ALIGN (0 == size ? 1 : size);
+		return p;
+	}
+
+	q = __schnur_arena_allocate (context, size);
+	if (NULL == q) {
+		return NULL;
+	}
+	memcpy (q, p, old_size < size ? old_size : size);
+
+	return q;
+}
+
+static void
+__schnur_arena_release (void* context, void* p) {
+	struct schnur_arena* arena = context;
+
+	// Only the most recent allocation is given back, everything else is
+	// released on reset.
+	if (NULL != p && p == arena->last) {
+		arena->offset = arena->last_offset;
+		arena->last = NULL;
+	}
+}
+
+struct schnur_arena*
+schnur_arena_new (size_t block_size) {
+	struct schnur_arena* arena = malloc (sizeof (struct schnur_arena));
+	if (NULL == arena) {
+		return NULL;
+	}
+
+	arena->allocator.allocate = __schnur_arena_allocate;
+	arena->allocator.reallocate = __schnur_arena_reallocate;
+	arena->allocator.release = __schnur_arena_release;
+	arena->allocator.context = arena;
+	arena->block_size = 0 == block_size
+		? SCHNUR_ARENA_DEFAULT_BLOCK_SIZE
+		: SCHNUR_ARENA_ALIGN (block_size);
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->offset = 0;
+	arena->last = NULL;
+	arena->last_offset = 0;
+
+	return arena;
+}
+
+int
+schnur_arena_free (struct schnur_arena* arena) {
+	struct schnur_arena_block* block;
+
+	if (NULL == arena) {
+		return 0;
+	}
+
+	block = arena->first;
+	while (NULL != block) {
+		struct schnur_arena_block* next = block->next;
+		free (block);
+		block = next;
+	}
+
+	free (arena);
+
+	return 1;
+}
+
+int
+schnur_arena_reset (struct schnur_arena* arena) {
+	if (NULL == arena) {
+		return 0;
+	}
+
+	arena->current = arena->first;
+	arena->offset = 0;
+	arena->last = NULL;
+	arena->last_offset = 0;
+
+	return 1;
+}
+
+const struct schnur_allocator*
+schnur_arena_allocator (struct schnur_arena* arena) {
+	if (NULL == arena) {
+		return NULL;
+	}
+
+	return &arena->allocator;
+}
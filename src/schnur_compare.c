@@ -0,0 +1,290 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+#include "schnur_cpu.h"
+
+#include <string.h>
+#include <stdint.h>
+
+/*
+	A kernel returns the index of the first character differing between a
+	and b, both holding at least n characters, or n if there is none.
+
+	Vectorized kernels compare bytes, so they work for any size of wchar_t:
+	the first differing byte lies within the first differing character.
+*/
+typedef size_t (*__schnur_compare_kernel) (const schnur_wide_t* a,
+	const schnur_wide_t* b, size_t n);
+
+static inline int
+__schnur_compare_lowest_bit (uint32_t mask) {
+#if defined(__GNUC__)
+	return __builtin_ctz (mask);
+#else
+	int i = 0;
+	while (0 == (mask & 1)) {
+		mask >>= 1;
+		++i;
+	}
+	return i;
+#endif
+}
+
+/// Number of characters in a 64-bit word.
+#define SCHNUR_COMPARE_WORD (sizeof (uint64_t) / sizeof (schnur_wide_t))
+
+static size_t
+__schnur_compare_mismatch_scalar (const schnur_wide_t* a, const schnur_wide_t* b, size_t n) {
+	size_t i;
+
+	for (i = 0; SCHNUR_COMPARE_WORD <= n - i; i += SCHNUR_COMPARE_WORD) {
+		uint64_t x, y;
+		memcpy (&x, a + i, sizeof (x));
+		memcpy (&y, b + i, sizeof (y));
+		if (x != y) {
+			break;
+		}
+	}
+
+	while (i < n && a[i] == b[i]) {
+		++i;
+	}
+
+	return i;
+}
+
+#if defined(SCHNUR_CPU_SSE2)
+/// Number of characters in a 128-bit register.
+#define SCHNUR_COMPARE_SSE2_STEP (16 / sizeof (schnur_wide_t))
+
+static inline size_t
+__schnur_compare_sse2_at (const schnur_wide_t* a, const schnur_wide_t* b, size_t i) {
+	uint32_t equal = (uint32_t)_mm_movemask_epi8 (_mm_cmpeq_epi8 (
+		_mm_loadu_si128 ((const __m128i*)(a + i)),
+		_mm_loadu_si128 ((const __m128i*)(b + i))));
+
+	return 0xFFFFu == equal
+		? SIZE_MAX
+		: i + __schnur_compare_lowest_bit (~equal) / sizeof (schnur_wide_t);
+}
+
+/*
+	SSE2: Compares two registers per step, 32 bytes. The remainder is covered
+	by a last register overlapping already compared characters, instead of a
+	scalar loop.
+*/
+static size_t
+__schnur_compare_mismatch_sse2 (const schnur_wide_t* a, const schnur_wide_t* b, size_t n) {
+	const size_t step = SCHNUR_COMPARE_SSE2_STEP;
+	size_t i, k;
+
+	if (n < step) {
+		return __schnur_compare_mismatch_scalar (a, b, n);
+	}
+
+	for (i = 0; 2 * step <= n - i; i += 2 * step) {
+		__m128i e0 = _mm_cmpeq_epi8 (
+			_mm_loadu_si128 ((const __m128i*)(a + i)),
+			_mm_loadu_si128 ((const __m128i*)(b + i)));
+		__m128i e1 = _mm_cmpeq_epi8 (
+			_mm_loadu_si128 ((const __m128i*)(a + i + step)),
+			_mm_loadu_si128 ((const __m128i*)(b + i + step)));
+		uint32_t equal = (uint32_t)_mm_movemask_epi8 (e0)
+			| (uint32_t)_mm_movemask_epi8 (e1) << 16;
+
+		if (0xFFFFFFFFu != equal) {
+			return i + __schnur_compare_lowest_bit (~equal) / sizeof (schnur_wide_t);
+		}
+	}
+
+	if (step <= n - i) {
+		k = __schnur_compare_sse2_at (a, b, i);
+		if (SIZE_MAX != k) {
+			return k;
+		}
+		i += step;
+	}
+
+	if (i < n) {
+		k = __schnur_compare_sse2_at (a, b, n - step);
+		if (SIZE_MAX != k) {
+			return k;
+		}
+	}
+
+	return n;
+}
+#endif
+
+#if defined(SCHNUR_CPU_AVX2)
+/// Number of characters in a 256-bit register.
+#define SCHNUR_COMPARE_AVX2_STEP (32 / sizeof (schnur_wide_t))
+
+SCHNUR_CPU_TARGET_AVX2 static inline size_t
+__schnur_compare_avx2_at (const schnur_wide_t* a, const schnur_wide_t* b, size_t i) {
+	uint32_t equal = (uint32_t)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (
+		_mm256_loadu_si256 ((const __m256i*)(a + i)),
+		_mm256_loadu_si256 ((const __m256i*)(b + i))));
+
+	return 0xFFFFFFFFu == equal
+		? SIZE_MAX
+		: i + __schnur_compare_lowest_bit (~equal) / sizeof (schnur_wide_t);
+}
+
+/*
+	AVX2: Compares two registers per step, 64 bytes. The equality masks are
+	combined first, so the common case of a full match costs one branch.
+	Inputs shorter than a register are left to SSE2, which avoids mixing
+	both instruction sets within a call.
+*/
+SCHNUR_CPU_TARGET_AVX2 static size_t
+__schnur_compare_mismatch_avx2 (const schnur_wide_t* a, const schnur_wide_t* b, size_t n) {
+	const size_t step = SCHNUR_COMPARE_AVX2_STEP;
+	size_t i, k;
+
+	if (n < step) {
+		return __schnur_compare_mismatch_sse2 (a, b, n);
+	}
+
+	for (i = 0; 2 * step <= n - i; i += 2 * step) {
+		__m256i e0 = _mm256_cmpeq_epi8 (
+			_mm256_loadu_si256 ((const __m256i*)(a + i)),
+			_mm256_loadu_si256 ((const __m256i*)(b + i)));
+		__m256i e1 = _mm256_cmpeq_epi8 (
+			_mm256_loadu_si256 ((const __m256i*)(a + i + step)),
+			_mm256_loadu_si256 ((const __m256i*)(b + i + step)));
+
+		if (-1 != _mm256_movemask_epi8 (_mm256_and_si256 (e0, e1))) {
+			uint32_t equal = (uint32_t)_mm256_movemask_epi8 (e0);
+			if (0xFFFFFFFFu != equal) {
+				return i + __schnur_compare_lowest_bit (~equal) / sizeof (schnur_wide_t);
+			}
+			equal = (uint32_t)_mm256_movemask_epi8 (e1);
+			return i + step + __schnur_compare_lowest_bit (~equal) / sizeof (schnur_wide_t);
+		}
+	}
+
+	if (step <= n - i) {
+		k = __schnur_compare_avx2_at (a, b, i);
+		if (SIZE_MAX != k) {
+			return k;
+		}
+		i += step;
+	}
+
+	if (i < n) {
+		k = __schnur_compare_avx2_at (a, b, n - step);
+		if (SIZE_MAX != k) {
+			return k;
+		}
+	}
+
+	return n;
+}
+#endif
+
+static __schnur_compare_kernel g_mismatch = NULL;
+
+/*
+	Selects the widest kernel supported by the running CPU.
+*/
+static __schnur_compare_kernel
+__schnur_compare_mismatch (void) {
+	__schnur_compare_kernel kernel = g_mismatch;
+
+	if (NULL == kernel) {
+		kernel = __schnur_compare_mismatch_scalar;
+#if defined(SCHNUR_CPU_SSE2)
+		kernel = __schnur_compare_mismatch_sse2;
+#endif
+#if defined(SCHNUR_CPU_AVX2)
+		if (__schnur_cpu_has_avx2 ()) {
+			kernel = __schnur_compare_mismatch_avx2;
+		}
+#endif
+		g_mismatch = kernel;
+	}
+
+	return kernel;
+}
+
+/*
+	Maps a character to a key ordered like code points. With UTF-16, units
+	of surrogate pairs (U+10000 and up) have to sort after U+E000 - U+FFFF.
+*/
+static inline uint32_t
+__schnur_compare_key (schnur_wide_t c) {
+	uint32_t u = (uint32_t)c;
+#if WCHAR_MAX <= 0xFFFF
+	u &= 0xFFFF;
+	if (0xD800 <= u) {
+		u = 0xE000 <= u ? u - 0x800 : u + 0x2000;
+	}
+#endif
+	return u;
+}
+
+size_t
+schnur_view_mismatch (struct schnur_view a, struct schnur_view b) {
+	size_t n = a.length < b.length ? a.length : b.length;
+
+	if (0 == n || a.data == b.data) {
+		return n;
+	}
+
+	return __schnur_compare_mismatch () (a.data, b.data, n);
+}
+
+int
+schnur_view_compare (struct schnur_view a, struct schnur_view b) {
+	size_t i = schnur_view_mismatch (a, b);
+	uint32_t x, y;
+
+	if (i == a.length || i == b.length) {
+		return (a.length > b.length) - (a.length < b.length);
+	}
+
+	x = __schnur_compare_key (a.data[i]);
+	y = __schnur_compare_key (b.data[i]);
+
+	return (x > y) - (x < y);
+}
+
+int
+schnur_compare (const struct schnur* self, const struct schnur* other) {
+	return schnur_view_compare (schnur_view_of (self), schnur_view_of (other));
+}
+
+int
+schnur_view_starts_with (struct schnur_view view, struct schnur_view prefix) {
+	return prefix.length <= view.length
+		&& prefix.length == schnur_view_mismatch (view, prefix);
+}
+
+int
+schnur_view_ends_with (struct schnur_view view, struct schnur_view suffix) {
+	return suffix.length <= view.length
+		&& schnur_view_starts_with (
+			schnur_view_slice (view, view.length - suffix.length, view.length),
+			suffix);
+}
+
+int
+schnur_starts_with (const struct schnur* self, struct schnur_view prefix) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_view_starts_with (schnur_view_of (self), prefix);
+}
+
+int
+schnur_ends_with (const struct schnur* self, struct schnur_view suffix) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_view_ends_with (schnur_view_of (self), suffix);
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include "schnur_cpu.h"
+
+#if defined(SCHNUR_CPU_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/// Cached result of __schnur_cpu_has_avx2, -1 until detected.
+static int g_has_avx2 = -1;
+
+static int
+__schnur_cpu_detect_avx2 (void) {
+#if ! defined(SCHNUR_CPU_AVX2)
+	return 0;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid (info, 0);
+	if (7 > info[0]) {
+		return 0;
+	}
+	__cpuid (info, 1);
+	// OSXSAVE and AVX, then check the OS saves YMM registers.
+	if (0x18000000 != (info[2] & 0x18000000)
+	 || 0x6 != (_xgetbv (0) & 0x6)) {
+		return 0;
+	}
+	__cpuidex (info, 7, 0);
+	return 0 != (info[1] & (1 << 5));
+#else
+	__builtin_cpu_init ();
+	return __builtin_cpu_supports ("avx2");
+#endif
+}
+
+int
+__schnur_cpu_has_avx2 (void) {
+	int has = g_has_avx2;
+
+	if (0 > has) {
+		has = 0 != __schnur_cpu_detect_avx2 ();
+		g_has_avx2 = has;
+	}
+
+	return has;
+}
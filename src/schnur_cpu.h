@@ -0,0 +1,38 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+/*
+	Internal: instruction sets available to the vectorized kernels. Not part
+	of the public interface.
+*/
+
+#ifndef SCHNUR_CPU_H
+#define SCHNUR_CPU_H
+
+#if defined(__x86_64__) || defined(_M_X64) \
+ || (defined(__i386__) && defined(__SSE2__)) \
+ || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+/// SSE2 is available at compile time.
+#define SCHNUR_CPU_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(_MSC_VER)
+/// AVX2 kernels are compiled and selected at runtime.
+#define SCHNUR_CPU_AVX2 1
+#include <immintrin.h>
+#if defined(__GNUC__)
+/// Compiles a function for AVX2, whatever the target of the build.
+#define SCHNUR_CPU_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#else
+#define SCHNUR_CPU_TARGET_AVX2
+#endif
+#endif
+#endif
+
+/*
+	Tells whether the running CPU and OS support AVX2. Detects it once, then
+	answers from cache. Always 0 if SCHNUR_CPU_AVX2 is not defined.
+*/
+int
+__schnur_cpu_has_avx2 (void);
+
+#endif
@@ -0,0 +1,585 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) \
+ || (defined(__i386__) && defined(__SSE2__)) \
+ || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+/// SSE2 is available at compile time.
+#define SCHNUR_FIND_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/// Needles up to this length are searched by filtering candidates on their
+/// first and last character. Longer ones use the Two-Way algorithm.
+#define SCHNUR_FIND_SHORT_NEEDLE 32
+
+/**
+	@brief: Preprocessed needle for the Two-Way algorithm in one direction.
+			  Splits the needle at a critical factorization needle[0, suffix)
+			  and needle[suffix, length), so that a mismatch in the right half
+			  allows shifting by the distance matched, and a mismatch in the
+			  left half by the period.
+*/
+struct schnur_needle_factor {
+	/**
+		@brief: Start of the right half.
+	*/
+	size_t suffix;
+
+	/**
+		@brief: Period of the needle, if periodic, otherwise a safe shift.
+	*/
+	size_t period;
+
+	/**
+		@brief: Whether the left half repeats within the right half.
+	*/
+	int periodic;
+
+	/**
+		@brief: Shift for the haystack character aligned with the end of the
+				  needle, indexed by its low byte. Colliding characters share
+				  the smallest shift, so shifts are never too long.
+	*/
+	size_t shift[256];
+};
+
+struct schnur_needle {
+	const struct schnur_allocator* allocator;
+
+	size_t length;
+
+	/**
+		@brief: Factorizations for searching forwards and backwards. Only set
+				  for needles longer than SCHNUR_FIND_SHORT_NEEDLE.
+	*/
+	struct schnur_needle_factor forward;
+	struct schnur_needle_factor backward;
+
+	schnur_wide_t data[];
+};
+
+/*
+	Character i of p holding n characters, counted from the end if reverse.
+	Called with constant reverse only, so the branch folds away.
+*/
+static inline uint32_t
+__schnur_find_at (const schnur_wide_t* p, size_t n, size_t i, int reverse) {
+	return (uint32_t)(reverse ? p[n - 1 - i] : p[i]);
+}
+
+/*
+	Computes the maximal suffix of x under the order given by flip, and the
+	period of that suffix. Returns its start.
+*/
+static inline size_t
+__schnur_find_maximal_suffix (const schnur_wide_t* x, size_t m, int reverse,
+	int flip, size_t* period) {
+	size_t max_suffix = SIZE_MAX;
+	size_t j = 0, k = 1, p = 1;
+
+	while (j + k < m) {
+		uint32_t a = __schnur_find_at (x, m, j + k, reverse);
+		uint32_t b = __schnur_find_at (x, m, max_suffix + k, reverse);
+
+		if (flip ? b < a : a < b) {
+			j += k;
+			k = 1;
+			p = j - max_suffix;
+		}
+		else if (a == b) {
+			if (k != p) {
+				++k;
+			}
+			else {
+				j += p;
+				k = 1;
+			}
+		}
+		else {
+			max_suffix = j++;
+			k = p = 1;
+		}
+	}
+
+	*period = p;
+
+	return max_suffix + 1;
+}
+
+static inline void
+__schnur_find_factorize (struct schnur_needle_factor* factor,
+	const schnur_wide_t* x, size_t m, int reverse) {
+	size_t period, period_flipped, suffix, suffix_flipped, i;
+
+	suffix = __schnur_find_maximal_suffix (x, m, reverse, 0, &period);
+	suffix_flipped = __schnur_find_maximal_suffix (x, m, reverse, 1, &period_flipped);
+	if (suffix < suffix_flipped) {
+		suffix = suffix_flipped;
+		period = period_flipped;
+	}
+
+	factor->suffix = suffix;
+	factor->periodic = period + suffix <= m;
+	for (i = 0; factor->periodic && i < suffix; ++i) {
+		factor->periodic = __schnur_find_at (x, m, i, reverse)
+			== __schnur_find_at (x, m, i + period, reverse);
+	}
+	factor->period = factor->periodic
+		? period
+		: (suffix > m - suffix ? suffix : m - suffix) + 1;
+
+	for (i = 0; i < 256; ++i) {
+		factor->shift[i] = m;
+	}
+	for (i = 0; i < m; ++i) {
+		factor->shift[__schnur_find_at (x, m, i, reverse) & 0xFF] = m - 1 - i;
+	}
+}
+
+/*
+	Two-Way search for needle x of length m in haystack h of length n, both
+	read backwards if reverse. Returns the position of the first match in
+	reading direction, or SCHNUR_NOT_FOUND. Runs in O(n + m), and usually
+	skips most of the haystack through the shift table.
+*/
+static inline size_t
+__schnur_find_two_way (const struct schnur_needle_factor* f,
+	const schnur_wide_t* x, size_t m, const schnur_wide_t* h, size_t n, int reverse) {
+	const size_t suffix = f->suffix;
+	const size_t period = f->period;
+	size_t memory = 0, j = 0, i, shift;
+
+	while (j <= n - m) {
+		shift = f->shift[__schnur_find_at (h, n, j + m - 1, reverse) & 0xFF];
+		if (0 < shift) {
+			// A periodic needle with a character out of place cannot match
+			// before the mismatch.
+			if (0 < memory && shift < period) {
+				shift = m - period;
+			}
+			memory = 0;
+			j += shift;
+			continue;
+		}
+
+		// The shift table only compares low bytes, so the last character
+		// still has to be checked.
+		i = suffix > memory ? suffix : memory;
+		while (i < m && __schnur_find_at (x, m, i, reverse)
+			== __schnur_find_at (h, n, i + j, reverse)) {
+			++i;
+		}
+
+		if (i < m) {
+			j += i - suffix + 1;
+			memory = 0;
+			continue;
+		}
+
+		for (i = suffix; memory < i && __schnur_find_at (x, m, i - 1, reverse)
+			== __schnur_find_at (h, n, i - 1 + j, reverse); --i) {}
+
+		if (i <= memory) {
+			return j;
+		}
+
+		j += period;
+		memory = f->periodic ? m - period : 0;
+	}
+
+	return SCHNUR_NOT_FOUND;
+}
+
+static inline int
+__schnur_find_lowest_bit (uint32_t mask) {
+#if defined(__GNUC__)
+	return __builtin_ctz (mask);
+#else
+	int i = 0;
+	while (0 == (mask & 1)) {
+		mask >>= 1;
+		++i;
+	}
+	return i;
+#endif
+}
+
+static inline int
+__schnur_find_highest_bit (uint32_t mask) {
+#if defined(__GNUC__)
+	return 31 - __builtin_clz (mask);
+#else
+	int i = 31;
+	while (0 == (mask & 0x80000000u)) {
+		mask <<= 1;
+		--i;
+	}
+	return i;
+#endif
+}
+
+/*
+	Checks the characters between first and last of a candidate.
+*/
+static inline int
+__schnur_find_inner_equal (const schnur_wide_t* candidate, const schnur_wide_t* x, size_t m) {
+	return 2 >= m || 0 == wmemcmp (candidate + 1, x + 1, m - 2);
+}
+
+#if defined(SCHNUR_FIND_SSE2)
+/// Number of characters in a 128-bit register.
+#define SCHNUR_FIND_STEP (16 / sizeof (schnur_wide_t))
+/// Bits of a byte mask set by a single matching character.
+#define SCHNUR_FIND_CHAR_BITS ((1u << sizeof (schnur_wide_t)) - 1)
+
+static inline __m128i
+__schnur_find_splat (schnur_wide_t c) {
+#if WCHAR_MAX > 0xFFFF
+	return _mm_set1_epi32 ((int)c);
+#else
+	return _mm_set1_epi16 ((short)c);
+#endif
+}
+
+static inline __m128i
+__schnur_find_cmpeq (__m128i a, __m128i b) {
+#if WCHAR_MAX > 0xFFFF
+	return _mm_cmpeq_epi32 (a, b);
+#else
+	return _mm_cmpeq_epi16 (a, b);
+#endif
+}
+
+/*
+	Bit set for every position p in [i, i + SCHNUR_FIND_STEP), at which h
+	holds the first and, m - 1 characters later, the last character.
+*/
+static inline uint32_t
+__schnur_find_candidates (const schnur_wide_t* h, size_t i, size_t m,
+	__m128i first, __m128i last) {
+	__m128i a = _mm_loadu_si128 ((const __m128i*)(h + i));
+	__m128i b = _mm_loadu_si128 ((const __m128i*)(h + i + m - 1));
+
+	return (uint32_t)_mm_movemask_epi8 (_mm_and_si128 (
+		__schnur_find_cmpeq (a, first), __schnur_find_cmpeq (b, last)));
+}
+#endif
+
+/*
+	Finds the first match of short needle x starting in [from, last].
+*/
+static size_t
+__schnur_find_short (const schnur_wide_t* x, size_t m,
+	const schnur_wide_t* h, size_t from, size_t last) {
+	size_t i = from;
+
+	if (1 == m) {
+		const schnur_wide_t* p = wmemchr (h + from, x[0], last - from + 1);
+		return NULL == p ? SCHNUR_NOT_FOUND : (size_t)(p - h);
+	}
+
+#if defined(SCHNUR_FIND_SSE2)
+	{
+		const __m128i first = __schnur_find_splat (x[0]);
+		const __m128i final = __schnur_find_splat (x[m - 1]);
+
+		for (; SCHNUR_FIND_STEP <= last - i + 1; i += SCHNUR_FIND_STEP) {
+			uint32_t mask = __schnur_find_candidates (h, i, m, first, final);
+
+			while (0 != mask) {
+				int bit = __schnur_find_lowest_bit (mask);
+				size_t p = i + (size_t)bit / sizeof (schnur_wide_t);
+
+				if (__schnur_find_inner_equal (h + p, x, m)) {
+					return p;
+				}
+				mask &= ~(SCHNUR_FIND_CHAR_BITS << bit);
+			}
+		}
+	}
+#endif
+
+	for (; i <= last; ++i) {
+		if (x[0] == h[i] && x[m - 1] == h[i + m - 1]
+		 && __schnur_find_inner_equal (h + i, x, m)) {
+			return i;
+		}
+	}
+
+	return SCHNUR_NOT_FOUND;
+}
+
+/*
+	Finds the last match of short needle x starting in [0, last].
+*/
+static size_t
+__schnur_rfind_short (const schnur_wide_t* x, size_t m,
+	const schnur_wide_t* h, size_t last) {
+	size_t end = last + 1;
+
+#if defined(SCHNUR_FIND_SSE2)
+	{
+		const __m128i first = __schnur_find_splat (x[0]);
+		const __m128i final = __schnur_find_splat (x[m - 1]);
+
+		for (; SCHNUR_FIND_STEP <= end; end -= SCHNUR_FIND_STEP) {
+			size_t i = end - SCHNUR_FIND_STEP;
+			uint32_t mask = __schnur_find_candidates (h, i, m, first, final);
+
+			while (0 != mask) {
+				int bit = __schnur_find_highest_bit (mask);
+				size_t p = i + (size_t)bit / sizeof (schnur_wide_t);
+
+				if (__schnur_find_inner_equal (h + p, x, m)) {
+					return p;
+				}
+				mask &= ~(SCHNUR_FIND_CHAR_BITS << (bit + 1 - sizeof (schnur_wide_t)));
+			}
+		}
+	}
+#endif
+
+	while (0 < end) {
+		--end;
+		if (x[0] == h[end] && x[m - 1] == h[end + m - 1]
+		 && __schnur_find_inner_equal (h + end, x, m)) {
+			return end;
+		}
+	}
+
+	return SCHNUR_NOT_FOUND;
+}
+
+/*
+	Finds the first match of x in h at or after from, using factor if x is
+	long. Both are valid views.
+*/
+static size_t
+__schnur_find (const struct schnur_needle_factor* factor,
+	const schnur_wide_t* x, size_t m, const schnur_wide_t* h, size_t n, size_t from) {
+	size_t found;
+
+	if (from > n || m > n - from) {
+		return SCHNUR_NOT_FOUND;
+	}
+	if (0 == m) {
+		return from;
+	}
+	if (SCHNUR_FIND_SHORT_NEEDLE >= m) {
+		return __schnur_find_short (x, m, h, from, n - m);
+	}
+
+	found = __schnur_find_two_way (factor, x, m, h + from, n - from, 0);
+
+	return SCHNUR_NOT_FOUND == found ? found : from + found;
+}
+
+/*
+	Finds the last match of x in h starting at or before from.
+*/
+static size_t
+__schnur_rfind (const struct schnur_needle_factor* factor,
+	const schnur_wide_t* x, size_t m, const schnur_wide_t* h, size_t n, size_t from) {
+	size_t found;
+
+	if (m > n) {
+		return SCHNUR_NOT_FOUND;
+	}
+	if (from > n - m) {
+		from = n - m;
+	}
+	if (0 == m) {
+		return from;
+	}
+	if (SCHNUR_FIND_SHORT_NEEDLE >= m) {
+		return __schnur_rfind_short (x, m, h, from);
+	}
+
+	// Reading backwards from the end of the last possible match.
+	found = __schnur_find_two_way (factor, x, m, h, from + m, 1);
+
+	return SCHNUR_NOT_FOUND == found ? found : from - found;
+}
+
+static size_t
+__schnur_count (const struct schnur_needle_factor* factor,
+	const schnur_wide_t* x, size_t m, const schnur_wide_t* h, size_t n) {
+	size_t count = 0, i = 0;
+
+	if (0 == m) {
+		return n + 1;
+	}
+
+	while (SCHNUR_NOT_FOUND != (i = __schnur_find (factor, x, m, h, n, i))) {
+		++count;
+		i += m;
+	}
+
+	return count;
+}
+
+static int
+__schnur_find_valid (struct schnur_view view) {
+	return NULL != view.data || 0 == view.length;
+}
+
+size_t
+schnur_view_find (struct schnur_view view, struct schnur_view needle, size_t from) {
+	struct schnur_needle_factor factor;
+
+	if (! __schnur_find_valid (view) || ! __schnur_find_valid (needle)) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	if (SCHNUR_FIND_SHORT_NEEDLE < needle.length) {
+		__schnur_find_factorize (&factor, needle.data, needle.length, 0);
+	}
+
+	return __schnur_find (&factor, needle.data, needle.length, view.data, view.length, from);
+}
+
+size_t
+schnur_view_rfind (struct schnur_view view, struct schnur_view needle, size_t from) {
+	struct schnur_needle_factor factor;
+
+	if (! __schnur_find_valid (view) || ! __schnur_find_valid (needle)) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	if (SCHNUR_FIND_SHORT_NEEDLE < needle.length) {
+		__schnur_find_factorize (&factor, needle.data, needle.length, 1);
+	}
+
+	return __schnur_rfind (&factor, needle.data, needle.length, view.data, view.length, from);
+}
+
+size_t
+schnur_view_count (struct schnur_view view, struct schnur_view needle) {
+	struct schnur_needle_factor factor;
+
+	if (! __schnur_find_valid (view) || ! __schnur_find_valid (needle)) {
+		return 0;
+	}
+
+	if (SCHNUR_FIND_SHORT_NEEDLE < needle.length) {
+		__schnur_find_factorize (&factor, needle.data, needle.length, 0);
+	}
+
+	return __schnur_count (&factor, needle.data, needle.length, view.data, view.length);
+}
+
+size_t
+schnur_find (const struct schnur* self, struct schnur_view needle, size_t from) {
+	if (NULL == self) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	return schnur_view_find (schnur_view_of (self), needle, from);
+}
+
+size_t
+schnur_rfind (const struct schnur* self, struct schnur_view needle, size_t from) {
+	if (NULL == self) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	return schnur_view_rfind (schnur_view_of (self), needle, from);
+}
+
+size_t
+schnur_count (const struct schnur* self, struct schnur_view needle) {
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_view_count (schnur_view_of (self), needle);
+}
+
+struct schnur_needle*
+schnur_needle_new (struct schnur_view needle, const struct schnur_allocator* allocator) {
+	struct schnur_needle* compiled;
+
+	if (! __schnur_find_valid (needle)) {
+		return NULL;
+	}
+
+	if (NULL == allocator) {
+		allocator = schnur_get_allocator ();
+	}
+	else if (NULL == allocator->allocate
+	 || NULL == allocator->reallocate
+	 || NULL == allocator->release) {
+		return NULL;
+	}
+
+	if (needle.length > (SIZE_MAX - sizeof (struct schnur_needle)) / sizeof (schnur_wide_t)) {
+		return NULL;
+	}
+
+	compiled = allocator->allocate (allocator->context,
+		sizeof (struct schnur_needle) + needle.length * sizeof (schnur_wide_t));
+	if (NULL == compiled) {
+		return NULL;
+	}
+
+	compiled->allocator = allocator;
+	compiled->length = needle.length;
+	if (0 < needle.length) {
+		wmemcpy (compiled->data, needle.data, needle.length);
+	}
+
+	if (SCHNUR_FIND_SHORT_NEEDLE < needle.length) {
+		__schnur_find_factorize (&compiled->forward, compiled->data, needle.length, 0);
+		__schnur_find_factorize (&compiled->backward, compiled->data, needle.length, 1);
+	}
+
+	return compiled;
+}
+
+int
+schnur_needle_free (struct schnur_needle* needle) {
+	if (NULL == needle) {
+		return 0;
+	}
+
+	needle->allocator->release (needle->allocator->context, needle);
+
+	return 1;
+}
+
+size_t
+schnur_needle_find (const struct schnur_needle* needle, struct schnur_view view, size_t from) {
+	if (NULL == needle || ! __schnur_find_valid (view)) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	return __schnur_find (&needle->forward, needle->data, needle->length,
+		view.data, view.length, from);
+}
+
+size_t
+schnur_needle_rfind (const struct schnur_needle* needle, struct schnur_view view, size_t from) {
+	if (NULL == needle || ! __schnur_find_valid (view)) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	return __schnur_rfind (&needle->backward, needle->data, needle->length,
+		view.data, view.length, from);
+}
+
+size_t
+schnur_needle_count (const struct schnur_needle* needle, struct schnur_view view) {
+	if (NULL == needle || ! __schnur_find_valid (view)) {
+		return 0;
+	}
+
+	return __schnur_count (&needle->forward, needle->data, needle->length,
+		view.data, view.length);
+}
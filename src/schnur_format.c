@@ -0,0 +1,678 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+
+/// Flags of a conversion specification.
+#define SCHNUR_FORMAT_LEFT 1
+#define SCHNUR_FORMAT_ZERO 2
+#define SCHNUR_FORMAT_PLUS 4
+#define SCHNUR_FORMAT_SPACE 8
+#define SCHNUR_FORMAT_ALTERNATE 16
+
+/// Conversions delegated to snprintf are formatted into a local buffer of
+/// this many bytes, longer ones into a temporary allocation.
+#define SCHNUR_FORMAT_LOCAL_SIZE 128
+
+/**
+	@brief: Length modifier of a conversion specification.
+*/
+enum schnur_format_size {
+	SCHNUR_FORMAT_INT = 0,
+	SCHNUR_FORMAT_CHAR,
+	SCHNUR_FORMAT_SHORT,
+	SCHNUR_FORMAT_LONG,
+	SCHNUR_FORMAT_LONG_LONG,
+	SCHNUR_FORMAT_INTMAX,
+	SCHNUR_FORMAT_SIZE,
+	SCHNUR_FORMAT_PTRDIFF,
+	SCHNUR_FORMAT_LONG_DOUBLE
+};
+
+/**
+	@brief: A parsed conversion specification.
+*/
+struct schnur_format_spec {
+	int flags;
+	/**
+		@brief: Minimum number of characters written.
+	*/
+	size_t width;
+	/**
+		@brief: Precision, negative if none was given.
+	*/
+	int precision;
+	enum schnur_format_size size;
+	schnur_wide_t conversion;
+};
+
+/**
+	@brief: Writes formatted characters to a buffer, while counting all
+			  characters, including those not fitting the buffer.
+*/
+struct schnur_format_writer {
+	schnur_wide_t* buf;
+	/**
+		@brief: Number of characters buf is able to hold, including the null
+				  terminator.
+	*/
+	size_t cap;
+	/**
+		@brief: Number of characters formatted so far.
+	*/
+	size_t length;
+	/**
+		@brief: Set, if the format or an argument is invalid, or the result
+				  is too long to count.
+	*/
+	int invalid;
+};
+
+/*
+	Reserves n characters of the writer, returns where to write them or NULL
+	if they do not fit the buffer.
+*/
+static schnur_wide_t*
+__schnur_format_claim (struct schnur_format_writer* w, size_t n) {
+	schnur_wide_t* at = NULL;
+
+	if (n > SIZE_MAX - 1 - w->length) {
+		w->invalid = 1;
+		return NULL;
+	}
+
+	if (NULL != w->buf && w->length + n < w->cap) {
+		at = w->buf + w->length;
+	}
+	w->length += n;
+
+	return at;
+}
+
+static void
+__schnur_format_put (struct schnur_format_writer* w, const schnur_wide_t* s, size_t n) {
+	schnur_wide_t* at = __schnur_format_claim (w, n);
+
+	if (NULL != at && 0 < n) {
+		memcpy (at, s, n * sizeof (schnur_wide_t));
+	}
+}
+
+static void
+__schnur_format_put_ascii (struct schnur_format_writer* w, const char* s, size_t n) {
+	schnur_wide_t* at = __schnur_format_claim (w, n);
+	size_t i;
+
+	if (NULL != at) {
+		for (i = 0; i < n; ++i) {
+			at[i] = (schnur_wide_t)(unsigned char)s[i];
+		}
+	}
+}
+
+static void
+__schnur_format_fill (struct schnur_format_writer* w, schnur_wide_t c, size_t n) {
+	schnur_wide_t* at = __schnur_format_claim (w, n);
+
+	if (NULL != at) {
+		wmemset (at, c, n);
+	}
+}
+
+/*
+	Pads a field of n characters to the width of spec, before or after the
+	field depending on its flags.
+*/
+static void
+__schnur_format_pad (struct schnur_format_writer* w,
+	const struct schnur_format_spec* spec, size_t n, int left) {
+	if (spec->width > n && left == (0 != (spec->flags & SCHNUR_FORMAT_LEFT))) {
+		__schnur_format_fill (w, SCHNUR_W (' '), spec->width - n);
+	}
+}
+
+/*
+	Writes the n characters of s, cut to the precision of spec and padded to
+	its width.
+*/
+static void
+__schnur_format_text (struct schnur_format_writer* w,
+	const struct schnur_format_spec* spec, const schnur_wide_t* s, size_t n) {
+	if (0 <= spec->precision && (size_t)spec->precision < n) {
+		n = (size_t)spec->precision;
+	}
+
+	__schnur_format_pad (w, spec, n, 0);
+	__schnur_format_put (w, s, n);
+	__schnur_format_pad (w, spec, n, 1);
+}
+
+/*
+	Decodes a null terminated utf-8 string, of which at most precision bytes
+	are read, padded to the width of spec.
+*/
+static void
+__schnur_format_utf8 (struct schnur_format_writer* w,
+	const struct schnur_format_spec* spec, const schnur_narrow_t* s) {
+	size_t bytes = 0, n;
+	schnur_wide_t* at;
+
+	while ((0 > spec->precision || bytes < (size_t)spec->precision)
+	 && SCHNUR_NC_NULL != s[bytes]) {
+		++bytes;
+	}
+
+	n = schnur_utf8_decode_length (s, bytes, NULL);
+	if (SCHNUR_UTF8_INVALID == n) {
+		w->invalid = 1;
+		return;
+	}
+
+	__schnur_format_pad (w, spec, n, 0);
+	at = __schnur_format_claim (w, n);
+	if (NULL != at) {
+		schnur_utf8_decode (at, s, bytes);
+	}
+	__schnur_format_pad (w, spec, n, 1);
+}
+
+/*
+	Writes an integer of given magnitude in base 8, 10 or 16, following the
+	rules of printf for flags, width and precision.
+*/
+static void
+__schnur_format_integer (struct schnur_format_writer* w,
+	const struct schnur_format_spec* spec, uintmax_t magnitude, int negative) {
+	// Enough for the octal digits of the largest magnitude.
+	schnur_wide_t digits[(sizeof (uintmax_t) * CHAR_BIT + 2) / 3 + 1];
+	const char* alphabet = SCHNUR_W ('X') == spec->conversion
+		? "0123456789ABCDEF"
+		: "0123456789abcdef";
+	const size_t size = sizeof (digits) / sizeof (digits[0]);
+	schnur_wide_t prefix[2];
+	size_t i = size, n, zeros = 0, p = 0, field;
+	int is_signed = SCHNUR_W ('d') == spec->conversion || SCHNUR_W ('i') == spec->conversion;
+
+	switch (spec->conversion) {
+		case SCHNUR_W ('o'):
+			do {
+				digits[--i] = (schnur_wide_t)('0' + (magnitude & 7));
+				magnitude >>= 3;
+			} while (0 < magnitude);
+			n = size - i;
+			break;
+		case SCHNUR_W ('x'):
+		case SCHNUR_W ('X'):
+			do {
+				digits[--i] = (schnur_wide_t)alphabet[magnitude & 15];
+				magnitude >>= 4;
+			} while (0 < magnitude);
+			n = size - i;
+			break;
+		default:
+			// Arguments are at most 64 bits wide on every supported platform.
+			i = 0;
+			n = schnur_format_u64 (digits, (uint64_t)magnitude);
+			break;
+	}
+
+	// A zero precision prints nothing for zero, except for the octal prefix.
+	if (0 == spec->precision && 1 == n && SCHNUR_W ('0') == digits[i]) {
+		n = 0;
+		if (SCHNUR_W ('o') == spec->conversion && (spec->flags & SCHNUR_FORMAT_ALTERNATE)) {
+			zeros = 1;
+		}
+	}
+	if (0 < spec->precision && (size_t)spec->precision > n) {
+		zeros = (size_t)spec->precision - n;
+	}
+
+	if (is_signed) {
+		if (negative) {
+			prefix[p++] = SCHNUR_W ('-');
+		}
+		else if (spec->flags & SCHNUR_FORMAT_PLUS) {
+			prefix[p++] = SCHNUR_W ('+');
+		}
+		else if (spec->flags & SCHNUR_FORMAT_SPACE) {
+			prefix[p++] = SCHNUR_W (' ');
+		}
+	}
+	else if (spec->flags & SCHNUR_FORMAT_ALTERNATE) {
+		if (SCHNUR_W ('o') == spec->conversion) {
+			if (0 == zeros && (0 == n || SCHNUR_W ('0') != digits[i])) {
+				zeros = 1;
+			}
+		}
+		else if (0 < n && SCHNUR_W ('0') != digits[i]
+		 && (SCHNUR_W ('x') == spec->conversion || SCHNUR_W ('X') == spec->conversion)) {
+			prefix[p++] = SCHNUR_W ('0');
+			prefix[p++] = spec->conversion;
+		}
+	}
+
+	field = p + zeros + n;
+	if (spec->width > field
+	 && (spec->flags & SCHNUR_FORMAT_ZERO)
+	 && 0 == (spec->flags & SCHNUR_FORMAT_LEFT)
+	 && 0 > spec->precision) {
+		zeros += spec->width - field;
+		field = spec->width;
+	}
+
+	__schnur_format_pad (w, spec, field, 0);
+	__schnur_format_put (w, prefix, p);
+	__schnur_format_fill (w, SCHNUR_W ('0'), zeros);
+	__schnur_format_put (w, digits + i, n);
+	__schnur_format_pad (w, spec, field, 1);
+}
+
+/*
+	Appends the flags of spec to a narrow format string at s.
+*/
+static char*
+__schnur_format_narrow_flags (char* s, const struct schnur_format_spec* spec) {
+	*s++ = '%';
+	if (spec->flags & SCHNUR_FORMAT_LEFT) *s++ = '-';
+	if (spec->flags & SCHNUR_FORMAT_ZERO) *s++ = '0';
+	if (spec->flags & SCHNUR_FORMAT_PLUS) *s++ = '+';
+	if (spec->flags & SCHNUR_FORMAT_SPACE) *s++ = ' ';
+	if (spec->flags & SCHNUR_FORMAT_ALTERNATE) *s++ = '#';
+
+	return s;
+}
+
+/*
+	Formats a floating point number or pointer with snprintf into size bytes
+	at text, using the narrow format built from spec.
+*/
+static int
+__schnur_format_snprintf_into (char* text, size_t size, const char* format,
+	const struct schnur_format_spec* spec, int precision, long double value, const void* pointer) {
+	if (SCHNUR_W ('p') == spec->conversion) {
+		return snprintf (text, size, format, (int)spec->width, pointer);
+	}
+	if (SCHNUR_FORMAT_LONG_DOUBLE == spec->size) {
+		return snprintf (text, size, format, (int)spec->width, precision, value);
+	}
+
+	return snprintf (text, size, format, (int)spec->width, precision, (double)value);
+}
+
+/*
+	Formats a floating point number or pointer with snprintf and widens the
+	result, which consists of ascii characters only.
+*/
+static void
+__schnur_format_snprintf (struct schnur_format_writer* w,
+	const struct schnur_format_spec* spec, int precision, long double value, const void* pointer) {
+	char format[16], local[SCHNUR_FORMAT_LOCAL_SIZE];
+	char* s = __schnur_format_narrow_flags (format, spec);
+	char* text = local;
+	const struct schnur_allocator* a = NULL;
+	int n;
+
+	*s++ = '*';
+	if (SCHNUR_W ('p') == spec->conversion) {
+		*s++ = 'p';
+	}
+	else {
+		*s++ = '.';
+		*s++ = '*';
+		if (SCHNUR_FORMAT_LONG_DOUBLE == spec->size) {
+			*s++ = 'L';
+		}
+		*s++ = (char)spec->conversion;
+	}
+	*s = '\0';
+
+	n = __schnur_format_snprintf_into (local, sizeof (local), format,
+		spec, precision, value, pointer);
+	if (0 <= n && sizeof (local) <= (size_t)n) {
+		a = schnur_get_allocator ();
+		text = a->allocate (a->context, (size_t)n + 1);
+		if (NULL == text) {
+			w->invalid = 1;
+			return;
+		}
+		__schnur_format_snprintf_into (text, (size_t)n + 1, format,
+			spec, precision, value, pointer);
+	}
+
+	if (0 > n) {
+		w->invalid = 1;
+	}
+	else {
+		__schnur_format_put_ascii (w, text, (size_t)n);
+	}
+
+	if (NULL != a) {
+		a->release (a->context, text);
+	}
+}
+
+/*
+	Parses a decimal number at *f not exceeding INT_MAX and advances *f past
+	it.
+*/
+static int
+__schnur_format_number (const schnur_wide_t** f, int* value) {
+	*value = 0;
+
+	while (SCHNUR_W ('0') <= **f && SCHNUR_W ('9') >= **f) {
+		int digit = (int)(*(*f)++ - SCHNUR_W ('0'));
+
+		if ((INT_MAX - digit) / 10 < *value) {
+			return 0;
+		}
+		*value = *value * 10 + digit;
+	}
+
+	return 1;
+}
+
+/*
+	Parses the conversion specification following a '%' at *format and
+	advances *format past it. Consumes arguments given as '*'.
+*/
+static int
+__schnur_format_parse (const schnur_wide_t** format,
+	struct schnur_format_spec* spec, va_list* args) {
+	const schnur_wide_t* f = *format;
+	int width;
+
+	memset (spec, 0, sizeof (struct schnur_format_spec));
+	spec->precision = -1;
+
+	for (;; ++f) {
+		switch (*f) {
+			case SCHNUR_W ('-'): spec->flags |= SCHNUR_FORMAT_LEFT; continue;
+			case SCHNUR_W ('0'): spec->flags |= SCHNUR_FORMAT_ZERO; continue;
+			case SCHNUR_W ('+'): spec->flags |= SCHNUR_FORMAT_PLUS; continue;
+			case SCHNUR_W (' '): spec->flags |= SCHNUR_FORMAT_SPACE; continue;
+			case SCHNUR_W ('#'): spec->flags |= SCHNUR_FORMAT_ALTERNATE; continue;
+			default: break;
+		}
+		break;
+	}
+
+	if (SCHNUR_W ('*') == *f) {
+		width = va_arg (*args, int);
+		if (0 > width) {
+			spec->flags |= SCHNUR_FORMAT_LEFT;
+			width = INT_MIN == width ? INT_MAX : -width;
+		}
+		++f;
+	}
+	else if (! __schnur_format_number (&f, &width)) {
+		return 0;
+	}
+	spec->width = (size_t)width;
+
+	if (SCHNUR_W ('.') == *f) {
+		++f;
+		if (SCHNUR_W ('*') == *f) {
+			spec->precision = va_arg (*args, int);
+			if (0 > spec->precision) {
+				spec->precision = -1;
+			}
+			++f;
+		}
+		else if (! __schnur_format_number (&f, &spec->precision)) {
+			return 0;
+		}
+	}
+
+	switch (*f) {
+		case SCHNUR_W ('h'):
+			spec->size = SCHNUR_W ('h') == f[1] ? SCHNUR_FORMAT_CHAR : SCHNUR_FORMAT_SHORT;
+			f += SCHNUR_FORMAT_CHAR == spec->size ? 2 : 1;
+			break;
+		case SCHNUR_W ('l'):
+			spec->size = SCHNUR_W ('l') == f[1] ? SCHNUR_FORMAT_LONG_LONG : SCHNUR_FORMAT_LONG;
+			f += SCHNUR_FORMAT_LONG_LONG == spec->size ? 2 : 1;
+			break;
+		case SCHNUR_W ('j'): spec->size = SCHNUR_FORMAT_INTMAX; ++f; break;
+		case SCHNUR_W ('z'): spec->size = SCHNUR_FORMAT_SIZE; ++f; break;
+		case SCHNUR_W ('t'): spec->size = SCHNUR_FORMAT_PTRDIFF; ++f; break;
+		case SCHNUR_W ('L'): spec->size = SCHNUR_FORMAT_LONG_DOUBLE; ++f; break;
+		default: break;
+	}
+
+	spec->conversion = *f;
+	if (SCHNUR_WC_NULL == *f) {
+		return 0;
+	}
+	*format = f + 1;
+
+	return 1;
+}
+
+/*
+	Fetches a signed integer argument of the size of spec.
+*/
+static intmax_t
+__schnur_format_signed (const struct schnur_format_spec* spec, va_list* args) {
+	switch (spec->size) {
+		case SCHNUR_FORMAT_CHAR: return (signed char)va_arg (*args, int);
+		case SCHNUR_FORMAT_SHORT: return (short)va_arg (*args, int);
+		case SCHNUR_FORMAT_LONG: return va_arg (*args, long);
+		case SCHNUR_FORMAT_LONG_LONG: return va_arg (*args, long long);
+		case SCHNUR_FORMAT_INTMAX: return va_arg (*args, intmax_t);
+		case SCHNUR_FORMAT_SIZE: return (ptrdiff_t)va_arg (*args, size_t);
+		case SCHNUR_FORMAT_PTRDIFF: return va_arg (*args, ptrdiff_t);
+		default: return va_arg (*args, int);
+	}
+}
+
+/*
+	Fetches an unsigned integer argument of the size of spec.
+*/
+static uintmax_t
+__schnur_format_unsigned (const struct schnur_format_spec* spec, va_list* args) {
+	switch (spec->size) {
+		case SCHNUR_FORMAT_CHAR: return (unsigned char)va_arg (*args, unsigned int);
+		case SCHNUR_FORMAT_SHORT: return (unsigned short)va_arg (*args, unsigned int);
+		case SCHNUR_FORMAT_LONG: return va_arg (*args, unsigned long);
+		case SCHNUR_FORMAT_LONG_LONG: return va_arg (*args, unsigned long long);
+		case SCHNUR_FORMAT_INTMAX: return va_arg (*args, uintmax_t);
+		case SCHNUR_FORMAT_SIZE: return va_arg (*args, size_t);
+		case SCHNUR_FORMAT_PTRDIFF: return (size_t)va_arg (*args, ptrdiff_t);
+		default: return va_arg (*args, unsigned int);
+	}
+}
+
+/*
+	Formats a single conversion specification.
+*/
+static void
+__schnur_format_conversion (struct schnur_format_writer* w,
+	const struct schnur_format_spec* spec, va_list* args) {
+	static const schnur_wide_t null_text[] = SCHNUR_W ("(null)");
+	const size_t null_length = sizeof (null_text) / sizeof (null_text[0]) - 1;
+
+	switch (spec->conversion) {
+		case SCHNUR_W ('%'): {
+			__schnur_format_put (w, SCHNUR_W ("%"), 1);
+			break;
+		}
+		case SCHNUR_W ('d'):
+		case SCHNUR_W ('i'): {
+			intmax_t value = __schnur_format_signed (spec, args);
+			uintmax_t magnitude = 0 > value
+				? (uintmax_t)0 - (uintmax_t)value
+				: (uintmax_t)value;
+			__schnur_format_integer (w, spec, magnitude, 0 > value);
+			break;
+		}
+		case SCHNUR_W ('u'):
+		case SCHNUR_W ('o'):
+		case SCHNUR_W ('x'):
+		case SCHNUR_W ('X'): {
+			__schnur_format_integer (w, spec, __schnur_format_unsigned (spec, args), 0);
+			break;
+		}
+		case SCHNUR_W ('c'): {
+			schnur_wide_t c = SCHNUR_FORMAT_LONG == spec->size
+				? (schnur_wide_t)va_arg (*args, wint_t)
+				: (schnur_wide_t)(unsigned char)va_arg (*args, int);
+			__schnur_format_pad (w, spec, 1, 0);
+			__schnur_format_put (w, &c, 1);
+			__schnur_format_pad (w, spec, 1, 1);
+			break;
+		}
+		case SCHNUR_W ('s'): {
+			if (SCHNUR_FORMAT_LONG == spec->size) {
+				const schnur_wide_t* s = va_arg (*args, const schnur_wide_t*);
+				size_t n = 0;
+
+				if (NULL == s) {
+					__schnur_format_text (w, spec, null_text, null_length);
+					break;
+				}
+				while ((0 > spec->precision || n < (size_t)spec->precision)
+				 && SCHNUR_WC_NULL != s[n]) {
+					++n;
+				}
+				__schnur_format_text (w, spec, s, n);
+			}
+			else {
+				const schnur_narrow_t* s = va_arg (*args, const schnur_narrow_t*);
+
+				if (NULL == s) {
+					__schnur_format_text (w, spec, null_text, null_length);
+					break;
+				}
+				__schnur_format_utf8 (w, spec, s);
+			}
+			break;
+		}
+		case SCHNUR_W ('v'): {
+			struct schnur_view view = va_arg (*args, struct schnur_view);
+
+			if (NULL == view.data && 0 < view.length) {
+				w->invalid = 1;
+				break;
+			}
+			__schnur_format_text (w, spec, view.data, view.length);
+			break;
+		}
+		case SCHNUR_W ('V'): {
+			const struct schnur* s = va_arg (*args, const struct schnur*);
+			struct schnur_view view = schnur_view_of (s);
+
+			if (NULL == s) {
+				__schnur_format_text (w, spec, null_text, null_length);
+				break;
+			}
+			__schnur_format_text (w, spec, view.data, view.length);
+			break;
+		}
+		case SCHNUR_W ('r'): {
+			struct schnur_format_spec text = *spec;
+			schnur_wide_t buf[SCHNUR_NUMBER_MAX_CHARS];
+			size_t n = schnur_format_f64 (buf, va_arg (*args, double));
+
+			text.precision = -1;
+			__schnur_format_text (w, &text, buf, n);
+			break;
+		}
+		case SCHNUR_W ('f'):
+		case SCHNUR_W ('F'):
+		case SCHNUR_W ('e'):
+		case SCHNUR_W ('E'):
+		case SCHNUR_W ('g'):
+		case SCHNUR_W ('G'):
+		case SCHNUR_W ('a'):
+		case SCHNUR_W ('A'): {
+			long double value = SCHNUR_FORMAT_LONG_DOUBLE == spec->size
+				? va_arg (*args, long double)
+				: (long double)va_arg (*args, double);
+			__schnur_format_snprintf (w, spec, spec->precision, value, NULL);
+			break;
+		}
+		case SCHNUR_W ('p'): {
+			__schnur_format_snprintf (w, spec, -1, 0, va_arg (*args, const void*));
+			break;
+		}
+		default: {
+			// Includes %n, which is not supported.
+			w->invalid = 1;
+			break;
+		}
+	}
+}
+
+int
+schnur_vformat_into (schnur_wide_t* buf, size_t cap, size_t* needed,
+	const schnur_wide_t* format, va_list args) {
+	struct schnur_format_writer w;
+	struct schnur_format_spec spec;
+	va_list ap;
+
+	if (NULL == format) {
+		if (NULL != needed) *needed = SCHNUR_FORMAT_INVALID;
+		return 0;
+	}
+
+	w.buf = buf;
+	w.cap = cap;
+	w.length = 0;
+	w.invalid = 0;
+
+	va_copy (ap, args);
+	while (SCHNUR_WC_NULL != *format && ! w.invalid) {
+		const schnur_wide_t* next = format;
+
+		while (SCHNUR_WC_NULL != *next && SCHNUR_W ('%') != *next) {
+			++next;
+		}
+		__schnur_format_put (&w, format, (size_t)(next - format));
+		format = next;
+
+		if (SCHNUR_W ('%') == *format) {
+			++format;
+			if (__schnur_format_parse (&format, &spec, &ap)) {
+				__schnur_format_conversion (&w, &spec, &ap);
+			}
+			else {
+				w.invalid = 1;
+			}
+		}
+	}
+	va_end (ap);
+
+	if (w.invalid) {
+		if (NULL != needed) *needed = SCHNUR_FORMAT_INVALID;
+		return 0;
+	}
+
+	if (NULL != needed) *needed = w.length;
+	if (NULL == buf || cap <= w.length) {
+		return 0;
+	}
+
+	buf[w.length] = SCHNUR_WC_NULL;
+
+	return 1;
+}
+
+int
+schnur_format_into (schnur_wide_t* buf, size_t cap, size_t* needed,
+	const schnur_wide_t* format, ...) {
+	va_list args;
+	int result;
+
+	va_start (args, format);
+	result = schnur_vformat_into (buf, cap, needed, format, args);
+	va_end (args);
+
+	return result;
+}
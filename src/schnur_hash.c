@@ -0,0 +1,114 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+
+/*
+	The hash follows xxHash64: four independent lanes consume 32 bytes per
+	step, which keeps multipliers busy in parallel, then a final avalanche
+	mixes all bits.
+*/
+#define SCHNUR_HASH_PRIME_1 UINT64_C (0x9E3779B185EBCA87)
+#define SCHNUR_HASH_PRIME_2 UINT64_C (0xC2B2AE3D27D4EB4F)
+#define SCHNUR_HASH_PRIME_3 UINT64_C (0x165667B19E3779F9)
+#define SCHNUR_HASH_PRIME_4 UINT64_C (0x85EBCA77C2B2AE63)
+#define SCHNUR_HASH_PRIME_5 UINT64_C (0x27D4EB2F165667C5)
+
+static inline uint64_t
+__schnur_hash_rotl (uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+__schnur_hash_read64 (const unsigned char* p) {
+	uint64_t x;
+	memcpy (&x, p, sizeof (x));
+	return x;
+}
+
+static inline uint32_t
+__schnur_hash_read32 (const unsigned char* p) {
+	uint32_t x;
+	memcpy (&x, p, sizeof (x));
+	return x;
+}
+
+static inline uint64_t
+__schnur_hash_round (uint64_t acc, uint64_t input) {
+	acc += input * SCHNUR_HASH_PRIME_2;
+	acc = __schnur_hash_rotl (acc, 31);
+	return acc * SCHNUR_HASH_PRIME_1;
+}
+
+static inline uint64_t
+__schnur_hash_merge (uint64_t acc, uint64_t lane) {
+	acc ^= __schnur_hash_round (0, lane);
+	return acc * SCHNUR_HASH_PRIME_1 + SCHNUR_HASH_PRIME_4;
+}
+
+uint64_t
+schnur_hash_view (struct schnur_view view) {
+	static const unsigned char empty[1] = { 0 };
+	const unsigned char* p = NULL == view.data
+		? empty
+		: (const unsigned char*)view.data;
+	size_t n = NULL == view.data ? 0 : view.length * sizeof (schnur_wide_t);
+	const unsigned char* end = p + n;
+	uint64_t h;
+
+	if (32 <= n) {
+		const unsigned char* limit = end - 32;
+		uint64_t v1 = SCHNUR_HASH_PRIME_1 + SCHNUR_HASH_PRIME_2;
+		uint64_t v2 = SCHNUR_HASH_PRIME_2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - SCHNUR_HASH_PRIME_1;
+
+		do {
+			v1 = __schnur_hash_round (v1, __schnur_hash_read64 (p));
+			v2 = __schnur_hash_round (v2, __schnur_hash_read64 (p + 8));
+			v3 = __schnur_hash_round (v3, __schnur_hash_read64 (p + 16));
+			v4 = __schnur_hash_round (v4, __schnur_hash_read64 (p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = __schnur_hash_rotl (v1, 1) + __schnur_hash_rotl (v2, 7)
+			+ __schnur_hash_rotl (v3, 12) + __schnur_hash_rotl (v4, 18);
+		h = __schnur_hash_merge (h, v1);
+		h = __schnur_hash_merge (h, v2);
+		h = __schnur_hash_merge (h, v3);
+		h = __schnur_hash_merge (h, v4);
+	}
+	else {
+		h = SCHNUR_HASH_PRIME_5;
+	}
+
+	h += (uint64_t)n;
+
+	for (; 8 <= end - p; p += 8) {
+		h ^= __schnur_hash_round (0, __schnur_hash_read64 (p));
+		h = __schnur_hash_rotl (h, 27) * SCHNUR_HASH_PRIME_1 + SCHNUR_HASH_PRIME_4;
+	}
+
+	if (4 <= end - p) {
+		h ^= (uint64_t)__schnur_hash_read32 (p) * SCHNUR_HASH_PRIME_1;
+		h = __schnur_hash_rotl (h, 23) * SCHNUR_HASH_PRIME_2 + SCHNUR_HASH_PRIME_3;
+		p += 4;
+	}
+
+	for (; p < end; ++p) {
+		h ^= (uint64_t)*p * SCHNUR_HASH_PRIME_5;
+		h = __schnur_hash_rotl (h, 11) * SCHNUR_HASH_PRIME_1;
+	}
+
+	h ^= h >> 33;
+	h *= SCHNUR_HASH_PRIME_2;
+	h ^= h >> 29;
+	h *= SCHNUR_HASH_PRIME_3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -0,0 +1,357 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/// Number of independently locked tables, must be a power of two.
+#define SCHNUR_INTERN_STRIPES 64
+/// Initial number of slots per table, must be a power of two.
+#define SCHNUR_INTERN_INITIAL_SLOTS 16
+
+#if defined(_WIN32)
+typedef SRWLOCK schnur_rwlock_t;
+static int  __schnur_rwlock_init (schnur_rwlock_t* l) { InitializeSRWLock (l); return 1; }
+static void __schnur_rwlock_destroy (schnur_rwlock_t* l) { (void)l; }
+static void __schnur_rwlock_read (schnur_rwlock_t* l) { AcquireSRWLockShared (l); }
+static void __schnur_rwlock_read_done (schnur_rwlock_t* l) { ReleaseSRWLockShared (l); }
+static void __schnur_rwlock_write (schnur_rwlock_t* l) { AcquireSRWLockExclusive (l); }
+static void __schnur_rwlock_write_done (schnur_rwlock_t* l) { ReleaseSRWLockExclusive (l); }
+#else
+typedef pthread_rwlock_t schnur_rwlock_t;
+static int  __schnur_rwlock_init (schnur_rwlock_t* l) { return 0 == pthread_rwlock_init (l, NULL); }
+static void __schnur_rwlock_destroy (schnur_rwlock_t* l) { pthread_rwlock_destroy (l); }
+static void __schnur_rwlock_read (schnur_rwlock_t* l) { pthread_rwlock_rdlock (l); }
+static void __schnur_rwlock_read_done (schnur_rwlock_t* l) { pthread_rwlock_unlock (l); }
+static void __schnur_rwlock_write (schnur_rwlock_t* l) { pthread_rwlock_wrlock (l); }
+static void __schnur_rwlock_write_done (schnur_rwlock_t* l) { pthread_rwlock_unlock (l); }
+#endif
+
+/**
+	@brief: A slot of an open addressing table.
+*/
+struct schnur_intern_entry {
+	/**
+		@brief: Hash of the interned characters.
+	*/
+	uint64_t hash;
+
+	/**
+		@brief: The canonical handle, NULL for empty slots.
+	*/
+	const struct schnur_frozen* frozen;
+};
+
+/**
+	@brief: One of the tables of a pool, guarded by its own lock.
+*/
+struct schnur_intern_stripe {
+	schnur_rwlock_t lock;
+
+	/**
+		@brief: Slots, linearly probed. NULL until the first insertion.
+	*/
+	struct schnur_intern_entry* entries;
+
+	/**
+		@brief: Number of slots, a power of two.
+	*/
+	size_t capacity;
+
+	/**
+		@brief: Number of occupied slots.
+	*/
+	size_t count;
+
+	/**
+		@brief: Number of bytes of character storage held.
+	*/
+	size_t bytes;
+
+	/**
+		@brief: Counters updated under the shared lock.
+	*/
+	atomic_size_t lookups;
+	atomic_size_t hits;
+	atomic_size_t bytes_saved;
+
+	/**
+		@brief: Keeps neighbouring stripes off this stripe's cache line.
+	*/
+	char padding[64];
+};
+
+struct schnur_intern_pool {
+	/**
+		@brief: Allocator managing the pool and all interned strings.
+	*/
+	const struct schnur_allocator* allocator;
+
+	struct schnur_intern_stripe stripes[SCHNUR_INTERN_STRIPES];
+};
+
+static size_t
+__schnur_intern_bytes (struct schnur_view view) {
+	return (view.length + 1) * sizeof (schnur_wide_t);
+}
+
+/*
+	Looks for view in stripe, which has to be locked.
+*/
+static const struct schnur_frozen*
+__schnur_intern_find (const struct schnur_intern_stripe* stripe,
+	uint64_t hash, struct schnur_view view) {
+	size_t mask = stripe->capacity - 1;
+	size_t i;
+
+	if (0 == stripe->count) {
+		return NULL;
+	}
+
+	for (i = (size_t)hash & mask; NULL != stripe->entries[i].frozen; i = (i + 1) & mask) {
+		if (hash == stripe->entries[i].hash
+		 && schnur_view_equal (schnur_frozen_view (stripe->entries[i].frozen), view)) {
+			return stripe->entries[i].frozen;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+__schnur_intern_place (struct schnur_intern_entry* entries, size_t capacity,
+	uint64_t hash, const struct schnur_frozen* frozen) {
+	size_t mask = capacity - 1;
+	size_t i = (size_t)hash & mask;
+
+	while (NULL != entries[i].frozen) {
+		i = (i + 1) & mask;
+	}
+
+	entries[i].hash = hash;
+	entries[i].frozen = frozen;
+}
+
+/*
+	Makes room for one more entry, keeping the load below 3/4.
+*/
+static int
+__schnur_intern_reserve (const struct schnur_allocator* a,
+	struct schnur_intern_stripe* stripe) {
+	struct schnur_intern_entry* entries;
+	size_t capacity, i;
+
+	if (stripe->count + 1 <= stripe->capacity / 4 * 3) {
+		return 1;
+	}
+
+	capacity = 0 == stripe->capacity
+		? SCHNUR_INTERN_INITIAL_SLOTS
+		: stripe->capacity * 2;
+	if (capacity > SIZE_MAX / sizeof (struct schnur_intern_entry)) {
+		return 0;
+	}
+
+	entries = a->allocate (a->context, capacity * sizeof (struct schnur_intern_entry));
+	if (NULL == entries) {
+		return 0;
+	}
+	memset (entries, 0, capacity * sizeof (struct schnur_intern_entry));
+
+	for (i = 0; i < stripe->capacity; ++i) {
+		if (NULL != stripe->entries[i].frozen) {
+			__schnur_intern_place (entries, capacity,
+				stripe->entries[i].hash, stripe->entries[i].frozen);
+		}
+	}
+
+	a->release (a->context, stripe->entries);
+	stripe->entries = entries;
+	stripe->capacity = capacity;
+
+	return 1;
+}
+
+static void
+__schnur_intern_hit (struct schnur_intern_stripe* stripe, struct schnur_view view) {
+	atomic_fetch_add_explicit (&stripe->hits, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit (&stripe->bytes_saved,
+		__schnur_intern_bytes (view), memory_order_relaxed);
+}
+
+struct schnur_intern_pool*
+schnur_intern_pool_new (const struct schnur_allocator* allocator) {
+	struct schnur_intern_pool* pool;
+	size_t i;
+
+	if (NULL == allocator) {
+		allocator = schnur_get_allocator ();
+	}
+	else if (NULL == allocator->allocate
+	 || NULL == allocator->reallocate
+	 || NULL == allocator->release) {
+		return NULL;
+	}
+
+	pool = allocator->allocate (allocator->context, sizeof (struct schnur_intern_pool));
+	if (NULL == pool) {
+		return NULL;
+	}
+
+	pool->allocator = allocator;
+	for (i = 0; i < SCHNUR_INTERN_STRIPES; ++i) {
+		struct schnur_intern_stripe* stripe = &pool->stripes[i];
+
+		if (! __schnur_rwlock_init (&stripe->lock)) {
+			while (0 < i) {
+				__schnur_rwlock_destroy (&pool->stripes[--i].lock);
+			}
+			allocator->release (allocator->context, pool);
+			return NULL;
+		}
+		stripe->entries = NULL;
+		stripe->capacity = 0;
+		stripe->count = 0;
+		stripe->bytes = 0;
+		atomic_init (&stripe->lookups, 0);
+		atomic_init (&stripe->hits, 0);
+		atomic_init (&stripe->bytes_saved, 0);
+	}
+
+	return pool;
+}
+
+int
+schnur_intern_pool_free (struct schnur_intern_pool* pool) {
+	const struct schnur_allocator* a;
+	size_t i, j;
+
+	if (NULL == pool) {
+		return 0;
+	}
+
+	a = pool->allocator;
+	for (i = 0; i < SCHNUR_INTERN_STRIPES; ++i) {
+		struct schnur_intern_stripe* stripe = &pool->stripes[i];
+
+		for (j = 0; j < stripe->capacity; ++j) {
+			schnur_frozen_release (stripe->entries[j].frozen);
+		}
+		a->release (a->context, stripe->entries);
+		__schnur_rwlock_destroy (&stripe->lock);
+	}
+
+	a->release (a->context, pool);
+
+	return 1;
+}
+
+/*
+	Interns view, given its hash.
+*/
+static const struct schnur_frozen*
+__schnur_intern (struct schnur_intern_pool* pool, struct schnur_view view, uint64_t hash) {
+	struct schnur_intern_stripe* stripe;
+	const struct schnur_frozen* frozen;
+	const struct schnur_frozen* existing;
+
+	stripe = &pool->stripes[hash >> 58 & (SCHNUR_INTERN_STRIPES - 1)];
+	atomic_fetch_add_explicit (&stripe->lookups, 1, memory_order_relaxed);
+
+	__schnur_rwlock_read (&stripe->lock);
+	frozen = __schnur_intern_find (stripe, hash, view);
+	__schnur_rwlock_read_done (&stripe->lock);
+
+	if (NULL != frozen) {
+		__schnur_intern_hit (stripe, view);
+		return frozen;
+	}
+
+	// Copy outside of the lock, another thread might insert it meanwhile.
+	frozen = schnur_frozen_new (view, pool->allocator);
+	if (NULL == frozen) {
+		return NULL;
+	}
+
+	__schnur_rwlock_write (&stripe->lock);
+	existing = __schnur_intern_find (stripe, hash, view);
+	if (NULL == existing) {
+		if (__schnur_intern_reserve (pool->allocator, stripe)) {
+			__schnur_intern_place (stripe->entries, stripe->capacity, hash, frozen);
+			++stripe->count;
+			stripe->bytes += __schnur_intern_bytes (view);
+		}
+		else {
+			schnur_frozen_release (frozen);
+			frozen = NULL;
+		}
+	}
+	__schnur_rwlock_write_done (&stripe->lock);
+
+	if (NULL != existing) {
+		schnur_frozen_release (frozen);
+		__schnur_intern_hit (stripe, view);
+		return existing;
+	}
+
+	return frozen;
+}
+
+const struct schnur_frozen*
+schnur_intern_view (struct schnur_intern_pool* pool, struct schnur_view view) {
+	if (NULL == pool || (NULL == view.data && 0 < view.length)) {
+		return NULL;
+	}
+
+	return __schnur_intern (pool, view, schnur_hash_view (view));
+}
+
+const struct schnur_frozen*
+schnur_intern (struct schnur_intern_pool* pool, const struct schnur* s) {
+	if (NULL == pool || NULL == s) {
+		return NULL;
+	}
+
+	// Reuses the hash cached in s.
+	return __schnur_intern (pool, schnur_view_of (s), schnur_hash (s));
+}
+
+int
+schnur_intern_pool_stats (struct schnur_intern_pool* pool,
+	struct schnur_intern_stats* stats) {
+	size_t i;
+
+	if (NULL == pool || NULL == stats) {
+		return 0;
+	}
+
+	memset (stats, 0, sizeof (struct schnur_intern_stats));
+	for (i = 0; i < SCHNUR_INTERN_STRIPES; ++i) {
+		struct schnur_intern_stripe* stripe = &pool->stripes[i];
+
+		__schnur_rwlock_read (&stripe->lock);
+		stats->strings += stripe->count;
+		stats->bytes += stripe->bytes;
+		__schnur_rwlock_read_done (&stripe->lock);
+
+		stats->lookups += atomic_load_explicit (&stripe->lookups, memory_order_relaxed);
+		stats->hits += atomic_load_explicit (&stripe->hits, memory_order_relaxed);
+		stats->bytes_saved += atomic_load_explicit (&stripe->bytes_saved, memory_order_relaxed);
+	}
+
+	return 1;
+}
@@ -0,0 +1,674 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if !defined(MAP_NORESERVE)
+#define MAP_NORESERVE 0
+#endif
+#endif
+
+/*
+	Number of bytes of the utf-8 sequence introduced by lead, 0 if lead
+	cannot start a sequence.
+*/
+static size_t
+__schnur_io_lead_length (unsigned char lead) {
+	if (0x80 > lead) return 1;
+	if (0xC2 > lead) return 0;
+	if (0xE0 > lead) return 2;
+	if (0xF0 > lead) return 3;
+	if (0xF5 > lead) return 4;
+
+	return 0;
+}
+
+/*
+	Number of trailing bytes of s forming the start of a sequence, which is
+	cut off by the end of s. Anything else is left for validation.
+*/
+static size_t
+__schnur_io_cut_length (const unsigned char* s, size_t n) {
+	size_t i;
+
+	for (i = 1; i <= n && i < 4; ++i) {
+		unsigned char b = s[n - i];
+		if (0x80 != (b & 0xC0)) {
+			return i < __schnur_io_lead_length (b) ? i : 0;
+		}
+	}
+
+	return 0;
+}
+
+void
+schnur_decoder_init (struct schnur_decoder* self) {
+	if (NULL == self) return;
+
+	memset (self->pending, 0, sizeof (self->pending));
+	self->pending_length = 0;
+	self->offset = 0;
+	self->error = 0;
+}
+
+int
+schnur_decoder_feed (struct schnur_decoder* self, const schnur_narrow_t* bytes, size_t n, struct schnur* target) {
+	const unsigned char* s = (const unsigned char*)bytes;
+	schnur_wide_t carried[2];
+	size_t k = 0, carried_length = 0, cut, length, error;
+
+	if (NULL == self || NULL == target || (NULL == bytes && 0 < n)) {
+		return 0;
+	}
+	if (0 == n) {
+		return 1;
+	}
+
+	// Complete the sequence carried over from the previous chunk.
+	if (0 < self->pending_length) {
+		size_t need = __schnur_io_lead_length (self->pending[0]);
+		size_t c = self->pending_length;
+
+		while (c < need && k < n) {
+			if (0x80 != (s[k] & 0xC0)) {
+				self->error = self->offset - self->pending_length;
+				return 0;
+			}
+			self->pending[c++] = s[k++];
+		}
+		if (c < need) {
+			self->pending_length = c;
+			self->offset += n;
+			return 1;
+		}
+
+		if (SCHNUR_UTF8_INVALID == schnur_utf8_decode_length ((const schnur_narrow_t*)self->pending, c, NULL)) {
+			self->error = self->offset - self->pending_length;
+			return 0;
+		}
+		carried_length = schnur_utf8_decode (carried, (const schnur_narrow_t*)self->pending, c);
+	}
+
+	length = schnur_length (target);
+	if (! schnur_append_view (target, schnur_view_n (carried, carried_length))) {
+		return 0;
+	}
+
+	// Undo the carried character, if the rest of the chunk fails.
+	cut = __schnur_io_cut_length (s + k, n - k);
+	error = SCHNUR_UTF8_INVALID;
+	if (! schnur_append_utf8 (target, bytes + k, n - k - cut, &error)) {
+		schnur_terminate (target, length);
+		if (SCHNUR_UTF8_INVALID != error) {
+			self->error = self->offset + k + error;
+		}
+		return 0;
+	}
+
+	memcpy (self->pending, s + n - cut, cut);
+	self->pending_length = cut;
+	self->offset += n;
+
+	return 1;
+}
+
+int
+schnur_decoder_finish (struct schnur_decoder* self) {
+	size_t offset;
+
+	if (NULL == self) return 0;
+
+	offset = self->offset - self->pending_length;
+	if (0 < self->pending_length) {
+		schnur_decoder_init (self);
+		self->error = offset;
+		return 0;
+	}
+
+	schnur_decoder_init (self);
+
+	return 1;
+}
+
+/*
+	Reads up to n bytes from fd, retrying if interrupted by a signal. Returns
+	the number of bytes read, 0 at end of file and -1 on error.
+*/
+static long long
+__schnur_io_read (int fd, void* buffer, size_t n) {
+	long long r;
+
+	do {
+#if defined(_WIN32)
+		r = _read (fd, buffer, (unsigned int)n);
+#else
+		r = read (fd, buffer, n);
+#endif
+	} while (0 > r && EINTR == errno);
+
+	return r;
+}
+
+/*
+	Feeds the decoder, reporting the offset of invalid input.
+*/
+static int
+__schnur_io_feed (struct schnur_decoder* decoder, const schnur_narrow_t* bytes, size_t n, struct schnur* target, size_t* error) {
+	if (schnur_decoder_feed (decoder, bytes, n, target)) {
+		return 1;
+	}
+	if (NULL != error) *error = decoder->error;
+
+	return 0;
+}
+
+/*
+	Checks the stream ended on a character boundary.
+*/
+static int
+__schnur_io_finish (struct schnur_decoder* decoder, size_t* error) {
+	if (schnur_decoder_finish (decoder)) {
+		return 1;
+	}
+	if (NULL != error) *error = decoder->error;
+
+	return 0;
+}
+
+int
+schnur_read_fd (struct schnur* self, int fd, size_t* error) {
+	schnur_narrow_t chunk[SCHNUR_READ_CHUNK_SIZE];
+	struct schnur_decoder decoder;
+	long long r;
+
+	if (NULL == self || 0 > fd) {
+		return 0;
+	}
+
+	schnur_decoder_init (&decoder);
+
+	while (0 < (r = __schnur_io_read (fd, chunk, sizeof (chunk)))) {
+		if (! __schnur_io_feed (&decoder, chunk, (size_t)r, self, error)) {
+			return 0;
+		}
+	}
+	if (0 > r) {
+		return 0;
+	}
+
+	return __schnur_io_finish (&decoder, error);
+}
+
+int
+schnur_read_file (struct schnur* self, FILE* file, size_t* error) {
+	schnur_narrow_t chunk[SCHNUR_READ_CHUNK_SIZE];
+	struct schnur_decoder decoder;
+	size_t r;
+
+	if (NULL == self || NULL == file) {
+		return 0;
+	}
+
+	schnur_decoder_init (&decoder);
+
+	while (0 < (r = fread (chunk, 1, sizeof (chunk), file))) {
+		if (! __schnur_io_feed (&decoder, chunk, r, self, error)) {
+			return 0;
+		}
+	}
+	if (ferror (file)) {
+		return 0;
+	}
+
+	return __schnur_io_finish (&decoder, error);
+}
+
+/*
+	Writes all n bytes to fd, retrying if interrupted by a signal.
+*/
+static int
+__schnur_io_write (int fd, const schnur_narrow_t* bytes, size_t n) {
+	long long r;
+
+	while (0 < n) {
+#if defined(_WIN32)
+		r = _write (fd, bytes, (unsigned int)(n < 0x40000000 ? n : 0x40000000));
+#else
+		r = write (fd, bytes, n);
+#endif
+		if (0 > r) {
+			if (EINTR == errno) continue;
+			return 0;
+		}
+		bytes += r;
+		n -= (size_t)r;
+	}
+
+	return 1;
+}
+
+/**
+	@brief: Encodes characters into a fixed buffer, writing it out whenever
+			  it fills up.
+*/
+struct __schnur_io_writer {
+	int fd;
+	size_t used;
+	schnur_narrow_t buffer[SCHNUR_WRITE_CHUNK_SIZE];
+};
+
+static int
+__schnur_io_flush (struct __schnur_io_writer* w) {
+	int ok = __schnur_io_write (w->fd, w->buffer, w->used);
+
+	w->used = 0;
+
+	return ok;
+}
+
+/*
+	Encodes view into the buffer, as many characters at once as surely fit.
+	Flushes early rather than encoding a few characters at a time.
+*/
+static int
+__schnur_io_put (struct __schnur_io_writer* w, struct schnur_view view) {
+	size_t room, k, n;
+
+	while (0 < view.length) {
+		room = SCHNUR_WRITE_CHUNK_SIZE - w->used;
+		k = room / SCHNUR_UTF8_MAX_BYTES;
+		if (k < view.length && room < SCHNUR_WRITE_CHUNK_SIZE / 8) {
+			if (! __schnur_io_flush (w)) return 0;
+			continue;
+		}
+		if (k > view.length) {
+			k = view.length;
+		}
+#if WCHAR_MAX <= 0xFFFF
+		// Keep surrogate pairs together.
+		if (k < view.length && 0xD800 <= view.data[k - 1] && 0xDBFF >= view.data[k - 1]) {
+			--k;
+		}
+#endif
+
+		n = schnur_utf8_encode (w->buffer + w->used, view.data, k);
+		if (SCHNUR_UTF8_INVALID == n) {
+			return 0;
+		}
+		w->used += n;
+		view.data += k;
+		view.length -= k;
+	}
+
+	return 1;
+}
+
+int
+schnur_write_fd (const struct schnur* self, int fd) {
+	return schnur_writev_fd (&self, 1, fd);
+}
+
+int
+schnur_writev_fd (const struct schnur* const* schnurs, size_t n, int fd) {
+	struct __schnur_io_writer w;
+	size_t i;
+
+	if ((NULL == schnurs && 0 < n) || 0 > fd) {
+		return 0;
+	}
+	for (i = 0; i < n; ++i) {
+		if (NULL == schnurs[i]) return 0;
+	}
+
+	w.fd = fd;
+	w.used = 0;
+	for (i = 0; i < n; ++i) {
+		if (! __schnur_io_put (&w, schnur_view_of (schnurs[i]))) {
+			return 0;
+		}
+	}
+
+	return __schnur_io_flush (&w);
+}
+
+/**
+	@brief: A utf-8 file mapped into memory, decoded block by block on
+			  first access into storage reserved for all of its characters.
+*/
+struct schnur_mapped {
+	/**
+		@brief: Allocator managing the mapping and its block index.
+	*/
+	const struct schnur_allocator* allocator;
+
+	/**
+		@brief: The mapped bytes of the file, NULL for empty files.
+	*/
+	const unsigned char* bytes;
+	size_t size;
+
+	/**
+		@brief: Storage for all characters plus null terminator. Memory is
+				  only committed for the pages written to.
+	*/
+	schnur_wide_t* data;
+	size_t data_size;
+
+	/**
+		@brief: Number of characters, known exactly from the prescan.
+	*/
+	size_t length;
+
+	/**
+		@brief: Number of characters decoded so far.
+	*/
+	size_t decoded_length;
+
+	/**
+		@brief: Offsets of block i in bytes and characters, block_count + 1
+				  entries each. Blocks start on character boundaries.
+	*/
+	size_t block_count;
+	size_t* byte_offsets;
+	size_t* char_offsets;
+
+	/**
+		@brief: Whether block i has been decoded, block_count entries.
+	*/
+	unsigned char* decoded;
+};
+
+#if defined(_WIN32)
+
+/*
+	Mapping files is implemented for POSIX systems only.
+*/
+static int
+__schnur_mapped_map (struct schnur_mapped* self, const char* path) {
+	(void)self;
+	(void)path;
+
+	return 0;
+}
+
+static int
+__schnur_mapped_reserve (struct schnur_mapped* self) {
+	(void)self;
+
+	return 0;
+}
+
+static void
+__schnur_mapped_unmap (struct schnur_mapped* self) {
+	(void)self;
+}
+
+#else
+
+/*
+	Maps the file at path read only. Empty files are not mapped at all.
+*/
+static int
+__schnur_mapped_map (struct schnur_mapped* self, const char* path) {
+	struct stat info;
+	void* bytes;
+	int fd;
+
+	fd = open (path, O_RDONLY);
+	if (0 > fd) {
+		return 0;
+	}
+	if (0 != fstat (fd, &info) || 0 > info.st_size || SIZE_MAX < (uintmax_t)info.st_size) {
+		close (fd);
+		return 0;
+	}
+
+	self->size = (size_t)info.st_size;
+	if (0 < self->size) {
+		bytes = mmap (NULL, self->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == bytes) {
+			close (fd);
+			return 0;
+		}
+		self->bytes = bytes;
+#if defined(MADV_SEQUENTIAL)
+		madvise (bytes, self->size, MADV_SEQUENTIAL);
+#endif
+	}
+	close (fd);
+
+	return 1;
+}
+
+/*
+	Reserves storage for length characters plus null terminator, without
+	committing memory. Anonymous pages read as zero, so it is terminated.
+*/
+static int
+__schnur_mapped_reserve (struct schnur_mapped* self) {
+	void* data;
+
+	if (self->length >= SIZE_MAX / sizeof (schnur_wide_t)) {
+		return 0;
+	}
+
+	self->data_size = (self->length + 1) * sizeof (schnur_wide_t);
+	data = mmap (NULL, self->data_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (MAP_FAILED == data) {
+		self->data_size = 0;
+		return 0;
+	}
+	self->data = data;
+
+	return 1;
+}
+
+static void
+__schnur_mapped_unmap (struct schnur_mapped* self) {
+	if (NULL != self->bytes) {
+		munmap ((void*)self->bytes, self->size);
+	}
+	if (NULL != self->data) {
+		munmap (self->data, self->data_size);
+	}
+}
+
+#endif
+
+/*
+	Splits the bytes into blocks starting on character boundaries, and
+	measures each of them. Validates the whole file in one pass.
+*/
+static int
+__schnur_mapped_prescan (struct schnur_mapped* self, size_t* error) {
+	const struct schnur_allocator* a = self->allocator;
+	size_t count = (self->size + SCHNUR_MAPPED_BLOCK_SIZE - 1) / SCHNUR_MAPPED_BLOCK_SIZE;
+	size_t i, k, n, e;
+	unsigned char* index;
+
+	index = a->allocate (a->context,
+		2 * (count + 1) * sizeof (size_t) + count);
+	if (NULL == index) {
+		return 0;
+	}
+
+	self->block_count = count;
+	self->byte_offsets = (size_t*)index;
+	self->char_offsets = self->byte_offsets + count + 1;
+	self->decoded = (unsigned char*)(self->char_offsets + count + 1);
+	memset (self->decoded, 0, count);
+
+	self->byte_offsets[0] = 0;
+	self->char_offsets[0] = 0;
+	for (i = 1; i <= count; ++i) {
+		k = i * SCHNUR_MAPPED_BLOCK_SIZE;
+		if (k >= self->size) {
+			k = self->size;
+		}
+		else {
+			// Skip at most three continuation bytes, more are invalid anyway.
+			for (e = 0; e < 3 && k < self->size && 0x80 == (self->bytes[k] & 0xC0); ++e) {
+				++k;
+			}
+		}
+		self->byte_offsets[i] = k;
+
+		k = self->byte_offsets[i - 1];
+		n = schnur_utf8_decode_length ((const schnur_narrow_t*)self->bytes + k,
+			self->byte_offsets[i] - k, &e);
+		if (SCHNUR_UTF8_INVALID == n) {
+			if (NULL != error) *error = k + e;
+			return 0;
+		}
+		self->char_offsets[i] = self->char_offsets[i - 1] + n;
+	}
+
+	self->length = self->char_offsets[count];
+
+	return 1;
+}
+
+/*
+	Index of the block holding character i, which has to be in range.
+*/
+static size_t
+__schnur_mapped_block (const struct schnur_mapped* self, size_t i) {
+	size_t low = 0, high = self->block_count;
+
+	while (1 < high - low) {
+		size_t middle = low + (high - low) / 2;
+		if (self->char_offsets[middle] <= i) {
+			low = middle;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+/*
+	Decodes the blocks first to last, unless done before.
+*/
+static void
+__schnur_mapped_decode (struct schnur_mapped* self, size_t first, size_t last) {
+	size_t i, k;
+
+	for (i = first; i <= last; ++i) {
+		if (self->decoded[i]) {
+			continue;
+		}
+
+		k = self->byte_offsets[i];
+		schnur_utf8_decode (self->data + self->char_offsets[i],
+			(const schnur_narrow_t*)self->bytes + k, self->byte_offsets[i + 1] - k);
+		self->decoded[i] = 1;
+		self->decoded_length += self->char_offsets[i + 1] - self->char_offsets[i];
+	}
+}
+
+struct schnur_mapped*
+schnur_mapped_open (const char* path, size_t* error) {
+	const struct schnur_allocator* a = schnur_get_allocator ();
+	struct schnur_mapped* mapped;
+
+	if (NULL == path) {
+		return NULL;
+	}
+
+	mapped = a->allocate (a->context, sizeof (struct schnur_mapped));
+	if (NULL == mapped) {
+		return NULL;
+	}
+	memset (mapped, 0, sizeof (struct schnur_mapped));
+	mapped->allocator = a;
+
+	if (! __schnur_mapped_map (mapped, path)
+	 || ! __schnur_mapped_prescan (mapped, error)
+	 || ! __schnur_mapped_reserve (mapped)) {
+		schnur_mapped_free (mapped);
+		return NULL;
+	}
+
+	return mapped;
+}
+
+int
+schnur_mapped_free (struct schnur_mapped* self) {
+	const struct schnur_allocator* a;
+
+	if (NULL == self) {
+		return 0;
+	}
+
+	a = self->allocator;
+	__schnur_mapped_unmap (self);
+	if (NULL != self->byte_offsets) {
+		a->release (a->context, self->byte_offsets);
+	}
+	a->release (a->context, self);
+
+	return 1;
+}
+
+size_t
+schnur_mapped_length (const struct schnur_mapped* self) {
+	return NULL == self ? 0 : self->length;
+}
+
+size_t
+schnur_mapped_decoded_length (const struct schnur_mapped* self) {
+	return NULL == self ? 0 : self->decoded_length;
+}
+
+schnur_wide_t
+schnur_mapped_get (struct schnur_mapped* self, size_t i) {
+	size_t block;
+
+	if (NULL == self || i >= self->length) {
+		return SCHNUR_WC_NULL;
+	}
+
+	block = __schnur_mapped_block (self, i);
+	__schnur_mapped_decode (self, block, block);
+
+	return self->data[i];
+}
+
+struct schnur_view
+schnur_mapped_slice (struct schnur_mapped* self, size_t begin, size_t end) {
+	struct schnur_view view = { NULL, 0 };
+
+	if (NULL == self || begin > end || end > self->length) {
+		return view;
+	}
+
+	if (begin < end) {
+		__schnur_mapped_decode (self,
+			__schnur_mapped_block (self, begin),
+			__schnur_mapped_block (self, end - 1));
+	}
+
+	view.data = self->data + begin;
+	view.length = end - begin;
+
+	return view;
+}
@@ -0,0 +1,605 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(SCHNUR_WITH_IO_URING)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+/// Smallest buffer read into, if the size of a file is unknown.
+#define SCHNUR_LOAD_MIN_BUFFER 4096
+
+/**
+	@brief: A file being read, into a buffer reused for every file loaded
+			  through the same slot.
+*/
+struct schnur_load_slot {
+	/**
+		@brief: Index of the file in the batch.
+	*/
+	size_t index;
+
+	/**
+		@brief: The open file, -1 if none.
+	*/
+	int fd;
+
+	/**
+		@brief: Size reported when opening, 0 if unknown, in which case the
+				  file is read until end of file.
+	*/
+	size_t size;
+
+	/**
+		@brief: Number of bytes read so far.
+	*/
+	size_t used;
+
+	/**
+		@brief: The buffer and its size in bytes.
+	*/
+	schnur_narrow_t* buffer;
+	size_t capacity;
+};
+
+enum schnur_load_state {
+	SCHNUR_LOAD_FAILED,
+	SCHNUR_LOAD_MORE,
+	SCHNUR_LOAD_DONE,
+};
+
+/*
+	Makes sure the slot has room for n bytes.
+*/
+static int
+__schnur_load_reserve (struct schnur_load_slot* slot, size_t n) {
+	const struct schnur_allocator* a = schnur_get_allocator ();
+	schnur_narrow_t* buffer;
+
+	if (slot->capacity >= n) {
+		return 1;
+	}
+
+	buffer = a->reallocate (a->context, slot->buffer, slot->capacity, n);
+	if (NULL == buffer) {
+		return 0;
+	}
+	slot->buffer = buffer;
+	slot->capacity = n;
+
+	return 1;
+}
+
+static void
+__schnur_load_close (struct schnur_load_slot* slot) {
+	if (0 <= slot->fd) {
+#if defined(_WIN32)
+		_close (slot->fd);
+#else
+		close (slot->fd);
+#endif
+		slot->fd = -1;
+	}
+}
+
+/*
+	Opens the file at path and prepares the slot for reading all of it.
+*/
+static int
+__schnur_load_open (struct schnur_load_slot* slot, size_t index, const char* path) {
+	struct stat info;
+
+	slot->index = index;
+	slot->size = 0;
+	slot->used = 0;
+#if defined(_WIN32)
+	slot->fd = NULL == path ? -1 : _open (path, _O_RDONLY | _O_BINARY);
+#else
+	slot->fd = NULL == path ? -1 : open (path, O_RDONLY);
+#endif
+	if (0 > slot->fd) {
+		return 0;
+	}
+
+	if (0 == fstat (slot->fd, &info) && 0 < info.st_size
+	 && SIZE_MAX > (uintmax_t)info.st_size) {
+		slot->size = (size_t)info.st_size;
+	}
+	if (! __schnur_load_reserve (slot, 0 < slot->size ? slot->size : SCHNUR_LOAD_MIN_BUFFER)) {
+		__schnur_load_close (slot);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+	Number of bytes to read next, growing the buffer for files of unknown
+	size. 0 on allocation failure.
+*/
+static size_t
+__schnur_load_wanted (struct schnur_load_slot* slot) {
+	if (0 < slot->size) {
+		return slot->size - slot->used;
+	}
+	if (slot->used == slot->capacity
+	 && (SIZE_MAX / 2 < slot->capacity || ! __schnur_load_reserve (slot, 2 * slot->capacity))) {
+		return 0;
+	}
+
+	return slot->capacity - slot->used;
+}
+
+/*
+	Accounts for r bytes read, a negative r being an error number.
+*/
+static enum schnur_load_state
+__schnur_load_advance (struct schnur_load_slot* slot, long long r) {
+	if (0 > r) {
+		return EINTR == -r || EAGAIN == -r ? SCHNUR_LOAD_MORE : SCHNUR_LOAD_FAILED;
+	}
+	if (0 == r) {
+		return SCHNUR_LOAD_DONE;
+	}
+
+	slot->used += (size_t)r;
+	if (0 < slot->size && slot->used == slot->size) {
+		return SCHNUR_LOAD_DONE;
+	}
+
+	return SCHNUR_LOAD_MORE;
+}
+
+/*
+	Closes the file and decodes what has been read, if successful.
+*/
+static int
+__schnur_load_finish (struct schnur_load_slot* slot, enum schnur_load_state state, struct schnur** schnurs) {
+	__schnur_load_close (slot);
+	if (SCHNUR_LOAD_DONE == state) {
+		schnurs[slot->index] = schnur_new_su_n (slot->buffer, slot->used, NULL);
+	}
+
+	return NULL != schnurs[slot->index];
+}
+
+static void
+__schnur_load_release (struct schnur_load_slot* slot) {
+	const struct schnur_allocator* a = schnur_get_allocator ();
+
+	__schnur_load_close (slot);
+	if (NULL != slot->buffer) {
+		a->release (a->context, slot->buffer);
+	}
+	slot->buffer = NULL;
+	slot->capacity = 0;
+}
+
+/**
+	@brief: Work shared by the threads of a batch, taking files in order.
+*/
+struct schnur_load_batch {
+	const char* const* paths;
+	size_t count;
+	struct schnur** schnurs;
+	atomic_size_t next;
+	atomic_size_t loaded;
+};
+
+/*
+	Loads files of the batch with blocking reads, until none are left.
+*/
+static void
+__schnur_load_work (struct schnur_load_batch* batch) {
+	struct schnur_load_slot slot = { 0, -1, 0, 0, NULL, 0 };
+	enum schnur_load_state state;
+	size_t i, wanted;
+	long long r;
+
+	while (batch->count > (i = atomic_fetch_add (&batch->next, 1))) {
+		if (! __schnur_load_open (&slot, i, batch->paths[i])) {
+			continue;
+		}
+
+		do {
+			wanted = __schnur_load_wanted (&slot);
+			if (0 == wanted) {
+				state = SCHNUR_LOAD_FAILED;
+				break;
+			}
+#if defined(_WIN32)
+			r = _read (slot.fd, slot.buffer + slot.used, (unsigned int)(wanted < 0x40000000 ? wanted : 0x40000000));
+#else
+			r = read (slot.fd, slot.buffer + slot.used, wanted);
+#endif
+			state = __schnur_load_advance (&slot, 0 > r ? -errno : r);
+		} while (SCHNUR_LOAD_MORE == state);
+
+		if (__schnur_load_finish (&slot, state, batch->schnurs)) {
+			atomic_fetch_add (&batch->loaded, 1);
+		}
+	}
+
+	__schnur_load_release (&slot);
+}
+
+#if defined(_WIN32)
+typedef HANDLE schnur_thread_t;
+static DWORD WINAPI __schnur_load_thread (LPVOID batch) { __schnur_load_work (batch); return 0; }
+static int  __schnur_thread_start (schnur_thread_t* t, struct schnur_load_batch* batch) { return NULL != (*t = CreateThread (NULL, 0, __schnur_load_thread, batch, 0, NULL)); }
+static void __schnur_thread_join (schnur_thread_t t) { WaitForSingleObject (t, INFINITE); CloseHandle (t); }
+#else
+typedef pthread_t schnur_thread_t;
+static void* __schnur_load_thread (void* batch) { __schnur_load_work (batch); return NULL; }
+static int  __schnur_thread_start (schnur_thread_t* t, struct schnur_load_batch* batch) { return 0 == pthread_create (t, NULL, __schnur_load_thread, batch); }
+static void __schnur_thread_join (schnur_thread_t t) { pthread_join (t, NULL); }
+#endif
+
+/*
+	Loads the batch on SCHNUR_LOAD_THREAD_COUNT threads, the calling one
+	included. Returns the number of files loaded.
+*/
+static size_t
+__schnur_load_threaded (struct schnur_load_batch* batch) {
+	schnur_thread_t threads[SCHNUR_LOAD_THREAD_COUNT];
+	size_t i, started = 0;
+
+	for (i = 1; i < SCHNUR_LOAD_THREAD_COUNT && i < batch->count; ++i) {
+		if (! __schnur_thread_start (&threads[started], batch)) {
+			break;
+		}
+		++started;
+	}
+
+	__schnur_load_work (batch);
+
+	for (i = 0; i < started; ++i) {
+		__schnur_thread_join (threads[i]);
+	}
+
+	return atomic_load (&batch->loaded);
+}
+
+#if defined(SCHNUR_WITH_IO_URING)
+
+/**
+	@brief: The rings shared with the kernel, set up without liburing.
+*/
+struct schnur_uring {
+	int fd;
+	unsigned int entries;
+
+	void* sq_ring;
+	size_t sq_ring_size;
+	_Atomic uint32_t* sq_head;
+	_Atomic uint32_t* sq_tail;
+	uint32_t sq_mask;
+	uint32_t* sq_array;
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+
+	void* cq_ring;
+	size_t cq_ring_size;
+	_Atomic uint32_t* cq_head;
+	_Atomic uint32_t* cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe* cqes;
+
+	/**
+		@brief: Number of entries queued, but not submitted yet.
+	*/
+	unsigned int pending;
+};
+
+static void
+__schnur_uring_close (struct schnur_uring* ring) {
+	if (NULL != ring->sqes) {
+		munmap (ring->sqes, ring->sqes_size);
+	}
+	if (NULL != ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+		munmap (ring->cq_ring, ring->cq_ring_size);
+	}
+	if (NULL != ring->sq_ring) {
+		munmap (ring->sq_ring, ring->sq_ring_size);
+	}
+	if (0 <= ring->fd) {
+		close (ring->fd);
+	}
+}
+
+/*
+	Sets up a ring of given number of entries. Fails where the kernel does
+	not support io_uring, or forbids it.
+*/
+static int
+__schnur_uring_open (struct schnur_uring* ring, unsigned int entries) {
+	struct io_uring_params p;
+	unsigned char* sq;
+	unsigned char* cq;
+	void* sqes;
+
+	memset (ring, 0, sizeof (*ring));
+	memset (&p, 0, sizeof (p));
+
+	ring->fd = (int)syscall (__NR_io_uring_setup, entries, &p);
+	if (0 > ring->fd) {
+		return 0;
+	}
+	ring->entries = p.sq_entries;
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (uint32_t);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size) {
+			ring->sq_ring_size = ring->cq_ring_size;
+		}
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	sq = mmap (NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (MAP_FAILED == sq) {
+		ring->sq_ring = NULL;
+		__schnur_uring_close (ring);
+		return 0;
+	}
+	ring->sq_ring = sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	}
+	else {
+		cq = mmap (NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (MAP_FAILED == cq) {
+			__schnur_uring_close (ring);
+			return 0;
+		}
+	}
+	ring->cq_ring = cq;
+
+	ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+	sqes = mmap (NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (MAP_FAILED == sqes) {
+		__schnur_uring_close (ring);
+		return 0;
+	}
+	ring->sqes = sqes;
+
+	ring->sq_head = (_Atomic uint32_t*)(sq + p.sq_off.head);
+	ring->sq_tail = (_Atomic uint32_t*)(sq + p.sq_off.tail);
+	ring->sq_mask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (uint32_t*)(sq + p.sq_off.array);
+	ring->cq_head = (_Atomic uint32_t*)(cq + p.cq_off.head);
+	ring->cq_tail = (_Atomic uint32_t*)(cq + p.cq_off.tail);
+	ring->cq_mask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	return 1;
+}
+
+/*
+	Queues a read of the slot's next bytes. There is always room, as no
+	more slots than entries are in flight.
+*/
+static void
+__schnur_uring_read (struct schnur_uring* ring, struct schnur_load_slot* slot, struct iovec* iov, size_t wanted) {
+	uint32_t tail = atomic_load_explicit (ring->sq_tail, memory_order_relaxed);
+	uint32_t i = tail & ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqes[i];
+
+	iov->iov_base = slot->buffer + slot->used;
+	iov->iov_len = wanted;
+
+	// Vectored reads are supported by every kernel with io_uring.
+	memset (sqe, 0, sizeof (*sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = slot->fd;
+	sqe->off = slot->used;
+	sqe->addr = (uint64_t)(uintptr_t)iov;
+	sqe->len = 1;
+	sqe->user_data = (uint64_t)(uintptr_t)slot;
+
+	ring->sq_array[i] = i;
+	atomic_store_explicit (ring->sq_tail, tail + 1, memory_order_release);
+	++ring->pending;
+}
+
+/*
+	Submits queued reads and waits for at least one completion.
+*/
+static int
+__schnur_uring_enter (struct schnur_uring* ring) {
+	long r;
+
+	// Anything but running short of resources means the ring is unusable.
+	do {
+		r = syscall (__NR_io_uring_enter, ring->fd, ring->pending, 1,
+			IORING_ENTER_GETEVENTS, NULL, 0);
+	} while (0 > r && (EINTR == errno || EAGAIN == errno || EBUSY == errno));
+
+	if (0 > r) {
+		return 0;
+	}
+	ring->pending -= (unsigned int)r;
+
+	return 1;
+}
+
+/*
+	Opens files of the batch into slot, until one opens. Returns 0 once the
+	batch is exhausted.
+*/
+static int
+__schnur_uring_next (struct schnur_load_batch* batch, struct schnur_load_slot* slot) {
+	size_t i;
+
+	while (batch->count > (i = atomic_fetch_add (&batch->next, 1))) {
+		if (__schnur_load_open (slot, i, batch->paths[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Loads the batch through io_uring, decoding each file on the calling
+	thread as soon as it has been read, while the reads of others proceed.
+	Returns 0 if io_uring is unavailable, before loading any file.
+*/
+static int
+__schnur_load_uring (struct schnur_load_batch* batch) {
+	const struct schnur_allocator* a = schnur_get_allocator ();
+	struct schnur_load_slot* slots;
+	struct iovec* iovs;
+	struct schnur_uring ring;
+	size_t n, i, wanted, in_flight = 0;
+	int ok = 1;
+
+	if (! __schnur_uring_open (&ring, SCHNUR_LOAD_QUEUE_DEPTH)) {
+		return 0;
+	}
+
+	n = ring.entries < batch->count ? ring.entries : batch->count;
+	slots = a->allocate (a->context, n * (sizeof (*slots) + sizeof (*iovs)));
+	if (NULL == slots) {
+		__schnur_uring_close (&ring);
+		return 0;
+	}
+	iovs = (struct iovec*)(slots + n);
+
+	for (i = 0; i < n; ++i) {
+		slots[i].fd = -1;
+		slots[i].buffer = NULL;
+		slots[i].capacity = 0;
+		if (__schnur_uring_next (batch, &slots[i])) {
+			__schnur_uring_read (&ring, &slots[i], &iovs[i], __schnur_load_wanted (&slots[i]));
+			++in_flight;
+		}
+	}
+
+	while (ok && 0 < in_flight) {
+		uint32_t head, tail;
+
+		ok = __schnur_uring_enter (&ring);
+
+		head = atomic_load_explicit (ring.cq_head, memory_order_relaxed);
+		tail = atomic_load_explicit (ring.cq_tail, memory_order_acquire);
+		for (; head != tail; ++head) {
+			struct io_uring_cqe* cqe = &ring.cqes[head & ring.cq_mask];
+			struct schnur_load_slot* slot = (struct schnur_load_slot*)(uintptr_t)cqe->user_data;
+			enum schnur_load_state state = __schnur_load_advance (slot, cqe->res);
+
+			i = (size_t)(slot - slots);
+			if (SCHNUR_LOAD_MORE == state) {
+				wanted = __schnur_load_wanted (slot);
+				if (0 < wanted) {
+					__schnur_uring_read (&ring, slot, &iovs[i], wanted);
+					continue;
+				}
+				state = SCHNUR_LOAD_FAILED;
+			}
+
+			if (__schnur_load_finish (slot, state, batch->schnurs)) {
+				atomic_fetch_add (&batch->loaded, 1);
+			}
+			if (__schnur_uring_next (batch, slot)) {
+				__schnur_uring_read (&ring, slot, &iovs[i], __schnur_load_wanted (slot));
+			}
+			else {
+				--in_flight;
+			}
+		}
+		atomic_store_explicit (ring.cq_head, head, memory_order_release);
+	}
+
+	__schnur_uring_close (&ring);
+	if (ok) {
+		for (i = 0; i < n; ++i) {
+			__schnur_load_release (&slots[i]);
+		}
+		a->release (a->context, slots);
+	}
+	else {
+		// Reads still in flight, on slots with an open file, may complete
+		// after the ring is gone. So their buffers and the vectors pointing
+		// there are leaked rather than released. The whole batch is loaded
+		// again by the threads.
+		for (i = 0; i < n; ++i) {
+			if (0 > slots[i].fd) {
+				__schnur_load_release (&slots[i]);
+			}
+			__schnur_load_close (&slots[i]);
+		}
+
+		atomic_store (&batch->next, 0);
+		for (i = 0; i < batch->count; ++i) {
+			if (NULL != batch->schnurs[i]) {
+				schnur_free (batch->schnurs[i]);
+				batch->schnurs[i] = NULL;
+			}
+		}
+		atomic_store (&batch->loaded, 0);
+		return 0;
+	}
+
+	return 1;
+}
+
+#endif
+
+int
+schnur_load_files (const char* const* paths, size_t count, struct schnur** schnurs, int flags) {
+	struct schnur_load_batch batch;
+	size_t i;
+
+	if (NULL == paths || NULL == schnurs) {
+		return 0 == count;
+	}
+
+	for (i = 0; i < count; ++i) {
+		schnurs[i] = NULL;
+	}
+
+	batch.paths = paths;
+	batch.count = count;
+	batch.schnurs = schnurs;
+	atomic_init (&batch.next, 0);
+	atomic_init (&batch.loaded, 0);
+
+#if defined(SCHNUR_WITH_IO_URING)
+	if (! (flags & SCHNUR_LOAD_THREADS) && __schnur_load_uring (&batch)) {
+		return count == atomic_load (&batch.loaded);
+	}
+#else
+	(void)flags;
+#endif
+
+	return count == __schnur_load_threaded (&batch);
+}
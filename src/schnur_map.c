@@ -0,0 +1,516 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) \
+ || (defined(__i386__) && defined(__SSE2__)) \
+ || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+/// SSE2 is available at compile time.
+#define SCHNUR_MAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/// Number of control bytes inspected at once.
+#define SCHNUR_MAP_GROUP 16
+/// Number of slots of the first table, a power of two of at least a group.
+#define SCHNUR_MAP_INITIAL_SLOTS 16
+
+/// Control byte of a slot never used.
+#define SCHNUR_MAP_EMPTY ((unsigned char)0x80)
+/// Control byte of a slot, whose entry was removed.
+#define SCHNUR_MAP_DELETED ((unsigned char)0xFE)
+
+/**
+	@brief: An entry of the map.
+*/
+struct schnur_map_slot {
+	/**
+		@brief: Full hash of the key, to skip most comparisons and rehashing.
+	*/
+	uint64_t hash;
+
+	/**
+		@brief: Length of the key, to skip comparisons without touching it.
+	*/
+	size_t length;
+
+	/**
+		@brief: Snapshot of the key.
+	*/
+	const struct schnur_frozen* key;
+
+	void* value;
+};
+
+/**
+	@brief: Open addressing table in the style of Swiss tables. Each slot has
+			  a control byte, holding 7 bits of the hash of a used slot, or
+			  marking it empty or deleted. Probing compares a whole group of
+			  control bytes at once, only visiting slots with matching bits.
+*/
+struct schnur_map {
+	const struct schnur_allocator* allocator;
+
+	/**
+		@brief: Slots, followed by their control bytes. NULL while empty.
+	*/
+	struct schnur_map_slot* slots;
+
+	/**
+		@brief: One control byte per slot, plus a copy of the first group,
+				  so groups can be loaded at any position without wrapping.
+	*/
+	unsigned char* control;
+
+	/**
+		@brief: Number of slots, a power of two.
+	*/
+	size_t capacity;
+
+	/**
+		@brief: Number of used slots.
+	*/
+	size_t count;
+
+	/**
+		@brief: Number of used and deleted slots together may not exceed
+				  this, otherwise probe sequences get too long.
+	*/
+	size_t growth_left;
+};
+
+/*
+	Bit i of the result is set, if control byte i of the group matches.
+*/
+#if defined(SCHNUR_MAP_SSE2)
+static inline uint32_t
+__schnur_map_match (const unsigned char* group, unsigned char c) {
+	__m128i g = _mm_loadu_si128 ((const __m128i*)group);
+	return (uint32_t)_mm_movemask_epi8 (_mm_cmpeq_epi8 (g, _mm_set1_epi8 ((char)c)));
+}
+
+static inline uint32_t
+__schnur_map_match_free (const unsigned char* group) {
+	// Empty and deleted slots have their high bit set.
+	return (uint32_t)_mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i*)group));
+}
+#else
+static inline uint32_t
+__schnur_map_match (const unsigned char* group, unsigned char c) {
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < SCHNUR_MAP_GROUP; ++i) {
+		mask |= (uint32_t)(c == group[i]) << i;
+	}
+
+	return mask;
+}
+
+static inline uint32_t
+__schnur_map_match_free (const unsigned char* group) {
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < SCHNUR_MAP_GROUP; ++i) {
+		mask |= (uint32_t)(group[i] >> 7) << i;
+	}
+
+	return mask;
+}
+#endif
+
+static inline int
+__schnur_map_lowest_bit (uint32_t mask) {
+#if defined(__GNUC__)
+	return __builtin_ctz (mask);
+#else
+	int i = 0;
+	while (0 == (mask & 1)) {
+		mask >>= 1;
+		++i;
+	}
+	return i;
+#endif
+}
+
+static inline unsigned char
+__schnur_map_h2 (uint64_t hash) {
+	return (unsigned char)(hash & 0x7F);
+}
+
+static inline size_t
+__schnur_map_h1 (uint64_t hash) {
+	return (size_t)(hash >> 7);
+}
+
+static void
+__schnur_map_set_control (struct schnur_map* map, size_t i, unsigned char c) {
+	map->control[i] = c;
+	if (i < SCHNUR_MAP_GROUP) {
+		map->control[map->capacity + i] = c;
+	}
+}
+
+/*
+	Finds the slot holding key, returns capacity if there is none.
+*/
+static size_t
+__schnur_map_find (const struct schnur_map* map, uint64_t hash, struct schnur_view key) {
+	unsigned char h2 = __schnur_map_h2 (hash);
+	size_t mask = map->capacity - 1;
+	size_t pos, step;
+
+	if (0 == map->count) {
+		return map->capacity;
+	}
+
+	pos = __schnur_map_h1 (hash) & mask;
+	for (step = SCHNUR_MAP_GROUP;; step += SCHNUR_MAP_GROUP) {
+		const unsigned char* group = map->control + pos;
+		uint32_t matches = __schnur_map_match (group, h2);
+
+		while (0 != matches) {
+			size_t i = (pos + __schnur_map_lowest_bit (matches)) & mask;
+			const struct schnur_map_slot* slot = &map->slots[i];
+
+			if (hash == slot->hash
+			 && key.length == slot->length
+			 && schnur_view_equal (schnur_frozen_view (slot->key), key)) {
+				return i;
+			}
+			matches &= matches - 1;
+		}
+
+		// An empty slot ends every probe sequence.
+		if (0 != __schnur_map_match (group, SCHNUR_MAP_EMPTY)) {
+			return map->capacity;
+		}
+
+		pos = (pos + step) & mask;
+	}
+}
+
+/*
+	Finds the first empty or deleted slot in the probe sequence of hash.
+*/
+static size_t
+__schnur_map_find_free (const struct schnur_map* map, uint64_t hash) {
+	size_t mask = map->capacity - 1;
+	size_t pos = __schnur_map_h1 (hash) & mask;
+	size_t step;
+
+	for (step = SCHNUR_MAP_GROUP;; step += SCHNUR_MAP_GROUP) {
+		uint32_t available = __schnur_map_match_free (map->control + pos);
+
+		if (0 != available) {
+			return (pos + __schnur_map_lowest_bit (available)) & mask;
+		}
+
+		pos = (pos + step) & mask;
+	}
+}
+
+/*
+	Moves all entries into a table of given capacity, dropping deleted slots.
+*/
+static int
+__schnur_map_rehash (struct schnur_map* map, size_t capacity) {
+	const struct schnur_allocator* a = map->allocator;
+	struct schnur_map_slot* old_slots = map->slots;
+	unsigned char* old_control = map->control;
+	size_t old_capacity = map->capacity;
+	size_t i;
+	void* block;
+
+	if (capacity > (SIZE_MAX - SCHNUR_MAP_GROUP)
+		/ (sizeof (struct schnur_map_slot) + 1)) {
+		return 0;
+	}
+
+	block = a->allocate (a->context,
+		capacity * sizeof (struct schnur_map_slot) + capacity + SCHNUR_MAP_GROUP);
+	if (NULL == block) {
+		return 0;
+	}
+
+	map->slots = block;
+	map->control = (unsigned char*)(map->slots + capacity);
+	map->capacity = capacity;
+	map->growth_left = capacity - capacity / 8 - map->count;
+	memset (map->control, SCHNUR_MAP_EMPTY, capacity + SCHNUR_MAP_GROUP);
+
+	for (i = 0; i < old_capacity; ++i) {
+		if (0 == (old_control[i] & 0x80)) {
+			size_t j = __schnur_map_find_free (map, old_slots[i].hash);
+			map->slots[j] = old_slots[i];
+			__schnur_map_set_control (map, j, old_control[i]);
+		}
+	}
+
+	a->release (a->context, old_slots);
+
+	return 1;
+}
+
+/*
+	Inserts key with given hash, or replaces its value. The key snapshot is
+	only taken, if key is new: from schnur, if given, otherwise from view.
+*/
+static int
+__schnur_map_set (struct schnur_map* map, uint64_t hash, struct schnur_view view,
+	const struct schnur* schnur, void* value) {
+	struct schnur_map_slot* slot;
+	const struct schnur_frozen* key;
+	size_t i;
+
+	if (NULL == map) {
+		return 0;
+	}
+
+	i = 0 == map->capacity ? 0 : __schnur_map_find (map, hash, view);
+	if (i < map->capacity) {
+		map->slots[i].value = value;
+		return 1;
+	}
+
+	key = NULL != schnur
+		? schnur_freeze (schnur)
+		: schnur_frozen_new (view, map->allocator);
+	if (NULL == key) {
+		return 0;
+	}
+
+	i = 0 == map->capacity ? 0 : __schnur_map_find_free (map, hash);
+
+	// Reusing a deleted slot is always possible, filling an empty one
+	// needs growth left.
+	if (0 == map->capacity
+	 || (0 == map->growth_left && SCHNUR_MAP_DELETED != map->control[i])) {
+		size_t capacity = 0 == map->capacity
+			? SCHNUR_MAP_INITIAL_SLOTS
+			: map->capacity;
+		// Only grow, if not mostly filled with deleted slots.
+		if (map->count >= capacity / 2) {
+			capacity *= 2;
+		}
+		if (0 == capacity || ! __schnur_map_rehash (map, capacity)) {
+			schnur_frozen_release (key);
+			return 0;
+		}
+		i = __schnur_map_find_free (map, hash);
+	}
+
+	if (SCHNUR_MAP_EMPTY == map->control[i]) {
+		--map->growth_left;
+	}
+
+	slot = &map->slots[i];
+	slot->hash = hash;
+	slot->length = view.length;
+	slot->key = key;
+	slot->value = value;
+	__schnur_map_set_control (map, i, __schnur_map_h2 (hash));
+	++map->count;
+
+	return 1;
+}
+
+static int
+__schnur_map_remove (struct schnur_map* map, uint64_t hash, struct schnur_view view,
+	void** value) {
+	size_t i;
+
+	if (NULL == map || 0 == map->capacity) {
+		return 0;
+	}
+
+	i = __schnur_map_find (map, hash, view);
+	if (i == map->capacity) {
+		return 0;
+	}
+
+	if (NULL != value) {
+		*value = map->slots[i].value;
+	}
+	schnur_frozen_release (map->slots[i].key);
+	__schnur_map_set_control (map, i, SCHNUR_MAP_DELETED);
+	--map->count;
+
+	return 1;
+}
+
+static int
+__schnur_map_get (const struct schnur_map* map, uint64_t hash, struct schnur_view view,
+	void** value) {
+	size_t i;
+
+	if (NULL == map || 0 == map->capacity) {
+		return 0;
+	}
+
+	i = __schnur_map_find (map, hash, view);
+	if (i == map->capacity) {
+		return 0;
+	}
+
+	if (NULL != value) {
+		*value = map->slots[i].value;
+	}
+
+	return 1;
+}
+
+static int
+__schnur_map_valid (struct schnur_view view) {
+	return NULL != view.data || 0 == view.length;
+}
+
+struct schnur_map*
+schnur_map_new (const struct schnur_allocator* allocator) {
+	struct schnur_map* map;
+
+	if (NULL == allocator) {
+		allocator = schnur_get_allocator ();
+	}
+	else if (NULL == allocator->allocate
+	 || NULL == allocator->reallocate
+	 || NULL == allocator->release) {
+		return NULL;
+	}
+
+	map = allocator->allocate (allocator->context, sizeof (struct schnur_map));
+	if (NULL == map) {
+		return NULL;
+	}
+
+	map->allocator = allocator;
+	map->slots = NULL;
+	map->control = NULL;
+	map->capacity = 0;
+	map->count = 0;
+	map->growth_left = 0;
+
+	return map;
+}
+
+int
+schnur_map_free (struct schnur_map* map) {
+	const struct schnur_allocator* a;
+	size_t i;
+
+	if (NULL == map) {
+		return 0;
+	}
+
+	a = map->allocator;
+	for (i = 0; i < map->capacity; ++i) {
+		if (0 == (map->control[i] & 0x80)) {
+			schnur_frozen_release (map->slots[i].key);
+		}
+	}
+	a->release (a->context, map->slots);
+	a->release (a->context, map);
+
+	return 1;
+}
+
+size_t
+schnur_map_count (const struct schnur_map* map) {
+	return NULL == map ? 0 : map->count;
+}
+
+int
+schnur_map_set (struct schnur_map* map, const struct schnur* key, void* value) {
+	if (NULL == key) {
+		return 0;
+	}
+
+	return __schnur_map_set (map, schnur_hash (key), schnur_view_of (key), key, value);
+}
+
+int
+schnur_map_set_view (struct schnur_map* map, struct schnur_view key, void* value) {
+	if (! __schnur_map_valid (key)) {
+		return 0;
+	}
+
+	return __schnur_map_set (map, schnur_hash_view (key), key, NULL, value);
+}
+
+int
+schnur_map_get (const struct schnur_map* map, const struct schnur* key, void** value) {
+	if (NULL == key) {
+		return 0;
+	}
+
+	return __schnur_map_get (map, schnur_hash (key), schnur_view_of (key), value);
+}
+
+int
+schnur_map_get_view (const struct schnur_map* map, struct schnur_view key, void** value) {
+	if (! __schnur_map_valid (key)) {
+		return 0;
+	}
+
+	return __schnur_map_get (map, schnur_hash_view (key), key, value);
+}
+
+int
+schnur_map_get_cstr (const struct schnur_map* map, const schnur_wide_t* key, void** value) {
+	if (NULL == key) {
+		return 0;
+	}
+
+	return schnur_map_get_view (map, schnur_view_cstr (key), value);
+}
+
+int
+schnur_map_remove (struct schnur_map* map, const struct schnur* key, void** value) {
+	if (NULL == key) {
+		return 0;
+	}
+
+	return __schnur_map_remove (map, schnur_hash (key), schnur_view_of (key), value);
+}
+
+int
+schnur_map_remove_view (struct schnur_map* map, struct schnur_view key, void** value) {
+	if (! __schnur_map_valid (key)) {
+		return 0;
+	}
+
+	return __schnur_map_remove (map, schnur_hash_view (key), key, value);
+}
+
+int
+schnur_map_next (const struct schnur_map* map, size_t* cursor,
+	struct schnur_view* key, void** value) {
+	size_t i;
+
+	if (NULL == map || NULL == cursor) {
+		return 0;
+	}
+
+	for (i = *cursor; i < map->capacity; ++i) {
+		if (0 == (map->control[i] & 0x80)) {
+			if (NULL != key) {
+				*key = schnur_frozen_view (map->slots[i].key);
+			}
+			if (NULL != value) {
+				*value = map->slots[i].value;
+			}
+			*cursor = i + 1;
+			return 1;
+		}
+	}
+
+	*cursor = map->capacity;
+
+	return 0;
+}
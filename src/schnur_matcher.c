@@ -0,0 +1,412 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/// Marks a missing pattern or transition.
+#define SCHNUR_MATCHER_NONE UINT32_MAX
+/// Characters below this get their class from a direct table.
+#define SCHNUR_MATCHER_DIRECT 128
+
+/**
+	@brief: A character of the patterns beyond the direct table, with its
+			  class.
+*/
+struct schnur_matcher_class {
+	uint32_t c;
+	uint32_t id;
+};
+
+/**
+	@brief: Aho-Corasick automaton as a dense DFA. Characters are mapped to
+			  classes first: one per distinct character of the patterns, and
+			  class 0 for all others. Transitions then form a table of states
+			  times classes, so scanning takes one lookup per character and
+			  no failure links have to be followed.
+*/
+struct schnur_matcher {
+	const struct schnur_allocator* allocator;
+
+	/**
+		@brief: Classes of characters below SCHNUR_MATCHER_DIRECT.
+	*/
+	uint32_t direct[SCHNUR_MATCHER_DIRECT];
+
+	/**
+		@brief: Classes of all other characters, sorted by character.
+	*/
+	struct schnur_matcher_class* classes;
+	size_t class_count;
+
+	/**
+		@brief: Number of columns of the transition table, the number of
+				  classes.
+	*/
+	size_t stride;
+
+	size_t states;
+
+	/**
+		@brief: Next state for each state and class, row by row.
+	*/
+	uint32_t* delta;
+
+	/**
+		@brief: For each state, the longest suffix state at which patterns
+				  end, possibly itself, or 0 if there is none.
+	*/
+	uint32_t* report;
+
+	/**
+		@brief: For each state, the longest proper suffix state at which
+				  patterns end, or 0 if there is none.
+	*/
+	uint32_t* dict;
+
+	/**
+		@brief: For each state, a pattern ending there, or NONE.
+	*/
+	uint32_t* first;
+
+	/**
+		@brief: For each pattern, another pattern of equal characters, or
+				  NONE.
+	*/
+	uint32_t* next;
+
+	/**
+		@brief: Length of each pattern.
+	*/
+	size_t* lengths;
+
+	size_t pattern_count;
+};
+
+static int
+__schnur_matcher_compare_chars (const void* a, const void* b) {
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+static inline uint32_t
+__schnur_matcher_class (const struct schnur_matcher* matcher, schnur_wide_t c) {
+	uint32_t u = (uint32_t)c;
+	size_t lo = 0, hi = matcher->class_count;
+
+	if (SCHNUR_MATCHER_DIRECT > u) {
+		return matcher->direct[u];
+	}
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (matcher->classes[mid].c < u) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo < matcher->class_count && u == matcher->classes[lo].c
+		? matcher->classes[lo].id
+		: 0;
+}
+
+static void*
+__schnur_matcher_allocate (const struct schnur_allocator* a, size_t count, size_t size) {
+	if (0 == count || count > SIZE_MAX / size) {
+		return NULL;
+	}
+
+	return a->allocate (a->context, count * size);
+}
+
+/*
+	Assigns a class to every distinct character of the patterns.
+*/
+static int
+__schnur_matcher_classify (struct schnur_matcher* matcher,
+	const struct schnur* const* patterns, size_t count, size_t total) {
+	const struct schnur_allocator* a = matcher->allocator;
+	uint32_t* chars;
+	size_t i, j, n = 0, distinct = 0;
+
+	chars = __schnur_matcher_allocate (a, total, sizeof (uint32_t));
+	if (NULL == chars) {
+		return 0;
+	}
+
+	for (i = 0; i < count; ++i) {
+		struct schnur_view view = schnur_view_of (patterns[i]);
+		for (j = 0; j < view.length; ++j) {
+			chars[n++] = (uint32_t)view.data[j];
+		}
+	}
+
+	qsort (chars, n, sizeof (uint32_t), __schnur_matcher_compare_chars);
+	for (i = 0; i < n; ++i) {
+		if (0 == i || chars[i - 1] != chars[i]) {
+			chars[distinct++] = chars[i];
+		}
+	}
+
+	memset (matcher->direct, 0, sizeof (matcher->direct));
+	for (i = 0; i < distinct && SCHNUR_MATCHER_DIRECT > chars[i]; ++i) {
+		matcher->direct[chars[i]] = (uint32_t)(i + 1);
+	}
+
+	matcher->class_count = distinct - i;
+	matcher->classes = 0 == matcher->class_count
+		? NULL
+		: __schnur_matcher_allocate (a, matcher->class_count, sizeof (struct schnur_matcher_class));
+	if (0 < matcher->class_count && NULL == matcher->classes) {
+		a->release (a->context, chars);
+		return 0;
+	}
+	for (j = 0; i < distinct; ++i, ++j) {
+		matcher->classes[j].c = chars[i];
+		matcher->classes[j].id = (uint32_t)(i + 1);
+	}
+
+	matcher->stride = distinct + 1;
+	a->release (a->context, chars);
+
+	return 1;
+}
+
+/*
+	Builds the trie of all patterns, then turns it into a DFA by resolving
+	missing transitions through failure links, in breadth first order.
+*/
+static int
+__schnur_matcher_build (struct schnur_matcher* matcher,
+	const struct schnur* const* patterns, size_t count, size_t total) {
+	const struct schnur_allocator* a = matcher->allocator;
+	const size_t stride = matcher->stride;
+	uint32_t* fail;
+	uint32_t* queue;
+	size_t i, j, head = 0, tail = 0, capacity = total + 1;
+	uint32_t s, t, f;
+
+	if (capacity > SIZE_MAX / stride) {
+		return 0;
+	}
+
+	matcher->delta = __schnur_matcher_allocate (a, capacity * stride, sizeof (uint32_t));
+	matcher->first = __schnur_matcher_allocate (a, capacity, sizeof (uint32_t));
+	fail = __schnur_matcher_allocate (a, capacity, sizeof (uint32_t));
+	queue = __schnur_matcher_allocate (a, capacity, sizeof (uint32_t));
+	if (NULL == matcher->delta || NULL == matcher->first
+	 || NULL == fail || NULL == queue) {
+		a->release (a->context, fail);
+		a->release (a->context, queue);
+		return 0;
+	}
+
+	for (i = 0; i < capacity * stride; ++i) {
+		matcher->delta[i] = SCHNUR_MATCHER_NONE;
+	}
+	matcher->first[0] = SCHNUR_MATCHER_NONE;
+	matcher->states = 1;
+
+	for (i = 0; i < count; ++i) {
+		struct schnur_view view = schnur_view_of (patterns[i]);
+
+		for (s = 0, j = 0; j < view.length; ++j) {
+			uint32_t* edge = &matcher->delta[s * stride
+				+ __schnur_matcher_class (matcher, view.data[j])];
+
+			if (SCHNUR_MATCHER_NONE == *edge) {
+				matcher->first[matcher->states] = SCHNUR_MATCHER_NONE;
+				*edge = (uint32_t)matcher->states++;
+			}
+			s = *edge;
+		}
+
+		matcher->next[i] = matcher->first[s];
+		matcher->first[s] = (uint32_t)i;
+		matcher->lengths[i] = view.length;
+	}
+
+	matcher->report = __schnur_matcher_allocate (a, matcher->states, sizeof (uint32_t));
+	matcher->dict = __schnur_matcher_allocate (a, matcher->states, sizeof (uint32_t));
+	if (NULL == matcher->report || NULL == matcher->dict) {
+		a->release (a->context, fail);
+		a->release (a->context, queue);
+		return 0;
+	}
+
+	fail[0] = 0;
+	matcher->dict[0] = 0;
+	matcher->report[0] = 0;
+	queue[tail++] = 0;
+
+	while (head < tail) {
+		s = queue[head++];
+
+		for (j = 0; j < stride; ++j) {
+			uint32_t* edge = &matcher->delta[s * stride + j];
+
+			// The failure state is closer to the root, its row is complete.
+			f = 0 == s ? 0 : matcher->delta[fail[s] * stride + j];
+
+			if (SCHNUR_MATCHER_NONE == *edge) {
+				*edge = f;
+				continue;
+			}
+
+			t = *edge;
+			fail[t] = f;
+			matcher->dict[t] = matcher->report[f];
+			matcher->report[t] = SCHNUR_MATCHER_NONE != matcher->first[t]
+				? t
+				: matcher->dict[t];
+			queue[tail++] = t;
+		}
+	}
+
+	a->release (a->context, fail);
+	a->release (a->context, queue);
+
+	// Gives back the space reserved for states shared by several patterns.
+	if (matcher->states < capacity) {
+		void* delta = a->reallocate (a->context, matcher->delta,
+			capacity * stride * sizeof (uint32_t),
+			matcher->states * stride * sizeof (uint32_t));
+		void* first;
+
+		if (NULL != delta) {
+			matcher->delta = delta;
+		}
+		first = a->reallocate (a->context, matcher->first,
+			capacity * sizeof (uint32_t), matcher->states * sizeof (uint32_t));
+		if (NULL != first) {
+			matcher->first = first;
+		}
+	}
+
+	return 1;
+}
+
+struct schnur_matcher*
+schnur_matcher_new (const struct schnur* const* patterns, size_t count,
+	const struct schnur_allocator* allocator) {
+	struct schnur_matcher* matcher;
+	size_t i, total = 0;
+
+	if (NULL == patterns || 0 == count || SCHNUR_MATCHER_NONE <= count) {
+		return NULL;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (NULL == patterns[i] || 0 == schnur_length (patterns[i])) {
+			return NULL;
+		}
+		total += schnur_length (patterns[i]);
+		if (SCHNUR_MATCHER_NONE <= total) {
+			return NULL;
+		}
+	}
+
+	if (NULL == allocator) {
+		allocator = schnur_get_allocator ();
+	}
+	else if (NULL == allocator->allocate
+	 || NULL == allocator->reallocate
+	 || NULL == allocator->release) {
+		return NULL;
+	}
+
+	matcher = allocator->allocate (allocator->context, sizeof (struct schnur_matcher));
+	if (NULL == matcher) {
+		return NULL;
+	}
+
+	memset (matcher, 0, sizeof (struct schnur_matcher));
+	matcher->allocator = allocator;
+	matcher->pattern_count = count;
+	matcher->next = __schnur_matcher_allocate (allocator, count, sizeof (uint32_t));
+	matcher->lengths = __schnur_matcher_allocate (allocator, count, sizeof (size_t));
+
+	if (NULL == matcher->next || NULL == matcher->lengths
+	 || ! __schnur_matcher_classify (matcher, patterns, count, total)
+	 || ! __schnur_matcher_build (matcher, patterns, count, total)) {
+		schnur_matcher_free (matcher);
+		return NULL;
+	}
+
+	return matcher;
+}
+
+int
+schnur_matcher_free (struct schnur_matcher* matcher) {
+	const struct schnur_allocator* a;
+
+	if (NULL == matcher) {
+		return 0;
+	}
+
+	a = matcher->allocator;
+	a->release (a->context, matcher->classes);
+	a->release (a->context, matcher->delta);
+	a->release (a->context, matcher->report);
+	a->release (a->context, matcher->dict);
+	a->release (a->context, matcher->first);
+	a->release (a->context, matcher->next);
+	a->release (a->context, matcher->lengths);
+	a->release (a->context, matcher);
+
+	return 1;
+}
+
+size_t
+schnur_matcher_memory (const struct schnur_matcher* matcher) {
+	if (NULL == matcher) {
+		return 0;
+	}
+
+	return sizeof (struct schnur_matcher)
+		+ matcher->class_count * sizeof (struct schnur_matcher_class)
+		+ matcher->states * matcher->stride * sizeof (uint32_t)
+		+ matcher->states * 3 * sizeof (uint32_t)
+		+ matcher->pattern_count * (sizeof (uint32_t) + sizeof (size_t));
+}
+
+size_t
+schnur_matcher_scan (const struct schnur_matcher* matcher, struct schnur_view view,
+	schnur_match_callback_t callback, void* context) {
+	const uint32_t* delta;
+	size_t stride, i, found = 0;
+	uint32_t s = 0, t, p;
+
+	if (NULL == matcher || NULL == view.data) {
+		return 0;
+	}
+
+	delta = matcher->delta;
+	stride = matcher->stride;
+
+	for (i = 0; i < view.length; ++i) {
+		s = delta[s * stride + __schnur_matcher_class (matcher, view.data[i])];
+
+		for (t = matcher->report[s]; 0 != t; t = matcher->dict[t]) {
+			for (p = matcher->first[t]; SCHNUR_MATCHER_NONE != p; p = matcher->next[p]) {
+				++found;
+				if (NULL != callback
+				 && ! callback (context, p, i + 1 - matcher->lengths[p])) {
+					return found;
+				}
+			}
+		}
+	}
+
+	return found;
+}
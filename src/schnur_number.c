@@ -0,0 +1,844 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+
+/// Significant digits kept when parsing a long decimal. Enough to round
+/// any double correctly, once a sticky digit marks the rest.
+#define SCHNUR_NUMBER_MAX_DIGITS 800
+
+/// Exponents beyond this magnitude over- or underflow any double, so
+/// larger ones are clamped while parsing.
+#define SCHNUR_NUMBER_MAX_EXPONENT 100000
+
+/// Doubles with up to this many significant digits read back exactly.
+#define SCHNUR_NUMBER_EXACT_DIGITS 15
+
+/// Doubles with this many significant digits always read back exactly.
+#define SCHNUR_NUMBER_ROUND_TRIP_DIGITS 17
+
+static const char g_digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/// Powers of ten representable exactly as double.
+static const double g_exact_powers[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+	Writes the decimal digits of value to buf, returns their number.
+*/
+static size_t
+__schnur_number_digits (schnur_wide_t* buf, uint64_t value) {
+	schnur_wide_t digits[20];
+	size_t i = sizeof (digits) / sizeof (digits[0]), n;
+
+	while (100 <= value) {
+		const char* pair = g_digit_pairs + 2 * (value % 100);
+		digits[--i] = (schnur_wide_t)pair[1];
+		digits[--i] = (schnur_wide_t)pair[0];
+		value /= 100;
+	}
+	if (10 <= value) {
+		const char* pair = g_digit_pairs + 2 * value;
+		digits[--i] = (schnur_wide_t)pair[1];
+		digits[--i] = (schnur_wide_t)pair[0];
+	}
+	else {
+		digits[--i] = (schnur_wide_t)('0' + value);
+	}
+
+	n = sizeof (digits) / sizeof (digits[0]) - i;
+	memcpy (buf, digits + i, n * sizeof (schnur_wide_t));
+
+	return n;
+}
+
+size_t
+schnur_format_u64 (schnur_wide_t* buf, uint64_t value) {
+	if (NULL == buf) {
+		return 0;
+	}
+
+	return __schnur_number_digits (buf, value);
+}
+
+size_t
+schnur_format_i64 (schnur_wide_t* buf, int64_t value) {
+	if (NULL == buf) {
+		return 0;
+	}
+
+	if (0 > value) {
+		*buf = SCHNUR_W ('-');
+		return 1 + __schnur_number_digits (buf + 1, (uint64_t)0 - (uint64_t)value);
+	}
+
+	return __schnur_number_digits (buf, (uint64_t)value);
+}
+
+/*
+	Converts significant digits d, read as an integer, times 10^exponent to
+	the nearest double. d holds n ascii digits without leading zeros.
+*/
+static double
+__schnur_number_to_double (const char* d, size_t n, long exponent) {
+	char text[SCHNUR_NUMBER_MAX_DIGITS + 32];
+	uint64_t mantissa = 0;
+	size_t i;
+
+	if (0 == n) {
+		return 0.0;
+	}
+
+	// Exact, if both the digits and the power of ten fit a double.
+	if (19 >= n && 22 >= labs (exponent)) {
+		for (i = 0; i < n; ++i) {
+			mantissa = mantissa * 10 + (uint64_t)(d[i] - '0');
+		}
+		if (mantissa <= ((uint64_t)1 << 53)) {
+			return 0 > exponent
+				? (double)mantissa / g_exact_powers[-exponent]
+				: (double)mantissa * g_exact_powers[exponent];
+		}
+	}
+
+	// Without a decimal point, strtod does not depend on the locale.
+	memcpy (text, d, n);
+	text[n++] = 'e';
+	if (0 > exponent) {
+		text[n++] = '-';
+		exponent = -exponent;
+	}
+	for (i = n; ; exponent /= 10) {
+		text[n++] = (char)('0' + exponent % 10);
+		if (10 > exponent) {
+			break;
+		}
+	}
+	text[n] = '\0';
+	// Digits of the exponent were written in reverse.
+	for (--n; i < n; ++i, --n) {
+		char c = text[i];
+		text[i] = text[n];
+		text[n] = c;
+	}
+
+	return strtod (text, NULL);
+}
+
+/**
+	@brief: A floating point number f * 2^e with a 64 bit significand, as
+			  used by the Grisu algorithm.
+*/
+struct schnur_number_fp {
+	uint64_t f;
+	int e;
+};
+
+/**
+	@brief: A power of ten 10^k, approximated by a normalized
+			  schnur_number_fp.
+*/
+struct schnur_number_power {
+	uint64_t f;
+	int16_t e;
+	int16_t k;
+};
+
+/// Grisu scales numbers by a cached power of ten into this binary
+/// exponent range, so integral digits fit 32 bits.
+#define SCHNUR_NUMBER_MIN_TARGET_EXPONENT -60
+
+/// Decimal exponent of the first cached power of ten.
+#define SCHNUR_NUMBER_MIN_CACHED_EXPONENT -348
+
+/// Decimal exponents of consecutive cached powers of ten are this far apart.
+#define SCHNUR_NUMBER_CACHED_EXPONENT_STEP 8
+
+/// Powers of ten 10^k for k in [-348, 340] in steps of 8, rounded to 64 bit
+/// significands.
+static const struct schnur_number_power g_cached_powers[] = {
+	{ UINT64_C (0xFA8FD5A0081C0288), -1220, -348 },
+	{ UINT64_C (0xBAAEE17FA23EBF76), -1193, -340 },
+	{ UINT64_C (0x8B16FB203055AC76), -1166, -332 },
+	{ UINT64_C (0xCF42894A5DCE35EA), -1140, -324 },
+	{ UINT64_C (0x9A6BB0AA55653B2D), -1113, -316 },
+	{ UINT64_C (0xE61ACF033D1A45DF), -1087, -308 },
+	{ UINT64_C (0xAB70FE17C79AC6CA), -1060, -300 },
+	{ UINT64_C (0xFF77B1FCBEBCDC4F), -1034, -292 },
+	{ UINT64_C (0xBE5691EF416BD60C), -1007, -284 },
+	{ UINT64_C (0x8DD01FAD907FFC3C), -980, -276 },
+	{ UINT64_C (0xD3515C2831559A83), -954, -268 },
+	{ UINT64_C (0x9D71AC8FADA6C9B5), -927, -260 },
+	{ UINT64_C (0xEA9C227723EE8BCB), -901, -252 },
+	{ UINT64_C (0xAECC49914078536D), -874, -244 },
+	{ UINT64_C (0x823C12795DB6CE57), -847, -236 },
+	{ UINT64_C (0xC21094364DFB5637), -821, -228 },
+	{ UINT64_C (0x9096EA6F3848984F), -794, -220 },
+	{ UINT64_C (0xD77485CB25823AC7), -768, -212 },
+	{ UINT64_C (0xA086CFCD97BF97F4), -741, -204 },
+	{ UINT64_C (0xEF340A98172AACE5), -715, -196 },
+	{ UINT64_C (0xB23867FB2A35B28E), -688, -188 },
+	{ UINT64_C (0x84C8D4DFD2C63F3B), -661, -180 },
+	{ UINT64_C (0xC5DD44271AD3CDBA), -635, -172 },
+	{ UINT64_C (0x936B9FCEBB25C996), -608, -164 },
+	{ UINT64_C (0xDBAC6C247D62A584), -582, -156 },
+	{ UINT64_C (0xA3AB66580D5FDAF6), -555, -148 },
+	{ UINT64_C (0xF3E2F893DEC3F126), -529, -140 },
+	{ UINT64_C (0xB5B5ADA8AAFF80B8), -502, -132 },
+	{ UINT64_C (0x87625F056C7C4A8B), -475, -124 },
+	{ UINT64_C (0xC9BCFF6034C13053), -449, -116 },
+	{ UINT64_C (0x964E858C91BA2655), -422, -108 },
+	{ UINT64_C (0xDFF9772470297EBD), -396, -100 },
+	{ UINT64_C (0xA6DFBD9FB8E5B88F), -369, -92 },
+	{ UINT64_C (0xF8A95FCF88747D94), -343, -84 },
+	{ UINT64_C (0xB94470938FA89BCF), -316, -76 },
+	{ UINT64_C (0x8A08F0F8BF0F156B), -289, -68 },
+	{ UINT64_C (0xCDB02555653131B6), -263, -60 },
+	{ UINT64_C (0x993FE2C6D07B7FAC), -236, -52 },
+	{ UINT64_C (0xE45C10C42A2B3B06), -210, -44 },
+	{ UINT64_C (0xAA242499697392D3), -183, -36 },
+	{ UINT64_C (0xFD87B5F28300CA0E), -157, -28 },
+	{ UINT64_C (0xBCE5086492111AEB), -130, -20 },
+	{ UINT64_C (0x8CBCCC096F5088CC), -103, -12 },
+	{ UINT64_C (0xD1B71758E219652C), -77, -4 },
+	{ UINT64_C (0x9C40000000000000), -50, 4 },
+	{ UINT64_C (0xE8D4A51000000000), -24, 12 },
+	{ UINT64_C (0xAD78EBC5AC620000), 3, 20 },
+	{ UINT64_C (0x813F3978F8940984), 30, 28 },
+	{ UINT64_C (0xC097CE7BC90715B3), 56, 36 },
+	{ UINT64_C (0x8F7E32CE7BEA5C70), 83, 44 },
+	{ UINT64_C (0xD5D238A4ABE98068), 109, 52 },
+	{ UINT64_C (0x9F4F2726179A2245), 136, 60 },
+	{ UINT64_C (0xED63A231D4C4FB27), 162, 68 },
+	{ UINT64_C (0xB0DE65388CC8ADA8), 189, 76 },
+	{ UINT64_C (0x83C7088E1AAB65DB), 216, 84 },
+	{ UINT64_C (0xC45D1DF942711D9A), 242, 92 },
+	{ UINT64_C (0x924D692CA61BE758), 269, 100 },
+	{ UINT64_C (0xDA01EE641A708DEA), 295, 108 },
+	{ UINT64_C (0xA26DA3999AEF774A), 322, 116 },
+	{ UINT64_C (0xF209787BB47D6B85), 348, 124 },
+	{ UINT64_C (0xB454E4A179DD1877), 375, 132 },
+	{ UINT64_C (0x865B86925B9BC5C2), 402, 140 },
+	{ UINT64_C (0xC83553C5C8965D3D), 428, 148 },
+	{ UINT64_C (0x952AB45CFA97A0B3), 455, 156 },
+	{ UINT64_C (0xDE469FBD99A05FE3), 481, 164 },
+	{ UINT64_C (0xA59BC234DB398C25), 508, 172 },
+	{ UINT64_C (0xF6C69A72A3989F5C), 534, 180 },
+	{ UINT64_C (0xB7DCBF5354E9BECE), 561, 188 },
+	{ UINT64_C (0x88FCF317F22241E2), 588, 196 },
+	{ UINT64_C (0xCC20CE9BD35C78A5), 614, 204 },
+	{ UINT64_C (0x98165AF37B2153DF), 641, 212 },
+	{ UINT64_C (0xE2A0B5DC971F303A), 667, 220 },
+	{ UINT64_C (0xA8D9D1535CE3B396), 694, 228 },
+	{ UINT64_C (0xFB9B7CD9A4A7443C), 720, 236 },
+	{ UINT64_C (0xBB764C4CA7A44410), 747, 244 },
+	{ UINT64_C (0x8BAB8EEFB6409C1A), 774, 252 },
+	{ UINT64_C (0xD01FEF10A657842C), 800, 260 },
+	{ UINT64_C (0x9B10A4E5E9913129), 827, 268 },
+	{ UINT64_C (0xE7109BFBA19C0C9D), 853, 276 },
+	{ UINT64_C (0xAC2820D9623BF429), 880, 284 },
+	{ UINT64_C (0x80444B5E7AA7CF85), 907, 292 },
+	{ UINT64_C (0xBF21E44003ACDD2D), 933, 300 },
+	{ UINT64_C (0x8E679C2F5E44FF8F), 960, 308 },
+	{ UINT64_C (0xD433179D9C8CB841), 986, 316 },
+	{ UINT64_C (0x9E19DB92B4E31BA9), 1013, 324 },
+	{ UINT64_C (0xEB96BF6EBADF77D9), 1039, 332 },
+	{ UINT64_C (0xAF87023B9BF0EE6B), 1066, 340 },
+};
+
+static const uint32_t g_small_powers[] = {
+	0, 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static inline struct schnur_number_fp
+__schnur_number_fp_minus (struct schnur_number_fp x, struct schnur_number_fp y) {
+	struct schnur_number_fp d;
+
+	d.f = x.f - y.f;
+	d.e = x.e;
+
+	return d;
+}
+
+/*
+	Multiplies two numbers, rounding the upper 64 bits of the product.
+*/
+static inline struct schnur_number_fp
+__schnur_number_fp_multiply (struct schnur_number_fp x, struct schnur_number_fp y) {
+	const uint64_t mask = UINT64_C (0xFFFFFFFF);
+	uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask) + (UINT64_C (1) << 31);
+	struct schnur_number_fp r;
+
+	r.f = ac + (ad >> 32) + (bc >> 32) + (middle >> 32);
+	r.e = x.e + y.e + 64;
+
+	return r;
+}
+
+static inline struct schnur_number_fp
+__schnur_number_fp_normalize (struct schnur_number_fp x) {
+	while (0 == (x.f & UINT64_C (0xFFC0000000000000))) {
+		x.f <<= 10;
+		x.e -= 10;
+	}
+	while (0 == (x.f & UINT64_C (0x8000000000000000))) {
+		x.f <<= 1;
+		--x.e;
+	}
+
+	return x;
+}
+
+/*
+	Moves the last digit of d towards the value w, as long as it stays
+	within the interval of numbers reading back to it. Returns 0, if the
+	digits are not guaranteed to be the closest shortest ones.
+*/
+static int
+__schnur_number_round_weed (char* d, size_t n, uint64_t distance, uint64_t delta,
+	uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+	uint64_t small_distance = distance - unit;
+	uint64_t big_distance = distance + unit;
+
+	while (rest < small_distance && delta - rest >= ten_kappa
+	 && (rest + ten_kappa < small_distance
+	  || small_distance - rest >= rest + ten_kappa - small_distance)) {
+		--d[n - 1];
+		rest += ten_kappa;
+	}
+
+	if (rest < big_distance && delta - rest >= ten_kappa
+	 && (rest + ten_kappa < big_distance
+	  || big_distance - rest > rest + ten_kappa - big_distance)) {
+		return 0;
+	}
+
+	return 2 * unit <= rest && rest <= delta - 4 * unit;
+}
+
+/*
+	Generates the shortest digits of w within the interval (low, high),
+	widened by one unit for the imprecision of the scaled boundaries.
+*/
+static int
+__schnur_number_grisu_digits (struct schnur_number_fp low, struct schnur_number_fp w,
+	struct schnur_number_fp high, char* d, size_t* n, int* kappa) {
+	uint64_t unit = 1;
+	struct schnur_number_fp too_low = { low.f - unit, low.e };
+	struct schnur_number_fp too_high = { high.f + unit, high.e };
+	struct schnur_number_fp unsafe = __schnur_number_fp_minus (too_high, too_low);
+	const int shift = -w.e;
+	const uint64_t one = UINT64_C (1) << shift;
+	uint32_t integral = (uint32_t)(too_high.f >> shift);
+	uint64_t fractional = too_high.f & (one - 1);
+	uint32_t divisor;
+	int guess = ((64 - shift + 1) * 1233 >> 12) + 1;
+
+	if (integral < g_small_powers[guess]) {
+		--guess;
+	}
+	divisor = g_small_powers[guess];
+	*kappa = guess;
+	*n = 0;
+
+	while (0 < *kappa) {
+		uint64_t rest;
+
+		d[(*n)++] = (char)('0' + integral / divisor);
+		integral %= divisor;
+		--*kappa;
+		rest = ((uint64_t)integral << shift) + fractional;
+		if (rest < unsafe.f) {
+			return __schnur_number_round_weed (d, *n,
+				__schnur_number_fp_minus (too_high, w).f, unsafe.f, rest,
+				(uint64_t)divisor << shift, unit);
+		}
+		divisor /= 10;
+	}
+
+	for (;;) {
+		fractional *= 10;
+		unit *= 10;
+		unsafe.f *= 10;
+		d[(*n)++] = (char)('0' + (fractional >> shift));
+		fractional &= one - 1;
+		--*kappa;
+		if (fractional < unsafe.f) {
+			return __schnur_number_round_weed (d, *n,
+				__schnur_number_fp_minus (too_high, w).f * unit, unsafe.f, fractional,
+				one, unit);
+		}
+	}
+}
+
+/*
+	Finds the shortest digits reading back to the positive finite value
+	with the Grisu3 algorithm. Returns 0 for the few numbers it cannot
+	decide. Otherwise d receives n digits, read as integer times 10^exponent.
+*/
+static int
+__schnur_number_grisu (double value, char* d, size_t* n, int* exponent) {
+	struct schnur_number_fp v, w, plus, minus, power;
+	uint64_t bits;
+	double scale;
+	int k, index, kappa;
+
+	memcpy (&bits, &value, sizeof (bits));
+	if (0 == (bits & UINT64_C (0x7FF0000000000000))) {
+		v.f = bits & UINT64_C (0x000FFFFFFFFFFFFF);
+		v.e = 1 - 1075;
+	}
+	else {
+		v.f = (bits & UINT64_C (0x000FFFFFFFFFFFFF)) + UINT64_C (0x0010000000000000);
+		v.e = (int)((bits & UINT64_C (0x7FF0000000000000)) >> 52) - 1075;
+	}
+	w = __schnur_number_fp_normalize (v);
+
+	// The boundaries lie halfway to the neighbouring doubles, the lower one
+	// closer, if value is a power of two.
+	plus.f = (v.f << 1) + 1;
+	plus.e = v.e - 1;
+	plus = __schnur_number_fp_normalize (plus);
+	if (0 == (bits & UINT64_C (0x000FFFFFFFFFFFFF)) && 0 != (bits & UINT64_C (0x7FF0000000000000))) {
+		minus.f = (v.f << 2) - 1;
+		minus.e = v.e - 2;
+	}
+	else {
+		minus.f = (v.f << 1) - 1;
+		minus.e = v.e - 1;
+	}
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	// Rounds the decimal exponent of 2^(target - e - 1) up, without libm.
+	scale = (SCHNUR_NUMBER_MIN_TARGET_EXPONENT - w.e - 1) * 0.30102999566398114;
+	k = (int)scale;
+	k += scale > (double)k;
+	index = (k - SCHNUR_NUMBER_MIN_CACHED_EXPONENT - 1) / SCHNUR_NUMBER_CACHED_EXPONENT_STEP + 1;
+	power.f = g_cached_powers[index].f;
+	power.e = g_cached_powers[index].e;
+
+	w = __schnur_number_fp_multiply (w, power);
+	minus = __schnur_number_fp_multiply (minus, power);
+	plus = __schnur_number_fp_multiply (plus, power);
+
+	if (! __schnur_number_grisu_digits (minus, w, plus, d, n, &kappa)) {
+		return 0;
+	}
+	*exponent = kappa - g_cached_powers[index].k;
+
+	return 1;
+}
+
+/*
+	Writes value rounded to given number of significant digits to d and
+	returns 1, if they read back to value. exponent receives the power of
+	ten of the first digit.
+*/
+static int
+__schnur_number_round (double value, int digits, char* d, int* exponent) {
+	char text[64];
+	const char* c = text;
+	size_t n = 0;
+
+	// Only the decimal point depends on the locale, which is skipped.
+	snprintf (text, sizeof (text), "%.*e", digits - 1, value);
+	for (; 'e' != *c; ++c) {
+		if ('0' <= *c && '9' >= *c) {
+			d[n++] = *c;
+		}
+	}
+	*exponent = atoi (c + 1);
+
+	return value == __schnur_number_to_double (d, n, *exponent - (long)n + 1);
+}
+
+/*
+	Finds the fewest significant digits, which read back to value. Writes
+	them to d without trailing zeros and returns their number. exponent
+	receives the power of ten of the first digit.
+*/
+static size_t
+__schnur_number_shortest (double value, char* d, int* exponent) {
+	size_t n;
+	int digits = SCHNUR_NUMBER_EXACT_DIGITS;
+
+	if (DBL_MIN > value) {
+		// Subnormals have less precision, so search all digit counts.
+		// Once some digits read back, more of them do as well.
+		int low = 1, high = SCHNUR_NUMBER_ROUND_TRIP_DIGITS;
+
+		while (low < high) {
+			int mid = low + (high - low) / 2;
+
+			if (__schnur_number_round (value, mid, d, exponent)) {
+				high = mid;
+			}
+			else {
+				low = mid + 1;
+			}
+		}
+		digits = low;
+		__schnur_number_round (value, digits, d, exponent);
+	}
+	else {
+		// Decimals up to 15 digits survive a round trip through a double,
+		// so rounding to 15 digits finds any shorter ones as well.
+		while (! __schnur_number_round (value, digits, d, exponent)
+		 && SCHNUR_NUMBER_ROUND_TRIP_DIGITS > digits) {
+			++digits;
+		}
+	}
+
+	n = (size_t)digits;
+	while (1 < n && '0' == d[n - 1]) {
+		--n;
+	}
+
+	return n;
+}
+
+size_t
+schnur_format_f64 (schnur_wide_t* buf, double value) {
+	char d[32];
+	schnur_wide_t* w = buf;
+	size_t n, i;
+	int exponent;
+
+	if (NULL == buf) {
+		return 0;
+	}
+
+	if (isnan (value)) {
+		wmemcpy (buf, SCHNUR_W ("nan"), 3);
+		return 3;
+	}
+	if (signbit (value)) {
+		*w++ = SCHNUR_W ('-');
+		value = -value;
+	}
+	if (isinf (value)) {
+		wmemcpy (w, SCHNUR_W ("inf"), 3);
+		return (size_t)(w - buf) + 3;
+	}
+
+	// Integers, e.g. counters, need no search for digits. All of them up to
+	// 2^53 are exact, so their digits are the shortest.
+	if (9007199254740992.0 >= value && value == (double)(uint64_t)value) {
+		return (size_t)(w - buf) + __schnur_number_digits (w, (uint64_t)value);
+	}
+
+	if (__schnur_number_grisu (value, d, &n, &exponent)) {
+		while (1 < n && '0' == d[n - 1]) {
+			--n;
+			++exponent;
+		}
+		exponent += (int)n - 1;
+	}
+	else {
+		n = __schnur_number_shortest (value, d, &exponent);
+	}
+
+	if (-4 > exponent || 16 <= exponent) {
+		*w++ = (schnur_wide_t)d[0];
+		if (1 < n) {
+			*w++ = SCHNUR_W ('.');
+			for (i = 1; i < n; ++i) {
+				*w++ = (schnur_wide_t)d[i];
+			}
+		}
+		*w++ = SCHNUR_W ('e');
+		*w++ = 0 > exponent ? SCHNUR_W ('-') : SCHNUR_W ('+');
+		if (-10 < exponent && 10 > exponent) {
+			*w++ = SCHNUR_W ('0');
+		}
+		w += __schnur_number_digits (w, (uint64_t)(0 > exponent ? -exponent : exponent));
+	}
+	else if (0 > exponent) {
+		*w++ = SCHNUR_W ('0');
+		*w++ = SCHNUR_W ('.');
+		for (i = 1; i < (size_t)-exponent; ++i) {
+			*w++ = SCHNUR_W ('0');
+		}
+		for (i = 0; i < n; ++i) {
+			*w++ = (schnur_wide_t)d[i];
+		}
+	}
+	else {
+		for (i = 0; i < n || i <= (size_t)exponent; ++i) {
+			if (i == (size_t)exponent + 1) {
+				*w++ = SCHNUR_W ('.');
+			}
+			*w++ = i < n ? (schnur_wide_t)d[i] : SCHNUR_W ('0');
+		}
+	}
+
+	return (size_t)(w - buf);
+}
+
+int
+schnur_append_i64 (struct schnur* self, int64_t value) {
+	schnur_wide_t buf[SCHNUR_NUMBER_MAX_CHARS];
+
+	return schnur_append_view (self, schnur_view_n (buf, schnur_format_i64 (buf, value)));
+}
+
+int
+schnur_append_u64 (struct schnur* self, uint64_t value) {
+	schnur_wide_t buf[SCHNUR_NUMBER_MAX_CHARS];
+
+	return schnur_append_view (self, schnur_view_n (buf, schnur_format_u64 (buf, value)));
+}
+
+int
+schnur_append_f64 (struct schnur* self, double value) {
+	schnur_wide_t buf[SCHNUR_NUMBER_MAX_CHARS];
+
+	return schnur_append_view (self, schnur_view_n (buf, schnur_format_f64 (buf, value)));
+}
+
+/*
+	Parses an optional sign at i, returns 1 for a minus sign.
+*/
+static int
+__schnur_number_sign (struct schnur_view view, size_t* i) {
+	if (*i < view.length
+	 && (SCHNUR_W ('-') == view.data[*i] || SCHNUR_W ('+') == view.data[*i])) {
+		return SCHNUR_W ('-') == view.data[(*i)++];
+	}
+
+	return 0;
+}
+
+static inline int
+__schnur_number_is_digit (struct schnur_view view, size_t i) {
+	return i < view.length
+		&& SCHNUR_W ('0') <= view.data[i] && SCHNUR_W ('9') >= view.data[i];
+}
+
+/*
+	Parses decimal digits at i into a magnitude, which saturates at limit.
+	Returns 0 if there are no digits or the magnitude exceeds limit.
+*/
+static int
+__schnur_number_magnitude (struct schnur_view view, size_t* i,
+	uint64_t limit, uint64_t* magnitude) {
+	size_t begin = *i;
+	int in_range = 1;
+
+	*magnitude = 0;
+	for (; __schnur_number_is_digit (view, *i); ++*i) {
+		uint64_t digit = (uint64_t)(view.data[*i] - SCHNUR_W ('0'));
+
+		if (*magnitude > (limit - digit) / 10) {
+			*magnitude = limit;
+			in_range = 0;
+		}
+		else if (in_range) {
+			*magnitude = *magnitude * 10 + digit;
+		}
+	}
+
+	return *i > begin && in_range;
+}
+
+int
+schnur_view_parse_i64 (struct schnur_view view, int64_t* value, size_t* consumed) {
+	uint64_t magnitude;
+	size_t i = 0;
+	int negative, ok;
+
+	if (NULL != consumed) *consumed = 0;
+	if (NULL == value || (NULL == view.data && 0 < view.length)) {
+		return 0;
+	}
+
+	negative = __schnur_number_sign (view, &i);
+	if (! __schnur_number_is_digit (view, i)) {
+		return 0;
+	}
+
+	ok = __schnur_number_magnitude (view, &i,
+		negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX, &magnitude);
+	*value = negative ? (int64_t)((uint64_t)0 - magnitude) : (int64_t)magnitude;
+	if (NULL != consumed) *consumed = i;
+
+	return ok;
+}
+
+int
+schnur_view_parse_u64 (struct schnur_view view, uint64_t* value, size_t* consumed) {
+	size_t i = 0;
+	int ok;
+
+	if (NULL != consumed) *consumed = 0;
+	if (NULL == value || (NULL == view.data && 0 < view.length)) {
+		return 0;
+	}
+
+	if (i < view.length && SCHNUR_W ('+') == view.data[i]) {
+		++i;
+	}
+	if (! __schnur_number_is_digit (view, i)) {
+		return 0;
+	}
+
+	ok = __schnur_number_magnitude (view, &i, UINT64_MAX, value);
+	if (NULL != consumed) *consumed = i;
+
+	return ok;
+}
+
+/*
+	Tells whether view continues at i with given lower case word, ignoring
+	case.
+*/
+static int
+__schnur_number_word (struct schnur_view view, size_t i, const char* word) {
+	for (; '\0' != *word; ++word, ++i) {
+		if (i >= view.length
+		 || (schnur_wide_t)*word != (view.data[i] | 0x20)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+int
+schnur_view_parse_f64 (struct schnur_view view, double* value, size_t* consumed) {
+	// One more for a sticky digit standing in for those cut off.
+	char d[SCHNUR_NUMBER_MAX_DIGITS + 1];
+	size_t i = 0, n = 0, mantissa = 0;
+	long exponent = 0;
+	int negative, point = 0, dropped = 0;
+
+	if (NULL != consumed) *consumed = 0;
+	if (NULL == value || (NULL == view.data && 0 < view.length)) {
+		return 0;
+	}
+
+	negative = __schnur_number_sign (view, &i);
+
+	if (__schnur_number_word (view, i, "inf")) {
+		*value = negative ? -HUGE_VAL : HUGE_VAL;
+		if (NULL != consumed) {
+			*consumed = i + (__schnur_number_word (view, i, "infinity") ? 8 : 3);
+		}
+		return 1;
+	}
+	if (__schnur_number_word (view, i, "nan")) {
+		*value = negative ? -NAN : NAN;
+		if (NULL != consumed) *consumed = i + 3;
+		return 1;
+	}
+
+	for (; i < view.length; ++i) {
+		schnur_wide_t c = view.data[i];
+
+		if (SCHNUR_W ('.') == c && ! point) {
+			point = 1;
+			continue;
+		}
+		if (SCHNUR_W ('0') > c || SCHNUR_W ('9') < c) {
+			break;
+		}
+
+		++mantissa;
+		if (0 == n && SCHNUR_W ('0') == c) {
+			// Leading zeros are not significant.
+			exponent -= point;
+		}
+		else if (SCHNUR_NUMBER_MAX_DIGITS > n) {
+			d[n++] = (char)c;
+			exponent -= point;
+		}
+		else {
+			dropped |= SCHNUR_W ('0') != c;
+			exponent += ! point;
+		}
+	}
+	if (0 == mantissa) {
+		return 0;
+	}
+	if (dropped) {
+		d[n++] = '1';
+		--exponent;
+	}
+
+	if (i < view.length && SCHNUR_W ('e') == (view.data[i] | 0x20)) {
+		size_t j = i + 1;
+		long e = 0;
+		int e_negative = __schnur_number_sign (view, &j);
+
+		if (__schnur_number_is_digit (view, j)) {
+			for (; __schnur_number_is_digit (view, j); ++j) {
+				if (SCHNUR_NUMBER_MAX_EXPONENT > e) {
+					e = e * 10 + (long)(view.data[j] - SCHNUR_W ('0'));
+				}
+			}
+			exponent += e_negative ? -e : e;
+			i = j;
+		}
+	}
+
+	*value = __schnur_number_to_double (d, n, exponent);
+	if (negative) {
+		*value = -*value;
+	}
+	if (NULL != consumed) *consumed = i;
+
+	return ! isinf (*value);
+}
+
+int
+schnur_parse_i64 (const struct schnur* self, int64_t* value, size_t* consumed) {
+	if (NULL != consumed) *consumed = 0;
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_view_parse_i64 (schnur_view_of (self), value, consumed);
+}
+
+int
+schnur_parse_u64 (const struct schnur* self, uint64_t* value, size_t* consumed) {
+	if (NULL != consumed) *consumed = 0;
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_view_parse_u64 (schnur_view_of (self), value, consumed);
+}
+
+int
+schnur_parse_f64 (const struct schnur* self, double* value, size_t* consumed) {
+	if (NULL != consumed) *consumed = 0;
+	if (NULL == self) {
+		return 0;
+	}
+
+	return schnur_view_parse_f64 (schnur_view_of (self), value, consumed);
+}
@@ -0,0 +1,417 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+
+/**
+	@brief: Characters stored with 1, 2 or 4 bytes each, the fewest able to
+			  hold every one of them.
+*/
+struct schnur_packed {
+	/**
+		@brief: Allocator managing the packed string and its heap storage.
+	*/
+	const struct schnur_allocator* allocator;
+
+	/**
+		@brief: The characters, pointing to local for short strings.
+	*/
+	unsigned char* data;
+
+	/**
+		@brief: Number of characters.
+	*/
+	size_t length;
+
+	/**
+		@brief: Size of data in bytes.
+	*/
+	size_t size;
+
+	/**
+		@brief: Bytes per character, 1, 2 or 4.
+	*/
+	unsigned char width;
+
+	/**
+		@brief: Inline storage for short strings, aligned for 4 byte wide
+				  characters.
+	*/
+	union {
+		/// Alignment only, never accessed.
+		uint32_t words[(SCHNUR_PACKED_INLINE_SIZE + 3) / 4];
+		/// The characters.
+		unsigned char bytes[SCHNUR_PACKED_INLINE_SIZE];
+	} local;
+};
+
+/*
+	Fewest bytes per character able to hold character c.
+*/
+static inline unsigned char
+__schnur_packed_width_of_char (schnur_wide_t c) {
+	uint32_t u = (uint32_t)c;
+#if WCHAR_MAX <= 0xFFFF
+	u &= 0xFFFF;
+#endif
+
+	return 0xFF >= u ? 1 : (0xFFFF >= u ? 2 : 4);
+}
+
+/*
+	Fewest bytes per character able to hold all n characters. Or-ing them
+	together needs no branch per character, so it vectorizes.
+*/
+static unsigned char
+__schnur_packed_width_of (const schnur_wide_t* s, size_t n) {
+	uint32_t bits = 0;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		bits |= (uint32_t)s[i];
+	}
+
+	return __schnur_packed_width_of_char ((schnur_wide_t)bits);
+}
+
+static inline schnur_wide_t
+__schnur_packed_at (const unsigned char* data, unsigned char width, size_t i) {
+	switch (width) {
+		case 1: return (schnur_wide_t)data[i];
+		case 2: return (schnur_wide_t)((const uint16_t*)data)[i];
+		default: return (schnur_wide_t)((const uint32_t*)data)[i];
+	}
+}
+
+/*
+	Stores n characters at index i, each of them fitting width.
+*/
+static void
+__schnur_packed_store (unsigned char* data, unsigned char width, size_t i, const schnur_wide_t* s, size_t n) {
+	size_t k;
+
+	switch (width) {
+		case 1:
+			for (k = 0; k < n; ++k) data[i + k] = (unsigned char)s[k];
+			break;
+		case 2:
+			for (k = 0; k < n; ++k) ((uint16_t*)data)[i + k] = (uint16_t)s[k];
+			break;
+		default:
+			for (k = 0; k < n; ++k) ((uint32_t*)data)[i + k] = (uint32_t)s[k];
+			break;
+	}
+}
+
+/*
+	Makes room for n characters of given width, converting the existing ones
+	if the width grows. Widens from the back, so it works in place.
+*/
+static int
+__schnur_packed_reserve (struct schnur_packed* self, size_t n, unsigned char width) {
+	const struct schnur_allocator* a = self->allocator;
+	unsigned char* data = self->data;
+	size_t size, i;
+
+	if (width < self->width) {
+		width = self->width;
+	}
+	if (n > SIZE_MAX / width) {
+		return 0;
+	}
+
+	if (n * width > self->size) {
+		// Grow by half, so appending runs in amortized linear time.
+		size = self->size + self->size / 2;
+		if (size < n * width || size / width < n) {
+			size = n * width;
+		}
+
+		if (self->data == self->local.bytes) {
+			data = a->allocate (a->context, size);
+			if (NULL != data) {
+				memcpy (data, self->local.bytes, self->length * self->width);
+			}
+		}
+		else {
+			data = a->reallocate (a->context, self->data, self->size, size);
+		}
+		if (NULL == data) {
+			return 0;
+		}
+		self->data = data;
+		self->size = size;
+	}
+
+	if (width > self->width) {
+		for (i = self->length; 0 < i--;) {
+			schnur_wide_t c = __schnur_packed_at (data, self->width, i);
+			__schnur_packed_store (data, width, i, &c, 1);
+		}
+		self->width = width;
+	}
+
+	return 1;
+}
+
+struct schnur_packed*
+schnur_packed_new (struct schnur_view view) {
+	const struct schnur_allocator* a = schnur_get_allocator ();
+	struct schnur_packed* packed;
+
+	if (NULL == view.data && 0 < view.length) {
+		return NULL;
+	}
+
+	packed = a->allocate (a->context, sizeof (struct schnur_packed));
+	if (NULL == packed) {
+		return NULL;
+	}
+
+	packed->allocator = a;
+	packed->data = packed->local.bytes;
+	packed->length = 0;
+	packed->size = SCHNUR_PACKED_INLINE_SIZE;
+	packed->width = 1;
+
+	if (! schnur_packed_append_view (packed, view)) {
+		schnur_packed_free (packed);
+		return NULL;
+	}
+
+	return packed;
+}
+
+int
+schnur_packed_free (struct schnur_packed* self) {
+	const struct schnur_allocator* a;
+
+	if (NULL == self) {
+		return 0;
+	}
+
+	a = self->allocator;
+	if (self->data != self->local.bytes) {
+		a->release (a->context, self->data);
+	}
+	a->release (a->context, self);
+
+	return 1;
+}
+
+size_t
+schnur_packed_length (const struct schnur_packed* self) {
+	return NULL == self ? 0 : self->length;
+}
+
+size_t
+schnur_packed_width (const struct schnur_packed* self) {
+	return NULL == self ? 0 : self->width;
+}
+
+schnur_wide_t
+schnur_packed_get (const struct schnur_packed* self, size_t i) {
+	if (NULL == self || i >= self->length) {
+		return SCHNUR_WC_NULL;
+	}
+
+	return __schnur_packed_at (self->data, self->width, i);
+}
+
+int
+schnur_packed_set (struct schnur_packed* self, size_t i, schnur_wide_t c) {
+	if (NULL == self || i >= self->length) {
+		return 0;
+	}
+
+	if (! __schnur_packed_reserve (self, self->length, __schnur_packed_width_of_char (c))) {
+		return 0;
+	}
+	__schnur_packed_store (self->data, self->width, i, &c, 1);
+
+	return 1;
+}
+
+int
+schnur_packed_append_view (struct schnur_packed* self, struct schnur_view view) {
+	if (NULL == self
+	 || (NULL == view.data && 0 < view.length)
+	 || view.length > SIZE_MAX / 4 - self->length) {
+		return 0;
+	}
+	if (0 == view.length) {
+		return 1;
+	}
+
+	if (! __schnur_packed_reserve (self, self->length + view.length,
+			__schnur_packed_width_of (view.data, view.length))) {
+		return 0;
+	}
+	__schnur_packed_store (self->data, self->width, self->length, view.data, view.length);
+	self->length += view.length;
+
+	return 1;
+}
+
+size_t
+schnur_packed_expand (const struct schnur_packed* self, size_t begin, size_t end, schnur_wide_t* dst) {
+	size_t i;
+
+	if (NULL == self || NULL == dst || begin > end || end > self->length) {
+		return 0;
+	}
+
+	switch (self->width) {
+		case 1:
+			for (i = begin; i < end; ++i) *dst++ = (schnur_wide_t)self->data[i];
+			break;
+		case 2:
+			for (i = begin; i < end; ++i) *dst++ = (schnur_wide_t)((const uint16_t*)self->data)[i];
+			break;
+		default:
+			for (i = begin; i < end; ++i) *dst++ = (schnur_wide_t)((const uint32_t*)self->data)[i];
+			break;
+	}
+
+	return end - begin;
+}
+
+struct schnur*
+schnur_packed_thaw (const struct schnur_packed* self) {
+	// Expands in chunks, leaving the schnur to its own API.
+	schnur_wide_t chunk[256];
+	struct schnur* s;
+	size_t i, n, room = sizeof (chunk) / sizeof (chunk[0]);
+
+	if (NULL == self) {
+		return NULL;
+	}
+
+	s = schnur_new_with_capacity (self->length);
+	if (NULL == s) {
+		return NULL;
+	}
+
+	for (i = 0; i < self->length; i += n) {
+		n = self->length - i < room ? self->length - i : room;
+		schnur_packed_expand (self, i, i + n, chunk);
+		if (! schnur_append_view (s, schnur_view_n (chunk, n))) {
+			schnur_free (s);
+			return NULL;
+		}
+	}
+
+	return s;
+}
+
+int
+schnur_packed_equal_view (const struct schnur_packed* self, struct schnur_view view) {
+	size_t i;
+
+	if (NULL == self || view.length != self->length) {
+		return 0;
+	}
+
+	for (i = 0; i < view.length; ++i) {
+		if (__schnur_packed_at (self->data, self->width, i) != view.data[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+	Maps a character to a key ordered like code points, just like
+	schnur_view_compare does.
+*/
+static inline uint32_t
+__schnur_packed_key (schnur_wide_t c) {
+	uint32_t u = (uint32_t)c;
+#if WCHAR_MAX <= 0xFFFF
+	u &= 0xFFFF;
+	if (0xD800 <= u) {
+		u = 0xE000 <= u ? u - 0x800 : u + 0x2000;
+	}
+#endif
+	return u;
+}
+
+int
+schnur_packed_compare (const struct schnur_packed* self, const struct schnur_packed* other) {
+	size_t a = schnur_packed_length (self);
+	size_t b = schnur_packed_length (other);
+	size_t n = a < b ? a : b, i;
+	uint32_t x, y;
+	int r;
+
+	if (0 == n) {
+		return (a > b) - (a < b);
+	}
+
+	// Bytes order like code points, so the C library compares them.
+	if (1 == self->width && 1 == other->width) {
+		r = memcmp (self->data, other->data, n);
+		return 0 != r ? (0 < r) - (0 > r) : (a > b) - (a < b);
+	}
+
+	for (i = 0; i < n; ++i) {
+		x = __schnur_packed_key (__schnur_packed_at (self->data, self->width, i));
+		y = __schnur_packed_key (__schnur_packed_at (other->data, other->width, i));
+		if (x != y) {
+			return (x > y) - (x < y);
+		}
+	}
+
+	return (a > b) - (a < b);
+}
+
+size_t
+schnur_packed_find (const struct schnur_packed* self, struct schnur_view needle, size_t from) {
+	const unsigned char* hit;
+	size_t i, k, last;
+	schnur_wide_t first;
+
+	if (NULL == self || (NULL == needle.data && 0 < needle.length)
+	 || from > self->length || needle.length > self->length - from) {
+		return SCHNUR_NOT_FOUND;
+	}
+	if (0 == needle.length) {
+		return from;
+	}
+
+	// A needle wider than the contents cannot occur.
+	if (__schnur_packed_width_of (needle.data, needle.length) > self->width) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	first = needle.data[0];
+	last = self->length - needle.length;
+	for (i = from; i <= last; ++i) {
+		if (1 == self->width) {
+			hit = memchr (self->data + i, (unsigned char)first, last + 1 - i);
+			if (NULL == hit) {
+				break;
+			}
+			i = (size_t)(hit - self->data);
+		}
+		else if (__schnur_packed_at (self->data, self->width, i) != first) {
+			continue;
+		}
+
+		for (k = 1; k < needle.length; ++k) {
+			if (__schnur_packed_at (self->data, self->width, i + k) != needle.data[k]) {
+				break;
+			}
+		}
+		if (k == needle.length) {
+			return i;
+		}
+	}
+
+	return SCHNUR_NOT_FOUND;
+}
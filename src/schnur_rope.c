@@ -0,0 +1,805 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+
+/// Number of spare inner nodes kept for reuse.
+#define SCHNUR_ROPE_SPARE_NODES 256
+/// Number of spare leaves kept for reuse.
+#define SCHNUR_ROPE_SPARE_LEAVES 4
+
+/**
+	@brief: Either a leaf holding characters, or an inner node joining two
+			  subtrees. Inner nodes are balanced like an AVL tree.
+*/
+struct schnur_rope_node {
+	/**
+		@brief: Number of characters in this subtree.
+	*/
+	size_t length;
+
+	/**
+		@brief: Height of this subtree, zero for leaves only.
+	*/
+	size_t height;
+
+	/**
+		@brief: Subtrees of inner nodes, NULL for leaves. Spare nodes are
+				  chained through left.
+	*/
+	struct schnur_rope_node* left;
+	struct schnur_rope_node* right;
+
+	/**
+		@brief: Characters of leaves, SCHNUR_ROPE_LEAF_SIZE in total.
+	*/
+	schnur_wide_t data[];
+};
+
+struct schnur_rope {
+	/**
+		@brief: Allocator managing the rope and all of its nodes.
+	*/
+	const struct schnur_allocator* allocator;
+
+	/**
+		@brief: Root of the tree, NULL for empty ropes.
+	*/
+	struct schnur_rope_node* root;
+
+	/**
+		@brief: Released nodes kept for reuse, so splitting and joining
+				  never fails once enough nodes were reserved.
+	*/
+	struct schnur_rope_node* spare_nodes;
+	size_t spare_node_count;
+	struct schnur_rope_node* spare_leaves;
+	size_t spare_leaf_count;
+};
+
+static size_t
+__schnur_rope_leaf_bytes (void) {
+	return sizeof (struct schnur_rope_node)
+		+ SCHNUR_ROPE_LEAF_SIZE * sizeof (schnur_wide_t);
+}
+
+static int
+__schnur_rope_is_leaf (const struct schnur_rope_node* node) {
+	return 0 == node->height;
+}
+
+/*
+	Takes a spare node or allocates a new one. Never fails, if enough nodes
+	were reserved before.
+*/
+static struct schnur_rope_node*
+__schnur_rope_take (struct schnur_rope* rope, int leaf) {
+	const struct schnur_allocator* a = rope->allocator;
+	struct schnur_rope_node** spare = leaf ? &rope->spare_leaves : &rope->spare_nodes;
+	size_t* count = leaf ? &rope->spare_leaf_count : &rope->spare_node_count;
+	struct schnur_rope_node* node = *spare;
+
+	if (NULL != node) {
+		*spare = node->left;
+		--*count;
+	}
+	else {
+		node = a->allocate (a->context, leaf
+			? __schnur_rope_leaf_bytes ()
+			: sizeof (struct schnur_rope_node));
+		if (NULL == node) {
+			return NULL;
+		}
+	}
+
+	node->length = 0;
+	node->height = leaf ? 0 : 1;
+	node->left = NULL;
+	node->right = NULL;
+
+	return node;
+}
+
+static void
+__schnur_rope_put (struct schnur_rope* rope, struct schnur_rope_node* node) {
+	const struct schnur_allocator* a = rope->allocator;
+	int leaf = __schnur_rope_is_leaf (node);
+	struct schnur_rope_node** spare = leaf ? &rope->spare_leaves : &rope->spare_nodes;
+	size_t* count = leaf ? &rope->spare_leaf_count : &rope->spare_node_count;
+
+	if (*count >= (leaf ? SCHNUR_ROPE_SPARE_LEAVES : SCHNUR_ROPE_SPARE_NODES)) {
+		a->release (a->context, node);
+		return;
+	}
+
+	node->left = *spare;
+	*spare = node;
+	++*count;
+}
+
+/*
+	Makes sure, taking given number of nodes and leaves does not fail.
+*/
+static int
+__schnur_rope_reserve (struct schnur_rope* rope, size_t nodes, size_t leaves) {
+	const struct schnur_allocator* a = rope->allocator;
+
+	while (rope->spare_node_count < nodes) {
+		struct schnur_rope_node* node = a->allocate (a->context, sizeof (struct schnur_rope_node));
+		if (NULL == node) {
+			return 0;
+		}
+		node->left = rope->spare_nodes;
+		rope->spare_nodes = node;
+		++rope->spare_node_count;
+	}
+
+	while (rope->spare_leaf_count < leaves) {
+		struct schnur_rope_node* node = a->allocate (a->context, __schnur_rope_leaf_bytes ());
+		if (NULL == node) {
+			return 0;
+		}
+		node->left = rope->spare_leaves;
+		rope->spare_leaves = node;
+		++rope->spare_leaf_count;
+	}
+
+	return 1;
+}
+
+/*
+	Number of inner nodes to reserve for splitting and joining trees of given
+	height. Every split or join takes at most one node per level.
+*/
+static size_t
+__schnur_rope_reserve_count (size_t height) {
+	return 3 * (height + 3);
+}
+
+static void
+__schnur_rope_release_tree (struct schnur_rope* rope, struct schnur_rope_node* node) {
+	while (NULL != node) {
+		struct schnur_rope_node* right = node->right;
+
+		if (! __schnur_rope_is_leaf (node)) {
+			__schnur_rope_release_tree (rope, node->left);
+		}
+		__schnur_rope_put (rope, node);
+
+		node = right;
+	}
+}
+
+static size_t
+__schnur_rope_height (const struct schnur_rope_node* node) {
+	return NULL == node ? 0 : node->height;
+}
+
+static void
+__schnur_rope_update (struct schnur_rope_node* node) {
+	size_t lh = node->left->height;
+	size_t rh = node->right->height;
+
+	node->length = node->left->length + node->right->length;
+	node->height = 1 + (lh > rh ? lh : rh);
+}
+
+static struct schnur_rope_node*
+__schnur_rope_rotate_left (struct schnur_rope_node* x) {
+	struct schnur_rope_node* y = x->right;
+
+	x->right = y->left;
+	__schnur_rope_update (x);
+	y->left = x;
+	__schnur_rope_update (y);
+
+	return y;
+}
+
+static struct schnur_rope_node*
+__schnur_rope_rotate_right (struct schnur_rope_node* x) {
+	struct schnur_rope_node* y = x->left;
+
+	x->left = y->right;
+	__schnur_rope_update (x);
+	y->right = x;
+	__schnur_rope_update (y);
+
+	return y;
+}
+
+/*
+	Restores the balance of an inner node, whose subtrees differ in height by
+	at most two.
+*/
+static struct schnur_rope_node*
+__schnur_rope_balance (struct schnur_rope_node* node) {
+	size_t lh, rh;
+
+	__schnur_rope_update (node);
+	lh = node->left->height;
+	rh = node->right->height;
+
+	if (lh > rh + 1) {
+		struct schnur_rope_node* l = node->left;
+		if (l->left->height < l->right->height) {
+			node->left = __schnur_rope_rotate_left (l);
+		}
+		return __schnur_rope_rotate_right (node);
+	}
+
+	if (rh > lh + 1) {
+		struct schnur_rope_node* r = node->right;
+		if (r->right->height < r->left->height) {
+			node->right = __schnur_rope_rotate_right (r);
+		}
+		return __schnur_rope_rotate_left (node);
+	}
+
+	return node;
+}
+
+static size_t
+__schnur_rope_room_right (const struct schnur_rope_node* node) {
+	while (! __schnur_rope_is_leaf (node)) {
+		node = node->right;
+	}
+
+	return SCHNUR_ROPE_LEAF_SIZE - node->length;
+}
+
+static size_t
+__schnur_rope_room_left (const struct schnur_rope_node* node) {
+	while (! __schnur_rope_is_leaf (node)) {
+		node = node->left;
+	}
+
+	return SCHNUR_ROPE_LEAF_SIZE - node->length;
+}
+
+/*
+	Appends n characters to the rightmost leaf of node, which must have room
+	for them.
+*/
+static void
+__schnur_rope_push_right (struct schnur_rope_node* node, const schnur_wide_t* s, size_t n) {
+	for (;;) {
+		node->length += n;
+		if (__schnur_rope_is_leaf (node)) {
+			break;
+		}
+		node = node->right;
+	}
+
+	memcpy (node->data + node->length - n, s, n * sizeof (schnur_wide_t));
+}
+
+/*
+	Prepends n characters to the leftmost leaf of node, which must have room
+	for them.
+*/
+static void
+__schnur_rope_push_left (struct schnur_rope_node* node, const schnur_wide_t* s, size_t n) {
+	for (;;) {
+		if (__schnur_rope_is_leaf (node)) {
+			break;
+		}
+		node->length += n;
+		node = node->left;
+	}
+
+	memmove (node->data + n, node->data, node->length * sizeof (schnur_wide_t));
+	memcpy (node->data, s, n * sizeof (schnur_wide_t));
+	node->length += n;
+}
+
+/*
+	Joins two balanced trees, with all characters of a in front of b. Takes
+	at most one node per level of the taller tree. Small leaves are merged
+	into their neighbours, so repeated edits do not fragment the rope.
+*/
+static struct schnur_rope_node*
+__schnur_rope_join (struct schnur_rope* rope,
+	struct schnur_rope_node* a, struct schnur_rope_node* b) {
+	struct schnur_rope_node* node;
+
+	if (NULL == a) return b;
+	if (NULL == b) return a;
+
+	if (__schnur_rope_is_leaf (b) && __schnur_rope_room_right (a) >= b->length) {
+		__schnur_rope_push_right (a, b->data, b->length);
+		__schnur_rope_put (rope, b);
+		return a;
+	}
+
+	if (__schnur_rope_is_leaf (a) && __schnur_rope_room_left (b) >= a->length) {
+		__schnur_rope_push_left (b, a->data, a->length);
+		__schnur_rope_put (rope, a);
+		return b;
+	}
+
+	if (a->height > b->height + 1) {
+		a->right = __schnur_rope_join (rope, a->right, b);
+		return __schnur_rope_balance (a);
+	}
+
+	if (b->height > a->height + 1) {
+		b->left = __schnur_rope_join (rope, a, b->left);
+		return __schnur_rope_balance (b);
+	}
+
+	node = __schnur_rope_take (rope, 0);
+	node->left = a;
+	node->right = b;
+	__schnur_rope_update (node);
+
+	return node;
+}
+
+/*
+	Splits the tree into the first i characters and the rest. Takes at most
+	one leaf, plus one node per level.
+*/
+static void
+__schnur_rope_split (struct schnur_rope* rope, struct schnur_rope_node* node, size_t i,
+	struct schnur_rope_node** left, struct schnur_rope_node** right) {
+	struct schnur_rope_node* l;
+	struct schnur_rope_node* r;
+
+	if (NULL == node || 0 == i) {
+		*left = NULL;
+		*right = node;
+		return;
+	}
+
+	if (i >= node->length) {
+		*left = node;
+		*right = NULL;
+		return;
+	}
+
+	if (__schnur_rope_is_leaf (node)) {
+		r = __schnur_rope_take (rope, 1);
+		r->length = node->length - i;
+		memcpy (r->data, node->data + i, r->length * sizeof (schnur_wide_t));
+		node->length = i;
+		*left = node;
+		*right = r;
+		return;
+	}
+
+	l = node->left;
+	r = node->right;
+	__schnur_rope_put (rope, node);
+
+	if (i <= l->length) {
+		struct schnur_rope_node* lr;
+		__schnur_rope_split (rope, l, i, left, &lr);
+		*right = __schnur_rope_join (rope, lr, r);
+	}
+	else {
+		struct schnur_rope_node* rl;
+		__schnur_rope_split (rope, r, i - l->length, &rl, right);
+		*left = __schnur_rope_join (rope, l, rl);
+	}
+}
+
+/*
+	Builds a balanced tree from n characters, splitting them into full leaves.
+	Returns NULL on failure.
+*/
+static struct schnur_rope_node*
+__schnur_rope_build (struct schnur_rope* rope, const schnur_wide_t* s, size_t n) {
+	struct schnur_rope_node* node;
+	size_t leaves, half;
+
+	if (n <= SCHNUR_ROPE_LEAF_SIZE) {
+		node = __schnur_rope_take (rope, 1);
+		if (NULL == node) {
+			return NULL;
+		}
+		node->length = n;
+		memcpy (node->data, s, n * sizeof (schnur_wide_t));
+		return node;
+	}
+
+	// Halves differ by at most one leaf, so their heights differ by at most one.
+	leaves = (n - 1) / SCHNUR_ROPE_LEAF_SIZE + 1;
+	half = leaves / 2 * SCHNUR_ROPE_LEAF_SIZE;
+
+	node = __schnur_rope_take (rope, 0);
+	if (NULL == node) {
+		return NULL;
+	}
+
+	node->left = __schnur_rope_build (rope, s, half);
+	if (NULL == node->left) {
+		__schnur_rope_put (rope, node);
+		return NULL;
+	}
+
+	node->right = __schnur_rope_build (rope, s + half, n - half);
+	if (NULL == node->right) {
+		__schnur_rope_release_tree (rope, node->left);
+		node->left = NULL;
+		__schnur_rope_put (rope, node);
+		return NULL;
+	}
+
+	__schnur_rope_update (node);
+
+	return node;
+}
+
+/*
+	Finds the leaf containing character i, storing the index of i within that
+	leaf in offset.
+*/
+static const struct schnur_rope_node*
+__schnur_rope_find (const struct schnur_rope_node* node, size_t i, size_t* offset) {
+	while (! __schnur_rope_is_leaf (node)) {
+		if (i < node->left->length) {
+			node = node->left;
+		}
+		else {
+			i -= node->left->length;
+			node = node->right;
+		}
+	}
+
+	*offset = i;
+
+	return node;
+}
+
+struct schnur_rope*
+schnur_rope_new (void) {
+	return schnur_rope_new_with_allocator (NULL);
+}
+
+struct schnur_rope*
+schnur_rope_new_with_allocator (const struct schnur_allocator* allocator) {
+	struct schnur_rope* rope;
+
+	if (NULL == allocator) {
+		allocator = schnur_get_allocator ();
+	}
+	else if (NULL == allocator->allocate
+	 || NULL == allocator->reallocate
+	 || NULL == allocator->release) {
+		return NULL;
+	}
+
+	rope = allocator->allocate (allocator->context, sizeof (struct schnur_rope));
+	if (NULL == rope) {
+		return NULL;
+	}
+
+	rope->allocator = allocator;
+	rope->root = NULL;
+	rope->spare_nodes = NULL;
+	rope->spare_node_count = 0;
+	rope->spare_leaves = NULL;
+	rope->spare_leaf_count = 0;
+
+	return rope;
+}
+
+int
+schnur_rope_free (struct schnur_rope* self) {
+	const struct schnur_allocator* a;
+	struct schnur_rope_node* node;
+
+	if (NULL == self) {
+		return 0;
+	}
+
+	a = self->allocator;
+
+	// Sparing nothing, every node is released.
+	self->spare_node_count = SCHNUR_ROPE_SPARE_NODES;
+	self->spare_leaf_count = SCHNUR_ROPE_SPARE_LEAVES;
+	__schnur_rope_release_tree (self, self->root);
+
+	while (NULL != (node = self->spare_nodes)) {
+		self->spare_nodes = node->left;
+		a->release (a->context, node);
+	}
+	while (NULL != (node = self->spare_leaves)) {
+		self->spare_leaves = node->left;
+		a->release (a->context, node);
+	}
+
+	a->release (a->context, self);
+
+	return 1;
+}
+
+size_t
+schnur_rope_length (const struct schnur_rope* self) {
+	if (NULL == self || NULL == self->root) {
+		return 0;
+	}
+
+	return self->root->length;
+}
+
+schnur_wide_t
+schnur_rope_get (const struct schnur_rope* self, size_t i) {
+	const struct schnur_rope_node* leaf;
+	size_t offset;
+
+	if (i >= schnur_rope_length (self)) {
+		return SCHNUR_WC_NULL;
+	}
+
+	leaf = __schnur_rope_find (self->root, i, &offset);
+
+	return leaf->data[offset];
+}
+
+int
+schnur_rope_append (struct schnur_rope* self, struct schnur_view view) {
+	return schnur_rope_insert (self, schnur_rope_length (self), view);
+}
+
+int
+schnur_rope_insert (struct schnur_rope* self, size_t i, struct schnur_view view) {
+	struct schnur_rope_node* mid;
+	struct schnur_rope_node* l;
+	struct schnur_rope_node* r;
+	size_t length = schnur_rope_length (self);
+	size_t fill = 0;
+	size_t height;
+
+	if (NULL == self || i > length
+	 || (NULL == view.data && 0 < view.length)
+	 || view.length > SIZE_MAX - length) {
+		return 0;
+	}
+
+	if (0 == view.length) {
+		return 1;
+	}
+
+	// Appending fills up the last leaf first.
+	if (i == length && NULL != self->root) {
+		fill = __schnur_rope_room_right (self->root);
+		if (fill > view.length) {
+			fill = view.length;
+		}
+	}
+
+	mid = NULL;
+	if (fill < view.length) {
+		mid = __schnur_rope_build (self, view.data + fill, view.length - fill);
+		if (NULL == mid) {
+			return 0;
+		}
+	}
+
+	height = __schnur_rope_height (self->root);
+	if (NULL != mid && height < mid->height) {
+		height = mid->height;
+	}
+	if (! __schnur_rope_reserve (self, __schnur_rope_reserve_count (height), 1)) {
+		__schnur_rope_release_tree (self, mid);
+		return 0;
+	}
+
+	if (0 < fill) {
+		__schnur_rope_push_right (self->root, view.data, fill);
+		i += fill;
+	}
+
+	__schnur_rope_split (self, self->root, i, &l, &r);
+	self->root = __schnur_rope_join (self, __schnur_rope_join (self, l, mid), r);
+
+	return 1;
+}
+
+int
+schnur_rope_erase (struct schnur_rope* self, size_t begin, size_t end) {
+	struct schnur_rope_node* l;
+	struct schnur_rope_node* mid;
+	struct schnur_rope_node* r;
+
+	if (NULL == self || begin > end || end > schnur_rope_length (self)) {
+		return 0;
+	}
+
+	if (begin == end) {
+		return 1;
+	}
+
+	if (! __schnur_rope_reserve (self,
+		__schnur_rope_reserve_count (self->root->height), 2)) {
+		return 0;
+	}
+
+	__schnur_rope_split (self, self->root, end, &mid, &r);
+	__schnur_rope_split (self, mid, begin, &l, &mid);
+	__schnur_rope_release_tree (self, mid);
+	self->root = __schnur_rope_join (self, l, r);
+
+	return 1;
+}
+
+int
+schnur_rope_concat (struct schnur_rope* self, struct schnur_rope* other) {
+	struct schnur_rope_iterator it;
+	struct schnur_view leaf;
+	size_t height;
+
+	if (NULL == self || NULL == other || self == other) {
+		return 0;
+	}
+
+	if (NULL == other->root) {
+		return 1;
+	}
+
+	if (other->root->length > SIZE_MAX - schnur_rope_length (self)) {
+		return 0;
+	}
+
+	// Nodes can only change hands, if they are released the same way.
+	if (self->allocator != other->allocator) {
+		it = schnur_rope_begin (other);
+		while (schnur_rope_next (&it, &leaf)) {
+			if (! schnur_rope_append (self, leaf)) {
+				return 0;
+			}
+		}
+		__schnur_rope_release_tree (other, other->root);
+		other->root = NULL;
+		return 1;
+	}
+
+	height = __schnur_rope_height (self->root);
+	if (height < other->root->height) {
+		height = other->root->height;
+	}
+	if (! __schnur_rope_reserve (self, __schnur_rope_reserve_count (height), 0)) {
+		return 0;
+	}
+
+	self->root = __schnur_rope_join (self, self->root, other->root);
+	other->root = NULL;
+
+	return 1;
+}
+
+struct schnur*
+schnur_rope_flatten (const struct schnur_rope* self) {
+	struct schnur_rope_iterator it;
+	struct schnur_view leaf;
+	struct schnur* s;
+
+	if (NULL == self) {
+		return NULL;
+	}
+
+	s = schnur_new_with_allocator (self->allocator);
+	if (NULL == s) {
+		return NULL;
+	}
+
+	if (! schnur_reserve (s, schnur_rope_length (self))) {
+		schnur_free (s);
+		return NULL;
+	}
+
+	it = schnur_rope_begin (self);
+	while (schnur_rope_next (&it, &leaf)) {
+		schnur_append_view (s, leaf);
+	}
+
+	return s;
+}
+
+struct schnur_rope_iterator
+schnur_rope_begin (const struct schnur_rope* self) {
+	struct schnur_rope_iterator it;
+
+	it.rope = self;
+	it.offset = 0;
+
+	return it;
+}
+
+int
+schnur_rope_next (struct schnur_rope_iterator* it, struct schnur_view* leaf) {
+	const struct schnur_rope_node* node;
+	size_t offset;
+
+	if (NULL == it || NULL == leaf
+	 || it->offset >= schnur_rope_length (it->rope)) {
+		return 0;
+	}
+
+	node = __schnur_rope_find (it->rope->root, it->offset, &offset);
+	leaf->data = node->data + offset;
+	leaf->length = node->length - offset;
+	it->offset += leaf->length;
+
+	return 1;
+}
+
+/*
+	Measures, or if dst is given encodes, all leaves as utf-8. Surrogate pairs
+	might be split across leaves, so a trailing high surrogate is carried over
+	to the next leaf.
+*/
+static size_t
+__schnur_rope_encode (const struct schnur_rope* self, schnur_narrow_t* dst) {
+	struct schnur_rope_iterator it = schnur_rope_begin (self);
+	struct schnur_view leaf;
+	schnur_wide_t pair[2];
+	size_t carry = 0;
+	size_t total = 0;
+	size_t n;
+
+	while (schnur_rope_next (&it, &leaf)) {
+		if (0 < carry) {
+			pair[1] = leaf.data[0];
+			n = NULL == dst
+				? schnur_utf8_encode_length (pair, 2)
+				: schnur_utf8_encode (dst + total, pair, 2);
+			if (SCHNUR_UTF8_INVALID == n) {
+				return SCHNUR_UTF8_INVALID;
+			}
+			total += n;
+			++leaf.data;
+			--leaf.length;
+			carry = 0;
+		}
+
+		if (0 < leaf.length
+		 && (unsigned long)leaf.data[leaf.length - 1] - 0xD800 < 0x400) {
+			pair[0] = leaf.data[leaf.length - 1];
+			--leaf.length;
+			carry = 1;
+		}
+
+		n = NULL == dst
+			? schnur_utf8_encode_length (leaf.data, leaf.length)
+			: schnur_utf8_encode (dst + total, leaf.data, leaf.length);
+		if (SCHNUR_UTF8_INVALID == n) {
+			return SCHNUR_UTF8_INVALID;
+		}
+		total += n;
+	}
+
+	// A lone high surrogate at the very end.
+	if (0 < carry) {
+		return SCHNUR_UTF8_INVALID;
+	}
+
+	return total;
+}
+
+int
+schnur_rope_narrow_into (const struct schnur_rope* self,
+	schnur_narrow_t* buf, size_t cap, size_t* needed) {
+	size_t size;
+
+	if (NULL == self) {
+		return 0;
+	}
+
+	size = __schnur_rope_encode (self, NULL);
+	if (NULL != needed) *needed = size;
+	if (SCHNUR_UTF8_INVALID == size || NULL == buf || cap <= size) {
+		return 0;
+	}
+
+	__schnur_rope_encode (self, buf);
+	buf[size] = SCHNUR_NC_NULL;
+
+	return 1;
+}
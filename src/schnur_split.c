@@ -0,0 +1,226 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) \
+ || (defined(__i386__) && defined(__SSE2__)) \
+ || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+/// SSE2 is available at compile time.
+#define SCHNUR_SPLIT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/// Sets of up to this many delimiters are scanned with one comparison per
+/// member and register. Larger sets are looked up character by character.
+#define SCHNUR_SPLIT_VECTOR_SET 8
+
+static inline int
+__schnur_split_lowest_bit (uint32_t mask) {
+#if defined(__GNUC__)
+	return __builtin_ctz (mask);
+#else
+	int i = 0;
+	while (0 == (mask & 1)) {
+		mask >>= 1;
+		++i;
+	}
+	return i;
+#endif
+}
+
+#if defined(SCHNUR_SPLIT_SSE2)
+/// Number of characters in a 128-bit register.
+#define SCHNUR_SPLIT_STEP (16 / sizeof (schnur_wide_t))
+
+static inline __m128i
+__schnur_split_splat (schnur_wide_t c) {
+#if WCHAR_MAX > 0xFFFF
+	return _mm_set1_epi32 ((int)c);
+#else
+	return _mm_set1_epi16 ((short)c);
+#endif
+}
+
+static inline __m128i
+__schnur_split_cmpeq (__m128i a, __m128i b) {
+#if WCHAR_MAX > 0xFFFF
+	return _mm_cmpeq_epi32 (a, b);
+#else
+	return _mm_cmpeq_epi16 (a, b);
+#endif
+}
+
+/*
+	Finds the first of the n characters of h at or after i, which is one of
+	the k members of set, or returns the index of the remaining characters
+	too few to fill a register.
+*/
+static size_t
+__schnur_split_scan_sse2 (const schnur_wide_t* h, size_t n, size_t i,
+	const schnur_wide_t* set, size_t k) {
+	__m128i members[SCHNUR_SPLIT_VECTOR_SET];
+	size_t j;
+
+	for (j = 0; j < k; ++j) {
+		members[j] = __schnur_split_splat (set[j]);
+	}
+
+	for (; SCHNUR_SPLIT_STEP <= n - i; i += SCHNUR_SPLIT_STEP) {
+		__m128i chunk = _mm_loadu_si128 ((const __m128i*)(h + i));
+		__m128i hits = __schnur_split_cmpeq (chunk, members[0]);
+		uint32_t mask;
+
+		for (j = 1; j < k; ++j) {
+			hits = _mm_or_si128 (hits, __schnur_split_cmpeq (chunk, members[j]));
+		}
+
+		mask = (uint32_t)_mm_movemask_epi8 (hits);
+		if (0 != mask) {
+			return i + (size_t)__schnur_split_lowest_bit (mask) / sizeof (schnur_wide_t);
+		}
+	}
+
+	return i;
+}
+#endif
+
+static inline int
+__schnur_split_is_delimiter (const struct schnur_tokenizer* tokenizer, schnur_wide_t c) {
+	uint32_t u = (uint32_t)c;
+
+	if (SCHNUR_SPLIT_CHAR == tokenizer->kind) {
+		return tokenizer->c == c;
+	}
+	if (128 > u) {
+		return 0 != (tokenizer->ascii[u >> 5] >> (u & 31) & 1);
+	}
+
+	return NULL != wmemchr (tokenizer->delimiters.data, c, tokenizer->delimiters.length);
+}
+
+/*
+	Finds the first delimiting character at or after from, returns the
+	length of the view if there is none.
+*/
+static size_t
+__schnur_split_find_member (const struct schnur_tokenizer* tokenizer, size_t from) {
+	const schnur_wide_t* h = tokenizer->view.data;
+	const size_t n = tokenizer->view.length;
+	const schnur_wide_t* set = &tokenizer->c;
+	size_t k = 1, i = from;
+
+	if (SCHNUR_SPLIT_ANY == tokenizer->kind) {
+		set = tokenizer->delimiters.data;
+		k = tokenizer->delimiters.length;
+		if (0 == k) {
+			return n;
+		}
+	}
+
+#if defined(SCHNUR_SPLIT_SSE2)
+	if (SCHNUR_SPLIT_VECTOR_SET >= k) {
+		// Stops at a delimiter, which the loop below confirms, or at the
+		// remaining characters.
+		i = __schnur_split_scan_sse2 (h, n, i, set, k);
+	}
+#endif
+
+	for (; i < n; ++i) {
+		if (__schnur_split_is_delimiter (tokenizer, h[i])) {
+			return i;
+		}
+	}
+
+	return n;
+}
+
+static struct schnur_tokenizer
+__schnur_split_new (struct schnur_view view, enum schnur_split_kind kind,
+	struct schnur_view delimiters, schnur_wide_t c, int flags) {
+	struct schnur_tokenizer tokenizer;
+	size_t i;
+
+	memset (&tokenizer, 0, sizeof (struct schnur_tokenizer));
+	tokenizer.view = view;
+	tokenizer.delimiters = delimiters;
+	tokenizer.c = c;
+	tokenizer.kind = kind;
+	tokenizer.flags = flags;
+
+	if ((NULL == view.data && 0 < view.length)
+	 || (NULL == delimiters.data && 0 < delimiters.length)) {
+		tokenizer.view.length = 0;
+		tokenizer.position = SCHNUR_NOT_FOUND;
+		return tokenizer;
+	}
+
+	if (SCHNUR_SPLIT_ANY == kind) {
+		for (i = 0; i < delimiters.length; ++i) {
+			uint32_t u = (uint32_t)delimiters.data[i];
+			if (128 > u) {
+				tokenizer.ascii[u >> 5] |= (uint32_t)1 << (u & 31);
+			}
+		}
+	}
+
+	return tokenizer;
+}
+
+struct schnur_tokenizer
+schnur_split_char (struct schnur_view view, schnur_wide_t c, int flags) {
+	struct schnur_view none = { NULL, 0 };
+
+	return __schnur_split_new (view, SCHNUR_SPLIT_CHAR, none, c, flags);
+}
+
+struct schnur_tokenizer
+schnur_split_any (struct schnur_view view, struct schnur_view delimiters, int flags) {
+	return __schnur_split_new (view, SCHNUR_SPLIT_ANY, delimiters, SCHNUR_WC_NULL, flags);
+}
+
+struct schnur_tokenizer
+schnur_split_view (struct schnur_view view, struct schnur_view delimiter, int flags) {
+	return __schnur_split_new (view, SCHNUR_SPLIT_VIEW, delimiter, SCHNUR_WC_NULL, flags);
+}
+
+int
+schnur_tokenizer_next (struct schnur_tokenizer* tokenizer) {
+	if (NULL == tokenizer) {
+		return 0;
+	}
+
+	while (SCHNUR_NOT_FOUND != tokenizer->position) {
+		const size_t n = tokenizer->view.length;
+		size_t begin = tokenizer->position;
+		size_t end, skip = 1;
+
+		if (SCHNUR_SPLIT_VIEW != tokenizer->kind) {
+			end = __schnur_split_find_member (tokenizer, begin);
+		}
+		else if (0 == tokenizer->delimiters.length) {
+			end = n;
+		}
+		else {
+			end = schnur_view_find (tokenizer->view, tokenizer->delimiters, begin);
+			skip = tokenizer->delimiters.length;
+			if (SCHNUR_NOT_FOUND == end) {
+				end = n;
+			}
+		}
+
+		tokenizer->position = end < n ? end + skip : SCHNUR_NOT_FOUND;
+
+		if (begin < end || 0 == (tokenizer->flags & SCHNUR_SPLIT_SKIP_EMPTY)) {
+			tokenizer->token = schnur_view_slice (tokenizer->view, begin, end);
+			tokenizer->offset = begin;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,656 @@
+// Copyright (c) 2013 - ∞ Sven Freiberg. All rights reserved.
+// See license.md for details.
+
+
+#include <schnur.h>
+#include "schnur_cpu.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#if WCHAR_MAX > 0xFFFF
+/// Number of wide characters needed to represent code point cp (UTF-32).
+#define SCHNUR_UTF8_UNITS(cp) 1
+#else
+/// Number of wide characters needed to represent code point cp (UTF-16).
+#define SCHNUR_UTF8_UNITS(cp) ((cp) > 0xFFFF ? 2 : 1)
+#endif
+
+/// Mask selecting the high bit of every byte in a 64-bit word.
+#define SCHNUR_UTF8_ASCII_MASK 0x8080808080808080ULL
+
+/*
+	Tells whether the 8 bytes at s are all ASCII.
+*/
+static inline int
+__schnur_utf8_is_ascii8 (const unsigned char* s) {
+	uint64_t w;
+	memcpy (&w, s, sizeof (w));
+	return 0 == (w & SCHNUR_UTF8_ASCII_MASK);
+}
+
+/*
+	Decodes a single multi-byte sequence (lead byte >= 0x80) of at most n
+	bytes at s. Rejects overlong forms, surrogates and code points beyond
+	U+10FFFF. Returns the number of bytes consumed, or 0 if invalid.
+*/
+static inline size_t
+__schnur_utf8_sequence (const unsigned char* s, size_t n, uint32_t* cp) {
+	unsigned char c = s[0];
+	unsigned char lo = 0x80, hi = 0xBF;
+
+	if (0xC2 <= c && 0xDF >= c) {
+		if (2 > n || 0x80 != (s[1] & 0xC0)) {
+			return 0;
+		}
+		*cp = ((uint32_t)(c & 0x1F) << 6) | (s[1] & 0x3F);
+		return 2;
+	}
+
+	if (0xE0 <= c && 0xEF >= c) {
+		if (0xE0 == c) lo = 0xA0; // Overlong.
+		if (0xED == c) hi = 0x9F; // Surrogates.
+		if (3 > n
+		 || lo > s[1] || hi < s[1]
+		 || 0x80 != (s[2] & 0xC0)) {
+			return 0;
+		}
+		*cp = ((uint32_t)(c & 0x0F) << 12)
+			| ((uint32_t)(s[1] & 0x3F) << 6)
+			| (s[2] & 0x3F);
+		return 3;
+	}
+
+	if (0xF0 <= c && 0xF4 >= c) {
+		if (0xF0 == c) lo = 0x90; // Overlong.
+		if (0xF4 == c) hi = 0x8F; // Beyond U+10FFFF.
+		if (4 > n
+		 || lo > s[1] || hi < s[1]
+		 || 0x80 != (s[2] & 0xC0)
+		 || 0x80 != (s[3] & 0xC0)) {
+			return 0;
+		}
+		*cp = ((uint32_t)(c & 0x07) << 18)
+			| ((uint32_t)(s[1] & 0x3F) << 12)
+			| ((uint32_t)(s[2] & 0x3F) << 6)
+			| (s[3] & 0x3F);
+		return 4;
+	}
+
+	return 0;
+}
+
+size_t
+schnur_utf8_decode_length (const schnur_narrow_t* str, size_t n, size_t* error) {
+	const unsigned char* s = (const unsigned char*)str;
+	size_t i = 0, length = 0;
+	uint32_t cp;
+
+	if (NULL == str) {
+		if (NULL != error) *error = 0;
+		return SCHNUR_UTF8_INVALID;
+	}
+
+	while (i < n) {
+		if (8 <= n - i && __schnur_utf8_is_ascii8 (s + i)) {
+			i += 8;
+			length += 8;
+			continue;
+		}
+
+		if (0x80 > s[i]) {
+			++i;
+			++length;
+			continue;
+		}
+
+		size_t k = __schnur_utf8_sequence (s + i, n - i, &cp);
+		if (0 == k) {
+			if (NULL != error) *error = i;
+			return SCHNUR_UTF8_INVALID;
+		}
+		i += k;
+		length += SCHNUR_UTF8_UNITS (cp);
+	}
+
+	return length;
+}
+
+size_t
+schnur_utf8_decode (schnur_wide_t* dst, const schnur_narrow_t* str, size_t n) {
+	const unsigned char* s = (const unsigned char*)str;
+	size_t i = 0, j = 0, k;
+	uint32_t cp;
+
+	if (NULL == dst || NULL == str) {
+		return SCHNUR_UTF8_INVALID;
+	}
+
+	while (i < n) {
+		if (8 <= n - i && __schnur_utf8_is_ascii8 (s + i)) {
+			for (k = 0; k < 8; ++k) {
+				dst[j + k] = (schnur_wide_t)s[i + k];
+			}
+			i += 8;
+			j += 8;
+			continue;
+		}
+
+		if (0x80 > s[i]) {
+			dst[j++] = (schnur_wide_t)s[i++];
+			continue;
+		}
+
+		k = __schnur_utf8_sequence (s + i, n - i, &cp);
+		if (0 == k) {
+			return SCHNUR_UTF8_INVALID;
+		}
+		i += k;
+
+#if WCHAR_MAX > 0xFFFF
+		dst[j++] = (schnur_wide_t)cp;
+#else
+		if (0xFFFF < cp) {
+			cp -= 0x10000;
+			dst[j++] = (schnur_wide_t)(0xD800 | (cp >> 10));
+			dst[j++] = (schnur_wide_t)(0xDC00 | (cp & 0x3FF));
+		}
+		else {
+			dst[j++] = (schnur_wide_t)cp;
+		}
+#endif
+	}
+
+	return j;
+}
+
+/*
+	Encodes a single code point as utf-8. Returns the number of bytes written.
+*/
+static inline size_t
+__schnur_utf8_put (unsigned char* d, uint32_t cp) {
+	if (0x80 > cp) {
+		d[0] = (unsigned char)cp;
+		return 1;
+	}
+	if (0x800 > cp) {
+		d[0] = (unsigned char)(0xC0 | (cp >> 6));
+		d[1] = (unsigned char)(0x80 | (cp & 0x3F));
+		return 2;
+	}
+	if (0x10000 > cp) {
+		d[0] = (unsigned char)(0xE0 | (cp >> 12));
+		d[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+		d[2] = (unsigned char)(0x80 | (cp & 0x3F));
+		return 3;
+	}
+	d[0] = (unsigned char)(0xF0 | (cp >> 18));
+	d[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+	d[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+	d[3] = (unsigned char)(0x80 | (cp & 0x3F));
+	return 4;
+}
+
+/*
+	Reads the code point of the wide character(s) at s, with at most n
+	characters available. Returns the number of characters consumed, or 0 on
+	lone surrogates and code points beyond U+10FFFF.
+*/
+static inline size_t
+__schnur_utf8_get (const schnur_wide_t* s, size_t n, uint32_t* cp) {
+	uint32_t c = (uint32_t)s[0];
+#if WCHAR_MAX > 0xFFFF
+	(void)n;
+	if (0x10FFFF < c || (0xD800 <= c && 0xDFFF >= c)) {
+		return 0;
+	}
+	*cp = c;
+	return 1;
+#else
+	c &= 0xFFFF;
+	if (0xD800 > c || 0xDFFF < c) {
+		*cp = c;
+		return 1;
+	}
+	if (0xDBFF < c || 2 > n) {
+		return 0;
+	}
+	uint32_t low = (uint32_t)s[1] & 0xFFFF;
+	if (0xDC00 > low || 0xDFFF < low) {
+		return 0;
+	}
+	*cp = 0x10000 + (((c - 0xD800) << 10) | (low - 0xDC00));
+	return 2;
+#endif
+}
+
+/*
+	Encoding kernels. Each one works on whole blocks of wide characters only.
+
+	measure: Adds the utf-8 size of leading characters to size. Stops at the
+	first block the kernel cannot handle (invalid, or non-ASCII for pure
+	ASCII kernels). Returns the number of characters measured.
+	encode_ascii: Narrows leading characters into dst. Stops at the first
+	block containing a non-ASCII character. Returns the number of characters
+	encoded.
+*/
+struct __schnur_utf8_kernels {
+	size_t (*measure) (const schnur_wide_t* s, size_t n, size_t* size);
+	size_t (*encode_ascii) (unsigned char* dst, const schnur_wide_t* s, size_t n);
+};
+
+/// Number of characters the scalar kernels look at per block.
+#define SCHNUR_UTF8_SCALAR_BLOCK 4
+
+static size_t
+__schnur_utf8_ascii_prefix_scalar (const schnur_wide_t* s, size_t n) {
+	size_t i;
+
+	for (i = 0; SCHNUR_UTF8_SCALAR_BLOCK <= n - i; i += SCHNUR_UTF8_SCALAR_BLOCK) {
+		uint32_t bits = (uint32_t)s[i] | (uint32_t)s[i + 1]
+			| (uint32_t)s[i + 2] | (uint32_t)s[i + 3];
+		if (0x7F < bits) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static size_t
+__schnur_utf8_encode_ascii_scalar (unsigned char* dst, const schnur_wide_t* s, size_t n) {
+	size_t i = __schnur_utf8_ascii_prefix_scalar (s, n);
+	size_t k;
+
+	for (k = 0; k < i; ++k) {
+		dst[k] = (unsigned char)s[k];
+	}
+
+	return i;
+}
+
+static size_t
+__schnur_utf8_measure_scalar (const schnur_wide_t* s, size_t n, size_t* size) {
+	size_t i = __schnur_utf8_ascii_prefix_scalar (s, n);
+	*size += i;
+	return i;
+}
+
+static const struct __schnur_utf8_kernels g_kernels_scalar = {
+	__schnur_utf8_measure_scalar,
+	__schnur_utf8_encode_ascii_scalar
+};
+
+#if defined(SCHNUR_CPU_SSE2)
+/*
+	SSE2: Narrows 16 characters per step. Tests all of them against the
+	ASCII range at once, then packs them down to bytes with saturation.
+*/
+#if WCHAR_MAX > 0xFFFF
+static inline int
+__schnur_utf8_sse2_load16 (const schnur_wide_t* s, __m128i v[4]) {
+	const __m128i high = _mm_set1_epi32 ((int)0xFFFFFF80);
+	__m128i bits;
+
+	v[0] = _mm_loadu_si128 ((const __m128i*)(s));
+	v[1] = _mm_loadu_si128 ((const __m128i*)(s + 4));
+	v[2] = _mm_loadu_si128 ((const __m128i*)(s + 8));
+	v[3] = _mm_loadu_si128 ((const __m128i*)(s + 12));
+	bits = _mm_or_si128 (_mm_or_si128 (v[0], v[1]), _mm_or_si128 (v[2], v[3]));
+	bits = _mm_and_si128 (bits, high);
+
+	return 0xFFFF == _mm_movemask_epi8 (_mm_cmpeq_epi32 (bits, _mm_setzero_si128 ()));
+}
+
+static inline __m128i
+__schnur_utf8_sse2_pack16 (const __m128i v[4]) {
+	return _mm_packus_epi16 (
+		_mm_packs_epi32 (v[0], v[1]),
+		_mm_packs_epi32 (v[2], v[3]));
+}
+#else
+static inline int
+__schnur_utf8_sse2_load16 (const schnur_wide_t* s, __m128i v[2]) {
+	const __m128i high = _mm_set1_epi16 ((short)0xFF80);
+	__m128i bits;
+
+	v[0] = _mm_loadu_si128 ((const __m128i*)(s));
+	v[1] = _mm_loadu_si128 ((const __m128i*)(s + 8));
+	bits = _mm_and_si128 (_mm_or_si128 (v[0], v[1]), high);
+
+	return 0xFFFF == _mm_movemask_epi8 (_mm_cmpeq_epi16 (bits, _mm_setzero_si128 ()));
+}
+
+static inline __m128i
+__schnur_utf8_sse2_pack16 (const __m128i v[2]) {
+	return _mm_packus_epi16 (v[0], v[1]);
+}
+#endif
+
+static size_t
+__schnur_utf8_encode_ascii_sse2 (unsigned char* dst, const schnur_wide_t* s, size_t n) {
+	__m128i v[4];
+	size_t i;
+
+	for (i = 0; 16 <= n - i; i += 16) {
+		if (! __schnur_utf8_sse2_load16 (s + i, v)) {
+			break;
+		}
+		_mm_storeu_si128 ((__m128i*)(dst + i), __schnur_utf8_sse2_pack16 (v));
+	}
+
+	return i;
+}
+
+#if WCHAR_MAX > 0xFFFF
+/// Number of steps after which lane counters are flushed, before they
+/// could overflow.
+#define SCHNUR_UTF8_FLUSH_STEPS 4096
+
+/*
+	Sums up the four 32-bit lanes of v.
+*/
+static inline size_t
+__schnur_utf8_sse2_sum (__m128i v) {
+	uint32_t lanes[4];
+	_mm_storeu_si128 ((__m128i*)lanes, v);
+	return (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+/*
+	Measures 4 code points per step. Each one takes one byte, plus one for
+	each of the thresholds 0x80, 0x800 and 0x10000 it reaches. Comparisons
+	yield -1 per lane, so subtracting them counts. Negative values, values
+	beyond U+10FFFF and surrogates stop the kernel.
+*/
+static size_t
+__schnur_utf8_measure_sse2 (const schnur_wide_t* s, size_t n, size_t* size) {
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i c80 = _mm_set1_epi32 (0x7F);
+	const __m128i c800 = _mm_set1_epi32 (0x7FF);
+	const __m128i c10000 = _mm_set1_epi32 (0xFFFF);
+	const __m128i cmax = _mm_set1_epi32 (0x10FFFF);
+	const __m128i smask = _mm_set1_epi32 ((int)0xFFFFF800);
+	const __m128i sval = _mm_set1_epi32 (0xD800);
+	__m128i acc = zero;
+	size_t i, steps = 0;
+
+	for (i = 0; 4 <= n - i; i += 4) {
+		__m128i v = _mm_loadu_si128 ((const __m128i*)(s + i));
+		__m128i bad = _mm_or_si128 (
+			_mm_or_si128 (_mm_cmpgt_epi32 (v, cmax), _mm_cmplt_epi32 (v, zero)),
+			_mm_cmpeq_epi32 (_mm_and_si128 (v, smask), sval));
+		if (0 != _mm_movemask_epi8 (bad)) {
+			break;
+		}
+		acc = _mm_sub_epi32 (acc, _mm_cmpgt_epi32 (v, c80));
+		acc = _mm_sub_epi32 (acc, _mm_cmpgt_epi32 (v, c800));
+		acc = _mm_sub_epi32 (acc, _mm_cmpgt_epi32 (v, c10000));
+		if (SCHNUR_UTF8_FLUSH_STEPS == ++steps) {
+			*size += __schnur_utf8_sse2_sum (acc);
+			acc = zero;
+			steps = 0;
+		}
+	}
+
+	*size += i + __schnur_utf8_sse2_sum (acc);
+
+	return i;
+}
+#else
+static size_t
+__schnur_utf8_ascii_prefix_sse2 (const schnur_wide_t* s, size_t n) {
+	__m128i v[4];
+	size_t i;
+
+	for (i = 0; 16 <= n - i; i += 16) {
+		if (! __schnur_utf8_sse2_load16 (s + i, v)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static size_t
+__schnur_utf8_measure_sse2 (const schnur_wide_t* s, size_t n, size_t* size) {
+	size_t i = __schnur_utf8_ascii_prefix_sse2 (s, n);
+	*size += i;
+	return i;
+}
+#endif
+
+static const struct __schnur_utf8_kernels g_kernels_sse2 = {
+	__schnur_utf8_measure_sse2,
+	__schnur_utf8_encode_ascii_sse2
+};
+#endif
+
+#if defined(SCHNUR_CPU_AVX2)
+/*
+	AVX2: Narrows 32 characters per step. Packing works within 128-bit lanes,
+	so a final permutation restores the original order.
+*/
+#if WCHAR_MAX > 0xFFFF
+SCHNUR_CPU_TARGET_AVX2 static inline int
+__schnur_utf8_avx2_load32 (const schnur_wide_t* s, __m256i v[4]) {
+	const __m256i high = _mm256_set1_epi32 ((int)0xFFFFFF80);
+	__m256i bits;
+
+	v[0] = _mm256_loadu_si256 ((const __m256i*)(s));
+	v[1] = _mm256_loadu_si256 ((const __m256i*)(s + 8));
+	v[2] = _mm256_loadu_si256 ((const __m256i*)(s + 16));
+	v[3] = _mm256_loadu_si256 ((const __m256i*)(s + 24));
+	bits = _mm256_or_si256 (_mm256_or_si256 (v[0], v[1]), _mm256_or_si256 (v[2], v[3]));
+
+	return _mm256_testz_si256 (bits, high);
+}
+
+SCHNUR_CPU_TARGET_AVX2 static inline __m256i
+__schnur_utf8_avx2_pack32 (const __m256i v[4]) {
+	__m256i bytes = _mm256_packus_epi16 (
+		_mm256_packs_epi32 (v[0], v[1]),
+		_mm256_packs_epi32 (v[2], v[3]));
+	return _mm256_permutevar8x32_epi32 (bytes,
+		_mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7));
+}
+#else
+SCHNUR_CPU_TARGET_AVX2 static inline int
+__schnur_utf8_avx2_load32 (const schnur_wide_t* s, __m256i v[2]) {
+	const __m256i high = _mm256_set1_epi16 ((short)0xFF80);
+
+	v[0] = _mm256_loadu_si256 ((const __m256i*)(s));
+	v[1] = _mm256_loadu_si256 ((const __m256i*)(s + 16));
+
+	return _mm256_testz_si256 (_mm256_or_si256 (v[0], v[1]), high);
+}
+
+SCHNUR_CPU_TARGET_AVX2 static inline __m256i
+__schnur_utf8_avx2_pack32 (const __m256i v[2]) {
+	return _mm256_permute4x64_epi64 (
+		_mm256_packus_epi16 (v[0], v[1]), 0xD8);
+}
+#endif
+
+SCHNUR_CPU_TARGET_AVX2 static size_t
+__schnur_utf8_encode_ascii_avx2 (unsigned char* dst, const schnur_wide_t* s, size_t n) {
+	__m256i v[4];
+	size_t i;
+
+	for (i = 0; 32 <= n - i; i += 32) {
+		if (! __schnur_utf8_avx2_load32 (s + i, v)) {
+			break;
+		}
+		_mm256_storeu_si256 ((__m256i*)(dst + i), __schnur_utf8_avx2_pack32 (v));
+	}
+
+	return i + __schnur_utf8_encode_ascii_sse2 (dst + i, s + i, n - i);
+}
+
+#if WCHAR_MAX > 0xFFFF
+/*
+	Same as __schnur_utf8_measure_sse2, with 8 code points per step.
+*/
+SCHNUR_CPU_TARGET_AVX2 static size_t
+__schnur_utf8_measure_avx2 (const schnur_wide_t* s, size_t n, size_t* size) {
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i c80 = _mm256_set1_epi32 (0x7F);
+	const __m256i c800 = _mm256_set1_epi32 (0x7FF);
+	const __m256i c10000 = _mm256_set1_epi32 (0xFFFF);
+	const __m256i cmax = _mm256_set1_epi32 (0x10FFFF);
+	const __m256i smask = _mm256_set1_epi32 ((int)0xFFFFF800);
+	const __m256i sval = _mm256_set1_epi32 (0xD800);
+	__m256i acc = zero;
+	size_t i, steps = 0;
+
+	for (i = 0; 8 <= n - i; i += 8) {
+		__m256i v = _mm256_loadu_si256 ((const __m256i*)(s + i));
+		__m256i bad = _mm256_or_si256 (
+			_mm256_or_si256 (_mm256_cmpgt_epi32 (v, cmax), _mm256_cmpgt_epi32 (zero, v)),
+			_mm256_cmpeq_epi32 (_mm256_and_si256 (v, smask), sval));
+		if (! _mm256_testz_si256 (bad, bad)) {
+			break;
+		}
+		acc = _mm256_sub_epi32 (acc, _mm256_cmpgt_epi32 (v, c80));
+		acc = _mm256_sub_epi32 (acc, _mm256_cmpgt_epi32 (v, c800));
+		acc = _mm256_sub_epi32 (acc, _mm256_cmpgt_epi32 (v, c10000));
+		if (SCHNUR_UTF8_FLUSH_STEPS == ++steps) {
+			*size += __schnur_utf8_sse2_sum (_mm_add_epi32 (
+				_mm256_castsi256_si128 (acc), _mm256_extracti128_si256 (acc, 1)));
+			acc = zero;
+			steps = 0;
+		}
+	}
+
+	*size += i + __schnur_utf8_sse2_sum (_mm_add_epi32 (
+		_mm256_castsi256_si128 (acc), _mm256_extracti128_si256 (acc, 1)));
+
+	return i + __schnur_utf8_measure_sse2 (s + i, n - i, size);
+}
+#else
+SCHNUR_CPU_TARGET_AVX2 static size_t
+__schnur_utf8_ascii_prefix_avx2 (const schnur_wide_t* s, size_t n) {
+	__m256i v[4];
+	size_t i;
+
+	for (i = 0; 32 <= n - i; i += 32) {
+		if (! __schnur_utf8_avx2_load32 (s + i, v)) {
+			break;
+		}
+	}
+
+	return i + __schnur_utf8_ascii_prefix_sse2 (s + i, n - i);
+}
+
+SCHNUR_CPU_TARGET_AVX2 static size_t
+__schnur_utf8_measure_avx2 (const schnur_wide_t* s, size_t n, size_t* size) {
+	size_t i = __schnur_utf8_ascii_prefix_avx2 (s, n);
+	*size += i;
+	return i;
+}
+#endif
+
+static const struct __schnur_utf8_kernels g_kernels_avx2 = {
+	__schnur_utf8_measure_avx2,
+	__schnur_utf8_encode_ascii_avx2
+};
+#endif
+
+static const struct __schnur_utf8_kernels* g_kernels = NULL;
+
+/*
+	Selects the widest set of kernels supported by the running CPU.
+*/
+static const struct __schnur_utf8_kernels*
+__schnur_utf8_kernels (void) {
+	const struct __schnur_utf8_kernels* kernels = g_kernels;
+
+	if (NULL == kernels) {
+		kernels = &g_kernels_scalar;
+#if defined(SCHNUR_CPU_SSE2)
+		kernels = &g_kernels_sse2;
+#endif
+#if defined(SCHNUR_CPU_AVX2)
+		if (__schnur_cpu_has_avx2 ()) {
+			kernels = &g_kernels_avx2;
+		}
+#endif
+		g_kernels = kernels;
+	}
+
+	return kernels;
+}
+
+/// Number of consecutive ASCII characters, after which the scalar loops
+/// hand back to the vectorized kernels.
+#define SCHNUR_UTF8_ASCII_RUN 16
+
+size_t
+schnur_utf8_encode_length (const schnur_wide_t* s, size_t n) {
+	const struct __schnur_utf8_kernels* kernels = __schnur_utf8_kernels ();
+	size_t i = 0, size = 0, run, k;
+	uint32_t cp;
+
+	if (NULL == s) {
+		return SCHNUR_UTF8_INVALID;
+	}
+
+	while (i < n) {
+		i += kernels->measure (s + i, n - i, &size);
+
+		for (run = 0; i < n && SCHNUR_UTF8_ASCII_RUN > run;) {
+			if (0x80 > (uint32_t)s[i]) {
+				++i;
+				++size;
+				++run;
+				continue;
+			}
+
+			k = __schnur_utf8_get (s + i, n - i, &cp);
+			if (0 == k) {
+				return SCHNUR_UTF8_INVALID;
+			}
+			i += k;
+			size += 2 + (0x800 <= cp) + (0x10000 <= cp);
+			run = 0;
+		}
+	}
+
+	return size;
+}
+
+size_t
+schnur_utf8_encode (schnur_narrow_t* dst, const schnur_wide_t* s, size_t n) {
+	const struct __schnur_utf8_kernels* kernels = __schnur_utf8_kernels ();
+	unsigned char* d = (unsigned char*)dst;
+	size_t i = 0, j = 0, run, k;
+	uint32_t cp;
+
+	if (NULL == dst || NULL == s) {
+		return SCHNUR_UTF8_INVALID;
+	}
+
+	while (i < n) {
+		k = kernels->encode_ascii (d + j, s + i, n - i);
+		i += k;
+		j += k;
+
+		for (run = 0; i < n && SCHNUR_UTF8_ASCII_RUN > run;) {
+			if (0x80 > (uint32_t)s[i]) {
+				d[j++] = (unsigned char)s[i++];
+				++run;
+				continue;
+			}
+
+			k = __schnur_utf8_get (s + i, n - i, &cp);
+			if (0 == k) {
+				return SCHNUR_UTF8_INVALID;
+			}
+			i += k;
+			j += __schnur_utf8_put (d + j, cp);
+			run = 0;
+		}
+	}
+
+	return j;
+}
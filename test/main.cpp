@@ -7,6 +7,11 @@
 */
 
 #include <catch.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <algorithm>
 
 extern "C" {
 	#include <stdlib.h>
@@ -14,6 +19,8 @@ extern "C" {
 	#include <wchar.h>
 	#include <string.h>
 	#include <locale.h>
+	#include <stdarg.h>
+	#include <math.h>
 
 	#include <schnur.h>
 }
@@ -46,7 +53,7 @@ TEST_CASE ("creation/new", "[string]") {
 
 		REQUIRE (NULL != s);
 		REQUIRE (NULL != schnur_raw (s));
-		REQUIRE (SCHNUR_BLOCK_SIZE == schnur_capacity (s));
+		REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_capacity (s));
 		REQUIRE (0 == schnur_length (s));
 
 		schnur_free (s);
@@ -66,7 +73,7 @@ TEST_CASE ("creation/new", "[string]") {
 		printf ("Raw length: %zu => %s\n", strlen (raw_base), raw_base);
 		schnur_t* new_su = schnur_new_su (raw_base);
 		REQUIRE (NULL != new_su);
-		REQUIRE (SCHNUR_BLOCK_SIZE == schnur_capacity (new_su));
+		REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_capacity (new_su));
 		REQUIRE (5 == schnur_length (new_su));
 		schnur_free (new_su);
 
@@ -74,7 +81,7 @@ TEST_CASE ("creation/new", "[string]") {
 		schnur_t* new_s = schnur_new_s (base);
 
 		REQUIRE (NULL != new_s);
-		REQUIRE (SCHNUR_BLOCK_SIZE == schnur_capacity (new_s));
+		REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_capacity (new_s));
 		size_t new_s_l = schnur_length (new_s);
 		REQUIRE (7 == new_s_l);
 
@@ -235,6 +242,20 @@ TEST_CASE ("appending", "[string]") {
 			}
 		}
 	}
+
+	SECTION ("schnur_append_string self") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("0123456789"))) {
+			REQUIRE (NULL != s);
+
+			for (size_t i = 0; i < 4; ++i) {
+				REQUIRE (1 == schnur_append_string (s, s));
+			}
+			REQUIRE (160 == schnur_length (s));
+			for (size_t i = 0; i < 160; ++i) {
+				REQUIRE (SCHNUR_W ('0') + (i % 10) == schnur_get (s, i));
+			}
+		}
+	}
 }
 
 TEST_CASE ("copy", "[string]") {
@@ -295,6 +316,10 @@ TEST_CASE ("expand/compact", "[string]") {
 		s = schnur_new ();
 		REQUIRE (NULL != s);
 
+		// Leaves inline storage.
+		REQUIRE (1 == schnur_expand (s));
+		REQUIRE (SCHNUR_BLOCK_SIZE == schnur_capacity (s));
+
 		schnur_expand (s);
 
 		SCHNUR_WIDE_SCOPED (s, sw) {
@@ -305,11 +330,72 @@ TEST_CASE ("expand/compact", "[string]") {
 		schnur_free (s);
 	}
 
+	SECTION ("schnur_expand linear") {
+		REQUIRE (1 == schnur_set_growth_policy (SCHNUR_GROWTH_LINEAR));
+		REQUIRE (SCHNUR_GROWTH_LINEAR == schnur_get_growth_policy ());
+
+		schnur_t* s = schnur_new ();
+		REQUIRE (NULL != s);
+		REQUIRE (1 == schnur_expand (s));
+		REQUIRE (1 == schnur_expand (s));
+		REQUIRE (1 == schnur_expand (s));
+		REQUIRE ((3 * SCHNUR_BLOCK_SIZE) == schnur_capacity (s));
+		schnur_free (s);
+
+		REQUIRE (1 == schnur_set_growth_policy (SCHNUR_GROWTH_GEOMETRIC));
+	}
+
+	SECTION ("schnur_expand geometric") {
+		REQUIRE (SCHNUR_GROWTH_GEOMETRIC == schnur_get_growth_policy ());
+
+		schnur_t* s = schnur_new ();
+		REQUIRE (NULL != s);
+		REQUIRE (1 == schnur_expand (s));
+		REQUIRE (1 == schnur_expand (s));
+		REQUIRE (1 == schnur_expand (s));
+		REQUIRE ((4 * SCHNUR_BLOCK_SIZE) == schnur_capacity (s));
+		schnur_free (s);
+	}
+
+	SECTION ("schnur_reserve") {
+		schnur_t* s = schnur_new_s (SCHNUR_W ("Grüß Gott"));
+		REQUIRE (NULL != s);
+
+		REQUIRE (1 == schnur_reserve (s, 1000));
+		REQUIRE (1000 < schnur_capacity (s));
+		REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("Grüß Gott")));
+
+		// Never shrinks.
+		size_t capacity = schnur_capacity (s);
+		REQUIRE (1 == schnur_reserve (s, 10));
+		REQUIRE (capacity == schnur_capacity (s));
+
+		for (size_t i = 0; i < 990; ++i) {
+			REQUIRE (1 == schnur_append (s, SCHNUR_W ('!')));
+		}
+		REQUIRE (capacity == schnur_capacity (s));
+
+		schnur_free (s);
+	}
+
+	SECTION ("schnur_new_with_capacity") {
+		schnur_t* s = schnur_new_with_capacity (5000);
+		REQUIRE (NULL != s);
+		REQUIRE (5000 < schnur_capacity (s));
+		REQUIRE (0 == schnur_length (s));
+
+		schnur_free (s);
+	}
+
 	SECTION ("schnur_compact") {
+		REQUIRE (1 == schnur_set_growth_policy (SCHNUR_GROWTH_LINEAR));
+
 		schnur_t* s = NULL;
 		s = schnur_new ();
 		REQUIRE (NULL != s);
 		REQUIRE (NULL != schnur_raw (s));
+		schnur_expand (s); // 1 * SCHNUR_BLOCK_SIZE
+		REQUIRE (NULL != schnur_raw (s));
 		schnur_expand (s);
 		REQUIRE (NULL != schnur_raw (s));
 		schnur_expand (s); // 3 * SCHNUR_BLOCK_SIZE
@@ -330,6 +416,67 @@ TEST_CASE ("expand/compact", "[string]") {
 		REQUIRE (1 == schnur_compact (s));
 		REQUIRE ((2 * SCHNUR_BLOCK_SIZE) == schnur_capacity (s));
 		schnur_free (s);
+
+		REQUIRE (1 == schnur_set_growth_policy (SCHNUR_GROWTH_GEOMETRIC));
+	}
+
+	SECTION ("inline storage") {
+		const schnur_wide_t* w = SCHNUR_W ("ευχαριστημένος");
+		const size_t l = wcslen (w);
+		REQUIRE (l < SCHNUR_INLINE_CAPACITY);
+
+		schnur_t* s = schnur_new_s (w);
+		REQUIRE (NULL != s);
+		REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_capacity (s));
+		REQUIRE ((SCHNUR_INLINE_CAPACITY * sizeof (schnur_wide_t))
+			== schnur_raw_size (s));
+		REQUIRE (0 == wcscmp ((schnur_wide_t*)schnur_raw (s), w));
+
+		// Moves to heap storage, keeping the contents.
+		REQUIRE (1 == schnur_append_cstr (s, w));
+		REQUIRE (SCHNUR_BLOCK_SIZE == schnur_capacity (s));
+		REQUIRE (2 * l == schnur_length (s));
+		for (size_t i = 0; i < 2 * l; ++i) {
+			REQUIRE (w[i % l] == schnur_get (s, i));
+		}
+
+		// Moves back inline, keeping the contents.
+		REQUIRE (1 == schnur_terminate (s, 3));
+		REQUIRE (1 == schnur_compact (s));
+		REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_capacity (s));
+		REQUIRE (3 == schnur_length (s));
+		REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("ευχ")));
+		REQUIRE (0 == schnur_compact (s));
+
+		REQUIRE (1 == schnur_reverse (s));
+		REQUIRE (1 == schnur_set (s, 0, SCHNUR_W ('X')));
+		REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("Xυε")));
+
+		schnur_free (s);
+	}
+
+	SECTION ("schnur_fill, then append") {
+		// Filled storage has no room for a terminator.
+		schnur_t* s = schnur_new ();
+		REQUIRE (NULL != s);
+		REQUIRE (1 == schnur_fill (s, SCHNUR_W ('X')));
+		REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_length (s));
+
+		REQUIRE (1 == schnur_append (s, SCHNUR_W ('Y')));
+		REQUIRE (SCHNUR_INLINE_CAPACITY + 1 == schnur_length (s));
+		REQUIRE (SCHNUR_W ('X') == schnur_get (s, 0));
+		REQUIRE (SCHNUR_W ('Y') == schnur_get (s, SCHNUR_INLINE_CAPACITY));
+		REQUIRE (SCHNUR_WC_NULL == schnur_view_of (s).data[SCHNUR_INLINE_CAPACITY + 1]);
+
+		// Moves back inline once it fits again.
+		REQUIRE (1 == schnur_terminate (s, 4));
+		REQUIRE (1 == schnur_compact (s));
+		REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_capacity (s));
+		REQUIRE (1 == schnur_fill (s, SCHNUR_W ('Z')));
+		REQUIRE (1 == schnur_reserve (s, 2 * SCHNUR_INLINE_CAPACITY));
+		REQUIRE (SCHNUR_W ('Z') == schnur_get (s, SCHNUR_INLINE_CAPACITY - 2));
+
+		schnur_free (s);
 	}
 }
 
@@ -370,6 +517,98 @@ TEST_CASE ("equal", "[string]") {
 		schnur_free (o);
 		schnur_free (s);
 	}
+
+	SECTION ("schnur_equal_cstr prefix") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("prefix"))) {
+			REQUIRE (0 == schnur_equal_cstr (s, SCHNUR_W ("prefixed")));
+			REQUIRE (0 == schnur_equal_cstr (s, SCHNUR_W ("prefi")));
+			REQUIRE (0 == schnur_equal_cstr (s, SCHNUR_W ("")));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("prefix")));
+		}
+	}
+
+	SECTION ("schnur_view_mismatch") {
+		std::vector<schnur_wide_t> a (200), b;
+		size_t n, i;
+
+		for (i = 0; i < a.size (); ++i) {
+			a[i] = (schnur_wide_t)(0x41 + i % 26 + (0 == i % 7 ? 0x400 : 0));
+		}
+		b = a;
+
+		// Every length and every position of the first difference, so each
+		// kernel sees mismatches in full steps as well as in the tail.
+		for (n = 0; n <= a.size (); ++n) {
+			REQUIRE (n == schnur_view_mismatch (schnur_view_n (&a[0], n), schnur_view_n (&b[0], n)));
+			for (i = 0; i < n; ++i) {
+				b[i] ^= 0x100;
+				REQUIRE (i == schnur_view_mismatch (schnur_view_n (&a[0], n), schnur_view_n (&b[0], n)));
+				REQUIRE (0 == schnur_view_equal (schnur_view_n (&a[0], n), schnur_view_n (&b[0], n)));
+				b[i] ^= 0x100;
+			}
+		}
+
+		REQUIRE (3 == schnur_view_mismatch (schnur_view_n (&a[0], 3), schnur_view_n (&a[0], 9)));
+		REQUIRE (0 == schnur_view_mismatch (schnur_view_n (NULL, 0), schnur_view_n (&a[0], 9)));
+	}
+
+	SECTION ("schnur_compare") {
+		const schnur_wide_t* sorted[] = {
+			SCHNUR_W (""),
+			SCHNUR_W ("a"),
+			SCHNUR_W ("ab"),
+			SCHNUR_W ("abc"),
+			SCHNUR_W ("abd"),
+			SCHNUR_W ("b"),
+			SCHNUR_W ("\u00e9"),
+			SCHNUR_W ("\uffee"),
+			SCHNUR_W ("\U0001F600"),
+			SCHNUR_W ("\U0001F600a"),
+		};
+		const size_t count = sizeof (sorted) / sizeof (sorted[0]);
+		std::vector<schnur_t*> strings;
+		size_t i, j;
+
+		for (i = 0; i < count; ++i) {
+			strings.push_back (schnur_new_s (sorted[i]));
+		}
+
+		for (i = 0; i < count; ++i) {
+			for (j = 0; j < count; ++j) {
+				int order = schnur_compare (strings[i], strings[j]);
+				REQUIRE ((i < j) == (0 > order));
+				REQUIRE ((i == j) == (0 == order));
+				REQUIRE ((i > j) == (0 < order));
+			}
+		}
+
+		REQUIRE (0 == schnur_compare (NULL, strings[0]));
+		REQUIRE (0 > schnur_compare (NULL, strings[1]));
+		REQUIRE (0 < schnur_view_compare (schnur_view_cstr (SCHNUR_W ("abcdefghijklmnopqrstuvwxyz0123456789z")),
+			schnur_view_cstr (SCHNUR_W ("abcdefghijklmnopqrstuvwxyz0123456789a"))));
+
+		for (i = 0; i < count; ++i) {
+			schnur_free (strings[i]);
+		}
+	}
+
+	SECTION ("schnur_starts_with / schnur_ends_with") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("/api/v1/users.json"))) {
+			REQUIRE (1 == schnur_starts_with (s, schnur_view_cstr (SCHNUR_W ("/api/"))));
+			REQUIRE (1 == schnur_starts_with (s, schnur_view_cstr (SCHNUR_W (""))));
+			REQUIRE (1 == schnur_starts_with (s, schnur_view_of (s)));
+			REQUIRE (0 == schnur_starts_with (s, schnur_view_cstr (SCHNUR_W ("/api/v2"))));
+			REQUIRE (0 == schnur_starts_with (s, schnur_view_cstr (SCHNUR_W ("/api/v1/users.json/"))));
+
+			REQUIRE (1 == schnur_ends_with (s, schnur_view_cstr (SCHNUR_W (".json"))));
+			REQUIRE (1 == schnur_ends_with (s, schnur_view_n (NULL, 0)));
+			REQUIRE (0 == schnur_ends_with (s, schnur_view_cstr (SCHNUR_W (".xml"))));
+			REQUIRE (0 == schnur_ends_with (s, schnur_view_cstr (SCHNUR_W ("//api/v1/users.json"))));
+		}
+
+		REQUIRE (0 == schnur_starts_with (NULL, schnur_view_cstr (SCHNUR_W (""))));
+		REQUIRE (1 == schnur_view_ends_with (schnur_view_n (NULL, 0), schnur_view_n (NULL, 0)));
+	}
 }
 
 TEST_CASE ("access", "[string]") {
@@ -424,3 +663,2396 @@ TEST_CASE ("string manipulation", "[string]") {
 		schnur_free (s);
 	}
 }
+
+static size_t g_test_allocations = 0;
+static size_t g_test_releases = 0;
+
+static void*
+test_allocate (void* context, size_t size) {
+	(void)context;
+	++g_test_allocations;
+	return malloc (size);
+}
+
+static void*
+test_reallocate (void* context, void* p, size_t old_size, size_t size) {
+	(void)context;
+	(void)old_size;
+	++g_test_allocations;
+	return realloc (p, size);
+}
+
+static void
+test_release (void* context, void* p) {
+	(void)context;
+	if (NULL != p) {
+		++g_test_releases;
+	}
+	free (p);
+}
+
+TEST_CASE ("allocator", "[string]") {
+	setlocale (LC_ALL, "");
+
+	const struct schnur_allocator counting = {
+		test_allocate, test_reallocate, test_release, NULL
+	};
+
+	SECTION ("schnur_set_allocator") {
+		g_test_allocations = g_test_releases = 0;
+		REQUIRE (schnur_default_allocator () == schnur_get_allocator ());
+		REQUIRE (1 == schnur_set_allocator (&counting));
+		REQUIRE (&counting == schnur_get_allocator ());
+
+		schnur_t* s = schnur_new_s (SCHNUR_W ("Hänsel mag Soße!"));
+		REQUIRE (NULL != s);
+		REQUIRE (0 < g_test_allocations);
+
+		// Keeps its allocator, even if the current one changes.
+		REQUIRE (1 == schnur_set_allocator (NULL));
+		REQUIRE (schnur_default_allocator () == schnur_get_allocator ());
+		REQUIRE (1 == schnur_append_cstr (s, SCHNUR_W (" Und Gretel?")));
+
+		schnur_wide_t* w = schnur_wide (s);
+		REQUIRE (NULL != w);
+		REQUIRE (1 == schnur_wide_release (s, w));
+
+		REQUIRE (1 == schnur_free (s));
+		REQUIRE (g_test_allocations == g_test_releases);
+
+		const struct schnur_allocator incomplete = {
+			test_allocate, NULL, test_release, NULL
+		};
+		REQUIRE (0 == schnur_set_allocator (&incomplete));
+		REQUIRE (NULL == schnur_new_with_allocator (&incomplete));
+	}
+
+	SECTION ("schnur_new_with_allocator") {
+		g_test_allocations = g_test_releases = 0;
+
+		SCHNUR_SCOPED (s, schnur_new_with_allocator (&counting)) {
+			REQUIRE (1 == schnur_copy_cstr (s, SCHNUR_W ("ευχαριστημένος")));
+			SCHNUR_WIDE_SCOPED (s, sw) {
+				REQUIRE (0 == wcscmp (sw, SCHNUR_W ("ευχαριστημένος")));
+			}
+		}
+
+		REQUIRE (2 == g_test_allocations);
+		REQUIRE (2 == g_test_releases);
+	}
+
+	SECTION ("schnur_arena") {
+		struct schnur_arena* arena = schnur_arena_new (256);
+		REQUIRE (NULL != arena);
+		const struct schnur_allocator* a = schnur_arena_allocator (arena);
+		REQUIRE (NULL != a);
+
+		for (int round = 0; round < 3; ++round) {
+			schnur_t* batch[64];
+			for (size_t i = 0; i < 64; ++i) {
+				batch[i] = schnur_new_with_allocator (a);
+				REQUIRE (NULL != batch[i]);
+				for (size_t j = 0; j <= i; ++j) {
+					REQUIRE (1 == schnur_append (batch[i], SCHNUR_W ('a') + (j % 26)));
+				}
+			}
+
+			for (size_t i = 0; i < 64; ++i) {
+				REQUIRE (i + 1 == schnur_length (batch[i]));
+				for (size_t j = 0; j <= i; ++j) {
+					REQUIRE (SCHNUR_W ('a') + (j % 26) == schnur_get (batch[i], j));
+				}
+
+				schnur_wide_t* w = schnur_wide (batch[i]);
+				REQUIRE (NULL != w);
+				REQUIRE (i + 1 == wcslen (w));
+			}
+
+			// Releases everything at once, without freeing one by one.
+			REQUIRE (1 == schnur_arena_reset (arena));
+		}
+
+		REQUIRE (1 == schnur_arena_free (arena));
+	}
+}
+
+TEST_CASE ("utf-8 decoding", "[string]") {
+	setlocale (LC_ALL, "");
+
+	SECTION ("schnur_new_su long") {
+		// Multi-byte sequences crossing every 8 and 32 byte boundary.
+		const schnur_wide_t* w =
+			SCHNUR_W ("Hänsel mag Soße! живи и воли, живот је кратак 🤗 ๐๓๓๗.๛");
+		const size_t l = wcslen (w);
+		std::string utf8;
+		for (int i = 0; i < 20; ++i) {
+			utf8 += "Hänsel mag Soße! живи и воли, живот је кратак 🤗 ๐๓๓๗.๛";
+		}
+
+		SCHNUR_SCOPED (s, schnur_new_su (utf8.c_str ())) {
+			REQUIRE (20 * l == schnur_length (s));
+			for (size_t i = 0; i < 20 * l; ++i) {
+				REQUIRE (w[i % l] == schnur_get (s, i));
+			}
+		}
+	}
+
+	SECTION ("schnur_new_su_n") {
+		const schnur_narrow_t raw[] = "a\0b\xC3\xA4";
+		size_t error = 42;
+
+		SCHNUR_SCOPED (s, schnur_new_su_n (raw, sizeof (raw) - 1, &error)) {
+			REQUIRE (42 == error);
+			REQUIRE (4 == schnur_length (s));
+			REQUIRE (SCHNUR_W ('\0') == schnur_get (s, 1));
+			REQUIRE (SCHNUR_W ('ä') == schnur_get (s, 3));
+		}
+
+		SCHNUR_SCOPED (e, schnur_new_su_n ("", 0, NULL)) {
+			REQUIRE (0 == schnur_length (e));
+		}
+	}
+
+	SECTION ("schnur_utf8_decode_length") {
+		size_t error = 0;
+
+		REQUIRE (0 == schnur_utf8_decode_length ("", 0, &error));
+		REQUIRE (3 == schnur_utf8_decode_length ("abc", 3, &error));
+		REQUIRE (1 == schnur_utf8_decode_length ("\xC3\xA4", 2, &error));
+		REQUIRE (1 == schnur_utf8_decode_length ("\xE2\x82\xAC", 3, &error));
+		REQUIRE ((sizeof (schnur_wide_t) < 4 ? 2 : 1)
+			== schnur_utf8_decode_length ("\xF0\x9F\xA4\x97", 4, &error));
+
+		struct { const char* s; size_t error; } invalid[] = {
+			{ "abcdefghij\x80", 10 },         // Stray continuation byte.
+			{ "ab\xC0\xAF", 2 },              // Overlong '/'.
+			{ "ab\xE0\x80\xAF", 2 },          // Overlong '/'.
+			{ "ab\xF0\x80\x80\xAF", 2 },      // Overlong '/'.
+			{ "\xED\xA0\x80", 0 },            // Surrogate.
+			{ "\xF4\x90\x80\x80", 0 },        // Beyond U+10FFFF.
+			{ "\xF5\x80\x80\x80", 0 },        // Invalid lead byte.
+			{ "abc\xE2\x82", 3 },             // Truncated.
+			{ "\xC3\xA4\xC3", 2 },            // Truncated.
+		};
+		for (size_t i = 0; i < sizeof (invalid) / sizeof (invalid[0]); ++i) {
+			INFO ("Invalid input #" << i);
+			error = 42;
+			REQUIRE (SCHNUR_UTF8_INVALID == schnur_utf8_decode_length (
+				invalid[i].s, strlen (invalid[i].s), &error));
+			REQUIRE (invalid[i].error == error);
+
+			error = 42;
+			REQUIRE (NULL == schnur_new_su_n (
+				invalid[i].s, strlen (invalid[i].s), &error));
+			REQUIRE (invalid[i].error == error);
+		}
+	}
+
+	SECTION ("schnur_utf8_decode") {
+		const schnur_narrow_t* raw = "0123456789\xD0\x89\xD1\x83\xD0\xB1\xD0\xB0\xD0\xB2";
+		const size_t n = strlen (raw);
+		schnur_wide_t w[16];
+
+		size_t l = schnur_utf8_decode_length (raw, n, NULL);
+		REQUIRE (15 == l);
+		REQUIRE (15 == schnur_utf8_decode (w, raw, n));
+		w[l] = SCHNUR_W ('\0');
+		REQUIRE (0 == wcscmp (w, SCHNUR_W ("0123456789Љубав")));
+	}
+}
+
+TEST_CASE ("utf-8 encoding", "[string]") {
+	setlocale (LC_ALL, "");
+
+	SECTION ("schnur_utf8_encode") {
+		const schnur_wide_t* w = SCHNUR_W ("aä€🤗");
+		const size_t l = wcslen (w);
+		schnur_narrow_t n[16];
+
+		REQUIRE (10 == schnur_utf8_encode_length (w, l));
+		REQUIRE (10 == schnur_utf8_encode (n, w, l));
+		REQUIRE (0 == memcmp (n, "a\xC3\xA4\xE2\x82\xAC\xF0\x9F\xA4\x97", 10));
+		REQUIRE (0 == schnur_utf8_encode_length (w, 0));
+	}
+
+	SECTION ("schnur_utf8_encode invalid") {
+		schnur_wide_t w[] = { SCHNUR_W ('a'), (schnur_wide_t)0xD800, SCHNUR_W ('b'), 0 };
+		schnur_narrow_t n[16];
+
+		REQUIRE (SCHNUR_UTF8_INVALID == schnur_utf8_encode_length (w, 3));
+		REQUIRE (SCHNUR_UTF8_INVALID == schnur_utf8_encode (n, w, 3));
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("abc"))) {
+			REQUIRE (1 == schnur_set (s, 1, (schnur_wide_t)0xDC00));
+			REQUIRE (NULL == schnur_narrow (s));
+		}
+	}
+
+	SECTION ("schnur_narrow ascii runs") {
+		// Exercises vectorized paths at every offset and tail length.
+		for (size_t prefix = 0; prefix < 40; ++prefix) {
+			for (size_t tail = 0; tail < 70; tail += 3) {
+				std::string expected;
+				SCHNUR_SCOPED_EMPTY (s) {
+					for (size_t i = 0; i < prefix; ++i) {
+						REQUIRE (1 == schnur_append (s, SCHNUR_W ('a') + (i % 26)));
+						expected += (char)('a' + (i % 26));
+					}
+					REQUIRE (1 == schnur_append (s, SCHNUR_W ('ß')));
+					expected += "\xC3\x9F";
+					for (size_t i = 0; i < tail; ++i) {
+						REQUIRE (1 == schnur_append (s, SCHNUR_W ('0') + (i % 10)));
+						expected += (char)('0' + (i % 10));
+					}
+
+					SCHNUR_NARROW_SCOPED (s, n) {
+						REQUIRE (expected == n);
+					}
+				}
+			}
+		}
+	}
+
+	SECTION ("round trip without locale") {
+		setlocale (LC_ALL, "C");
+
+		const schnur_narrow_t* raw = "Hänsel mag Soße! живи и воли 🤗 ๐๓๓๗.๛";
+		SCHNUR_SCOPED (s, schnur_new_su (raw)) {
+			SCHNUR_NARROW_SCOPED (s, n) {
+				REQUIRE (0 == strcmp (raw, n));
+			}
+		}
+
+		setlocale (LC_ALL, "");
+	}
+}
+
+TEST_CASE ("into buffer", "[string]") {
+	setlocale (LC_ALL, "");
+
+	SECTION ("schnur_narrow_into") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("Hänsel mag Soße!"))) {
+			schnur_narrow_t buf[64];
+			size_t needed = 0;
+
+			// Size query.
+			REQUIRE (0 == schnur_narrow_into (s, NULL, 0, &needed));
+			REQUIRE (18 == needed);
+
+			// Too small, nothing written.
+			memset (buf, 'X', sizeof (buf));
+			REQUIRE (0 == schnur_narrow_into (s, buf, 18, &needed));
+			REQUIRE (18 == needed);
+			REQUIRE ('X' == buf[0]);
+
+			// Exactly fits, measured first.
+			REQUIRE (1 == schnur_narrow_into (s, buf, 19, &needed));
+			REQUIRE (18 == needed);
+			REQUIRE (0 == strcmp (buf, "Hänsel mag Soße!"));
+
+			// Worst case fits.
+			needed = 0;
+			REQUIRE (1 == schnur_narrow_into (s, buf, sizeof (buf), &needed));
+			REQUIRE (18 == needed);
+			REQUIRE (0 == strcmp (buf, "Hänsel mag Soße!"));
+		}
+
+		SCHNUR_SCOPED_EMPTY (e) {
+			schnur_narrow_t buf[4] = "abc";
+			REQUIRE (1 == schnur_narrow_into (e, buf, sizeof (buf), NULL));
+			REQUIRE ('\0' == buf[0]);
+		}
+	}
+
+	SECTION ("schnur_narrow_range_into") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("Hänsel mag Soße!"))) {
+			schnur_narrow_t buf[64];
+			size_t needed = 0;
+
+			REQUIRE (1 == schnur_narrow_range_into (s, 11, 15, buf, sizeof (buf), &needed));
+			REQUIRE (5 == needed);
+			REQUIRE (0 == strcmp (buf, "Soße"));
+
+			REQUIRE (1 == schnur_narrow_range_into (s, 3, 3, buf, 1, &needed));
+			REQUIRE (0 == needed);
+			REQUIRE ('\0' == buf[0]);
+
+			REQUIRE (0 == schnur_narrow_range_into (s, 4, 3, buf, sizeof (buf), NULL));
+			REQUIRE (0 == schnur_narrow_range_into (s, 0, 17, buf, sizeof (buf), NULL));
+
+			REQUIRE (1 == schnur_set (s, 2, (schnur_wide_t)0xDFFF));
+			REQUIRE (0 == schnur_narrow_range_into (s, 0, 4, buf, sizeof (buf), &needed));
+			REQUIRE (SCHNUR_UTF8_INVALID == needed);
+			REQUIRE (0 == schnur_narrow_range_into (s, 0, 4, NULL, 0, &needed));
+			REQUIRE (SCHNUR_UTF8_INVALID == needed);
+			REQUIRE (1 == schnur_narrow_range_into (s, 3, 6, buf, sizeof (buf), NULL));
+			REQUIRE (0 == strcmp (buf, "sel"));
+		}
+	}
+
+	SECTION ("schnur_wide_into") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("солнце"))) {
+			schnur_wide_t buf[8];
+			size_t needed = 0;
+
+			REQUIRE (0 == schnur_wide_into (s, NULL, 0, &needed));
+			REQUIRE (6 == needed);
+			REQUIRE (0 == schnur_wide_into (s, buf, 6, NULL));
+			REQUIRE (1 == schnur_wide_into (s, buf, 7, NULL));
+			REQUIRE (0 == wcscmp (buf, SCHNUR_W ("солнце")));
+
+			REQUIRE (1 == schnur_wide_range_into (s, 1, 3, buf, 3, &needed));
+			REQUIRE (2 == needed);
+			REQUIRE (0 == wcscmp (buf, SCHNUR_W ("ол")));
+			REQUIRE (0 == schnur_wide_range_into (s, 1, 7, buf, 8, NULL));
+		}
+	}
+
+	SECTION ("scoped buffer") {
+		static schnur_narrow_t scratch[8];
+		static schnur_wide_t wide_scratch[8];
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("Soße"))) {
+			SCHNUR_NARROW_SCOPED_BUFFER (s, n, scratch, sizeof (scratch)) {
+				REQUIRE (scratch == n);
+				REQUIRE (0 == strcmp (n, "Soße"));
+			}
+			SCHNUR_WIDE_SCOPED_BUFFER (s, w, wide_scratch, 8) {
+				REQUIRE (wide_scratch == w);
+				REQUIRE (0 == wcscmp (w, SCHNUR_W ("Soße")));
+			}
+
+			// Falls back to allocation.
+			REQUIRE (1 == schnur_append_cstr (s, SCHNUR_W (" mit Senf")));
+			SCHNUR_NARROW_SCOPED_BUFFER (s, n, scratch, sizeof (scratch)) {
+				REQUIRE (scratch != n);
+				REQUIRE (0 == strcmp (n, "Soße mit Senf"));
+			}
+			SCHNUR_WIDE_SCOPED_BUFFER (s, w, wide_scratch, 8) {
+				REQUIRE (wide_scratch != w);
+				REQUIRE (0 == wcscmp (w, SCHNUR_W ("Soße mit Senf")));
+			}
+		}
+	}
+}
+
+TEST_CASE ("view", "[string]") {
+	schnur_set_growth_policy (SCHNUR_GROWTH_GEOMETRIC);
+
+	SECTION ("schnur_slice") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("Hello, wonderful world!"))) {
+			schnur_view_t v = schnur_slice (s, 7, 16);
+
+			REQUIRE (9 == v.length);
+			REQUIRE (schnur_view_of (s).data + 7 == v.data);
+			REQUIRE (1 == schnur_view_equal (v, schnur_view_cstr (SCHNUR_W ("wonderful"))));
+			REQUIRE (SCHNUR_W ('w') == schnur_view_get (v, 0));
+			REQUIRE (SCHNUR_W ('l') == schnur_view_get (v, 8));
+			REQUIRE (SCHNUR_WC_NULL == schnur_view_get (v, 9));
+
+			schnur_view_t w = schnur_view_slice (v, 3, 9);
+			REQUIRE (1 == schnur_view_equal (w, schnur_view_cstr (SCHNUR_W ("derful"))));
+
+			REQUIRE (NULL == schnur_slice (s, 5, 4).data);
+			REQUIRE (0 == schnur_slice (s, 0, 24).length);
+			REQUIRE (NULL == schnur_view_slice (v, 0, 10).data);
+			REQUIRE (1 == schnur_equal_view (s, schnur_slice (s, 0, schnur_length (s))));
+			REQUIRE (0 == schnur_equal_view (s, v));
+		}
+	}
+
+	SECTION ("schnur_view_equal") {
+		const schnur_wide_t text[] = SCHNUR_W ("abcabc");
+
+		REQUIRE (1 == schnur_view_equal (schnur_view_n (text, 3), schnur_view_n (text + 3, 3)));
+		REQUIRE (0 == schnur_view_equal (schnur_view_n (text, 3), schnur_view_n (text + 1, 3)));
+		REQUIRE (0 == schnur_view_equal (schnur_view_n (text, 3), schnur_view_n (text, 2)));
+		REQUIRE (1 == schnur_view_equal (schnur_view_n (NULL, 4), schnur_view_n (text, 0)));
+	}
+
+	SECTION ("schnur_new_view") {
+		const schnur_wide_t text[] = SCHNUR_W ("Sonnenschein");
+
+		SCHNUR_SCOPED (s, schnur_new_view (schnur_view_n (text + 6, 6))) {
+			REQUIRE (6 == schnur_length (s));
+			REQUIRE (0 == wcscmp (schnur_view_of (s).data, SCHNUR_W ("schein")));
+		}
+		SCHNUR_SCOPED (s, schnur_new_view (schnur_view_n (NULL, 0))) {
+			REQUIRE (0 == schnur_length (s));
+		}
+	}
+
+	SECTION ("schnur_copy_view") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("Hello, wonderful world!"))) {
+			REQUIRE (1 == schnur_copy_view (s, schnur_slice (s, 7, 16)));
+			REQUIRE (0 == wcscmp (schnur_view_of (s).data, SCHNUR_W ("wonderful")));
+			REQUIRE (1 == schnur_copy_view (s, schnur_view_n (NULL, 0)));
+			REQUIRE (0 == schnur_length (s));
+		}
+	}
+
+	SECTION ("schnur_append_view") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("abc"))) {
+			int i;
+
+			// Appending from itself, while storage moves to the heap.
+			for (i = 0; i < 6; ++i) {
+				REQUIRE (1 == schnur_append_view (s, schnur_view_of (s)));
+			}
+			REQUIRE (192 == schnur_length (s));
+			REQUIRE (1 == schnur_append_view (s, schnur_slice (s, 0, 2)));
+			REQUIRE (0 == wcscmp (schnur_view_of (s).data + 189, SCHNUR_W ("abcab")));
+		}
+	}
+}
+
+static void
+require_rope_equal (const struct schnur_rope* rope, const std::wstring& expected) {
+	struct schnur_rope_iterator it = schnur_rope_begin (rope);
+	struct schnur_view leaf;
+	std::wstring actual;
+
+	REQUIRE (expected.size () == schnur_rope_length (rope));
+	while (schnur_rope_next (&it, &leaf)) {
+		REQUIRE (0 < leaf.length);
+		REQUIRE (SCHNUR_ROPE_LEAF_SIZE >= leaf.length);
+		actual.append (leaf.data, leaf.length);
+	}
+	REQUIRE (expected == actual);
+}
+
+TEST_CASE ("rope", "[string]") {
+	SECTION ("schnur_rope_append") {
+		struct schnur_rope* rope = schnur_rope_new ();
+		std::wstring expected;
+		std::wstring chunk;
+		int i;
+
+		REQUIRE (NULL != rope);
+		REQUIRE (0 == schnur_rope_length (rope));
+		REQUIRE (SCHNUR_WC_NULL == schnur_rope_get (rope, 0));
+
+		for (i = 0; i < 5000; ++i) {
+			chunk.push_back ((schnur_wide_t)(L'a' + i % 26));
+			expected += chunk.substr (0, i % 37);
+			REQUIRE (1 == schnur_rope_append (rope, schnur_view_n (chunk.data (), i % 37)));
+		}
+		require_rope_equal (rope, expected);
+		REQUIRE (expected[12345] == schnur_rope_get (rope, 12345));
+
+		SCHNUR_SCOPED (s, schnur_rope_flatten (rope)) {
+			REQUIRE (expected.size () == schnur_length (s));
+			REQUIRE (0 == wcscmp (schnur_view_of (s).data, expected.c_str ()));
+		}
+
+		REQUIRE (1 == schnur_rope_free (rope));
+	}
+
+	SECTION ("schnur_rope_insert / schnur_rope_erase") {
+		struct schnur_rope* rope = schnur_rope_new ();
+		std::wstring expected;
+		std::wstring text;
+		unsigned int seed = 42;
+		int i;
+
+		for (i = 0; i < 3000; ++i) {
+			text.push_back ((schnur_wide_t)(L'A' + i % 26));
+		}
+
+		for (i = 0; i < 2000; ++i) {
+			size_t begin, n;
+
+			seed = seed * 1103515245u + 12345u;
+			begin = expected.empty () ? 0 : (seed >> 8) % (expected.size () + 1);
+			seed = seed * 1103515245u + 12345u;
+			n = (seed >> 8) % (0 == i % 7 ? 3000 : 40);
+
+			if (0 == i % 3 && begin < expected.size ()) {
+				if (n > expected.size () - begin) {
+					n = expected.size () - begin;
+				}
+				REQUIRE (1 == schnur_rope_erase (rope, begin, begin + n));
+				expected.erase (begin, n);
+			}
+			else {
+				REQUIRE (1 == schnur_rope_insert (rope, begin, schnur_view_n (text.data (), n)));
+				expected.insert (begin, text.data (), n);
+			}
+
+			if (0 == i % 97) {
+				require_rope_equal (rope, expected);
+			}
+		}
+		require_rope_equal (rope, expected);
+
+		REQUIRE (0 == schnur_rope_insert (rope, expected.size () + 1, schnur_view_cstr (SCHNUR_W ("x"))));
+		REQUIRE (0 == schnur_rope_erase (rope, 2, 1));
+		REQUIRE (0 == schnur_rope_erase (rope, 0, expected.size () + 1));
+		REQUIRE (1 == schnur_rope_erase (rope, 0, expected.size ()));
+		require_rope_equal (rope, L"");
+
+		REQUIRE (1 == schnur_rope_free (rope));
+	}
+
+	SECTION ("schnur_rope_concat") {
+		struct schnur_arena* arena = schnur_arena_new (0);
+		struct schnur_rope* a = schnur_rope_new ();
+		struct schnur_rope* b = schnur_rope_new ();
+		struct schnur_rope* c = schnur_rope_new_with_allocator (schnur_arena_allocator (arena));
+		std::wstring expected;
+		std::wstring part;
+		int i;
+
+		for (i = 0; i < 20000; ++i) {
+			part.push_back ((schnur_wide_t)(L'0' + i % 10));
+		}
+
+		for (i = 0; i < 50; ++i) {
+			REQUIRE (1 == schnur_rope_append (b, schnur_view_n (part.data (), part.size () - i)));
+			REQUIRE (1 == schnur_rope_concat (a, b));
+			REQUIRE (0 == schnur_rope_length (b));
+			expected.append (part.data (), part.size () - i);
+		}
+		require_rope_equal (a, expected);
+
+		// Different allocators copy.
+		REQUIRE (1 == schnur_rope_append (c, schnur_view_cstr (SCHNUR_W ("tail"))));
+		REQUIRE (1 == schnur_rope_concat (a, c));
+		REQUIRE (0 == schnur_rope_length (c));
+		expected += L"tail";
+		require_rope_equal (a, expected);
+
+		REQUIRE (0 == schnur_rope_concat (a, a));
+
+		REQUIRE (1 == schnur_rope_free (c));
+		REQUIRE (1 == schnur_arena_free (arena));
+		REQUIRE (1 == schnur_rope_free (b));
+		REQUIRE (1 == schnur_rope_free (a));
+	}
+
+	SECTION ("schnur_rope_narrow_into") {
+		struct schnur_rope* rope = schnur_rope_new ();
+		std::wstring part (SCHNUR_ROPE_LEAF_SIZE - 1, L'a');
+		schnur_narrow_t small[4];
+		size_t needed = 0;
+		int i;
+
+		for (i = 0; i < 3; ++i) {
+			REQUIRE (1 == schnur_rope_append (rope, schnur_view_n (part.data (), part.size ())));
+			REQUIRE (1 == schnur_rope_append (rope, schnur_view_cstr (SCHNUR_W ("ß"))));
+		}
+
+		REQUIRE (0 == schnur_rope_narrow_into (rope, small, sizeof (small), &needed));
+		REQUIRE (3 * (part.size () + 2) == needed);
+
+		std::string buf (needed + 1, 'x');
+		REQUIRE (1 == schnur_rope_narrow_into (rope, &buf[0], buf.size (), NULL));
+		REQUIRE (needed == strlen (buf.c_str ()));
+		REQUIRE (0 == strncmp (buf.c_str () + part.size (), "ß", 2));
+
+		REQUIRE (1 == schnur_rope_append (rope, schnur_view_n (SCHNUR_W ("\xDFFF"), 1)));
+		REQUIRE (0 == schnur_rope_narrow_into (rope, &buf[0], buf.size (), &needed));
+		REQUIRE (SCHNUR_UTF8_INVALID == needed);
+
+		REQUIRE (1 == schnur_rope_free (rope));
+	}
+}
+
+TEST_CASE ("copy on write", "[string]") {
+	const struct schnur_allocator counting = {
+		test_allocate, test_reallocate, test_release, NULL
+	};
+	const schnur_wide_t* text = SCHNUR_W ("A rather long configuration value, stored on the heap.");
+
+	SECTION ("schnur_copy") {
+		schnur_t* a = schnur_new_with_allocator (&counting);
+		schnur_t* b = schnur_new_with_allocator (&counting);
+		size_t allocations;
+
+		REQUIRE (1 == schnur_copy_cstr (a, text));
+		allocations = g_test_allocations;
+
+		// Shares storage, until modified.
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (allocations == g_test_allocations);
+		REQUIRE (schnur_raw (a) == schnur_raw (b));
+		REQUIRE (1 == schnur_equal (a, b));
+
+		REQUIRE (1 == schnur_set (b, 0, SCHNUR_W ('a')));
+		REQUIRE (allocations + 1 == g_test_allocations);
+		REQUIRE (schnur_raw (a) != schnur_raw (b));
+		REQUIRE (SCHNUR_W ('A') == schnur_get (a, 0));
+		REQUIRE (SCHNUR_W ('a') == schnur_get (b, 0));
+
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (1 == schnur_append (a, SCHNUR_W ('!')));
+		REQUIRE (0 == wcscmp (schnur_view_of (b).data, text));
+		REQUIRE (schnur_length (a) == schnur_length (b) + 1);
+
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (1 == schnur_reverse (a));
+		REQUIRE (SCHNUR_W ('!') == schnur_get (a, 0));
+		REQUIRE (SCHNUR_W ('A') == schnur_get (b, 0));
+
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (1 == schnur_terminate (a, 3));
+		REQUIRE (3 == schnur_length (a));
+		REQUIRE (schnur_length (b) == wcslen (text) + 1);
+
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (1 == schnur_fill (a, SCHNUR_W ('x')));
+		REQUIRE (0 == wcscmp (schnur_view_of (b).data, SCHNUR_W ("!.p")));
+
+		// Unsharing filled storage, which has no room for a terminator.
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (schnur_capacity (b) == schnur_length (b));
+		REQUIRE (1 == schnur_set (b, 0, SCHNUR_W ('y')));
+		REQUIRE (SCHNUR_W ('x') == schnur_get (a, 0));
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (1 == schnur_append (b, SCHNUR_W ('y')));
+		REQUIRE (schnur_length (a) + 1 == schnur_length (b));
+		REQUIRE (SCHNUR_W ('y') == schnur_get (b, schnur_length (a)));
+		REQUIRE (SCHNUR_W ('x') == schnur_get (a, 0));
+
+		// Appending a view into shared storage.
+		REQUIRE (1 == schnur_copy_cstr (a, text));
+		REQUIRE (1 == schnur_copy (b, a));
+		REQUIRE (1 == schnur_append_view (a, schnur_view_of (b)));
+		REQUIRE (2 * wcslen (text) == schnur_length (a));
+		REQUIRE (0 == wcscmp (schnur_view_of (b).data, text));
+
+		REQUIRE (1 == schnur_free (a));
+		REQUIRE (1 == schnur_free (b));
+		REQUIRE (g_test_allocations == g_test_releases);
+	}
+
+	SECTION ("schnur_freeze") {
+		schnur_t* s = schnur_new_with_allocator (&counting);
+		const struct schnur_frozen* frozen;
+		const struct schnur_frozen* small;
+
+		REQUIRE (1 == schnur_copy_cstr (s, text));
+		frozen = schnur_freeze (s);
+		REQUIRE (NULL != frozen);
+		REQUIRE (schnur_raw (s) == schnur_frozen_view (frozen).data);
+
+		REQUIRE (1 == schnur_append_cstr (s, SCHNUR_W (" Changed.")));
+		REQUIRE (1 == schnur_view_equal (schnur_frozen_view (frozen), schnur_view_cstr (text)));
+
+		REQUIRE (frozen == schnur_frozen_retain (frozen));
+		REQUIRE (1 == schnur_frozen_release (frozen));
+
+		SCHNUR_SCOPED (t, schnur_thaw (frozen)) {
+			REQUIRE (schnur_raw (t) == schnur_frozen_view (frozen).data);
+			REQUIRE (1 == schnur_set (t, 0, SCHNUR_W ('a')));
+			REQUIRE (SCHNUR_W ('A') == schnur_view_get (schnur_frozen_view (frozen), 0));
+		}
+
+		REQUIRE (1 == schnur_copy_cstr (s, SCHNUR_W ("short")));
+		small = schnur_freeze (s);
+		REQUIRE (NULL != small);
+		REQUIRE (1 == schnur_append (s, SCHNUR_W ('!')));
+		REQUIRE (1 == schnur_view_equal (schnur_frozen_view (small), schnur_view_cstr (SCHNUR_W ("short"))));
+		SCHNUR_SCOPED (t, schnur_thaw (small)) {
+			REQUIRE (1 == schnur_equal_cstr (t, SCHNUR_W ("short")));
+		}
+
+		REQUIRE (1 == schnur_free (s));
+		REQUIRE (1 == schnur_frozen_release (frozen));
+		REQUIRE (1 == schnur_frozen_release (small));
+		REQUIRE (0 == schnur_frozen_release (NULL));
+		REQUIRE (g_test_allocations == g_test_releases);
+	}
+}
+
+TEST_CASE ("intern", "[string]") {
+	SECTION ("schnur_intern") {
+		struct schnur_intern_pool* pool = schnur_intern_pool_new (NULL);
+		struct schnur_intern_stats stats;
+		const struct schnur_frozen* a;
+		const struct schnur_frozen* b;
+		const struct schnur_frozen* c;
+
+		REQUIRE (NULL != pool);
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("content-type"))) {
+			a = schnur_intern (pool, s);
+			REQUIRE (NULL != a);
+			REQUIRE (1 == schnur_view_equal (schnur_frozen_view (a), schnur_view_of (s)));
+
+			// Modifying the source does not touch the interned string.
+			REQUIRE (1 == schnur_set (s, 0, SCHNUR_W ('C')));
+			REQUIRE (SCHNUR_W ('c') == schnur_view_get (schnur_frozen_view (a), 0));
+		}
+
+		b = schnur_intern_view (pool, schnur_view_cstr (SCHNUR_W ("content-type")));
+		c = schnur_intern_view (pool, schnur_view_cstr (SCHNUR_W ("content-length")));
+		REQUIRE (a == b);
+		REQUIRE (a != c);
+		REQUIRE (c == schnur_intern_view (pool, schnur_view_n (SCHNUR_W ("content-length: 42"), 14)));
+		REQUIRE (NULL != schnur_intern_view (pool, schnur_view_n (NULL, 0)));
+		schnur_view_t invalid = { NULL, 1 };
+		REQUIRE (NULL == schnur_intern_view (pool, invalid));
+
+		REQUIRE (1 == schnur_intern_pool_stats (pool, &stats));
+		REQUIRE (5 == stats.lookups);
+		REQUIRE (2 == stats.hits);
+		REQUIRE (3 == stats.strings);
+		REQUIRE ((13 + 15 + 1) * sizeof (schnur_wide_t) == stats.bytes);
+		REQUIRE ((13 + 15) * sizeof (schnur_wide_t) == stats.bytes_saved);
+
+		// Retained handles outlive the pool.
+		REQUIRE (a == schnur_frozen_retain (a));
+		REQUIRE (1 == schnur_intern_pool_free (pool));
+		REQUIRE (1 == schnur_view_equal (schnur_frozen_view (a), schnur_view_cstr (SCHNUR_W ("content-type"))));
+		REQUIRE (1 == schnur_frozen_release (a));
+	}
+
+	SECTION ("many strings") {
+		struct schnur_intern_pool* pool = schnur_intern_pool_new (NULL);
+		std::vector<const struct schnur_frozen*> handles;
+		struct schnur_intern_stats stats;
+		int i;
+
+		for (i = 0; i < 10000; ++i) {
+			std::wstring key = L"key-" + std::to_wstring (i);
+			handles.push_back (schnur_intern_view (pool, schnur_view_n (key.data (), key.size ())));
+			REQUIRE (NULL != handles.back ());
+		}
+		for (i = 0; i < 10000; ++i) {
+			std::wstring key = L"key-" + std::to_wstring (i);
+			REQUIRE (handles[i] == schnur_intern_view (pool, schnur_view_n (key.data (), key.size ())));
+		}
+
+		REQUIRE (1 == schnur_intern_pool_stats (pool, &stats));
+		REQUIRE (10000 == stats.strings);
+		REQUIRE (10000 == stats.hits);
+		REQUIRE (1 == schnur_intern_pool_free (pool));
+	}
+
+	SECTION ("threads") {
+		struct schnur_intern_pool* pool = schnur_intern_pool_new (NULL);
+		std::vector<std::thread> threads;
+		std::vector<const struct schnur_frozen*> results (8 * 1000);
+		struct schnur_intern_stats stats;
+		int t, i;
+
+		for (t = 0; t < 8; ++t) {
+			threads.push_back (std::thread ([pool, &results, t] () {
+				for (int j = 0; j < 1000; ++j) {
+					std::wstring key = L"header-" + std::to_wstring ((j * 7 + t) % 1000);
+					results[t * 1000 + j] = schnur_intern_view (pool, schnur_view_n (key.data (), key.size ()));
+				}
+			}));
+		}
+		for (t = 0; t < 8; ++t) {
+			threads[t].join ();
+		}
+
+		for (i = 0; i < 8 * 1000; ++i) {
+			std::wstring key = L"header-" + std::to_wstring (((i % 1000) * 7 + i / 1000) % 1000);
+			REQUIRE (NULL != results[i]);
+			REQUIRE (results[i] == schnur_intern_view (pool, schnur_view_n (key.data (), key.size ())));
+		}
+
+		REQUIRE (1 == schnur_intern_pool_stats (pool, &stats));
+		REQUIRE (1000 == stats.strings);
+		REQUIRE (16000 == stats.lookups);
+		REQUIRE (15000 == stats.hits);
+		REQUIRE (1 == schnur_intern_pool_free (pool));
+	}
+}
+
+TEST_CASE ("hash", "[string]") {
+	SECTION ("schnur_hash_view") {
+		const schnur_wide_t* text = SCHNUR_W ("The quick brown fox jumps over the lazy dog.");
+		std::vector<uint64_t> hashes;
+		size_t i;
+
+		REQUIRE (schnur_hash_view (schnur_view_n (NULL, 0)) == schnur_hash_view (schnur_view_n (text, 0)));
+
+		// Every prefix, covering all tail lengths.
+		for (i = 0; i <= wcslen (text); ++i) {
+			hashes.push_back (schnur_hash_view (schnur_view_n (text, i)));
+		}
+		std::sort (hashes.begin (), hashes.end ());
+		REQUIRE (hashes.end () == std::adjacent_find (hashes.begin (), hashes.end ()));
+
+		hashes.clear ();
+		for (i = 0; i < 10000; ++i) {
+			std::wstring key = L"key-" + std::to_wstring (i);
+			hashes.push_back (schnur_hash_view (schnur_view_n (key.data (), key.size ())));
+		}
+		std::sort (hashes.begin (), hashes.end ());
+		REQUIRE (hashes.end () == std::adjacent_find (hashes.begin (), hashes.end ()));
+	}
+
+	SECTION ("schnur_hash") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("Hänsel mag Soße!"))) {
+			uint64_t h = schnur_hash (s);
+
+			REQUIRE (h == schnur_hash_view (schnur_view_cstr (SCHNUR_W ("Hänsel mag Soße!"))));
+			REQUIRE (h == schnur_hash (s));
+
+			// Modifications reset the cached hash.
+			REQUIRE (1 == schnur_set (s, 0, SCHNUR_W ('h')));
+			REQUIRE (schnur_hash_view (schnur_view_of (s)) == schnur_hash (s));
+			REQUIRE (h != schnur_hash (s));
+
+			REQUIRE (1 == schnur_append_cstr (s, SCHNUR_W (" Und Gretel mag Kuchen.")));
+			REQUIRE (schnur_hash_view (schnur_view_of (s)) == schnur_hash (s));
+
+			REQUIRE (1 == schnur_reverse (s));
+			REQUIRE (schnur_hash_view (schnur_view_of (s)) == schnur_hash (s));
+
+			REQUIRE (1 == schnur_terminate (s, 5));
+			REQUIRE (schnur_hash_view (schnur_view_of (s)) == schnur_hash (s));
+
+			REQUIRE (1 == schnur_copy_cstr (s, SCHNUR_W ("Hänsel mag Soße!")));
+			REQUIRE (h == schnur_hash (s));
+
+			REQUIRE (1 == schnur_append (s, SCHNUR_W ('!')));
+			REQUIRE (schnur_hash_view (schnur_view_of (s)) == schnur_hash (s));
+		}
+
+		REQUIRE (0 == schnur_hash (NULL));
+	}
+
+	SECTION ("schnur_equal") {
+		SCHNUR_SCOPED (a, schnur_new_s (SCHNUR_W ("content-type"))) {
+			SCHNUR_SCOPED (b, schnur_new_s (SCHNUR_W ("content-typo"))) {
+				schnur_hash (a);
+				REQUIRE (0 == schnur_equal (a, b));
+				schnur_hash (b);
+				REQUIRE (0 == schnur_equal (a, b));
+
+				REQUIRE (1 == schnur_set (b, 11, SCHNUR_W ('e')));
+				REQUIRE (1 == schnur_equal (a, b));
+				schnur_hash (b);
+				REQUIRE (1 == schnur_equal (a, b));
+
+				// Copies share the cached hash.
+				REQUIRE (1 == schnur_copy_cstr (a, SCHNUR_W ("A string long enough to live on the heap")));
+				schnur_hash (a);
+				REQUIRE (1 == schnur_copy (b, a));
+				REQUIRE (1 == schnur_equal (a, b));
+				REQUIRE (schnur_hash (a) == schnur_hash (b));
+			}
+		}
+	}
+}
+
+TEST_CASE ("map", "[string]") {
+	SECTION ("schnur_map_set / schnur_map_get") {
+		struct schnur_map* map = schnur_map_new (NULL);
+		int values[3] = { 1, 2, 3 };
+		void* value = NULL;
+
+		REQUIRE (NULL != map);
+		REQUIRE (0 == schnur_map_count (map));
+		REQUIRE (0 == schnur_map_get_cstr (map, SCHNUR_W ("/index"), &value));
+
+		SCHNUR_SCOPED (key, schnur_new_s (SCHNUR_W ("/index"))) {
+			REQUIRE (1 == schnur_map_set (map, key, &values[0]));
+
+			// The map keeps its own snapshot of the key.
+			REQUIRE (1 == schnur_set (key, 1, SCHNUR_W ('I')));
+			REQUIRE (0 == schnur_map_get (map, key, &value));
+		}
+
+		REQUIRE (1 == schnur_map_set_view (map, schnur_view_cstr (SCHNUR_W ("/api/users")), &values[1]));
+		REQUIRE (1 == schnur_map_set_view (map, schnur_view_cstr (SCHNUR_W ("")), &values[2]));
+		REQUIRE (3 == schnur_map_count (map));
+
+		REQUIRE (1 == schnur_map_get_cstr (map, SCHNUR_W ("/index"), &value));
+		REQUIRE (&values[0] == value);
+		REQUIRE (1 == schnur_map_get_view (map, schnur_view_n (SCHNUR_W ("/api/users/42"), 10), &value));
+		REQUIRE (&values[1] == value);
+		REQUIRE (1 == schnur_map_get_view (map, schnur_view_n (NULL, 0), &value));
+		REQUIRE (&values[2] == value);
+		REQUIRE (0 == schnur_map_get_cstr (map, SCHNUR_W ("/api"), NULL));
+
+		// Replaces the value.
+		REQUIRE (1 == schnur_map_set_view (map, schnur_view_cstr (SCHNUR_W ("/index")), &values[2]));
+		REQUIRE (3 == schnur_map_count (map));
+		REQUIRE (1 == schnur_map_get_cstr (map, SCHNUR_W ("/index"), &value));
+		REQUIRE (&values[2] == value);
+
+		REQUIRE (1 == schnur_map_remove_view (map, schnur_view_cstr (SCHNUR_W ("/index")), &value));
+		REQUIRE (&values[2] == value);
+		REQUIRE (0 == schnur_map_remove_view (map, schnur_view_cstr (SCHNUR_W ("/index")), NULL));
+		REQUIRE (0 == schnur_map_get_cstr (map, SCHNUR_W ("/index"), NULL));
+		REQUIRE (2 == schnur_map_count (map));
+
+		REQUIRE (1 == schnur_map_free (map));
+	}
+
+	SECTION ("many keys") {
+		const struct schnur_allocator counting = {
+			test_allocate, test_reallocate, test_release, NULL
+		};
+		struct schnur_map* map;
+		std::vector<schnur_t*> keys;
+		struct schnur_view key;
+		void* value;
+		size_t cursor = 0, seen = 0;
+		intptr_t i;
+
+		g_test_allocations = g_test_releases = 0;
+		map = schnur_map_new (&counting);
+
+		for (i = 0; i < 20000; ++i) {
+			std::wstring text = L"/route/" + std::to_wstring (i) + (0 == i % 3 ? L"/with/a/rather/long/suffix" : L"");
+			keys.push_back (schnur_new_s (text.c_str ()));
+			REQUIRE (1 == schnur_map_set (map, keys.back (), (void*)i));
+		}
+		REQUIRE (20000 == schnur_map_count (map));
+
+		for (i = 0; i < 20000; ++i) {
+			REQUIRE (1 == schnur_map_get (map, keys[i], &value));
+			REQUIRE (i == (intptr_t)value);
+		}
+
+		// Churn through removals and insertions, reusing deleted slots.
+		for (i = 0; i < 20000; i += 2) {
+			REQUIRE (1 == schnur_map_remove (map, keys[i], &value));
+			REQUIRE (i == (intptr_t)value);
+		}
+		REQUIRE (10000 == schnur_map_count (map));
+		for (i = 0; i < 20000; ++i) {
+			REQUIRE ((i % 2) == schnur_map_get (map, keys[i], NULL));
+		}
+		for (i = 0; i < 20000; i += 2) {
+			REQUIRE (1 == schnur_map_set (map, keys[i], (void*)(i + 1)));
+		}
+
+		while (schnur_map_next (map, &cursor, &key, &value)) {
+			void* found = NULL;
+
+			REQUIRE (1 == schnur_map_get_view (map, key, &found));
+			REQUIRE (value == found);
+			++seen;
+		}
+		REQUIRE (20000 == seen);
+
+		for (i = 0; i < 20000; ++i) {
+			schnur_free (keys[i]);
+		}
+		REQUIRE (1 == schnur_map_free (map));
+		REQUIRE (g_test_allocations == g_test_releases);
+	}
+}
+
+/*
+	Reference search, checking every position.
+*/
+static size_t
+naive_find (const std::wstring& h, const std::wstring& x, size_t from, bool reverse) {
+	size_t i;
+
+	if (x.size () > h.size ()) {
+		return SCHNUR_NOT_FOUND;
+	}
+
+	if (reverse) {
+		for (i = std::min (from, h.size () - x.size ()) + 1; 0 < i--;) {
+			if (0 == h.compare (i, x.size (), x)) {
+				return i;
+			}
+		}
+		return SCHNUR_NOT_FOUND;
+	}
+
+	for (i = from; i + x.size () <= h.size (); ++i) {
+		if (0 == h.compare (i, x.size (), x)) {
+			return i;
+		}
+	}
+	return SCHNUR_NOT_FOUND;
+}
+
+TEST_CASE ("find", "[string]") {
+	SECTION ("schnur_find / schnur_rfind / schnur_count") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("GET /index.html HTTP/1.1, GET /favicon.ico HTTP/1.1"))) {
+			REQUIRE (0 == schnur_find (s, schnur_view_cstr (SCHNUR_W ("GET")), 0));
+			REQUIRE (26 == schnur_find (s, schnur_view_cstr (SCHNUR_W ("GET")), 1));
+			REQUIRE (26 == schnur_rfind (s, schnur_view_cstr (SCHNUR_W ("GET")), SCHNUR_NOT_FOUND));
+			REQUIRE (0 == schnur_rfind (s, schnur_view_cstr (SCHNUR_W ("GET")), 25));
+			REQUIRE (SCHNUR_NOT_FOUND == schnur_find (s, schnur_view_cstr (SCHNUR_W ("POST")), 0));
+			REQUIRE (SCHNUR_NOT_FOUND == schnur_find (s, schnur_view_cstr (SCHNUR_W ("G")), 100));
+			REQUIRE (2 == schnur_count (s, schnur_view_cstr (SCHNUR_W ("HTTP/1.1"))));
+			REQUIRE (4 == schnur_count (s, schnur_view_cstr (SCHNUR_W ("/"))));
+			REQUIRE (schnur_length (s) + 1 == schnur_count (s, schnur_view_n (NULL, 0)));
+			REQUIRE (3 == schnur_find (s, schnur_view_n (NULL, 0), 3));
+			REQUIRE (schnur_length (s) == schnur_rfind (s, schnur_view_n (NULL, 0), SCHNUR_NOT_FOUND));
+		}
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("aaaaa"))) {
+			REQUIRE (2 == schnur_count (s, schnur_view_cstr (SCHNUR_W ("aa"))));
+		}
+
+		REQUIRE (SCHNUR_NOT_FOUND == schnur_find (NULL, schnur_view_cstr (SCHNUR_W ("a")), 0));
+		REQUIRE (0 == schnur_count (NULL, schnur_view_cstr (SCHNUR_W ("a"))));
+	}
+
+	SECTION ("random haystacks") {
+		// Small alphabets produce many partial matches and periodic needles,
+		// both short and long enough for the Two-Way algorithm.
+		unsigned int seed = 12345;
+		int round;
+
+		for (round = 0; round < 400; ++round) {
+			std::wstring h, x;
+			size_t n, m, from;
+			int alphabet;
+
+			seed = seed * 1103515245 + 12345;
+			alphabet = 2 + (int)(seed >> 16) % 3;
+			seed = seed * 1103515245 + 12345;
+			n = (seed >> 16) % 300;
+			seed = seed * 1103515245 + 12345;
+			m = 1 + (seed >> 16) % 70;
+
+			for (size_t i = 0; i < n; ++i) {
+				seed = seed * 1103515245 + 12345;
+				h += (schnur_wide_t)(L'a' + (int)(seed >> 16) % alphabet);
+			}
+
+			// Half of the needles are taken from the haystack.
+			seed = seed * 1103515245 + 12345;
+			if (0 == (seed >> 16) % 2 && m <= n) {
+				seed = seed * 1103515245 + 12345;
+				x = h.substr ((seed >> 16) % (n - m + 1), m);
+			}
+			else {
+				for (size_t i = 0; i < m; ++i) {
+					seed = seed * 1103515245 + 12345;
+					x += (schnur_wide_t)(L'a' + (int)(seed >> 16) % alphabet);
+				}
+			}
+
+			struct schnur_view hv = schnur_view_n (h.data (), h.size ());
+			struct schnur_view xv = schnur_view_n (x.data (), x.size ());
+			struct schnur_needle* needle = schnur_needle_new (xv, NULL);
+			size_t count = 0, i = 0;
+
+			REQUIRE (NULL != needle);
+
+			for (from = 0; from <= n + 1; from += 1 + from / 8) {
+				size_t expected = naive_find (h, x, from, false);
+				REQUIRE (expected == schnur_view_find (hv, xv, from));
+				REQUIRE (expected == schnur_needle_find (needle, hv, from));
+
+				expected = naive_find (h, x, from, true);
+				REQUIRE (expected == schnur_view_rfind (hv, xv, from));
+				REQUIRE (expected == schnur_needle_rfind (needle, hv, from));
+			}
+
+			while (SCHNUR_NOT_FOUND != (i = naive_find (h, x, i, false))) {
+				++count;
+				i += m;
+			}
+			REQUIRE (count == schnur_view_count (hv, xv));
+			REQUIRE (count == schnur_needle_count (needle, hv));
+
+			REQUIRE (1 == schnur_needle_free (needle));
+		}
+	}
+
+	SECTION ("long needle") {
+		std::wstring h (100000, L'a'), x (1000, L'a');
+
+		// Worst case for naive search: every position nearly matches.
+		x[0] = L'b';
+		h[50000] = L'b';
+
+		SCHNUR_SCOPED (s, schnur_new_s (h.c_str ())) {
+			REQUIRE (50000 == schnur_find (s, schnur_view_n (x.data (), x.size ()), 0));
+			REQUIRE (50000 == schnur_rfind (s, schnur_view_n (x.data (), x.size ()), SCHNUR_NOT_FOUND));
+			REQUIRE (1 == schnur_count (s, schnur_view_n (x.data (), x.size ())));
+
+			x[0] = L'a';
+			x[999] = L'b';
+			REQUIRE (49001 == schnur_find (s, schnur_view_n (x.data (), x.size ()), 0));
+			REQUIRE (SCHNUR_NOT_FOUND == schnur_find (s, schnur_view_n (x.data (), x.size ()), 49002));
+
+			// Characters sharing the low byte of the needle's characters.
+			x[999] = (schnur_wide_t)(L'b' + 0x100);
+			REQUIRE (SCHNUR_NOT_FOUND == schnur_find (s, schnur_view_n (x.data (), x.size ()), 0));
+		}
+	}
+}
+
+struct test_match {
+	size_t pattern;
+	size_t offset;
+
+	bool operator< (const test_match& other) const {
+		return offset + 0 < other.offset || (offset == other.offset && pattern < other.pattern);
+	}
+
+	bool operator== (const test_match& other) const {
+		return pattern == other.pattern && offset == other.offset;
+	}
+};
+
+static int
+test_collect_match (void* context, size_t pattern, size_t offset) {
+	std::vector<test_match>* matches = (std::vector<test_match>*)context;
+	matches->push_back (test_match { pattern, offset });
+	return 1;
+}
+
+static int
+test_first_match (void* context, size_t pattern, size_t offset) {
+	*(size_t*)context = offset;
+	(void)pattern;
+	return 0;
+}
+
+TEST_CASE ("matcher", "[string]") {
+	SECTION ("schnur_matcher_scan") {
+		const schnur_wide_t* words[] = {
+			SCHNUR_W ("he"), SCHNUR_W ("she"), SCHNUR_W ("his"), SCHNUR_W ("hers"),
+			SCHNUR_W ("straße"), SCHNUR_W ("he")
+		};
+		schnur_t* patterns[6];
+		std::vector<test_match> matches;
+		struct schnur_matcher* matcher;
+		size_t i, first = 0;
+
+		for (i = 0; i < 6; ++i) {
+			patterns[i] = schnur_new_s (words[i]);
+		}
+
+		matcher = schnur_matcher_new (patterns, 6, NULL);
+		REQUIRE (NULL != matcher);
+		REQUIRE (0 < schnur_matcher_memory (matcher));
+
+		REQUIRE (5 == schnur_matcher_scan (matcher,
+			schnur_view_cstr (SCHNUR_W ("ushers, straße")), test_collect_match, &matches));
+		REQUIRE (5 == matches.size ());
+		std::sort (matches.begin (), matches.end ());
+		REQUIRE ((test_match { 1, 1 }) == matches[0]);
+		REQUIRE ((test_match { 0, 2 }) == matches[1]);
+		REQUIRE ((test_match { 3, 2 }) == matches[2]);
+		REQUIRE ((test_match { 5, 2 }) == matches[3]);
+		REQUIRE ((test_match { 4, 8 }) == matches[4]);
+
+		REQUIRE (0 == schnur_matcher_scan (matcher, schnur_view_cstr (SCHNUR_W ("strasse")), NULL, NULL));
+		REQUIRE (1 == schnur_matcher_scan (matcher, schnur_view_cstr (SCHNUR_W ("xxxhis")), NULL, NULL));
+		REQUIRE (1 == schnur_matcher_scan (matcher, schnur_view_cstr (SCHNUR_W ("a his, hers")), test_first_match, &first));
+		REQUIRE (2 == first);
+
+		REQUIRE (1 == schnur_matcher_free (matcher));
+
+		// Empty patterns would match everywhere.
+		REQUIRE (1 == schnur_copy_cstr (patterns[5], SCHNUR_W ("")));
+		REQUIRE (NULL == schnur_matcher_new (patterns, 6, NULL));
+		REQUIRE (NULL == schnur_matcher_new (patterns, 0, NULL));
+
+		for (i = 0; i < 6; ++i) {
+			schnur_free (patterns[i]);
+		}
+	}
+
+	SECTION ("random patterns") {
+		unsigned int seed = 4242;
+		int round;
+
+		for (round = 0; round < 50; ++round) {
+			std::vector<schnur_t*> patterns;
+			std::vector<std::wstring> words;
+			std::vector<test_match> expected, matches;
+			std::wstring text;
+			struct schnur_matcher* matcher;
+			size_t i, j, count;
+
+			seed = seed * 1103515245 + 12345;
+			count = 1 + (seed >> 16) % 40;
+			for (i = 0; i < count; ++i) {
+				std::wstring word;
+				seed = seed * 1103515245 + 12345;
+				for (j = 1 + (seed >> 16) % 6; 0 < j; --j) {
+					seed = seed * 1103515245 + 12345;
+					// Mostly ASCII, some characters beyond the direct table.
+					word += (schnur_wide_t)(0 == (seed >> 16) % 5 ? 0x3B1 : L'a') + (int)(seed >> 20) % 3;
+				}
+				words.push_back (word);
+				patterns.push_back (schnur_new_s (word.c_str ()));
+			}
+			for (i = 0; i < 500; ++i) {
+				seed = seed * 1103515245 + 12345;
+				text += (schnur_wide_t)(0 == (seed >> 16) % 5 ? 0x3B1 : L'a') + (int)(seed >> 20) % 4;
+			}
+
+			for (i = 0; i < text.size (); ++i) {
+				for (j = 0; j < count; ++j) {
+					if (0 == text.compare (i, words[j].size (), words[j])) {
+						expected.push_back (test_match { j, i });
+					}
+				}
+			}
+
+			matcher = schnur_matcher_new (&patterns[0], count, NULL);
+			REQUIRE (NULL != matcher);
+			REQUIRE (expected.size () == schnur_matcher_scan (matcher,
+				schnur_view_n (text.data (), text.size ()), test_collect_match, &matches));
+			std::sort (matches.begin (), matches.end ());
+			REQUIRE (expected == matches);
+
+			REQUIRE (1 == schnur_matcher_free (matcher));
+			for (i = 0; i < count; ++i) {
+				schnur_free (patterns[i]);
+			}
+		}
+	}
+}
+
+TEST_CASE ("edit", "[string]") {
+	SECTION ("schnur_replace_all") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("Hello {{name}}, welcome to {{place}}, {{name}}!"))) {
+			REQUIRE (1 == schnur_replace_all (s, schnur_view_cstr (SCHNUR_W ("{{name}}")), schnur_view_cstr (SCHNUR_W ("Ada"))));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("Hello Ada, welcome to {{place}}, Ada!")));
+
+			REQUIRE (1 == schnur_replace_all (s, schnur_view_cstr (SCHNUR_W ("{{place}}")), schnur_view_cstr (SCHNUR_W ("the analytical engine room"))));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("Hello Ada, welcome to the analytical engine room, Ada!")));
+
+			REQUIRE (1 == schnur_replace_all (s, schnur_view_cstr (SCHNUR_W ("Ada")), schnur_view_cstr (SCHNUR_W ("Bob"))));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("Hello Bob, welcome to the analytical engine room, Bob!")));
+
+			REQUIRE (1 == schnur_replace_all (s, schnur_view_cstr (SCHNUR_W ("missing")), schnur_view_cstr (SCHNUR_W ("x"))));
+			REQUIRE (0 == schnur_replace_all (s, schnur_view_n (NULL, 0), schnur_view_cstr (SCHNUR_W ("x"))));
+
+			REQUIRE (1 == schnur_replace_all (s, schnur_view_cstr (SCHNUR_W (" ")), schnur_view_n (NULL, 0)));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("HelloBob,welcometotheanalyticalengineroom,Bob!")));
+
+			// Needle and replacement from self.
+			REQUIRE (1 == schnur_replace_all (s, schnur_slice (s, 5, 8), schnur_slice (s, 0, 5)));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("HelloHello,welcometotheanalyticalengineroom,Hello!")));
+		}
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("aaaaa"))) {
+			REQUIRE (1 == schnur_replace_all (s, schnur_view_cstr (SCHNUR_W ("aa")), schnur_view_cstr (SCHNUR_W ("b"))));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("bba")));
+		}
+	}
+
+	SECTION ("schnur_replace_all shared") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("one two one two one two one two one two"))) {
+			SCHNUR_SCOPED_EMPTY (copy) {
+				REQUIRE (1 == schnur_copy (copy, s));
+				REQUIRE (1 == schnur_replace_all (copy, schnur_view_cstr (SCHNUR_W ("one")), schnur_view_cstr (SCHNUR_W ("1"))));
+				REQUIRE (1 == schnur_equal_cstr (copy, SCHNUR_W ("1 two 1 two 1 two 1 two 1 two")));
+				REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("one two one two one two one two one two")));
+			}
+		}
+	}
+
+	SECTION ("schnur_apply_edits") {
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("0123456789"))) {
+			struct schnur_edit edits[] = {
+				{ 0, 0, schnur_view_cstr (SCHNUR_W ("<")) },
+				{ 2, 5, schnur_view_cstr (SCHNUR_W ("-")) },
+				{ 7, 7, schnur_view_cstr (SCHNUR_W ("++")) },
+				{ 10, 10, schnur_view_cstr (SCHNUR_W (">")) },
+			};
+			struct schnur_edit unsorted[] = {
+				{ 4, 5, schnur_view_n (NULL, 0) },
+				{ 2, 3, schnur_view_n (NULL, 0) },
+			};
+			struct schnur_edit outside[] = {
+				{ 4, 50, schnur_view_n (NULL, 0) },
+			};
+
+			REQUIRE (1 == schnur_apply_edits (s, edits, 4));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("<01-56++789>")));
+
+			REQUIRE (0 == schnur_apply_edits (s, unsorted, 2));
+			REQUIRE (0 == schnur_apply_edits (s, outside, 1));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("<01-56++789>")));
+			REQUIRE (1 == schnur_apply_edits (s, NULL, 0));
+		}
+	}
+
+	SECTION ("random edits") {
+		unsigned int seed = 99;
+		int round;
+
+		for (round = 0; round < 2000; ++round) {
+			std::wstring expected, source;
+			std::vector<struct schnur_edit> edits;
+			// Views point into the replacements, which must not move.
+			std::deque<std::wstring> replacements;
+			size_t n, i, at = 0;
+			schnur_t* s;
+			schnur_t* copy = NULL;
+
+			seed = seed * 1103515245 + 12345;
+			n = (seed >> 16) % 60;
+			for (i = 0; i < n; ++i) {
+				source += (schnur_wide_t)(L'a' + i % 26);
+			}
+			s = schnur_new_s (source.c_str ());
+
+			// Sometimes leave spare capacity, or share the storage.
+			seed = seed * 1103515245 + 12345;
+			if (0 == (seed >> 16) % 3) {
+				REQUIRE (1 == schnur_reserve (s, 200));
+			}
+			else if (1 == (seed >> 16) % 3) {
+				copy = schnur_new ();
+				REQUIRE (1 == schnur_copy (copy, s));
+			}
+
+			while (at <= n) {
+				struct schnur_edit e;
+				seed = seed * 1103515245 + 12345;
+				e.begin = at + (seed >> 16) % 5;
+				seed = seed * 1103515245 + 12345;
+				e.end = e.begin + (seed >> 16) % 4;
+				if (e.end > n) {
+					break;
+				}
+				seed = seed * 1103515245 + 12345;
+				replacements.push_back (std::wstring ((seed >> 16) % 6, (schnur_wide_t)(L'A' + replacements.size () % 26)));
+				// Some replacements are taken from the string itself.
+				seed = seed * 1103515245 + 12345;
+				if (0 == (seed >> 16) % 4 && 2 <= n) {
+					e.replacement = schnur_slice (s, 0, 2);
+					replacements.back () = source.substr (0, 2);
+				}
+				else {
+					e.replacement = schnur_view_n (replacements.back ().data (), replacements.back ().size ());
+				}
+				edits.push_back (e);
+				at = e.end;
+			}
+
+			at = 0;
+			for (i = 0; i < edits.size (); ++i) {
+				expected += source.substr (at, edits[i].begin - at) + replacements[i];
+				at = edits[i].end;
+			}
+			expected += source.substr (at);
+
+			REQUIRE (1 == schnur_apply_edits (s, edits.empty () ? NULL : &edits[0], edits.size ()));
+			REQUIRE (expected.size () == schnur_length (s));
+			REQUIRE (1 == schnur_equal_cstr (s, expected.c_str ()));
+			if (NULL != copy) {
+				REQUIRE (1 == schnur_equal_cstr (copy, source.c_str ()));
+				schnur_free (copy);
+			}
+			schnur_free (s);
+		}
+	}
+}
+
+/*
+	Joins the tokens of tokenizer with '|', to compare them at once.
+*/
+static std::wstring
+join_tokens (struct schnur_tokenizer tokenizer) {
+	std::wstring joined;
+	int first = 1;
+
+	while (schnur_tokenizer_next (&tokenizer)) {
+		if (! first) {
+			joined += L'|';
+		}
+		joined.append (tokenizer.token.data, tokenizer.token.length);
+		first = 0;
+	}
+
+	return joined;
+}
+
+TEST_CASE ("split", "[string]") {
+	SECTION ("schnur_split_char") {
+		struct schnur_view csv = schnur_view_cstr (SCHNUR_W ("name,,age,city,"));
+		struct schnur_tokenizer empty;
+		struct schnur_view invalid;
+		size_t offsets[5], count = 0;
+
+		REQUIRE (L"name||age|city|" == join_tokens (schnur_split_char (csv, L',', 0)));
+		REQUIRE (L"name|age|city" == join_tokens (schnur_split_char (csv, L',', SCHNUR_SPLIT_SKIP_EMPTY)));
+		REQUIRE (L"name,,age,city," == join_tokens (schnur_split_char (csv, L';', 0)));
+
+		SCHNUR_FOR_EACH_TOKEN (t, schnur_split_char (csv, L',', 0)) {
+			REQUIRE (csv.data + t.offset == t.token.data);
+			offsets[count++] = t.offset;
+		}
+		REQUIRE (5 == count);
+		REQUIRE (0 == offsets[0]);
+		REQUIRE (5 == offsets[1]);
+		REQUIRE (6 == offsets[2]);
+		REQUIRE (10 == offsets[3]);
+		REQUIRE (15 == offsets[4]);
+
+		count = 0;
+		SCHNUR_FOR_EACH_TOKEN (t, schnur_split_char (csv, L',', SCHNUR_SPLIT_SKIP_EMPTY)) {
+			if (schnur_view_equal (t.token, schnur_view_cstr (SCHNUR_W ("age")))) {
+				break;
+			}
+			++count;
+		}
+		REQUIRE (1 == count);
+
+		// An empty view is a single empty token, unless empty ones are skipped.
+		empty = schnur_split_char (schnur_view_n (NULL, 0), L',', 0);
+		REQUIRE (1 == schnur_tokenizer_next (&empty));
+		REQUIRE (0 == empty.token.length);
+		REQUIRE (0 == schnur_tokenizer_next (&empty));
+		REQUIRE (0 == schnur_tokenizer_next (&empty));
+
+		empty = schnur_split_char (schnur_view_n (NULL, 0), L',', SCHNUR_SPLIT_SKIP_EMPTY);
+		REQUIRE (0 == schnur_tokenizer_next (&empty));
+
+		invalid.data = NULL;
+		invalid.length = 3;
+		empty = schnur_split_char (invalid, L',', 0);
+		REQUIRE (0 == schnur_tokenizer_next (&empty));
+		REQUIRE (0 == schnur_tokenizer_next (NULL));
+	}
+
+	SECTION ("schnur_split_any / schnur_split_view") {
+		struct schnur_view line = schnur_view_cstr (SCHNUR_W (" GET\t/index.html  HTTP/1.1\r\n"));
+
+		REQUIRE (L"GET|/index.html|HTTP/1.1" == join_tokens (schnur_split_any (line,
+			schnur_view_cstr (SCHNUR_W (" \t\r\n")), SCHNUR_SPLIT_SKIP_EMPTY)));
+		REQUIRE (L"|GET|/index.html||HTTP/1.1||" == join_tokens (schnur_split_any (line,
+			schnur_view_cstr (SCHNUR_W (" \t\r\n")), 0)));
+		REQUIRE (L"a|b|c" == join_tokens (schnur_split_any (schnur_view_cstr (SCHNUR_W ("a→b·c")),
+			schnur_view_cstr (SCHNUR_W ("→·")), 0)));
+		REQUIRE (L"abc" == join_tokens (schnur_split_any (schnur_view_cstr (SCHNUR_W ("abc")),
+			schnur_view_n (NULL, 0), 0)));
+
+		REQUIRE (L"key|value||x" == join_tokens (schnur_split_view (
+			schnur_view_cstr (SCHNUR_W ("key::value::::x")), schnur_view_cstr (SCHNUR_W ("::")), 0)));
+		REQUIRE (L"a|:b" == join_tokens (schnur_split_view (
+			schnur_view_cstr (SCHNUR_W ("a:::b")), schnur_view_cstr (SCHNUR_W ("::")), 0)));
+		REQUIRE (L"key|value|x" == join_tokens (schnur_split_view (
+			schnur_view_cstr (SCHNUR_W ("::key::value::::x::")), schnur_view_cstr (SCHNUR_W ("::")),
+			SCHNUR_SPLIT_SKIP_EMPTY)));
+		REQUIRE (L"abc" == join_tokens (schnur_split_view (schnur_view_cstr (SCHNUR_W ("abc")),
+			schnur_view_n (NULL, 0), 0)));
+	}
+
+	SECTION ("random views") {
+		// Lengths around the register width, and delimiter sets scanned
+		// with vectors or looked up character by character.
+		static const schnur_wide_t alphabet[] = L"ab,;: \x00E9\x2192xyz0123456789";
+		unsigned int seed = 4242;
+		int round;
+
+		for (round = 0; round < 3000; ++round) {
+			std::wstring text, set, expected;
+			size_t n, k, i, at = 0;
+			int flags, first = 1;
+
+			seed = seed * 1103515245 + 12345;
+			n = (seed >> 16) % 80;
+			for (i = 0; i < n; ++i) {
+				seed = seed * 1103515245 + 12345;
+				text += alphabet[(seed >> 16) % 10];
+			}
+			seed = seed * 1103515245 + 12345;
+			k = 1 + (seed >> 16) % 12;
+			for (i = 0; i < k; ++i) {
+				seed = seed * 1103515245 + 12345;
+				set += alphabet[2 + (seed >> 16) % (sizeof (alphabet) / sizeof (alphabet[0]) - 3)];
+			}
+			seed = seed * 1103515245 + 12345;
+			flags = (seed >> 16) % 2 ? SCHNUR_SPLIT_SKIP_EMPTY : 0;
+
+			for (i = 0; i <= n; ++i) {
+				if (i == n || std::wstring::npos != set.find (text[i])) {
+					if (i > at || 0 == flags) {
+						expected += (first ? L"" : L"|") + text.substr (at, i - at);
+						first = 0;
+					}
+					at = i + 1;
+				}
+			}
+
+			REQUIRE (expected == join_tokens (schnur_split_any (
+				schnur_view_n (text.data (), n), schnur_view_n (set.data (), k), flags)));
+			if (1 == k) {
+				REQUIRE (expected == join_tokens (schnur_split_char (
+					schnur_view_n (text.data (), n), set[0], flags)));
+				REQUIRE (expected == join_tokens (schnur_split_view (
+					schnur_view_n (text.data (), n), schnur_view_n (set.data (), 1), flags)));
+			}
+		}
+	}
+}
+
+TEST_CASE ("join", "[string]") {
+	SECTION ("schnur_join") {
+		struct schnur_view fields[] = {
+			schnur_view_cstr (SCHNUR_W ("4711")),
+			schnur_view_cstr (SCHNUR_W ("Jane Q. Public")),
+			schnur_view_n (NULL, 0),
+			schnur_view_cstr (SCHNUR_W ("Berlin")),
+		};
+
+		SCHNUR_SCOPED (s, schnur_join (schnur_view_cstr (SCHNUR_W (",")), fields, 4)) {
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("4711,Jane Q. Public,,Berlin")));
+			REQUIRE (schnur_length (s) + 1 == schnur_capacity (s));
+		}
+		SCHNUR_SCOPED (s, schnur_join (schnur_view_cstr (SCHNUR_W (", ")), fields, 1)) {
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("4711")));
+		}
+		SCHNUR_SCOPED (s, schnur_join (schnur_view_cstr (SCHNUR_W (", ")), NULL, 0)) {
+			REQUIRE (0 == schnur_length (s));
+		}
+
+		fields[2].length = 1;
+		REQUIRE (NULL == schnur_join (schnur_view_cstr (SCHNUR_W (",")), fields, 4));
+	}
+
+	SECTION ("schnur_append_many / schnur_append_join") {
+		struct schnur_view parts[] = {
+			schnur_view_cstr (SCHNUR_W ("[")),
+			schnur_view_cstr (SCHNUR_W ("info")),
+			schnur_view_cstr (SCHNUR_W ("] ")),
+			schnur_view_cstr (SCHNUR_W ("request served in 12 ms")),
+		};
+		struct schnur_view invalid[2];
+
+		invalid[0] = schnur_view_cstr (SCHNUR_W ("ok"));
+		invalid[1].data = NULL;
+		invalid[1].length = 3;
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("12:00:00 "))) {
+			REQUIRE (1 == schnur_append_many (s, parts, 4));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("12:00:00 [info] request served in 12 ms")));
+
+			REQUIRE (0 == schnur_append_many (s, invalid, 2));
+			REQUIRE (0 == schnur_append_many (s, NULL, 1));
+			REQUIRE (1 == schnur_append_many (s, NULL, 0));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("12:00:00 [info] request served in 12 ms")));
+
+			REQUIRE (1 == schnur_append_join (s, schnur_view_cstr (SCHNUR_W ("; ")), parts + 1, 2));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("12:00:00 [info] request served in 12 msinfo; ] ")));
+		}
+	}
+
+	SECTION ("parts from self") {
+		// Once within capacity, once growing past it, once shared.
+		SCHNUR_SCOPED (s, schnur_new_with_capacity (64)) {
+			REQUIRE (1 == schnur_copy_cstr (s, SCHNUR_W ("abc")));
+			struct schnur_view parts[] = { schnur_slice (s, 1, 3), schnur_slice (s, 0, 1) };
+			REQUIRE (1 == schnur_append_join (s, schnur_slice (s, 2, 3), parts, 2));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("abcbcca")));
+		}
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("0123456789"))) {
+			struct schnur_view parts[] = { schnur_view_of (s), schnur_view_of (s), schnur_view_of (s) };
+			REQUIRE (1 == schnur_append_join (s, schnur_slice (s, 0, 1), parts, 3));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("012345678901234567890012345678900123456789")));
+
+			SCHNUR_SCOPED_EMPTY (copy) {
+				REQUIRE (1 == schnur_copy (copy, s));
+				struct schnur_view tail[] = { schnur_slice (copy, 0, 2) };
+				REQUIRE (1 == schnur_append_many (copy, tail, 1));
+				REQUIRE (1 == schnur_equal_cstr (copy, SCHNUR_W ("01234567890123456789001234567890012345678901")));
+				REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("012345678901234567890012345678900123456789")));
+			}
+		}
+	}
+}
+
+/*
+	Formats with schnur_vformat_into, to compare against swprintf.
+*/
+static std::wstring
+format_string (const schnur_wide_t* format, ...) {
+	std::wstring result;
+	size_t needed = 0;
+	va_list args;
+
+	va_start (args, format);
+	schnur_wide_t* buffer = new schnur_wide_t[256];
+	if (schnur_vformat_into (buffer, 256, &needed, format, args)) {
+		result.assign (buffer, needed);
+	}
+	else {
+		result = L"<invalid>";
+	}
+	delete[] buffer;
+	va_end (args);
+
+	return result;
+}
+
+TEST_CASE ("format", "[string]") {
+	SECTION ("schnur_format_into") {
+		struct schnur_view name = schnur_view_cstr (SCHNUR_W ("Ada Lovelace"));
+		schnur_wide_t small[8];
+		size_t needed = 0;
+
+		REQUIRE (L"42 -7 ff 0X1F 17 %" == format_string (SCHNUR_W ("%d %i %x %#X %o %%"), 42, -7, 255, 31, 15));
+		REQUIRE (L"[   42] [42   ] [00042] [+42] [ 42]" == format_string (SCHNUR_W ("[%5d] [%-5d] [%05d] [%+d] [% d]"), 42, 42, 42, 42, 42));
+		REQUIRE (L"18446744073709551615 -9223372036854775808" == format_string (SCHNUR_W ("%llu %lld"), 18446744073709551615ULL, (long long)(-9223372036854775807LL - 1)));
+		REQUIRE (L"4294967295 65535 255 -1" == format_string (SCHNUR_W ("%zu %hu %hhu %td"), (size_t)4294967295u, 65535, 255, (ptrdiff_t)-1));
+
+		REQUIRE (L"Ada Lovelace|Ada|  Ada" == format_string (SCHNUR_W ("%v|%.3v|%5.3v"), name, name, name));
+		REQUIRE (L"Љубав|живот|(null)" == format_string (SCHNUR_W ("%s|%ls|%ls"), "Љубав", L"живот", (const schnur_wide_t*)NULL));
+		REQUIRE (L"x|→|  a" == format_string (SCHNUR_W ("%c|%lc|%3c"), 'x', (wint_t)L'→', 'a'));
+		REQUIRE (L"<invalid>" == format_string (SCHNUR_W ("%s"), "\xC0\xAF"));
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("schnur"))) {
+			REQUIRE (L"<schnur>" == format_string (SCHNUR_W ("<%V>"), s));
+		}
+
+		REQUIRE (L"0.1 3.141592653589793 1e+100 0.30000000000000004 inf" == format_string (
+			SCHNUR_W ("%r %r %r %r %r"), 0.1, 3.141592653589793, 1e100, 0.1 + 0.2, HUGE_VAL));
+		REQUIRE (L"3.14 1.500000e+00 2.5" == format_string (SCHNUR_W ("%.2f %e %Lg"), 3.14159, 1.5, (long double)2.5));
+
+		REQUIRE (0 == schnur_format_into (small, 8, &needed, SCHNUR_W ("%d apples"), 12));
+		REQUIRE (9 == needed);
+		REQUIRE (0 == schnur_format_into (NULL, 0, &needed, SCHNUR_W ("")));
+		REQUIRE (0 == needed);
+		REQUIRE (1 == schnur_format_into (small, 8, &needed, SCHNUR_W ("%d apple"), 1));
+		REQUIRE (0 == wcscmp (small, L"1 apple"));
+
+		REQUIRE (0 == schnur_format_into (small, 8, &needed, SCHNUR_W ("%n"), &needed));
+		REQUIRE (SCHNUR_FORMAT_INVALID == needed);
+		REQUIRE (0 == schnur_format_into (small, 8, &needed, SCHNUR_W ("%"), 1));
+		REQUIRE (0 == schnur_format_into (small, 8, &needed, SCHNUR_W ("%99999999999d"), 1));
+		REQUIRE (SCHNUR_FORMAT_INVALID == needed);
+	}
+
+	SECTION ("random numbers") {
+		// Compares against the C library for all combinations of flags.
+		static const char* const flags[] = { "", "-", "0", "+", " ", "#", "-+", "0#", "+0", " #" };
+		static const char* const conversions[] = { "d", "i", "u", "x", "X", "o", "lld", "llx", "hd", "hhu", "f", "e", "g", "G", "a" };
+		unsigned int seed = 1337;
+		int round;
+
+		for (round = 0; round < 20000; ++round) {
+			char narrow[32];
+			schnur_wide_t format[32], expected[256];
+			long long value;
+			double real;
+			const char* conversion;
+			int width, precision;
+			size_t i;
+
+			seed = seed * 1103515245 + 12345;
+			conversion = conversions[(seed >> 16) % 15];
+			seed = seed * 1103515245 + 12345;
+			width = (int)((seed >> 16) % 24) - 4;
+			seed = seed * 1103515245 + 12345;
+			precision = (int)((seed >> 16) % 22) - 3;
+			seed = seed * 1103515245 + 12345;
+			value = (long long)(seed >> 8) * (long long)((seed >> 4) % 4000000) - 1000000000000LL;
+			if (0 == (seed >> 16) % 7) {
+				value = 0;
+			}
+			real = (double)value / (double)(1 + (seed >> 20) % 1000);
+
+			snprintf (narrow, sizeof (narrow), "%%%s%s%s%s", flags[(seed >> 12) % 10],
+				0 > width ? "" : std::to_string (width).c_str (),
+				0 > precision ? "" : ("." + std::to_string (precision)).c_str (),
+				conversion);
+			for (i = 0; i <= strlen (narrow); ++i) {
+				format[i] = (schnur_wide_t)narrow[i];
+			}
+
+			if (strchr ("feEgGa", conversion[strlen (conversion) - 1])) {
+				swprintf (expected, 256, format, real);
+				REQUIRE (std::wstring (expected) == format_string (format, real));
+			}
+			else if (0 == strncmp (conversion, "ll", 2)) {
+				swprintf (expected, 256, format, value);
+				REQUIRE (std::wstring (expected) == format_string (format, value));
+			}
+			else {
+				swprintf (expected, 256, format, (int)value);
+				REQUIRE (std::wstring (expected) == format_string (format, (int)value));
+			}
+		}
+	}
+
+	SECTION ("schnur_appendf") {
+		SCHNUR_SCOPED (s, schnur_new ()) {
+			REQUIRE (1 == schnur_appendf (s, SCHNUR_W ("[%s] %d"), "info", 7));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("[info] 7")));
+			REQUIRE (SCHNUR_INLINE_CAPACITY == schnur_capacity (s));
+
+			// Grows once, formatting views of self.
+			REQUIRE (1 == schnur_appendf (s, SCHNUR_W (" %V|%v|%-12r|"), s, schnur_slice (s, 1, 5), 0.25));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("[info] 7 [info] 7|info|0.25        |")));
+
+			REQUIRE (0 == schnur_appendf (s, SCHNUR_W (" %q"), 1));
+			REQUIRE (0 == schnur_appendf (s, SCHNUR_W ("%s tail"), "\xFF"));
+			REQUIRE (0 == schnur_appendf (s, NULL));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("[info] 7 [info] 7|info|0.25        |")));
+			REQUIRE (0 == wcscmp ((const schnur_wide_t*)schnur_raw (s), L"[info] 7 [info] 7|info|0.25        |"));
+
+			SCHNUR_SCOPED_EMPTY (copy) {
+				REQUIRE (1 == schnur_copy (copy, s));
+				REQUIRE (1 == schnur_appendf (copy, SCHNUR_W ("%zu"), schnur_length (s)));
+				REQUIRE (1 == schnur_equal_cstr (copy, SCHNUR_W ("[info] 7 [info] 7|info|0.25        |36")));
+				REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("[info] 7 [info] 7|info|0.25        |")));
+			}
+
+			// Filled storage, own and shared, has no room for a terminator.
+			REQUIRE (1 == schnur_fill (s, SCHNUR_W ('x')));
+			SCHNUR_SCOPED_EMPTY (copy) {
+				REQUIRE (1 == schnur_copy (copy, s));
+				REQUIRE (1 == schnur_appendf (copy, SCHNUR_W ("%d"), 42));
+				REQUIRE (schnur_length (s) + 2 == schnur_length (copy));
+				REQUIRE (SCHNUR_W ('4') == schnur_get (copy, schnur_length (s)));
+			}
+			REQUIRE (1 == schnur_appendf (s, SCHNUR_W ("%d"), 42));
+			REQUIRE (SCHNUR_W ('2') == schnur_get (s, schnur_length (s) - 1));
+		}
+	}
+}
+
+TEST_CASE ("number", "[string]") {
+	SECTION ("schnur_append_i64 / schnur_append_u64 / schnur_append_f64") {
+		SCHNUR_SCOPED (s, schnur_new ()) {
+			REQUIRE (1 == schnur_append_i64 (s, 0));
+			REQUIRE (1 == schnur_append (s, L' '));
+			REQUIRE (1 == schnur_append_i64 (s, INT64_MIN));
+			REQUIRE (1 == schnur_append (s, L' '));
+			REQUIRE (1 == schnur_append_u64 (s, UINT64_MAX));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("0 -9223372036854775808 18446744073709551615")));
+		}
+
+		SCHNUR_SCOPED (s, schnur_new ()) {
+			const double values[] = { 0.1, -2.5, 1e16, 123456789.0, 1e-5, 0.0001, 5e-324, 1.7976931348623157e308, -0.0, 0.1 + 0.2, 100.0 };
+
+			for (double value : values) {
+				REQUIRE (1 == schnur_append_f64 (s, value));
+				REQUIRE (1 == schnur_append (s, L' '));
+			}
+			REQUIRE (1 == schnur_append_f64 (s, HUGE_VAL));
+			REQUIRE (1 == schnur_append_f64 (s, -HUGE_VAL));
+			REQUIRE (1 == schnur_append_f64 (s, NAN));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("0.1 -2.5 1e+16 123456789 1e-05 0.0001 5e-324 1.7976931348623157e+308 -0 0.30000000000000004 100 inf-infnan")));
+		}
+	}
+
+	SECTION ("schnur_parse_i64 / schnur_parse_u64") {
+		int64_t i = 0;
+		uint64_t u = 0;
+		size_t consumed = 0;
+
+		REQUIRE (1 == schnur_view_parse_i64 (schnur_view_cstr (SCHNUR_W ("-42 apples")), &i, &consumed));
+		REQUIRE (-42 == i);
+		REQUIRE (3 == consumed);
+		REQUIRE (1 == schnur_view_parse_i64 (schnur_view_cstr (SCHNUR_W ("-9223372036854775808")), &i, &consumed));
+		REQUIRE (INT64_MIN == i);
+		REQUIRE (0 == schnur_view_parse_i64 (schnur_view_cstr (SCHNUR_W ("9223372036854775808!")), &i, &consumed));
+		REQUIRE (INT64_MAX == i);
+		REQUIRE (19 == consumed);
+		REQUIRE (0 == schnur_view_parse_i64 (schnur_view_cstr (SCHNUR_W (" 1")), &i, &consumed));
+		REQUIRE (0 == consumed);
+		REQUIRE (0 == schnur_view_parse_i64 (schnur_view_cstr (SCHNUR_W ("+")), &i, &consumed));
+		REQUIRE (0 == consumed);
+
+		REQUIRE (1 == schnur_view_parse_u64 (schnur_view_cstr (SCHNUR_W ("+18446744073709551615")), &u, &consumed));
+		REQUIRE (UINT64_MAX == u);
+		REQUIRE (21 == consumed);
+		REQUIRE (0 == schnur_view_parse_u64 (schnur_view_cstr (SCHNUR_W ("18446744073709551616")), &u, &consumed));
+		REQUIRE (UINT64_MAX == u);
+		REQUIRE (0 == schnur_view_parse_u64 (schnur_view_cstr (SCHNUR_W ("-1")), &u, &consumed));
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("1234567890123"))) {
+			REQUIRE (1 == schnur_parse_i64 (s, &i, NULL));
+			REQUIRE (1234567890123LL == i);
+		}
+		REQUIRE (0 == schnur_parse_u64 (NULL, &u, &consumed));
+	}
+
+	SECTION ("schnur_parse_f64") {
+		double d = 0;
+		size_t consumed = 0;
+
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W ("3.25e2 ms")), &d, &consumed));
+		REQUIRE (325.0 == d);
+		REQUIRE (6 == consumed);
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W ("-.5e")), &d, &consumed));
+		REQUIRE (-0.5 == d);
+		REQUIRE (3 == consumed);
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W ("7.")), &d, &consumed));
+		REQUIRE (7.0 == d);
+		REQUIRE (2 == consumed);
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W ("-Infinity")), &d, &consumed));
+		REQUIRE (-HUGE_VAL == d);
+		REQUIRE (9 == consumed);
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W ("NaN")), &d, &consumed));
+		REQUIRE (d != d);
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W ("1e-400")), &d, &consumed));
+		REQUIRE (0.0 == d);
+		REQUIRE (0 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W ("1e400")), &d, &consumed));
+		REQUIRE (HUGE_VAL == d);
+		REQUIRE (5 == consumed);
+		REQUIRE (0 == schnur_view_parse_f64 (schnur_view_cstr (SCHNUR_W (".e1")), &d, &consumed));
+		REQUIRE (0 == consumed);
+
+		// Halfway between 1 and the next double, decided by the last digit.
+		std::wstring halfway = L"1.00000000000000011102230246251565404236316680908203125";
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_n (halfway.data (), halfway.size ()), &d, NULL));
+		REQUIRE (1.0 == d);
+		halfway += std::wstring (1000, L'0') + L"1";
+		REQUIRE (1 == schnur_view_parse_f64 (schnur_view_n (halfway.data (), halfway.size ()), &d, &consumed));
+		REQUIRE (1.0000000000000002 == d);
+		REQUIRE (halfway.size () == consumed);
+	}
+
+	SECTION ("random doubles") {
+		uint64_t seed = 0x9E3779B97F4A7C15ULL;
+		int round;
+
+		for (round = 0; round < 50000; ++round) {
+			schnur_wide_t buf[SCHNUR_NUMBER_MAX_CHARS];
+			char narrow[64];
+			double value, parsed = 0, expected;
+			size_t n, i, consumed = 0, digits = 0;
+
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			memcpy (&value, &seed, sizeof (value));
+			if (! isfinite (value)) {
+				continue;
+			}
+
+			n = schnur_format_f64 (buf, value);
+			REQUIRE (SCHNUR_NUMBER_MAX_CHARS >= n);
+			REQUIRE (1 == schnur_view_parse_f64 (schnur_view_n (buf, n), &parsed, &consumed));
+			REQUIRE (n == consumed);
+			REQUIRE (value == parsed);
+
+			// Never more significant digits than the C library needs with 15.
+			std::wstring significant;
+			for (i = 0; i < n && L'e' != buf[i]; ++i) {
+				if ((L'0' <= buf[i] && L'9' >= buf[i]) && (L'0' != buf[i] || ! significant.empty ())) {
+					significant += buf[i];
+				}
+			}
+			digits = significant.find_last_not_of (L'0') + 1;
+			snprintf (narrow, sizeof (narrow), "%.15g", value);
+			if (strtod (narrow, NULL) == value) {
+				REQUIRE (15 >= digits);
+			}
+
+			// Parsing agrees with strtod on 20 significant digits.
+			snprintf (narrow, sizeof (narrow), "%.19e", value);
+			expected = strtod (narrow, NULL);
+			for (i = 0; i <= strlen (narrow); ++i) {
+				buf[i] = (schnur_wide_t)narrow[i];
+			}
+			REQUIRE (1 == schnur_view_parse_f64 (schnur_view_n (buf, strlen (narrow)), &parsed, NULL));
+			REQUIRE (expected == parsed);
+		}
+	}
+}
+
+TEST_CASE ("decoder", "[string]") {
+	// Mixes one to four byte sequences, so chunks split all of them.
+	const char text[] = "ascii \xc3\xa4\xc3\xb6\xc3\xbc \xd0\xb6\xd0\xb8\xd0\xb2\xd0\xbe\xd1\x82 \xe2\x82\xac\xe6\x97\xa5 \xf0\x9f\x98\x80\xf0\x9f\x8c\x8d end";
+	const size_t n = sizeof (text) - 1;
+
+	SECTION ("schnur_append_utf8") {
+		size_t error = 0;
+
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W (">"))) {
+			REQUIRE (1 == schnur_append_utf8 (s, text, n, NULL));
+			SCHNUR_SCOPED (expected, schnur_new_su_n (text, n, NULL)) {
+				REQUIRE (schnur_length (expected) + 1 == schnur_length (s));
+				REQUIRE (0 == wcscmp ((const schnur_wide_t*)schnur_raw (expected), (const schnur_wide_t*)schnur_raw (s) + 1));
+			}
+
+			REQUIRE (0 == schnur_append_utf8 (s, "ab\xc3", 3, &error));
+			REQUIRE (2 == error);
+			REQUIRE (1 == schnur_append_utf8 (s, NULL, 0, NULL));
+			REQUIRE (0 == schnur_append_utf8 (NULL, text, n, NULL));
+		}
+	}
+
+	SECTION ("schnur_decoder_feed, random chunks") {
+		uint32_t seed = 0x9E3779B9u;
+
+		SCHNUR_SCOPED (expected, schnur_new_su_n (text, n, NULL)) {
+			for (int round = 0; round < 1000; ++round) {
+				struct schnur_decoder decoder;
+				size_t i = 0;
+
+				schnur_decoder_init (&decoder);
+				SCHNUR_SCOPED (s, schnur_new ()) {
+					while (i < n) {
+						seed ^= seed << 13;
+						seed ^= seed >> 17;
+						seed ^= seed << 5;
+						size_t k = std::min (n - i, (size_t)(seed % 9));
+						REQUIRE (1 == schnur_decoder_feed (&decoder, text + i, k, s));
+						i += k;
+					}
+					REQUIRE (1 == schnur_decoder_finish (&decoder));
+					REQUIRE (1 == schnur_equal (expected, s));
+				}
+			}
+		}
+	}
+
+	SECTION ("schnur_decoder_feed, invalid input") {
+		struct schnur_decoder decoder;
+
+		SCHNUR_SCOPED (s, schnur_new ()) {
+			// Cut off at the end of the stream.
+			schnur_decoder_init (&decoder);
+			REQUIRE (1 == schnur_decoder_feed (&decoder, "ab\xe2\x82", 4, s));
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("ab")));
+			REQUIRE (0 == schnur_decoder_finish (&decoder));
+			REQUIRE (2 == decoder.error);
+
+			// Carried sequence interrupted in the next chunk.
+			schnur_decoder_init (&decoder);
+			REQUIRE (1 == schnur_decoder_feed (&decoder, "xyz\xf0\x9f", 5, s));
+			REQUIRE (0 == schnur_decoder_feed (&decoder, "a", 1, s));
+			REQUIRE (3 == decoder.error);
+
+			// Invalid byte within a later chunk leaves the target untouched.
+			schnur_decoder_init (&decoder);
+			REQUIRE (1 == schnur_decoder_feed (&decoder, "\xc3", 1, s));
+			REQUIRE (0 == schnur_decoder_feed (&decoder, "\xa4ok\xff", 4, s));
+			REQUIRE (4 == decoder.error);
+			REQUIRE (1 == schnur_equal_cstr (s, SCHNUR_W ("abxyz")));
+
+			// Overlong sequence split between chunks.
+			schnur_decoder_init (&decoder);
+			REQUIRE (1 == schnur_decoder_feed (&decoder, "\xe0", 1, s));
+			REQUIRE (0 == schnur_decoder_feed (&decoder, "\x80\x80", 2, s));
+			REQUIRE (0 == decoder.error);
+		}
+	}
+
+	SECTION ("schnur_read_file / schnur_read_fd") {
+		FILE* file = tmpfile ();
+		size_t error = 0;
+		std::string content;
+
+		REQUIRE (NULL != file);
+		// Spans several chunks, so sequences cross chunk boundaries.
+		while (content.size () < 3 * SCHNUR_READ_CHUNK_SIZE) {
+			content += text;
+		}
+		REQUIRE (content.size () == fwrite (content.data (), 1, content.size (), file));
+		fflush (file);
+
+		SCHNUR_SCOPED (expected, schnur_new_su_n (content.data (), content.size (), NULL)) {
+			rewind (file);
+			SCHNUR_SCOPED (s, schnur_new ()) {
+				REQUIRE (1 == schnur_read_file (s, file, &error));
+				REQUIRE (1 == schnur_equal (expected, s));
+			}
+
+			rewind (file);
+			SCHNUR_SCOPED (s, schnur_new ()) {
+				REQUIRE (1 == schnur_read_fd (s, fileno (file), &error));
+				REQUIRE (1 == schnur_equal (expected, s));
+			}
+		}
+
+		fseek (file, 0, SEEK_END);
+		fputs ("\xed\xa0\x80", file);
+		fflush (file);
+		rewind (file);
+		SCHNUR_SCOPED (s, schnur_new ()) {
+			REQUIRE (0 == schnur_read_file (s, file, &error));
+			REQUIRE (content.size () == error);
+		}
+
+		fclose (file);
+		REQUIRE (0 == schnur_read_fd (NULL, 0, NULL));
+		REQUIRE (0 == schnur_read_file (NULL, NULL, NULL));
+	}
+}
+
+TEST_CASE ("write", "[string]") {
+	const schnur_wide_t* words[] = {
+		SCHNUR_W ("ascii "), SCHNUR_W ("\u00e4\u00f6\u00fc "), SCHNUR_W ("\u0436\u0438\u0432\u043e\u0442 "),
+		SCHNUR_W ("\u20ac\u65e5 "), SCHNUR_W ("\U0001F600\U0001F30D "), SCHNUR_W (""),
+	};
+	const size_t word_count = sizeof (words) / sizeof (words[0]);
+
+	// Reads back everything written to file so far.
+	auto read_back = [] (FILE* file) {
+		std::string bytes;
+		char chunk[4096];
+		size_t r;
+
+		fflush (file);
+		rewind (file);
+		while (0 < (r = fread (chunk, 1, sizeof (chunk), file))) {
+			bytes.append (chunk, r);
+		}
+		return bytes;
+	};
+
+	SECTION ("schnur_write_fd") {
+		FILE* file = tmpfile ();
+		uint32_t seed = 0x2545F491u;
+
+		REQUIRE (NULL != file);
+		// Longer than the buffer, with sequences crossing its end.
+		SCHNUR_SCOPED (s, schnur_new ()) {
+			while (schnur_length (s) < 3 * SCHNUR_WRITE_CHUNK_SIZE) {
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+				REQUIRE (1 == schnur_append_cstr (s, words[seed % word_count]));
+			}
+
+			REQUIRE (1 == schnur_write_fd (s, fileno (file)));
+			schnur_narrow_t* expected = schnur_narrow (s);
+			REQUIRE (NULL != expected);
+			REQUIRE (std::string (expected) == read_back (file));
+			schnur_narrow_free (expected);
+		}
+		fclose (file);
+
+		REQUIRE (0 == schnur_write_fd (NULL, 1));
+		SCHNUR_SCOPED (s, schnur_new ()) {
+			REQUIRE (0 == schnur_write_fd (s, -1));
+		}
+	}
+
+	SECTION ("schnur_writev_fd") {
+		FILE* file = tmpfile ();
+		std::vector<schnur_t*> schnurs;
+		std::string expected;
+
+		REQUIRE (NULL != file);
+		for (size_t i = 0; i < 1000; ++i) {
+			schnur_t* s = schnur_new_s (words[i % word_count]);
+			REQUIRE (NULL != s);
+			schnurs.push_back (s);
+
+			// Empty schnurs have no narrow copy.
+			schnur_narrow_t* narrow = schnur_narrow (s);
+			if (NULL != narrow) {
+				expected += narrow;
+				schnur_narrow_free (narrow);
+			}
+		}
+
+		REQUIRE (1 == schnur_writev_fd (schnurs.data (), schnurs.size (), fileno (file)));
+		REQUIRE (expected == read_back (file));
+		REQUIRE (1 == schnur_writev_fd (NULL, 0, fileno (file)));
+
+		// Nothing is written, if an entry is missing.
+		schnur_t* missing[] = { schnurs[0], NULL };
+		REQUIRE (0 == schnur_writev_fd (missing, 2, fileno (file)));
+		REQUIRE (expected == read_back (file));
+
+		for (schnur_t* s : schnurs) {
+			schnur_free (s);
+		}
+		fclose (file);
+	}
+
+	SECTION ("unencodable characters") {
+		FILE* file = tmpfile ();
+
+		REQUIRE (NULL != file);
+		SCHNUR_SCOPED (s, schnur_new_s (SCHNUR_W ("ok "))) {
+			REQUIRE (1 == schnur_append (s, (schnur_wide_t)0xD800));
+			REQUIRE (0 == schnur_write_fd (s, fileno (file)));
+		}
+		fclose (file);
+	}
+}
+
+TEST_CASE ("load", "[string]") {
+	const char line[] = "line \xc3\xa4\xd0\xb6\xe2\x82\xac\xf0\x9f\x98\x80\n";
+	const size_t count = 300;
+	std::vector<std::string> names, contents;
+	std::vector<const char*> paths;
+	uint32_t seed = 0x6C8E9CF5u;
+
+	// Mostly small files, some empty, some larger than any buffer.
+	for (size_t i = 0; i < count; ++i) {
+		std::string content;
+		size_t lines;
+
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		lines = 0 == i % 50 ? 20000 : seed % 40;
+		for (size_t j = 0; j < lines; ++j) {
+			content += line;
+		}
+
+		names.push_back ("schnur-load-test-" + std::to_string (i) + ".txt");
+		contents.push_back (content);
+		FILE* file = fopen (names.back ().c_str (), "wb");
+		REQUIRE (NULL != file);
+		REQUIRE (content.size () == fwrite (content.data (), 1, content.size (), file));
+		fclose (file);
+	}
+	// An invalid file and a missing one.
+	contents[7] += "\xc3(";
+	FILE* file = fopen (names[7].c_str (), "ab");
+	REQUIRE (NULL != file);
+	fputs ("\xc3(", file);
+	fclose (file);
+	names.push_back ("schnur-load-missing.txt");
+	contents.push_back ("");
+
+	for (const std::string& name : names) {
+		paths.push_back (name.c_str ());
+	}
+
+	for (int flags : { 0, SCHNUR_LOAD_THREADS }) {
+		std::vector<schnur_t*> schnurs (paths.size (), (schnur_t*)1);
+
+		REQUIRE (0 == schnur_load_files (paths.data (), paths.size (), schnurs.data (), flags));
+		for (size_t i = 0; i < paths.size (); ++i) {
+			if (7 == i || count == i) {
+				REQUIRE (NULL == schnurs[i]);
+				continue;
+			}
+			REQUIRE (NULL != schnurs[i]);
+			SCHNUR_SCOPED (expected, schnur_new_su_n (contents[i].data (), contents[i].size (), NULL)) {
+				REQUIRE (1 == schnur_equal (expected, schnurs[i]));
+			}
+			schnur_free (schnurs[i]);
+		}
+
+		// Without the broken ones, everything loads.
+		REQUIRE (1 == schnur_load_files (paths.data () + 8, count - 8, schnurs.data (), flags));
+		for (size_t i = 0; i < count - 8; ++i) {
+			REQUIRE (NULL != schnurs[i]);
+			schnur_free (schnurs[i]);
+		}
+	}
+
+	REQUIRE (1 == schnur_load_files (NULL, 0, NULL, 0));
+	REQUIRE (0 == schnur_load_files (NULL, 1, NULL, 0));
+
+	for (size_t i = 0; i < count; ++i) {
+		remove (names[i].c_str ());
+	}
+}
+
+TEST_CASE ("packed", "[string]") {
+	SECTION ("widths") {
+		struct schnur_packed* c = schnur_packed_new (schnur_view_cstr (SCHNUR_W ("plain ascii")));
+
+		REQUIRE (NULL != c);
+		REQUIRE (1 == schnur_packed_width (c));
+		REQUIRE (11 == schnur_packed_length (c));
+		REQUIRE (L'p' == schnur_packed_get (c, 0));
+		REQUIRE (SCHNUR_WC_NULL == schnur_packed_get (c, 11));
+
+		// Widens on demand, keeping what is stored.
+		REQUIRE (1 == schnur_packed_append_view (c, schnur_view_cstr (SCHNUR_W (" \u00e4"))));
+		REQUIRE (1 == schnur_packed_width (c));
+		REQUIRE (1 == schnur_packed_set (c, 0, L'\u0436'));
+		REQUIRE (2 == schnur_packed_width (c));
+		REQUIRE (1 == schnur_packed_equal_view (c, schnur_view_cstr (SCHNUR_W ("\u0436lain ascii \u00e4"))));
+		if (WCHAR_MAX > 0xFFFF) {
+			REQUIRE (1 == schnur_packed_append_view (c, schnur_view_cstr (SCHNUR_W ("\U0001F600"))));
+			REQUIRE (4 == schnur_packed_width (c));
+			REQUIRE (1 == schnur_packed_equal_view (c, schnur_view_cstr (SCHNUR_W ("\u0436lain ascii \u00e4\U0001F600"))));
+		}
+		REQUIRE (0 == schnur_packed_set (c, 100, L'x'));
+		REQUIRE (1 == schnur_packed_free (c));
+
+		c = schnur_packed_new (schnur_view_cstr (SCHNUR_W ("")));
+		REQUIRE (NULL != c);
+		REQUIRE (0 == schnur_packed_length (c));
+		REQUIRE (1 == schnur_packed_free (c));
+		REQUIRE (0 == schnur_packed_free (NULL));
+	}
+
+	SECTION ("inline, wide") {
+		// Fill the inline storage with 2 and 4 byte wide characters.
+		std::wstring two (SCHNUR_PACKED_INLINE_SIZE / 2, L'\u0436');
+		std::wstring four (SCHNUR_PACKED_INLINE_SIZE / 4,
+			(schnur_wide_t)(WCHAR_MAX > 0xFFFF ? 0x1F600 : 0xFFFF));
+		two[1] = L'\u20ac';
+		four[1] = L'\u00e4';
+
+		struct schnur_packed* c = schnur_packed_new (schnur_view_n (two.c_str (), two.size ()));
+		REQUIRE (NULL != c);
+		REQUIRE (2 == schnur_packed_width (c));
+		REQUIRE (L'\u20ac' == schnur_packed_get (c, 1));
+		REQUIRE (1 == schnur_packed_set (c, 0, L'\u00e4'));
+		REQUIRE (L'\u00e4' == schnur_packed_get (c, 0));
+		REQUIRE (1 == schnur_packed_find (c, schnur_view_cstr (SCHNUR_W ("\u20ac")), 0));
+		REQUIRE (1 == schnur_packed_free (c));
+
+		c = schnur_packed_new (schnur_view_n (four.c_str (), four.size ()));
+		REQUIRE (NULL != c);
+		REQUIRE ((WCHAR_MAX > 0xFFFF ? 4 : 2) == schnur_packed_width (c));
+		REQUIRE (1 == schnur_packed_equal_view (c, schnur_view_n (four.c_str (), four.size ())));
+		REQUIRE (1 == schnur_packed_set (c, 0, L'x'));
+		REQUIRE (L'x' == schnur_packed_get (c, 0));
+		REQUIRE (four[1] == schnur_packed_get (c, 1));
+		REQUIRE (four[2] == schnur_packed_get (c, 2));
+		REQUIRE (1 == schnur_packed_free (c));
+	}
+
+	SECTION ("thaw, long") {
+		std::wstring str;
+		for (size_t i = 0; i < 1000; ++i) {
+			str += (schnur_wide_t)(0 == i % 3 ? L'\u20ac' : L'a' + i % 26);
+		}
+
+		struct schnur_packed* c = schnur_packed_new (schnur_view_n (str.c_str (), str.size ()));
+		REQUIRE (NULL != c);
+		SCHNUR_SCOPED (s, schnur_packed_thaw (c)) {
+			REQUIRE (str.size () == schnur_length (s));
+			REQUIRE (1 == schnur_view_equal (schnur_view_n (str.c_str (), str.size ()), schnur_view_of (s)));
+		}
+		REQUIRE (1 == schnur_packed_free (c));
+	}
+
+	SECTION ("random, against schnur") {
+		const schnur_wide_t alphabet[] = {
+			L'a', L'b', L'c', L' ', L'\u00e4', L'\u00ff', L'\u0436', L'\u20ac', L'\uffff',
+			(schnur_wide_t)(WCHAR_MAX > 0xFFFF ? 0x1F600 : 0x41),
+		};
+		uint32_t seed = 0x1B873593u;
+
+		auto next = [&seed] () {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			return seed;
+		};
+		// Mostly ascii, sometimes wider.
+		auto random_view = [&] (std::wstring& str, size_t wide) {
+			size_t n = next () % 40;
+			str.clear ();
+			for (size_t i = 0; i < n; ++i) {
+				str += alphabet[next () % (0 == next () % wide ? 10 : 3)];
+			}
+			return schnur_view_n (str.data (), str.size ());
+		};
+
+		for (int round = 0; round < 2000; ++round) {
+			std::wstring a, b, c;
+			struct schnur_view va = random_view (a, 4), vb = random_view (b, 4);
+			struct schnur_packed* ca = schnur_packed_new (va);
+			struct schnur_packed* cb = schnur_packed_new (vb);
+
+			REQUIRE (NULL != ca);
+			REQUIRE (NULL != cb);
+			REQUIRE (1 == schnur_packed_equal_view (ca, va));
+
+			int expected = schnur_view_compare (va, vb);
+			int got = schnur_packed_compare (ca, cb);
+			REQUIRE (((expected > 0) - (expected < 0)) == ((got > 0) - (got < 0)));
+			REQUIRE (0 == schnur_packed_compare (ca, ca));
+
+			// Appending keeps every character, whatever the widths.
+			struct schnur_view vc = random_view (c, 2);
+			REQUIRE (1 == schnur_packed_append_view (ca, vc));
+			a += c;
+			va = schnur_view_n (a.data (), a.size ());
+			REQUIRE (1 == schnur_packed_equal_view (ca, va));
+			for (size_t i = 0; i < a.size (); ++i) {
+				REQUIRE (a[i] == schnur_packed_get (ca, i));
+			}
+
+			// Searches agree with views.
+			for (size_t from = 0; from <= a.size (); from += 7) {
+				struct schnur_view needle = schnur_view_slice (vb, 0, next () % 3);
+				REQUIRE (schnur_view_find (va, needle, from) == schnur_packed_find (ca, needle, from));
+			}
+
+			SCHNUR_SCOPED (s, schnur_packed_thaw (ca)) {
+				REQUIRE (1 == schnur_view_equal (va, schnur_view_of (s)));
+			}
+
+			std::vector<schnur_wide_t> expanded (a.size () + 1);
+			REQUIRE (a.size () == schnur_packed_expand (ca, 0, a.size (), expanded.data ()));
+			REQUIRE (1 == schnur_view_equal (va, schnur_view_n (expanded.data (), a.size ())));
+
+			schnur_packed_free (ca);
+			schnur_packed_free (cb);
+		}
+	}
+}
+
+#if !defined(_WIN32)
+TEST_CASE ("mapped", "[string]") {
+	const char* path = "schnur-mapped-test.txt";
+	const char line[] = "line \xc3\xa4\xd0\xb6\xe2\x82\xac\xf0\x9f\x98\x80\n";
+	std::string content;
+	FILE* file;
+
+	// Several blocks, with sequences crossing block boundaries.
+	while (content.size () < 3 * SCHNUR_MAPPED_BLOCK_SIZE + 1000) {
+		content += line;
+	}
+	file = fopen (path, "wb");
+	REQUIRE (NULL != file);
+	REQUIRE (content.size () == fwrite (content.data (), 1, content.size (), file));
+	fclose (file);
+
+	SECTION ("schnur_mapped_get / schnur_mapped_slice") {
+		SCHNUR_SCOPED (expected, schnur_new_su_n (content.data (), content.size (), NULL)) {
+			struct schnur_mapped* mapped = schnur_mapped_open (path, NULL);
+			size_t length = schnur_length (expected);
+
+			REQUIRE (NULL != mapped);
+			REQUIRE (length == schnur_mapped_length (mapped));
+			REQUIRE (0 == schnur_mapped_decoded_length (mapped));
+
+			// Touching the last character decodes the last block only.
+			REQUIRE (L'\n' == schnur_mapped_get (mapped, length - 1));
+			REQUIRE (0 < schnur_mapped_decoded_length (mapped));
+			REQUIRE (length > schnur_mapped_decoded_length (mapped));
+			REQUIRE (SCHNUR_WC_NULL == schnur_mapped_get (mapped, length));
+
+			struct schnur_view tail = schnur_mapped_slice (mapped, length - 10, length);
+			REQUIRE (1 == schnur_view_equal (tail, schnur_slice (expected, length - 10, length)));
+
+			struct schnur_view all = schnur_mapped_slice (mapped, 0, length);
+			REQUIRE (length == schnur_mapped_decoded_length (mapped));
+			REQUIRE (1 == schnur_view_equal (all, schnur_view_of (expected)));
+			REQUIRE (SCHNUR_WC_NULL == all.data[length]);
+
+			REQUIRE (NULL == schnur_mapped_slice (mapped, 2, 1).data);
+			REQUIRE (NULL == schnur_mapped_slice (mapped, 0, length + 1).data);
+			REQUIRE (1 == schnur_mapped_free (mapped));
+		}
+	}
+
+	SECTION ("invalid files") {
+		size_t error = 0;
+
+		file = fopen (path, "ab");
+		REQUIRE (NULL != file);
+		fputs ("\xc3(", file);
+		fclose (file);
+		REQUIRE (NULL == schnur_mapped_open (path, &error));
+		REQUIRE (content.size () == error);
+
+		file = fopen (path, "wb");
+		REQUIRE (NULL != file);
+		fclose (file);
+		struct schnur_mapped* mapped = schnur_mapped_open (path, NULL);
+		REQUIRE (NULL != mapped);
+		REQUIRE (0 == schnur_mapped_length (mapped));
+		REQUIRE (NULL == schnur_mapped_slice (mapped, 0, 1).data);
+		REQUIRE (1 == schnur_mapped_free (mapped));
+
+		REQUIRE (NULL == schnur_mapped_open ("schnur-missing-file.txt", NULL));
+		REQUIRE (0 == schnur_mapped_free (NULL));
+	}
+
+	remove (path);
+}
+#endif